@@ -8,6 +8,7 @@ typedef struct {
     PyObject_VAR_HEAD
     PyObject *string;
     MINDEX_T *indices;
+    PyObject *vowels;
 } MoraStrObject;
 
 static PyTypeObject MoraStrType;
@@ -62,6 +63,53 @@ static unsigned char katakana_rimes[KATAKANA_RNG] = {
     [KANA_ID(L'ヮ')] = (COLUMN_A << SMALL_KANA_OFF) | GLIDE,
 };
 
+/* one letter per mora for MoraStr.vowels(); N, Q and R stand for the
+ * moraic nasal, the geminate and the long vowel respectively */
+#define VOWEL_LETTERS "AIUEONQR"
+static char katakana_vowel_letters[KATAKANA_RNG];
+
+/* equivalence classes for the fold= option of search methods */
+enum {
+    FOLD_DAKUTEN = 1,
+    FOLD_SMALL = 2,
+    FOLD_ARCHAIC = 4,
+    FOLD_CHOON = 8,
+    FOLD_TABLE_CNT = 16,
+};
+#define FOLD_LETTERS "dsac"
+
+static const wchar_t *FOLD_PAIRS[] = {
+    [FOLD_DAKUTEN] = L"ガカギキグクゲケゴコザサジシズスゼセゾソダタヂチヅツデテドト"
+                     L"バハパハビヒピヒブフプフベヘペヘボホポホ"
+                     L"ヴウ\x30f7ワ\x30f8ヰ\x30f9ヱ\x30faヲ", /*ヷヸヹヺ*/
+    [FOLD_SMALL] = L"ァアィイゥウェエォオッツャヤュユョヨヮワヵカヶケ",
+    [FOLD_ARCHAIC] = L"ヰイヱエヲオヴブヂジヅズ"
+                     L"\x30f7バ\x30f8ビ\x30f9ベ\x30faボ", /*ヷヸヹヺ*/
+    /* 'ー' depends on the mora before it; see MoraStr_fold_() */
+    [FOLD_CHOON] = L"",
+};
+static Katakana katakana_fold_table[FOLD_TABLE_CNT][KATAKANA_RNG];
+
+/* gojuon collation: the primary weight is the position of the base kana
+ * in GOJUON_ORDER (0 for marks ignored at that level), the secondary one
+ * tells plain, voiced and semi-voiced kana apart and the tertiary one
+ * full-size kana, small kana and each mark. Weights start at 2 so that
+ * sort keys can separate levels with 1. */
+enum {COLLATE_PRIMARY, COLLATE_SECONDARY, COLLATE_TERTIARY, COLLATE_LEVELS};
+#define COLLATE_MIN 2
+#define COLLATE_SEP 1
+static const wchar_t GOJUON_ORDER[] = \
+    L"アイウエオカキクケコサシスセソタチツテトナニヌネノ"
+    L"ハヒフヘホマミムメモヤユヨラリルレロワヰヱヲン";
+static const wchar_t COLLATE_MARKS[] = L"ー・ヽヾ";
+static unsigned char katakana_collation[COLLATE_LEVELS][KATAKANA_RNG];
+
+
+static Katakana
+fold_root_(const Katakana *table, Katakana k) {
+    while (table[KANA_ID(k)] != k) {k = table[KANA_ID(k)];}
+    return k;
+}
 
 static void
 init_katakana_table(void) {
@@ -74,6 +122,51 @@ init_katakana_table(void) {
             kana_ch++;
         }
     }
+    for (int i = 0; i < KATAKANA_RNG; ++i) {
+        katakana_vowel_letters[i] = "_AIUEO__N"[katakana_rimes[i] & COLUMN_MASK];
+    }
+    katakana_vowel_letters[KANA_ID(L'ッ')] = 'Q';
+    katakana_vowel_letters[KANA_ID(L'ー')] = 'R';
+    katakana_vowel_letters[KANA_ID(L'ヵ')] = 'A';
+    katakana_vowel_letters[KANA_ID(L'ヶ')] = 'E';
+
+    /* a set of flags folds each kana to the root of its class in the
+     * union of the pairs of those flags, so that adding a flag only ever
+     * merges classes (ヴ, ウ, ブ and フ are all one class with "ad") */
+    for (int flags = 0; flags < FOLD_TABLE_CNT; ++flags) {
+        Katakana *table = katakana_fold_table[flags];
+        for (int i = 0; i < KATAKANA_RNG; ++i) {
+            table[i] = (Katakana)(KATAKANA_OFF + i);
+        }
+        for (int bit = 1; bit < FOLD_TABLE_CNT; bit <<= 1) {
+            if (!(flags & bit)) {continue;}
+            for (const wchar_t *w = FOLD_PAIRS[bit]; *w; w += 2) {
+                Katakana r0 = fold_root_(table, (Katakana)w[0]);
+                Katakana r1 = fold_root_(table, (Katakana)w[1]);
+                if (r0 != r1) {table[KANA_ID(r0)] = r1;}
+            }
+        }
+        for (int i = 0; i < KATAKANA_RNG; ++i) {
+            table[i] = fold_root_(table, (Katakana)(KATAKANA_OFF + i));
+        }
+    }
+
+    const Katakana *base = katakana_fold_table[FOLD_DAKUTEN | FOLD_SMALL];
+    for (int i = 0; i < KATAKANA_RNG; ++i) {
+        const wchar_t *pos = wcschr(GOJUON_ORDER, (wchar_t)base[i]);
+        const wchar_t *mark = \
+            wcschr(COLLATE_MARKS, (wchar_t)(KATAKANA_OFF + i));
+        bool voiced = katakana_fold_table[FOLD_DAKUTEN][i] != KATAKANA_OFF + i;
+        bool small = katakana_fold_table[FOLD_SMALL][i] != KATAKANA_OFF + i;
+        bool semi_voiced = voiced && wcschr(L"パピプペポ", KATAKANA_OFF + i);
+        katakana_collation[COLLATE_PRIMARY][i] = pos && !mark ? \
+            (unsigned char)(COLLATE_MIN + (pos - GOJUON_ORDER)) : 0;
+        katakana_collation[COLLATE_SECONDARY][i] = \
+            COLLATE_MIN + voiced + semi_voiced;
+        katakana_collation[COLLATE_TERTIARY][i] = mark ? \
+            (unsigned char)(COLLATE_MIN + 2 + (mark - COLLATE_MARKS)) : \
+            COLLATE_MIN + small;
+    }
 }
 
 
@@ -85,11 +178,16 @@ small_kana_vowel(Katakana k) {
 
 #define VOWEL_FROM_KATAKANA(ch) (katakana_rimes[KANA_ID(ch)] & COLUMN_MASK)
 
-static inline int
-VALIDATE_MORA_BOUNDARY_(Katakana k1, Katakana k2) {
+/* Whether k2 is a small kana that joins the mora of k1 before it. */
+static inline bool
+small_kana_attaches(Katakana k1, Katakana k2) {
     int small_kana = small_kana_vowel(k2);
+    return small_kana && small_kana != VOWEL_FROM_KATAKANA(k1);
+}
 
-    if (small_kana && small_kana != VOWEL_FROM_KATAKANA(k1)) {
+static inline int
+VALIDATE_MORA_BOUNDARY_(Katakana k1, Katakana k2) {
+    if (small_kana_attaches(k1, k2)) {
         PyErr_SetString(PyExc_ValueError, "ill-formed mora string");
         return -1;
     }
@@ -1131,8 +1229,11 @@ MoraStr_INDICES_ALLOC_(uint32_t size) {
 } while(0)
 
 
+/* head tells whether text stands at the head of a string; a small kana
+   there is warned about. */
 static Py_ssize_t
-count_morae(PyObject *text, Py_ssize_t length, MINDEX_T **indices_p) {
+count_morae_(PyObject *text, Py_ssize_t length, MINDEX_T **indices_p,
+        bool head) {
     static MINDEX_T pool[32] = {0};
 
     MoraStr_assert(length >= 0);
@@ -1163,7 +1264,7 @@ count_morae(PyObject *text, Py_ssize_t length, MINDEX_T **indices_p) {
         Katakana k = text_buf[0];
         rime = katakana_rimes[KANA_ID(k)];
         small_kana = rime >> SMALL_KANA_OFF;
-        if (small_kana) {
+        if (small_kana && head) {
             if (PyErr_WarnEx(PyExc_Warning,
                     "base string starts with a small kana", 1) < 0) {
                 goto error;
@@ -1221,6 +1322,8 @@ error:
 
 #undef length
 }
+#define count_morae(text, length, indices_p) \
+    count_morae_(text, length, indices_p, true)
 
 
 static PyObject *
@@ -1253,7 +1356,7 @@ MoraStr_copy_(PyTypeObject *type, MoraStrObject *obj) {
 
 
 static PyObject *
-MoraStr_from_unicode_(PyObject *u, bool validate) {
+MoraStr_from_text_(PyObject *u, bool validate, bool head) {
     static PyTypeObject *type = &MoraStrType;
 
     assert(PyUnicode_Check(u));
@@ -1267,7 +1370,7 @@ MoraStr_from_unicode_(PyObject *u, bool validate) {
         Py_XSETREF(string, u);
     }
     Py_ssize_t length = PyUnicode_GET_LENGTH(string), mora_cnt;
-    mora_cnt = length ? count_morae(string, length, &indices) : 0LL;
+    mora_cnt = length ? count_morae_(string, length, &indices, head) : 0LL;
 
     if (mora_cnt == -1) {goto error;}
     if (!mora_cnt) {
@@ -1290,6 +1393,131 @@ error:
 }
 
 
+static PyObject *
+MoraStr_from_unicode_(PyObject *u, bool validate) {
+    return MoraStr_from_text_(u, validate, true);
+}
+
+
+static PyObject *
+MoraStr_from_object_(PyObject *obj, const char *err_fmt) {
+    if (PyUnicode_Check(obj)) {
+        return MoraStr_from_unicode_(obj, true);
+    } else if (MoraStr_Check(obj)) {
+        return Py_NewRef(obj);
+    }
+    PyErr_Format(PyExc_TypeError, err_fmt, Py_TYPE(obj)->tp_name);
+    return NULL;
+}
+
+
+/* O& converter for the fold= keyword: a string of FOLD_LETTERS or None */
+static int
+MoraStr_fold_converter(PyObject *obj, int *flags) {
+    *flags = 0;
+    if (obj == Py_None) {return 1;}
+    if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError,
+            "fold must be str or None, not %.100s", Py_TYPE(obj)->tp_name);
+        return 0;
+    }
+    static const int fold_bits[] = {
+        FOLD_DAKUTEN, FOLD_SMALL, FOLD_ARCHAIC, FOLD_CHOON};
+    Py_ssize_t len = PyUnicode_GET_LENGTH(obj);
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        Py_UCS4 ch = PyUnicode_READ_CHAR(obj, i);
+        const char *found = ch && ch < 128 ? \
+            strchr(FOLD_LETTERS, (int)ch) : NULL;
+        if (!found) {
+            PyErr_Format(PyExc_ValueError,
+                "fold must consist of the letters '%s', not %R",
+                FOLD_LETTERS, obj);
+            return 0;
+        }
+        *flags |= fold_bits[found - FOLD_LETTERS];
+    }
+    return 1;
+}
+
+
+/* Returns a MoraStr whose characters are replaced with the representative
+ * of their equivalence classes. Folding never changes the length, so the
+ * result keeps the mora boundaries of the original object; it is only
+ * meant as a search buffer and may not be a well-formed mora string.
+ * With FOLD_CHOON, each 'ー' then becomes the vowel of the mora before
+ * it; a leading 'ー' has none and is kept (see MoraStr_choon_lead_()). */
+static PyObject *
+MoraStr_fold_(PyObject *morastr, int flags) {
+    Py_ssize_t mora_cnt = Py_SIZE(morastr);
+    if (!flags || !mora_cnt) {return Py_NewRef(morastr);}
+
+    PyObject *string = MoraStr_STRING(morastr);
+    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
+    const MINDEX_T *indices = MoraStr_INDICES(morastr);
+    PyObject *folded = PyUnicode_New(len, PyUnicode_MAX_CHAR_VALUE(string));
+    if (!folded) {return NULL;}
+
+    const Katakana *table = katakana_fold_table[flags & (FOLD_TABLE_CNT-1)];
+    const Katakana *s = KatakanaArray_from_str(string);
+    Katakana *t = KatakanaArray_from_str(folded);
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        t[i] = table[KANA_ID(s[i])];
+    }
+    if (flags & FOLD_CHOON) {
+        for (Py_ssize_t i = 1; i < len; ++i) {
+            if (t[i] != L'ー') {continue;}
+            int vowel = small_kana_vowel(t[i-1]);
+            if (!vowel) {vowel = VOWEL_FROM_KATAKANA(t[i-1]);}
+            if (COLUMN_A <= vowel && vowel <= COLUMN_O) {
+                t[i] = (Katakana)L"アイウエオ"[vowel - COLUMN_A];
+            }
+        }
+    }
+
+    MINDEX_T *new_indices = NULL;
+    if (indices) {
+        new_indices = MoraStr_INDICES_ALLOC(mora_cnt);
+        if (!new_indices) {
+            Py_DECREF(folded);
+            return NULL;
+        }
+        memcpy(new_indices, indices, sizeof(MINDEX_T)*mora_cnt);
+    }
+    MoraStrObject *result = (MoraStrObject *)
+        MoraStrType.tp_alloc(&MoraStrType, 0);
+    if (!result) {
+        Py_DECREF(folded);
+        MoraStr_Free(new_indices);
+        return NULL;
+    }
+    Py_SET_SIZE(result, mora_cnt);
+    result->string = folded;
+    result->indices = new_indices;
+    return (PyObject *)result;
+}
+
+
+/* Folds both operands of a search method, converting submora to MoraStr. */
+static int
+MoraStr_fold_operands_(
+    PyObject **self, PyObject **submora, int flags, const char *err_fmt)
+{
+    PyObject *sub = MoraStr_from_object_(*submora, err_fmt);
+    if (!sub) {return -1;}
+    PyObject *folded_sub = MoraStr_fold_(sub, flags);
+    Py_DECREF(sub);
+    if (!folded_sub) {return -1;}
+    PyObject *folded_self = MoraStr_fold_(*self, flags);
+    if (!folded_self) {
+        Py_DECREF(folded_sub);
+        return -1;
+    }
+    *self = folded_self;
+    *submora = folded_sub;
+    return 0;
+}
+
+
 static PyObject *
 MoraStr_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
     static char *kwlist[] = {"", "ignore", NULL};
@@ -1357,6 +1585,7 @@ static void
 MoraStr_dealloc(MoraStrObject *self) {
     Py_XDECREF(self->string);
     MoraStr_Free(self->indices);
+    Py_XDECREF(self->vowels);
     Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
@@ -1747,21 +1976,198 @@ error:
 }
 
 
+/* Interned str objects for single morae, shared by indexing and
+ * iteration so that list(m) allocates nothing once the table is warm and
+ * equal morae are the same object. Each entry has a slot: a single
+ * character's slot is its KANA_ID, and longer morae take the next free
+ * slot from KATAKANA_RNG up. Those are found by their packed character
+ * ids in a small open-addressing table. Entries are never released.
+ * Should the table ever fill up, a fresh str is returned instead. */
+#define MORA_STR_TABLE_SIZE 4096
+#define MORA_SLOT_MAX (KATAKANA_RNG + MORA_STR_TABLE_SIZE / 4 * 3)
+
+static PyObject *mora_strs[MORA_SLOT_MAX];
+static uint32_t mora_str_keys[MORA_STR_TABLE_SIZE];
+static uint16_t mora_str_slots[MORA_STR_TABLE_SIZE];
+static Py_ssize_t mora_slot_cnt = KATAKANA_RNG;
+
+/* Common multi-character morae. init_mora_ids() registers them first, in
+ * this order, so that their slots are the same in every process and
+ * serve as IDs: single characters have their KANA_ID and these are
+ * numbered from KATAKANA_RNG up, all below 256. Entries may only be
+ * appended, so that stored IDs stay valid. Any other mora gets its ID
+ * from mora_id_code_(). */
+static const wchar_t MORA_ID_INVENTORY[] =
+    L"キャ キュ キョ シャ シュ ショ チャ チュ チョ ニャ ニュ ニョ "
+    L"ヒャ ヒュ ヒョ ミャ ミュ ミョ リャ リュ リョ ギャ ギュ ギョ "
+    L"ジャ ジュ ジョ ヂャ ヂュ ヂョ ビャ ビュ ビョ ピャ ピュ ピョ "
+    L"イェ キェ ギェ シェ ジェ チェ ニェ ヒェ ビェ ピェ ミェ リェ "
+    L"ウァ ウィ ウェ ウォ ヴァ ヴィ ヴェ ヴォ ヴャ ヴョ "
+    L"ファ フィ フェ フォ フャ フョ クァ クィ クェ クォ クヮ "
+    L"グァ グィ グェ グォ グヮ ツァ ツィ ツェ ツォ スィ ズィ "
+    L"ティ ディ テュ デュ トゥ ドゥ ホゥ";
+static Py_ssize_t mora_id_cnt;
+
+/* IDs from MORA_ID_CODED up encode a mora of two or three characters as
+ * KANA_ID(first) << 8 | small(second) << 4 | small(third), where small()
+ * numbers the kana that can join the character before them from 1 and
+ * is 0 for a missing third character. The largest is below 0x6100. */
+#define MORA_ID_CODED 256
+static unsigned char mora_small_codes[KATAKANA_RNG];
+static Katakana mora_small_chars[16];
+
+
+/* Returns the slot of the registered multi-character mora p[0:len], or
+   -1 with *key and *i set to where mora_slot_of_() would register it. */
+static inline Py_ssize_t
+mora_slot_find_(const Katakana *p, Py_ssize_t len, uint32_t *key, uint32_t *i)
+{
+    uint32_t mask = MORA_STR_TABLE_SIZE - 1, h;
+    *key = (uint32_t)len;
+    for (Py_ssize_t j = 0; j < len; ++j) {
+        *key = (*key << 7) | (uint32_t)KANA_ID(p[j]);
+    }
+    h = *key * 2654435761u;
+    for (*i = (h ^ (h >> 15)) & mask; mora_str_keys[*i];
+            *i = (*i + 1) & mask) {
+        if (mora_str_keys[*i] == *key) {return mora_str_slots[*i];}
+    }
+    return -1;
+}
+
+
+/* Returns the slot of the mora p[0:len], registering it on first use,
+   -1 if the table is full, or -2 on error. */
+static Py_ssize_t
+mora_slot_of_(const Katakana *p, Py_ssize_t len) {
+    Py_ssize_t slot;
+    uint32_t key = 0, i = 0;
+    if (len == 1) {
+        slot = KANA_ID(*p);
+        if (mora_strs[slot]) {return slot;}
+    } else {
+        slot = mora_slot_find_(p, len, &key, &i);
+        if (slot >= 0) {return slot;}
+        if (len > MORA_CONTENT_MAX || mora_slot_cnt == MORA_SLOT_MAX) {
+            return -1;
+        }
+        slot = mora_slot_cnt;
+    }
+    PyObject *mora = PyUnicode_FromKindAndData(KATAKANA_KIND, p, len);
+    if (!mora) {return -2;}
+    PyUnicode_InternInPlace(&mora);
+    mora_strs[slot] = mora;
+    if (len > 1) {
+        mora_str_keys[i] = key;
+        mora_str_slots[i] = (uint16_t)slot;
+        ++mora_slot_cnt;
+    }
+    return slot;
+}
+
+
+static int
+init_mora_ids(void) {
+    const wchar_t *w = MORA_ID_INVENTORY;
+    while (*w) {
+        Py_ssize_t len = 0;
+        Katakana mora[MORA_CONTENT_MAX];
+        while (*w && *w != L' ') {mora[len++] = (Katakana)*w++;}
+        if (mora_slot_of_(mora, len) < 0) {return -1;}
+        if (*w) {++w;}
+    }
+    mora_id_cnt = mora_slot_cnt;
+    MoraStr_assert(mora_id_cnt <= MORA_ID_CODED);
+
+    int code = 0;
+    for (int i = 0; i < KATAKANA_RNG; ++i) {
+        if (!(katakana_rimes[i] >> SMALL_KANA_OFF)) {continue;}
+        mora_small_codes[i] = (unsigned char)++code;
+        mora_small_chars[code] = (Katakana)(KATAKANA_OFF + i);
+    }
+    MoraStr_assert(code < 16);
+    return 0;
+}
+
+
+static inline uint16_t
+mora_id_code_(const Katakana *p, Py_ssize_t len) {
+    MoraStr_assert(len == 2 || len == 3);
+    MoraStr_assert(mora_small_codes[KANA_ID(p[1])]);
+    return (uint16_t)(MORA_ID_CODED + (KANA_ID(p[0]) << 8 |
+        mora_small_codes[KANA_ID(p[1])] << 4 |
+        (len == 3 ? mora_small_codes[KANA_ID(p[2])] : 0)));
+}
+
+
+/* Returns the mora ID of p[0:len]. init_mora_ids() registered the
+   inventory first, so looking it up never registers anything. */
+static uint16_t
+mora_id_of_(const Katakana *p, Py_ssize_t len) {
+    if (len == 1) {return (uint16_t)KANA_ID(*p);}
+    uint32_t key, i;
+    Py_ssize_t slot = mora_slot_find_(p, len, &key, &i);
+    if (0 <= slot && slot < mora_id_cnt) {return (uint16_t)slot;}
+    return (uint16_t)mora_id_code_(p, len);
+}
+
+
+/* Writes the characters of the mora with the ID id to p and returns
+   their number, or 0 if id is not the ID of any single mora. */
+static Py_ssize_t
+mora_id_chars_(Py_ssize_t id, Katakana *p) {
+    if (id < KATAKANA_RNG) {
+        p[0] = (Katakana)(KATAKANA_OFF + id);
+        return is_zenkaku_katakana(p[0]);
+    }
+    if (id < mora_id_cnt) {
+        Py_ssize_t len = PyUnicode_GET_LENGTH(mora_strs[id]);
+        memcpy(p, KatakanaArray_from_str(mora_strs[id]),
+               sizeof(Katakana) * len);
+        return len;
+    }
+    id -= MORA_ID_CODED;
+    if (id < 0 || id >> 8 >= KATAKANA_RNG) {return 0;}
+    int first = (int)(id >> 8), second = (id >> 4) & 15, third = id & 15;
+    if (!second || !mora_small_chars[second] ||
+            (third && !mora_small_chars[third])) {return 0;}
+    Py_ssize_t len = third ? 3 : 2;
+    p[0] = (Katakana)(KATAKANA_OFF + first);
+    p[1] = mora_small_chars[second];
+    p[2] = mora_small_chars[third];
+    if (!is_zenkaku_katakana(p[0])) {return 0;}
+    for (Py_ssize_t j = 1; j < len; ++j) {
+        /* a small kana with the vowel before it starts a mora */
+        if (small_kana_vowel(p[j]) == VOWEL_FROM_KATAKANA(p[j-1])) {
+            return 0;
+        }
+    }
+    /* the inventory morae only have their own IDs */
+    return mora_id_of_(p, len) == MORA_ID_CODED + id ? len : 0;
+}
+
+
+static PyObject *
+mora_str_lookup_(const Katakana *p, Py_ssize_t len) {
+    Py_ssize_t slot = mora_slot_of_(p, len);
+    if (slot == -1) {
+        return PyUnicode_FromKindAndData(KATAKANA_KIND, p, len);
+    }
+    return slot < 0 ? NULL : Py_NewRef(mora_strs[slot]);
+}
+
+
 static inline PyObject *
 MoraStr_Item(MoraStrObject *self, Py_ssize_t i) {
     PyObject *string = MoraStr_STRING(self);
     MINDEX_T *indices = MoraStr_INDICES(self);
     assert(PyUnicode_Check(string));
+    const Katakana *buf = KatakanaArray_from_str(string);
 
-    if (!indices) {
-        Katakana k = KATAKANA_STR_READ(string, i);
-        return PyUnicode_FromOrdinal(k);
-    }
+    if (!indices) {return mora_str_lookup_(buf + i, 1);}
 
     Py_ssize_t s_start = i ? indices[i-1] : 0LL, s_end = indices[i];
-    const Katakana *buf = KatakanaArray_from_str(string);
-    return PyUnicode_FromKindAndData(
-        KATAKANA_KIND, (const void*)(buf+s_start), s_end - s_start);
+    return mora_str_lookup_(buf + s_start, s_end - s_start);
 }
 
 
@@ -1781,13 +2187,24 @@ MoraStr___getnewargs__(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
 }
 
 
+static PyObject *MoraStr_to_bytes(MoraStrObject *, PyObject *);
+
 static PyObject *
 MoraStr___reduce__(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
     static unaryfunc object_reduce = NULL;
+    /* one bound method for all, so that pickle memoizes it */
+    static PyObject *from_bytes = NULL;
 
     PyTypeObject *type = Py_TYPE(self);
     if (IS_MORASTR_TYPE(type)) {
-        return Py_BuildValue("O(O)", type, MoraStr_STRING(self));
+        if (!from_bytes) {
+            from_bytes = \
+                PyObject_GetAttrString((PyObject *)type, "from_bytes");
+            if (!from_bytes) {return NULL;}
+        }
+        PyObject *data = MoraStr_to_bytes(self, NULL);
+        if (!data) {return NULL;}
+        return Py_BuildValue("O(N)", from_bytes, data);
     }
     if (!object_reduce) {
         PyMethodDef *meth = PyBaseObject_Type.tp_methods;
@@ -1864,6 +2281,16 @@ static unsigned char katakana_hash_[96] = {
 
 #define KATAKANA_HASH64(key) (1ULL << katakana_hash_[KANA_ID(key)])
 
+/* packs the kana ids of a mora (at most 3 characters) into one integer */
+static inline uint32_t
+mora_key_(const Katakana *m, Py_ssize_t len) {
+    uint32_t key = 0;
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        key = (key << 7) | (uint32_t)KANA_ID(m[i]);
+    }
+    return key;
+}
+
 
 static Py_ssize_t
 katakana_mora_rev_search_x(
@@ -1902,16 +2329,8 @@ katakana_mora_rev_search_x(
             return m_idx + 1;
 
         mismatch:
-            --m_idx;
-            i = m_idx < 0 ? m_idx+1 : indices[m_idx];
-            if (i < end) {break;}
-            if (!(KATAKANA_HASH64(s[i]) & mask)) {
-                i -= p_len;
-            } else if (gap) {
-                i -= gap;
-            } else {
-                continue;
-            }
+            /* p[1..gap] differs from s[i], which equals the first kana */
+            i -= gap + 1;
         } else {
             --m_idx;
             i = m_idx < 0 ? m_idx+1 : indices[m_idx];
@@ -1973,8 +2392,25 @@ katakana_mora_rev_search(
 #undef BITAP_UINT_T
 
 #define BITAP_UINT_T uint64_t
+#define BITAP_MULTI
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+#undef BITAP_MULTI
+
+typedef struct {uint64_t w[2];} bitvec128_t;
+typedef struct {uint64_t w[4];} bitvec256_t;
+
+#define BITAP_UINT_T bitvec128_t
+#define BITAP_WORDS 2
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+#undef BITAP_WORDS
+
+#define BITAP_UINT_T bitvec256_t
+#define BITAP_WORDS 4
 #include "cmorastr_bitap.h"
 #undef BITAP_UINT_T
+#undef BITAP_WORDS
 
 #undef BITAP_TABLE_SIZE
 
@@ -1986,6 +2422,87 @@ katakana_mora_rev_search(
 #undef TWOWAY_SSIZE_T
 #undef TWOWAY_SSIZE_MAX
 
+#define ACMATCH_TABLE_SIZE KATAKANA_RNG
+#include "cmorastr_acmatch.c"
+#undef ACMATCH_TABLE_SIZE
+
+#include "cmorastr_moraindex.c"
+
+#include "cmorastr_prefixset.c"
+
+#include "cmorastr_morapattern.c"
+
+#include "cmorastr_ngram.c"
+
+#include "cmorastr_pack.c"
+
+#undef CHAR_INDEX
+
+#define BITAP_TABLE_SIZE 128
+#define CHAR_INDEX(ch) (ch)
+#define BITAP_CHAR_T Py_UCS1
+#define BITAP_NAME_SUFFIX _ucs1
+#define BITAP_PLAIN_ONLY
+
+#define BITAP_UINT_T uint32_t
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+
+#define BITAP_UINT_T uint64_t
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+
+#undef BITAP_TABLE_SIZE
+#undef CHAR_INDEX
+#undef BITAP_CHAR_T
+#undef BITAP_NAME_SUFFIX
+#undef BITAP_PLAIN_ONLY
+
+/* forward searches over the KANA_ID codes of MoraStrArray */
+#define CHAR_INDEX(ch) (ch)
+#define BITAP_TABLE_SIZE KATAKANA_RNG
+#define BITAP_CHAR_T uint8_t
+#define BITAP_NAME_SUFFIX _code
+#define BITAP_FORWARD_ONLY
+
+#define BITAP_UINT_T uint32_t
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+
+#define BITAP_UINT_T uint64_t
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+
+#define BITAP_UINT_T bitvec128_t
+#define BITAP_WORDS 2
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+#undef BITAP_WORDS
+
+#define BITAP_UINT_T bitvec256_t
+#define BITAP_WORDS 4
+#include "cmorastr_bitap.h"
+#undef BITAP_UINT_T
+#undef BITAP_WORDS
+
+#undef BITAP_TABLE_SIZE
+#undef BITAP_CHAR_T
+#undef BITAP_NAME_SUFFIX
+#undef BITAP_FORWARD_ONLY
+
+#define TWOWAY_TABLE_SIZE KATAKANA_RNG
+#define TWOWAY_SSIZE_T MINDEX_T
+#define TWOWAY_SSIZE_MAX MINDEX_MAX
+#define TWOWAY_CHAR_T uint8_t
+#define TWOWAY_NAME_SUFFIX _code
+#define TWOWAY_FORWARD_ONLY
+#include "cmorastr_twoway.c"
+#undef TWOWAY_TABLE_SIZE
+#undef TWOWAY_SSIZE_T
+#undef TWOWAY_SSIZE_MAX
+#undef TWOWAY_CHAR_T
+#undef TWOWAY_NAME_SUFFIX
+#undef TWOWAY_FORWARD_ONLY
 #undef CHAR_INDEX
 
 
@@ -1995,6 +2512,8 @@ katakana_mora_rev_search(
 #define SEARCH_BITAP 3
 #define SEARCH_BITAP64 4
 #define SEARCH_ADAPTIVE 5
+#define SEARCH_BITAP128 6
+#define SEARCH_BITAP256 7
 
 #define MoraStr_ALGORITHM SEARCH_DEFAULT
 
@@ -2023,6 +2542,8 @@ select_search_algorithm(
         p_len <= 32 ? SEARCH_BITAP :
 #if defined(__LP64__) || defined(_WIN64)
         p_len <= 64 ? SEARCH_BITAP64 :
+        p_len <= 128 ? SEARCH_BITAP128 :
+        p_len <= 256 ? SEARCH_BITAP256 :
 #endif
         s_len - p_len > 3 && SEARCH_TWOWAY ? SEARCH_TWOWAY :
         SEARCH_EXHAUSTIVE
@@ -2055,6 +2576,14 @@ generic_katakana_search_x(
         return bitap_search_uint64_t(
             s, s_len, p, p_len, mora_off, count);
     }
+    if (algorithm == SEARCH_BITAP128) {
+        return bitap_search_bitvec128_t(
+            s, s_len, p, p_len, mora_off, count);
+    }
+    if (algorithm == SEARCH_BITAP256) {
+        return bitap_search_bitvec256_t(
+            s, s_len, p, p_len, mora_off, count);
+    }
     MoraStr_assert(algorithm == SEARCH_EXHAUSTIVE);
     
     s += mora_off; s_len -= mora_off;
@@ -2126,6 +2655,16 @@ generic_mora_search_x(
             s, s_len, p, p_len,
             mora_off, p_moracnt, indices, count);
     }
+    if (algorithm == SEARCH_BITAP128) {
+        return bitap_mora_search_bitvec128_t(
+            s, s_len, p, p_len,
+            mora_off, p_moracnt, indices, count);
+    }
+    if (algorithm == SEARCH_BITAP256) {
+        return bitap_mora_search_bitvec256_t(
+            s, s_len, p, p_len,
+            mora_off, p_moracnt, indices, count);
+    }
     MoraStr_assert(algorithm == SEARCH_EXHAUSTIVE);
 
     Py_ssize_t i = mora_off ? indices[mora_off-1] : 0LL;
@@ -2177,6 +2716,87 @@ generic_mora_search(
 }
 
 
+/* Returns the mora index of the last occurrence of p within
+ * morae [mora_off, s_moracnt), s_len being the end of that range in
+ * characters. If indices is NULL, every mora is a single character.
+ * bitap_table is a table from bitap_rev_table_new for p, or NULL. */
+static Py_ssize_t
+generic_mora_rev_search(
+    const Katakana *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const Katakana *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const MINDEX_T *indices, const void *bitap_table)
+{
+    MoraStr_assert(p_len > 0 && s_len >= 0);
+
+    int algorithm = select_search_algorithm(
+        s_len, p_len,
+        !indices ? mora_off : mora_off ? indices[mora_off-1] : 0LL,
+        (bool)indices);
+
+    if (algorithm == SEARCH_TWOWAY) {
+        return two_way_mora_rev_search(
+            s, s_len, s_moracnt, p, p_len, p_moracnt, mora_off, indices,
+            NULL);
+    }
+    if (algorithm == SEARCH_BITAP) {
+        return bitap_mora_rev_search_uint32_t(
+            s, s_len, s_moracnt, p, p_len, p_moracnt, mora_off, indices,
+            bitap_table);
+    }
+    if (algorithm == SEARCH_BITAP64) {
+        return bitap_mora_rev_search_uint64_t(
+            s, s_len, s_moracnt, p, p_len, p_moracnt, mora_off, indices,
+            bitap_table);
+    }
+    if (algorithm == SEARCH_BITAP128) {
+        return bitap_mora_rev_search_bitvec128_t(
+            s, s_len, s_moracnt, p, p_len, p_moracnt, mora_off, indices,
+            bitap_table);
+    }
+    if (algorithm == SEARCH_BITAP256) {
+        return bitap_mora_rev_search_bitvec256_t(
+            s, s_len, s_moracnt, p, p_len, p_moracnt, mora_off, indices,
+            bitap_table);
+    }
+    MoraStr_assert(algorithm == SEARCH_EXHAUSTIVE);
+
+    if (indices) {
+        return katakana_mora_rev_search(
+            s, s_len, s_moracnt, p, p_len, p_moracnt, mora_off, indices);
+    }
+    KanaPattern kp;
+    KanaPattern_init(&kp, p, p_len);
+    for (Py_ssize_t i = s_len - p_len; i >= mora_off; --i) {
+        if (KanaPattern_eq(&kp, s+i, p_len)) {return i;}
+    }
+    return -1;
+}
+
+
+/* Builds the table that the reverse bitap search of algorithm uses for p,
+   so that repeated searches for the same needle can share it. Returns
+   NULL if algorithm uses no table or on allocation failure; the searches
+   then build their own. Free it with PyMem_Free. */
+static void *
+bitap_rev_table_new(const Katakana *p, Py_ssize_t p_len, int algorithm) {
+    void *table = NULL;
+    if (algorithm == SEARCH_BITAP) {
+        table = PyMem_Calloc(KATAKANA_RNG, sizeof(uint32_t));
+        if (table) {bitap_rev_prepare_uint32_t(p, p_len, table);}
+    } else if (algorithm == SEARCH_BITAP64) {
+        table = PyMem_Calloc(KATAKANA_RNG, sizeof(uint64_t));
+        if (table) {bitap_rev_prepare_uint64_t(p, p_len, table);}
+    } else if (algorithm == SEARCH_BITAP128) {
+        table = PyMem_Calloc(KATAKANA_RNG, sizeof(bitvec128_t));
+        if (table) {bitap_rev_prepare_bitvec128_t(p, p_len, table);}
+    } else if (algorithm == SEARCH_BITAP256) {
+        table = PyMem_Calloc(KATAKANA_RNG, sizeof(bitvec256_t));
+        if (table) {bitap_rev_prepare_bitvec256_t(p, p_len, table);}
+    }
+    return table;
+}
+
+
 static inline int
 search_algorithm_prepare(
     const Katakana *Py_UNUSED(s), Py_ssize_t s_len,
@@ -2250,28 +2870,282 @@ parse_submora(PyObject *submora,
 }
 
 
-static int
-MoraStr_contains(MoraStrObject *self, PyObject *submora) {
-    static const char *err_fmt = \
-        "string requeired as left operand, not %.200s";
+/* Under the 'c' fold, a needle starting with 'ー' has no mora whose vowel
+   it could lengthen, so that 'ー' matches any vowel mora instead. */
+static inline bool
+MoraStr_choon_lead_(PyObject *folded, int fold) {
+    return (fold & FOLD_CHOON) && Py_SIZE(folded) &&
+        KatakanaArray_from_str(MoraStr_STRING(folded))[0] == L'ー';
+}
 
-    Py_ssize_t submora_cnt, substr_len;
-    PyObject *substr;
 
-    substr = parse_submora(submora, &submora_cnt, &substr_len, err_fmt);
-    if (!substr) {return submora_cnt ? -1 : 1;}
+/* Packs the patterns of a tuple into bm. If fold is nonzero, each of them
+   is folded first. Sets *has_empty if one of them is empty. Patterns
+   with multi-character morae are left out if one_char_morae is true,
+   since they cannot match such a MoraStr. */
+static int
+MoraStr_pack_patterns_(
+    PyObject *tuple, int fold, bool one_char_morae,
+    struct bitap_multi_uint64_t *bm, bool *has_empty, const char *err_fmt)
+{
+    Py_ssize_t n = PyTuple_GET_SIZE(tuple), n_bits = 0;
+    PyObject *strs = PyTuple_New(n);
+    if (!strs) {return -1;}
+    Py_ssize_t *moracnt = PyMem_New(Py_ssize_t, n ? n : 1);
+    if (!moracnt) {
+        Py_DECREF(strs);
+        PyErr_NoMemory();
+        return -1;
+    }
 
-    PyObject *string = MoraStr_STRING(self);
-    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
-    if (len < substr_len) {
-        Py_DECREF(substr);
-        return 0;
+    *has_empty = false;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *item = PyTuple_GET_ITEM(tuple, i), *substr;
+        Py_ssize_t cnt, len;
+        if (fold) {
+            PyObject *morastr = MoraStr_from_object_(item, err_fmt);
+            if (!morastr) {goto error;}
+            Py_SETREF(morastr, MoraStr_fold_(morastr, fold));
+            if (!morastr) {goto error;}
+            cnt = Py_SIZE(morastr);
+            substr = cnt ? Py_NewRef(MoraStr_STRING(morastr)) : NULL;
+            len = cnt ? PyUnicode_GET_LENGTH(substr) : 0;
+            Py_DECREF(morastr);
+        } else {
+            substr = parse_submora(item, &cnt, &len, err_fmt);
+            if (cnt == -1) {goto error;}
+        }
+        if (!cnt) {
+            *has_empty = true;
+            continue;
+        }
+        if (one_char_morae && cnt != len) {
+            Py_DECREF(substr);
+            continue;
+        }
+        PyTuple_SET_ITEM(strs, i, substr);
+        moracnt[i] = cnt;
+        n_bits += len;
     }
 
-    MINDEX_T *indices = MoraStr_INDICES(self);
-    Py_ssize_t result;
-    if (!indices && submora_cnt != substr_len) {
-        Py_DECREF(substr);
+    if (bitap_multi_init_uint64_t(bm, n_bits) == -1) {goto error;}
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *substr = PyTuple_GET_ITEM(strs, i);
+        if (!substr) {continue;}
+        const Katakana *p = KatakanaArray_from_str(substr);
+        Py_ssize_t off = bm->used;
+        bitap_multi_add_uint64_t(
+            bm, p, PyUnicode_GET_LENGTH(substr), moracnt[i]);
+        if ((fold & FOLD_CHOON) && p[0] == L'ー') {
+            /* see MoraStr_choon_lead_() */
+            for (const wchar_t *v = L"アイウエオ"; *v; ++v) {
+                bitap_multi_accept_uint64_t(bm, off, (Katakana)*v);
+            }
+        }
+    }
+    PyMem_Free(moracnt);
+    Py_DECREF(strs);
+    return 0;
+
+error:
+    PyMem_Free(moracnt);
+    Py_DECREF(strs);
+    return -1;
+}
+
+
+/* Searches morae [start, end) of self for all the patterns in tuple in
+   one pass. An empty pattern matches at start. Returns what
+   bitap_multi_search_uint64_t() does, or -2 on error. */
+static Py_ssize_t
+MoraStr_multi_search_(
+    MoraStrObject *self, PyObject *tuple, int fold,
+    Py_ssize_t start, Py_ssize_t end, Py_ssize_t count, bool anchored,
+    const char *err_fmt)
+{
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    struct bitap_multi_uint64_t bm;
+    bool has_empty;
+    if (MoraStr_pack_patterns_(
+            tuple, fold, !indices, &bm, &has_empty, err_fmt) == -1) {
+        return -2;
+    }
+    Py_ssize_t result = count;
+    if (has_empty && count == -1) {
+        result = start;
+    } else if (bm.used && start < end) {
+        const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(self));
+        Py_ssize_t s_len = !indices ? end : (Py_ssize_t)indices[end-1];
+        result = bitap_multi_search_uint64_t(
+            &bm, s, s_len, start, indices, count, anchored);
+    }
+    bitap_multi_dealloc_uint64_t(&bm);
+    return result;
+}
+
+
+/* Searches the folded self for a folded needle that MoraStr_choon_lead_()
+   accepts, packed on its own. Returns what MoraStr_multi_search_() does;
+   folding them again with FOLD_CHOON changes nothing. */
+static Py_ssize_t
+MoraStr_choon_search_(MoraStrObject *self, PyObject *sub,
+        Py_ssize_t start, Py_ssize_t end, Py_ssize_t count)
+{
+    static const char *err_fmt = "%.100s";
+
+    PyObject *tuple = PyTuple_Pack(1, sub);
+    if (!tuple) {return -2;}
+    Py_ssize_t result = MoraStr_multi_search_(
+        self, tuple, FOLD_CHOON, start, end, count, false, err_fmt);
+    Py_DECREF(tuple);
+    return result;
+}
+
+
+static int
+MoraStrArray_grow_(void **p, Py_ssize_t *cap, Py_ssize_t need, size_t size);
+
+
+/* Returns a list of the positions of such a needle for finditer() and
+   rfinditer(): every one if overlapping, otherwise the non-overlapping
+   ones taken from the left, or from the right in descending order if
+   reverse. */
+static PyObject *
+MoraStr_choon_positions_(MoraStrObject *self, PyObject *sub,
+        BoolPred charwise, BoolPred overlapping, bool reverse)
+{
+    static const char *err_fmt = "%.100s";
+
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    Py_ssize_t mora_cnt = Py_SIZE(self), sub_cnt = Py_SIZE(sub);
+    PyObject *tuple = PyTuple_Pack(1, sub);
+    if (!tuple) {return NULL;}
+    struct bitap_multi_uint64_t bm;
+    bool has_empty;
+    int status = MoraStr_pack_patterns_(
+        tuple, FOLD_CHOON, !indices, &bm, &has_empty, err_fmt);
+    Py_DECREF(tuple);
+    if (status == -1) {return NULL;}
+
+    MINDEX_T *found = NULL;
+    Py_ssize_t n = 0, cap = 0;
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(self));
+    Py_ssize_t s_len = PyUnicode_GET_LENGTH(MoraStr_STRING(self));
+    for (Py_ssize_t pos = 0; bm.used && pos < mora_cnt;) {
+        Py_ssize_t k = bitap_multi_search_uint64_t(
+            &bm, s, s_len, pos, indices, -1, false);
+        if (k == -1) {break;}
+        if (n == cap && MoraStrArray_grow_(
+                (void **)&found, &cap, n + 1, sizeof(MINDEX_T)) == -1) {
+            bitap_multi_dealloc_uint64_t(&bm);
+            return NULL;
+        }
+        found[n++] = MINDEX(k);
+        pos = k + 1;
+    }
+    bitap_multi_dealloc_uint64_t(&bm);
+
+    PyObject *result = PyList_New(0);
+    Py_ssize_t limit = reverse ? mora_cnt : 0;
+    for (Py_ssize_t j = 0; result && j < n; ++j) {
+        Py_ssize_t k = found[reverse ? n - 1 - j : j];
+        if (!overlapping) {
+            if (reverse ? k + sub_cnt > limit : k < limit) {continue;}
+            limit = reverse ? k : k + sub_cnt;
+        }
+        if (charwise && indices && k) {k = indices[k-1];}
+        PyObject *item = PyLong_FromSsize_t(k);
+        if (!item || PyList_Append(result, item) == -1) {Py_CLEAR(result);}
+        Py_XDECREF(item);
+    }
+    MoraStr_Free(found);
+    return result;
+}
+
+
+static int
+MoraStr_contains_any_(MoraStrObject *self, PyObject *tuple, int fold) {
+    static const char *err_fmt = \
+        "tuple for contains must only contain str or MoraStr, not %.100s";
+
+    PyObject *folded = fold ? \
+        MoraStr_fold_((PyObject *)self, fold) : Py_NewRef(self);
+    if (!folded) {return -1;}
+    Py_ssize_t result = MoraStr_multi_search_(
+        (MoraStrObject *)folded, tuple, fold,
+        0, Py_SIZE(folded), -1, false, err_fmt);
+    Py_DECREF(folded);
+    if (result == -2) {return -1;}
+    return result != -1;
+}
+
+
+static int
+MoraStr_contains(MoraStrObject *self, PyObject *submora);
+
+
+static PyObject *
+MoraStr_contains_method(MoraStrObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "fold", NULL};
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *submora;
+    int fold = 0;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$O&", kwlist, &submora,
+            MoraStr_fold_converter, &fold)) {
+        return NULL;
+    }
+    if (PyTuple_Check(submora)) {
+        int result = MoraStr_contains_any_(self, submora, fold);
+        if (result == -1) {return NULL;}
+        return PyBool_FromLong(result);
+    }
+    if (MoraStr_fold_operands_(
+            (PyObject **)&self, &submora, fold, err_fmt) == -1) {
+        return NULL;
+    }
+    int result;
+    if (MoraStr_choon_lead_(submora, fold)) {
+        Py_ssize_t found = MoraStr_choon_search_(
+            self, submora, 0, Py_SIZE(self), -1);
+        result = found == -2 ? -1 : found != -1;
+    } else {
+        result = MoraStr_contains(self, submora);
+    }
+    Py_DECREF(self);
+    Py_DECREF(submora);
+    if (result == -1) {return NULL;}
+    return PyBool_FromLong(result);
+}
+
+
+static int
+MoraStr_contains(MoraStrObject *self, PyObject *submora) {
+    static const char *err_fmt = \
+        "string requeired as left operand, not %.200s";
+
+    Py_ssize_t submora_cnt, substr_len;
+    PyObject *substr;
+
+    if (PyTuple_Check(submora)) {
+        return MoraStr_contains_any_(self, submora, 0);
+    }
+    substr = parse_submora(submora, &submora_cnt, &substr_len, err_fmt);
+    if (!substr) {return submora_cnt ? -1 : 1;}
+
+    PyObject *string = MoraStr_STRING(self);
+    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
+    if (len < substr_len) {
+        Py_DECREF(substr);
+        return 0;
+    }
+
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    Py_ssize_t result;
+    if (!indices && submora_cnt != substr_len) {
+        Py_DECREF(substr);
         return 0;
     }
     const Katakana *s = KatakanaArray_from_str(string);
@@ -2288,6 +3162,30 @@ MoraStr_contains(MoraStrObject *self, PyObject *submora) {
 }
 
 
+typedef struct {
+    PyObject_HEAD
+    PyObject *pattern;
+    struct MoraPattern *mp;
+} MoraPatternObject;
+
+static PyTypeObject MoraPatternType;
+
+static int
+MoraPattern_check_fold_(PyObject *submora, int fold);
+
+static Py_ssize_t
+MoraPattern_find_(MoraStrObject *self, PyObject *pattern,
+        Py_ssize_t start, Py_ssize_t end);
+
+static PyObject *
+MoraPattern_count_(MoraStrObject *self, PyObject *pattern,
+        Py_ssize_t start, Py_ssize_t end);
+
+static PyObject *
+MoraPattern_finditer_(PyObject *self, PyObject *pattern,
+        BoolPred charwise, BoolPred overlapping);
+
+
 static Py_ssize_t
 MoraStr_findindex(MoraStrObject *self, PyObject *submora,
         Py_ssize_t start, Py_ssize_t end)
@@ -2295,6 +3193,9 @@ MoraStr_findindex(MoraStrObject *self, PyObject *submora,
     static const char *err_fmt = \
         "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
 
+    if (Py_TYPE(submora) == &MoraPatternType) {
+        return MoraPattern_find_(self, submora, start, end);
+    }
     BoolPred charwise = false;
     if (start == -1) {
         charwise = true; start = 0;
@@ -2376,23 +3277,18 @@ MoraStr_rfindindex(MoraStrObject *self, PyObject *submora,
     }
 
     Py_ssize_t result;
-    if (!indices) {
-        if (substr_len == 1) {
-            Py_UCS4 ch = (Py_UCS4)KATAKANA_STR_READ(substr, 0);
-            result = PyUnicode_FindChar(
-                string, ch, start, end, -1);
-        } else {
-            result = PyUnicode_Find(
-                string, substr, start, end, -1);
-        }
+    if (!indices && substr_len == 1) {
+        Py_UCS4 ch = (Py_UCS4)KATAKANA_STR_READ(substr, 0);
+        result = PyUnicode_FindChar(
+            string, ch, start, end, -1);
     } else {
         const Katakana *s = KatakanaArray_from_str(string);
         const Katakana *p = KatakanaArray_from_str(substr);
 
-        result = katakana_mora_rev_search(
+        result = generic_mora_rev_search(
             s, len, end, p, substr_len, submora_cnt,
-            start, indices);
-        if (charwise && 0 < result) {
+            start, indices, NULL);
+        if (charwise && indices && 0 < result) {
             result = indices[result-1];
         }
     }
@@ -2451,14 +3347,55 @@ MoraStr_Count(MoraStrObject *self, PyObject *submora,
 }
 
 
+/* Counts the non-overlapping occurrences of any pattern in tuple. Where
+   matches overlap, the one that ends first is taken. Empty patterns are
+   ignored. */
+static PyObject *
+MoraStr_count_any_(MoraStrObject *self, PyObject *tuple,
+        Py_ssize_t start, Py_ssize_t end, int fold)
+{
+    static const char *err_fmt = \
+        "tuple for count must only contain str or MoraStr, not %.100s";
+
+    PyObject *folded = fold ? \
+        MoraStr_fold_((PyObject *)self, fold) : Py_NewRef(self);
+    if (!folded) {return NULL;}
+    Py_ssize_t result = MoraStr_multi_search_(
+        (MoraStrObject *)folded, tuple, fold,
+        start, end, PY_SSIZE_T_MAX, false, err_fmt);
+    Py_DECREF(folded);
+    if (result == -2) {return NULL;}
+    return PyLong_FromSsize_t(PY_SSIZE_T_MAX - result);
+}
+
+
 static PyObject *
-MoraStr_count(MoraStrObject *self, PyObject *const *args, Py_ssize_t nargs) {
+MoraStr_count(MoraStrObject *self, PyObject *const *args, Py_ssize_t nargs,
+        PyObject *kwnames)
+{
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
     PyObject *submora;
     Py_ssize_t length, start = 0, end = PY_SSIZE_T_MAX;
+    int fold = 0;
 
     if (MoraStr_VALIDATE_NUM_ARGS("count", 1, 3, nargs) == -1) {
         return NULL;
     };
+    if (kwnames) {
+        for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(kwnames); ++i) {
+            PyObject *key = PyTuple_GET_ITEM(kwnames, i);
+            if (PyUnicode_CompareWithASCIIString(key, "fold")) {
+                PyErr_Format(PyExc_TypeError,
+                    "count() got an unexpected keyword argument '%S'", key);
+                return NULL;
+            }
+            if (!MoraStr_fold_converter(args[nargs+i], &fold)) {
+                return NULL;
+            }
+        }
+    }
     submora = args[0];
     switch (nargs) {
         case 3:
@@ -2472,44 +3409,97 @@ MoraStr_count(MoraStrObject *self, PyObject *const *args, Py_ssize_t nargs) {
     if (length < start) {return PyLong_FromLong(0);}
     PySlice_AdjustIndices(length, &start, &end, 1);
 
-    Py_ssize_t result = MoraStr_Count(self, submora, start, end);
+    if (PyTuple_Check(submora)) {
+        return MoraStr_count_any_(self, submora, start, end, fold);
+    }
+    if (MoraPattern_check_fold_(submora, fold) < 0) {return NULL;}
+    if (Py_TYPE(submora) == &MoraPatternType) {
+        return MoraPattern_count_(self, submora, start, end);
+    }
+    if (fold && MoraStr_fold_operands_(
+            (PyObject **)&self, &submora, fold, err_fmt) == -1) {
+        return NULL;
+    }
+    Py_ssize_t result;
+    if (MoraStr_choon_lead_(submora, fold)) {
+        result = MoraStr_choon_search_(
+            self, submora, start, end, PY_SSIZE_T_MAX);
+        result = result == -2 ? -1 : PY_SSIZE_T_MAX - result;
+    } else {
+        result = MoraStr_Count(self, submora, start, end);
+    }
+    if (fold) {
+        Py_DECREF(self);
+        Py_DECREF(submora);
+    }
     if (result == -1) {return NULL;}
     return PyLong_FromSsize_t(result);
 }
 
 
-static PyObject *
-MoraStr_find(MoraStrObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"", "", "", "charwise", NULL};
+/* Parses the arguments of find() and index() and returns the index found,
+ * -1 if not found, or -2 on error. */
+static Py_ssize_t
+MoraStr_find_args_(MoraStrObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "", "", "charwise", "fold", NULL};
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
 
     PyObject *submora, *arg_x = NULL, *arg_y = NULL;
     BoolPred charwise = false;
+    int fold = 0;
 
     if (!PyArg_ParseTupleAndKeywords(
-            args, kwds, "O|OO$p", kwlist,
-            &submora, &arg_x, &arg_y, &charwise)) {return NULL;}
+            args, kwds, "O|OO$pO&", kwlist,
+            &submora, &arg_x, &arg_y, &charwise,
+            MoraStr_fold_converter, &fold)) {return -2;}
 
-    if (kwds && arg_x) {
+    if (arg_x && kwds && PyDict_GetItemString(kwds, "charwise")) {
         PyErr_SetString(PyExc_TypeError,
             "keyword argument 'charwise' is available only when "
             "start/end arguments are not specified");
-        return NULL;
+        return -2;
     }
 
     Py_ssize_t start = 0, end = PY_SSIZE_T_MAX;
     if (arg_x) {
-        if (!MoraStr_SliceIndex(arg_x, &start)) {return NULL;}
+        if (!MoraStr_SliceIndex(arg_x, &start)) {return -2;}
     }
     if (arg_y) {
-        if (!MoraStr_SliceIndex(arg_y, &end)) {return NULL;}
+        if (!MoraStr_SliceIndex(arg_y, &end)) {return -2;}
     }
 
     Py_ssize_t length = Py_SIZE(self);
-    if (length < start) {return PyLong_FromLong(-1);}
+    if (length < start) {return -1;}
     PySlice_AdjustIndices(length, &start, &end, 1);
 
     if (charwise) {start = -1;}
-    Py_ssize_t result = MoraStr_findindex(self, submora, start, end);
+    if (MoraPattern_check_fold_(submora, fold) < 0) {return -2;}
+    if (fold && MoraStr_fold_operands_(
+            (PyObject **)&self, &submora, fold, err_fmt) == -1) {
+        return -2;
+    }
+    Py_ssize_t result;
+    if (MoraStr_choon_lead_(submora, fold)) {
+        result = MoraStr_choon_search_(
+            self, submora, charwise ? 0 : start, end, -1);
+        if (charwise && 0 < result && MoraStr_INDICES(self)) {
+            result = MoraStr_INDICES(self)[result-1];
+        }
+    } else {
+        result = MoraStr_findindex(self, submora, start, end);
+    }
+    if (fold) {
+        Py_DECREF(self);
+        Py_DECREF(submora);
+    }
+    return result;
+}
+
+
+static PyObject *
+MoraStr_find(MoraStrObject *self, PyObject *args, PyObject *kwds) {
+    Py_ssize_t result = MoraStr_find_args_(self, args, kwds);
     if (result == -2) {return NULL;}
     return PyLong_FromSsize_t(result);
 }
@@ -2517,43 +3507,13 @@ MoraStr_find(MoraStrObject *self, PyObject *args, PyObject *kwds) {
 
 static PyObject *
 MoraStr_index(MoraStrObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"", "", "", "charwise", NULL};
-
-    PyObject *submora, *arg_x = NULL, *arg_y = NULL;
-    BoolPred charwise = false;
-
-    if (!PyArg_ParseTupleAndKeywords(
-            args, kwds, "O|OO$p", kwlist,
-            &submora, &arg_x, &arg_y, &charwise)) {return NULL;}
-
-    if (kwds && arg_x) {
-        PyErr_SetString(PyExc_TypeError,
-            "keyword argument 'charwise' is available only when "
-            "start/end arguments are not specified");
+    Py_ssize_t result = MoraStr_find_args_(self, args, kwds);
+    if (result == -2) {return NULL;}
+    if (result == -1) {
+        PyErr_SetString(PyExc_ValueError, "submora-string not found");
         return NULL;
     }
-
-    Py_ssize_t start = 0, end = PY_SSIZE_T_MAX;
-    if (arg_x) {
-        if (!MoraStr_SliceIndex(arg_x, &start)) {return NULL;}
-    }
-    if (arg_y) {
-        if (!MoraStr_SliceIndex(arg_y, &end)) {return NULL;}
-    }
-
-    Py_ssize_t length = Py_SIZE(self);
-    if (length < start) {goto notfound;}
-    PySlice_AdjustIndices(length, &start, &end, 1);
-
-    if (charwise) {start = -1;}
-    Py_ssize_t result = MoraStr_findindex(self, submora, start, end);
-    if (result == -2) {return NULL;}
-    if (result == -1) {goto notfound;}
     return PyLong_FromSsize_t(result);
-
-notfound:
-    PyErr_SetString(PyExc_ValueError, "submora-string not found");
-    return NULL;
 }
 
 
@@ -3040,58 +4000,523 @@ MoraStr_replace(
 }
 
 
-static PyObject *
-MoraStr_rfind(MoraStrObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"", "", "", "charwise", NULL};
+/*********************** translate **************************/
+/* Morae of a single character are looked up directly by KANA_ID; longer
+ * ones (up to MORATRANS_KEY_MAX characters) go through a small
+ * open-addressing table keyed by their packed character ids. Values are
+ * copied into one pool so that translate() never touches Python
+ * objects. */
+#define MORATRANS_KEY_MAX 3
 
-    PyObject *submora, *arg_x = NULL, *arg_y = NULL;
-    BoolPred charwise = false;
+struct MoraTransEntry {
+    MINDEX_T off;       /* into chars */
+    MINDEX_T len;
+    MINDEX_T mora_cnt;
+    MINDEX_T ends_off;  /* into ends: mora ends relative to off */
+};
 
-    if (!PyArg_ParseTupleAndKeywords(
-            args, kwds, "O|OO$p", kwlist,
-            &submora, &arg_x, &arg_y, &charwise)) {return NULL;}
+typedef struct {
+    PyObject_HEAD
+    Py_ssize_t n_entries;
+    struct MoraTransEntry *entries;
+    Katakana *chars;
+    MINDEX_T *ends;
+    uint32_t *keys;
+    int32_t *slots;
+    uint32_t mask;
+    int32_t single[KATAKANA_RNG];  /* entry index + 1, or 0 */
+} MoraTransTableObject;
+
+static PyTypeObject MoraTransTableType;
+
+
+static inline uint32_t
+moratrans_key_(const Katakana *p, Py_ssize_t len) {
+    uint32_t key = (uint32_t)len;
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        key = (key << 7) | (uint32_t)KANA_ID(p[i]);
+    }
+    return key;
+}
 
-    if (kwds && arg_x) {
-        PyErr_SetString(PyExc_TypeError,
-            "keyword argument 'charwise' is available only when "
-            "start/end arguments are not specified");
-        return NULL;
+
+static inline uint32_t
+moratrans_hash_(uint32_t key) {
+    uint32_t h = key * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+
+static inline int32_t
+MoraTransTable_lookup_(
+    const MoraTransTableObject *table, const Katakana *p, Py_ssize_t len)
+{
+    if (len == 1) {return table->single[KANA_ID(*p)] - 1;}
+    if (len > MORATRANS_KEY_MAX || !table->keys) {return -1;}
+    uint32_t key = moratrans_key_(p, len), mask = table->mask;
+    for (uint32_t i = moratrans_hash_(key) & mask; table->keys[i];
+            i = (i + 1) & mask) {
+        if (table->keys[i] == key) {return table->slots[i];}
     }
+    return -1;
+}
 
-    Py_ssize_t start = 0, end = PY_SSIZE_T_MAX;
-    if (arg_x) {
-        if (!MoraStr_SliceIndex(arg_x, &start)) {return NULL;}
+
+/* pairs is a list of (key, value) tuples, where key is the str of a
+   single mora and value is a MoraStr. Later pairs override earlier
+   ones. */
+static PyObject *
+MoraTransTable_from_pairs_(PyObject *pairs) {
+    Py_ssize_t n = PyList_GET_SIZE(pairs);
+    Py_ssize_t n_multi = 0, n_chars = 0, n_morae = 0;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *pair = PyList_GET_ITEM(pairs, i);
+        PyObject *key = PyTuple_GET_ITEM(pair, 0);
+        PyObject *value = PyTuple_GET_ITEM(pair, 1);
+        n_multi += PyUnicode_GET_LENGTH(key) > 1;
+        n_chars += PyUnicode_GET_LENGTH(MoraStr_STRING(value));
+        n_morae += Py_SIZE(value);
+        if (n_chars > MINDEX_MAX || n_morae > MINDEX_MAX) {
+            PyErr_SetString(PyExc_OverflowError,
+                "translation table is too large");
+            return NULL;
+        }
     }
-    if (arg_y) {
-        if (!MoraStr_SliceIndex(arg_y, &end)) {return NULL;}
+
+    MoraTransTableObject *table = (MoraTransTableObject *)
+        MoraTransTableType.tp_alloc(&MoraTransTableType, 0);
+    if (!table) {return NULL;}
+    table->n_entries = n;
+    table->entries = PyMem_New(struct MoraTransEntry, n ? n : 1);
+    table->chars = PyMem_New(Katakana, n_chars ? n_chars : 1);
+    table->ends = PyMem_New(MINDEX_T, n_morae ? n_morae : 1);
+    if (!table->entries || !table->chars || !table->ends) {goto nomemory;}
+    if (n_multi) {
+        uint32_t cap = 8;
+        while (cap < 2 * (size_t)n_multi) {cap *= 2;}
+        table->keys = PyMem_Calloc(cap, sizeof(uint32_t));
+        table->slots = PyMem_New(int32_t, cap);
+        if (!table->keys || !table->slots) {goto nomemory;}
+        table->mask = cap - 1;
+    }
+
+    MINDEX_T off = 0, ends_off = 0;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *pair = PyList_GET_ITEM(pairs, i);
+        PyObject *key = PyTuple_GET_ITEM(pair, 0);
+        PyObject *value = PyTuple_GET_ITEM(pair, 1);
+
+        PyObject *string = MoraStr_STRING(value);
+        Py_ssize_t len = PyUnicode_GET_LENGTH(string);
+        Py_ssize_t mora_cnt = Py_SIZE(value);
+        struct MoraTransEntry *e = table->entries + i;
+        e->off = off;
+        e->len = MINDEX(len);
+        e->mora_cnt = MINDEX(mora_cnt);
+        e->ends_off = ends_off;
+        if (len) {
+            memcpy(table->chars + off,
+                   KatakanaArray_from_str(string), sizeof(Katakana)*len);
+        }
+        INDICES_FILL_COPY(table->ends + ends_off,
+            MoraStr_INDICES(value), mora_cnt, 0);
+        off += e->len;
+        ends_off += e->mora_cnt;
+
+        const Katakana *k = KatakanaArray_from_str(key);
+        Py_ssize_t k_len = PyUnicode_GET_LENGTH(key);
+        if (k_len == 1) {
+            table->single[KANA_ID(*k)] = (int32_t)i + 1;
+            continue;
+        }
+        uint32_t h = moratrans_key_(k, k_len), mask = table->mask;
+        uint32_t j = moratrans_hash_(h) & mask;
+        while (table->keys[j] && table->keys[j] != h) {j = (j + 1) & mask;}
+        table->keys[j] = h;
+        table->slots[j] = (int32_t)i;
     }
+    return (PyObject *)table;
 
-    Py_ssize_t length = Py_SIZE(self);
-    if (length < start) {return PyLong_FromLong(-1);}
-    PySlice_AdjustIndices(length, &start, &end, 1);
+nomemory:
+    Py_DECREF(table);
+    return PyErr_NoMemory();
+}
 
-    if (charwise) {start = -1;}
-    Py_ssize_t result = MoraStr_rfindindex(self, submora, start, end);
-    if (result == -2) {return NULL;}
-    return PyLong_FromSsize_t(result);
+
+static void
+MoraTransTable_dealloc(MoraTransTableObject *self) {
+    PyMem_Free(self->entries);
+    PyMem_Free(self->chars);
+    PyMem_Free(self->ends);
+    PyMem_Free(self->keys);
+    PyMem_Free(self->slots);
+    Py_TYPE(self)->tp_free((PyObject *) self);
 }
 
 
-static PyObject *
-MoraStr_rindex(MoraStrObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"", "", "", "charwise", NULL};
+static Py_ssize_t
+MoraTransTable_length(MoraTransTableObject *self) {
+    return self->n_entries;
+}
 
-    PyObject *submora, *arg_x = NULL, *arg_y = NULL;
-    BoolPred charwise = false;
 
-    if (!PyArg_ParseTupleAndKeywords(
-            args, kwds, "O|OO$p", kwlist,
-            &submora, &arg_x, &arg_y, &charwise)) {return NULL;}
+static PySequenceMethods moratranstable_as_sequence = {
+    .sq_length = (lenfunc)MoraTransTable_length,
+};
 
-    if (kwds && arg_x) {
-        PyErr_SetString(PyExc_TypeError,
-            "keyword argument 'charwise' is available only when "
-            "start/end arguments are not specified");
+static PyTypeObject MoraTransTableType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.morastr_transtable",
+    .tp_basicsize = sizeof(MoraTransTableObject),
+    .tp_dealloc = (destructor)MoraTransTable_dealloc,
+    .tp_as_sequence = &moratranstable_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "Compiled mora-to-mora mapping returned by MoraStr.maketrans()."),
+};
+
+
+/* Appends (key, value) to pairs after checking that key is a single mora.
+   A value may start with a small kana; translate() checks each seam.
+   Steals both references. */
+static int
+MoraStr_maketrans_push_(PyObject *pairs, PyObject *key, PyObject *value) {
+    if (!key || !value) {goto error;}
+    Py_ssize_t k_len = PyUnicode_GET_LENGTH(key);
+    if (!k_len || k_len > MORATRANS_KEY_MAX) {
+        PyErr_Format(PyExc_ValueError,
+            "maketrans keys must be single morae of at most %d "
+            "characters, not %R", MORATRANS_KEY_MAX, key);
+        goto error;
+    }
+    PyObject *pair = PyTuple_Pack(2, key, value);
+    Py_DECREF(key);
+    Py_DECREF(value);
+    if (!pair) {return -1;}
+    int status = PyList_Append(pairs, pair);
+    Py_DECREF(pair);
+    return status;
+
+error:
+    Py_XDECREF(key);
+    Py_XDECREF(value);
+    return -1;
+}
+
+
+/* Like MoraStr_from_object_(), but without warning about a leading small
+   kana: keys and values stand for morae in the middle of a string. */
+static PyObject *
+MoraStr_maketrans_arg_(PyObject *obj, const char *err_fmt) {
+    if (PyUnicode_Check(obj)) {return MoraStr_from_text_(obj, true, false);}
+    return MoraStr_from_object_(obj, err_fmt);
+}
+
+
+/* Returns the str of the single mora in obj, or NULL with an error set. */
+static PyObject *
+MoraStr_maketrans_key_(PyObject *obj, const char *err_fmt) {
+    PyObject *morastr = MoraStr_maketrans_arg_(obj, err_fmt);
+    if (!morastr) {return NULL;}
+    if (Py_SIZE(morastr) != 1) {
+        PyErr_Format(PyExc_ValueError,
+            "maketrans keys must be single morae of at most %d "
+            "characters, not %R", MORATRANS_KEY_MAX, obj);
+        Py_DECREF(morastr);
+        return NULL;
+    }
+    PyObject *key = Py_NewRef(MoraStr_STRING(morastr));
+    Py_DECREF(morastr);
+    return key;
+}
+
+
+/* Pushes the i-th mora of morastr, as a key or a value, for each i. */
+static int
+MoraStr_maketrans_zip_(PyObject *pairs, PyObject *x, PyObject *y) {
+    PyObject *xs = MoraStr_STRING(x), *ys = y ? MoraStr_STRING(y) : NULL;
+    const MINDEX_T *x_ind = MoraStr_INDICES(x);
+    const MINDEX_T *y_ind = y ? MoraStr_INDICES(y) : NULL;
+    Py_ssize_t xa = 0, ya = 0;
+    for (Py_ssize_t i = 0; i < Py_SIZE(x); ++i) {
+        Py_ssize_t xb = x_ind ? x_ind[i] : i + 1;
+        PyObject *key = PyUnicode_Substring(xs, xa, xb), *value;
+        if (y) {
+            Py_ssize_t yb = y_ind ? y_ind[i] : i + 1;
+            PyObject *sub = PyUnicode_Substring(ys, ya, yb);
+            value = sub ? MoraStr_from_text_(sub, false, false) : NULL;
+            Py_XDECREF(sub);
+            ya = yb;
+        } else {
+            value = Empty_MoraStr();
+        }
+        if (MoraStr_maketrans_push_(pairs, key, value) < 0) {return -1;}
+        xa = xb;
+    }
+    return 0;
+}
+
+
+static PyObject *
+MoraStr_maketrans_dict_(PyObject *dict) {
+    static const char *err_fmt = \
+        "maketrans keys and values must be kana strings or MoraStr "
+        "objects, not '%.200s'";
+
+    PyObject *pairs = PyList_New(0);
+    if (!pairs) {return NULL;}
+    PyObject *k, *v;
+    Py_ssize_t pos = 0;
+    while (PyDict_Next(dict, &pos, &k, &v)) {
+        PyObject *key = MoraStr_maketrans_key_(k, err_fmt);
+        PyObject *value = !key ? NULL : \
+            v == Py_None ? Empty_MoraStr() : \
+            MoraStr_maketrans_arg_(v, err_fmt);
+        if (MoraStr_maketrans_push_(pairs, key, value) < 0) {
+            Py_DECREF(pairs);
+            return NULL;
+        }
+    }
+    PyObject *table = MoraTransTable_from_pairs_(pairs);
+    Py_DECREF(pairs);
+    return table;
+}
+
+
+static PyObject *
+MoraStr_maketrans(PyObject *Py_UNUSED(null), PyObject *args) {
+    static const char *err_fmt = \
+        "maketrans arguments must be kana strings or MoraStr objects, "
+        "not '%.200s'";
+
+    PyObject *x, *y = NULL, *z = NULL;
+    if (!PyArg_ParseTuple(args, "O|OO:maketrans", &x, &y, &z)) {
+        return NULL;
+    }
+    if (!y) {
+        if (!PyDict_Check(x)) {
+            PyErr_SetString(PyExc_TypeError,
+                "if you give only one argument to maketrans "
+                "it must be a dict");
+            return NULL;
+        }
+        return MoraStr_maketrans_dict_(x);
+    }
+
+    PyObject *pairs = NULL, *table = NULL;
+    PyObject *xm = MoraStr_maketrans_arg_(x, err_fmt);
+    PyObject *ym = xm ? MoraStr_maketrans_arg_(y, err_fmt) : NULL;
+    PyObject *zm = ym && z ? MoraStr_maketrans_arg_(z, err_fmt) : NULL;
+{ /* got ownership */
+    if (!ym || (z && !zm)) {goto done;}
+    if (Py_SIZE(xm) != Py_SIZE(ym)) {
+        PyErr_SetString(PyExc_ValueError,
+            "the first two maketrans arguments must have equal "
+            "mora length");
+        goto done;
+    }
+    pairs = PyList_New(0);
+    if (!pairs) {goto done;}
+    if (MoraStr_maketrans_zip_(pairs, xm, ym) < 0) {goto done;}
+    if (zm && MoraStr_maketrans_zip_(pairs, zm, NULL) < 0) {goto done;}
+    table = MoraTransTable_from_pairs_(pairs);
+}
+done:
+    Py_XDECREF(xm);
+    Py_XDECREF(ym);
+    Py_XDECREF(zm);
+    Py_XDECREF(pairs);
+    return table;
+}
+
+
+static PyObject *
+MoraStr_translate(MoraStrObject *self, PyObject *arg) {
+    static PyTypeObject *type = &MoraStrType;
+
+    PyObject *table_obj;
+    if (Py_TYPE(arg) == &MoraTransTableType) {
+        table_obj = Py_NewRef(arg);
+    } else if (PyDict_Check(arg)) {
+        table_obj = MoraStr_maketrans_dict_(arg);
+        if (!table_obj) {return NULL;}
+    } else {
+        PyErr_Format(PyExc_TypeError,
+            "translate() argument must be a dict or a table returned by "
+            "MoraStr.maketrans(), not '%.200s'", Py_TYPE(arg)->tp_name);
+        return NULL;
+    }
+    const MoraTransTableObject *table = (MoraTransTableObject *)table_obj;
+    PyObject *new_string = NULL;
+    MINDEX_T *new_indices = NULL;
+    int32_t *hits = NULL;
+    MoraStrObject *result = NULL;
+{ /* got ownership */
+    Py_ssize_t mora_cnt = Py_SIZE(self);
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(self));
+    const MINDEX_T *indices = MoraStr_INDICES(self);
+
+    /* first pass: look every mora up once, recording the mapped ones
+       as (mora index, entry) pairs and the exact size of the result */
+    Py_ssize_t len = indices ? indices[mora_cnt-1] : mora_cnt;
+    Py_ssize_t new_len = len, new_mora_cnt = mora_cnt, n_hits = 0;
+    Py_ssize_t hits_cap = 0;
+    for (Py_ssize_t i = 0, a = 0; i < mora_cnt; ++i) {
+        Py_ssize_t b = indices ? indices[i] : i + 1;
+        int32_t e = MoraTransTable_lookup_(table, s + a, b - a);
+        if (e >= 0) {
+            if (n_hits == hits_cap) {
+                hits_cap = hits_cap ? Py_MIN(hits_cap * 2, mora_cnt) : 64;
+                int32_t *grown = (int32_t *)PyMem_Realloc(
+                    hits, sizeof(int32_t) * 2 * (size_t)hits_cap);
+                if (!grown) {  /* hits is left intact */
+                    PyErr_NoMemory();
+                    goto error;
+                }
+                hits = grown;
+            }
+            hits[2*n_hits] = (int32_t)i;
+            hits[2*n_hits+1] = e;
+            n_hits++;
+            new_len += table->entries[e].len - (b - a);
+            new_mora_cnt += table->entries[e].mora_cnt - 1;
+        }
+        a = b;
+    }
+    if (!n_hits) {
+        Py_DECREF(table_obj);
+        if (MoraStr_CheckExact(self)) {return Py_NewRef(self);}
+        return MoraStr_copy_(type, self);
+    }
+    if (new_len > MINDEX_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "translated string is too long");
+        goto error;
+    }
+    if (!new_len) {
+        PyMem_Free(hits);
+        Py_DECREF(table_obj);
+        return Empty_MoraStr();
+    }
+
+    /* second pass: the unmapped run before each hit is copied in bulk;
+       its chars land at their original offsets plus shift */
+    new_string = PyUnicode_New(new_len, 0xffff);
+    if (!new_string) {goto error;}
+    if (new_len != new_mora_cnt) {
+        new_indices = MoraStr_INDICES_ALLOC(new_mora_cnt);
+        if (!new_indices) {goto error;}
+    }
+    Katakana *t = KatakanaArray_from_str(new_string);
+    Py_ssize_t shift = 0, run = 0, next = 0, k = 0;
+    for (Py_ssize_t h = 0; h <= n_hits; ++h) {
+        Py_ssize_t i = h < n_hits ? hits[2*h] : mora_cnt;
+        Py_ssize_t a = !i ? 0 : indices ? indices[i-1] : i;
+        if (run < a) {
+            if (h && run + shift) {
+                if (VALIDATE_MORA_BOUNDARY(
+                    Bounds_KANA, t[run+shift-1], s[run]) < 0) {goto error;}
+            }
+            Py_MEMCPY(t + run + shift, s + run, sizeof(Katakana)*(a - run));
+            if (new_indices) {
+                for (; next < i; ++next) {
+                    new_indices[k++] = MINDEX(
+                        (indices ? indices[next] : next + 1) + shift);
+                }
+            }
+        }
+        if (h == n_hits) {break;}
+
+        Py_ssize_t b = indices ? indices[i] : i + 1;
+        const struct MoraTransEntry *ent = table->entries + hits[2*h+1];
+        const Katakana *r = table->chars + ent->off;
+        Py_ssize_t j = a + shift;
+        if (ent->len && j) {
+            if (VALIDATE_MORA_BOUNDARY(
+                Bounds_KANA, t[j-1], r[0]) < 0) {goto error;}
+        }
+        Py_MEMCPY(t + j, r, sizeof(Katakana)*ent->len);
+        if (new_indices) {
+            INDICES_FILL_COPY(new_indices + k,
+                table->ends + ent->ends_off, ent->mora_cnt, MINDEX(j));
+            k += ent->mora_cnt;
+        }
+        shift += ent->len - (b - a);
+        run = b;
+        next = i + 1;
+    }
+    MoraStr_assert(len + shift == new_len);
+    PyMem_Free(hits);
+
+    result = (MoraStrObject *) type->tp_alloc(type, 0);
+    if (!result) {goto error;}
+    Py_SET_SIZE(result, new_mora_cnt);
+    result->string = new_string;
+    result->indices = new_indices;
+    Py_DECREF(table_obj);
+    return (PyObject *)result;
+}
+
+error:
+    Py_DECREF(table_obj);
+    PyMem_Free(hits);
+    Py_XDECREF(new_string);
+    MoraStr_INDICES_DEL(new_indices);
+    return NULL;
+}
+
+
+static PyObject *
+MoraStr_rfind(MoraStrObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "", "", "charwise", NULL};
+
+    PyObject *submora, *arg_x = NULL, *arg_y = NULL;
+    BoolPred charwise = false;
+
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|OO$p", kwlist,
+            &submora, &arg_x, &arg_y, &charwise)) {return NULL;}
+
+    if (kwds && arg_x) {
+        PyErr_SetString(PyExc_TypeError,
+            "keyword argument 'charwise' is available only when "
+            "start/end arguments are not specified");
+        return NULL;
+    }
+
+    Py_ssize_t start = 0, end = PY_SSIZE_T_MAX;
+    if (arg_x) {
+        if (!MoraStr_SliceIndex(arg_x, &start)) {return NULL;}
+    }
+    if (arg_y) {
+        if (!MoraStr_SliceIndex(arg_y, &end)) {return NULL;}
+    }
+
+    Py_ssize_t length = Py_SIZE(self);
+    if (length < start) {return PyLong_FromLong(-1);}
+    PySlice_AdjustIndices(length, &start, &end, 1);
+
+    if (charwise) {start = -1;}
+    Py_ssize_t result = MoraStr_rfindindex(self, submora, start, end);
+    if (result == -2) {return NULL;}
+    return PyLong_FromSsize_t(result);
+}
+
+
+static PyObject *
+MoraStr_rindex(MoraStrObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "", "", "charwise", NULL};
+
+    PyObject *submora, *arg_x = NULL, *arg_y = NULL;
+    BoolPred charwise = false;
+
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|OO$p", kwlist,
+            &submora, &arg_x, &arg_y, &charwise)) {return NULL;}
+
+    if (kwds && arg_x) {
+        PyErr_SetString(PyExc_TypeError,
+            "keyword argument 'charwise' is available only when "
+            "start/end arguments are not specified");
         return NULL;
     }
 
@@ -3119,6 +4544,102 @@ notfound:
 }
 
 
+/* Tuples of more prefixes than this are compiled into a trie instead
+   of being matched one by one (or packed into a multi-needle bitap). */
+#define PREFIXTRIE_TUPLE_THRESHOLD 16
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *patterns;
+    struct PrefixTrie *head;
+    struct PrefixTrie *tail;
+} PrefixSetObject;
+
+static PyTypeObject PrefixSetType;
+
+
+static struct PrefixTrie *
+MoraStr_prefix_trie_from_tuple_(
+    PyObject *tuple, bool reverse, const char *err_fmt)
+{
+    struct PrefixTrie *trie = prefix_trie_new(reverse);
+    if (!trie) {return NULL;}
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(tuple); ++i) {
+        Py_ssize_t cnt, len;
+        PyObject *substr = parse_submora(
+            PyTuple_GET_ITEM(tuple, i), &cnt, &len, err_fmt);
+        if (cnt == -1) {goto error;}
+        if (!cnt) {
+            prefix_trie_add(trie, NULL, 0, 0);
+            continue;
+        }
+        int status = prefix_trie_add(
+            trie, KatakanaArray_from_str(substr), len, cnt);
+        Py_DECREF(substr);
+        if (status < 0) {goto error;}
+    }
+    return trie;
+
+error:
+    prefix_trie_dealloc(trie);
+    return NULL;
+}
+
+
+/* Matches a compiled trie against the head (or, for a reverse trie, the
+   tail) of morae [start, end) of self. */
+static bool
+MoraStr_tailmatch_trie_(
+    MoraStrObject *self, const struct PrefixTrie *trie,
+    Py_ssize_t start, Py_ssize_t end, int direction)
+{
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(self));
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    Py_ssize_t s_start, s_end;
+    if (!indices) {
+        s_start = start; s_end = end;
+    } else {
+        s_start = start ? indices[start-1] : 0LL;
+        s_end = end ? indices[end-1] : 0LL;
+    }
+    if (direction < 0) {
+        return prefix_trie_match_head(
+            trie, s, s_start, s_end, start, end, indices);
+    }
+    return prefix_trie_match_tail(
+        trie, s, s_start, s_end, start, end, indices);
+}
+
+
+/* Handles a PrefixSet or a large tuple for startswith/endswith.
+   Returns 1 or 0, -1 on error, or -2 if subobj should be handled by
+   the caller. */
+static int
+MoraStr_tailmatch_set_(
+    MoraStrObject *self, PyObject *subobj,
+    Py_ssize_t start, Py_ssize_t end, int direction, const char *err_fmt)
+{
+    if (Py_TYPE(subobj) == &PrefixSetType) {
+        PrefixSetObject *set = (PrefixSetObject *)subobj;
+        if (Py_SIZE(self) < start) {return 0;}
+        return MoraStr_tailmatch_trie_(
+            self, direction < 0 ? set->head : set->tail,
+            start, end, direction);
+    }
+    if (!PyTuple_Check(subobj) ||
+            PyTuple_GET_SIZE(subobj) <= PREFIXTRIE_TUPLE_THRESHOLD) {
+        return -2;
+    }
+    struct PrefixTrie *trie = MoraStr_prefix_trie_from_tuple_(
+        subobj, direction > 0, err_fmt);
+    if (!trie) {return -1;}
+    int result = Py_SIZE(self) >= start && \
+        MoraStr_tailmatch_trie_(self, trie, start, end, direction);
+    prefix_trie_dealloc(trie);
+    return result;
+}
+
+
 static PyObject *
 MoraStr_startswith(
         MoraStrObject *self, PyObject *const *args, Py_ssize_t nargs) {
@@ -3126,8 +4647,8 @@ MoraStr_startswith(
         "tuple for startswith must only contain str or MoraStr, "
         "not %.100s";
     static const char *tailmatch_err_fmt = \
-        "startswith first arg must be a kana string "
-        "or a tuple of kana strings, not %.100s";
+        "startswith first arg must be a kana string, a tuple of "
+        "kana strings or a PrefixSet, not %.100s";
 
     PyObject *subobj;
     Py_ssize_t length, start = 0, end = PY_SSIZE_T_MAX;
@@ -3156,19 +4677,22 @@ MoraStr_startswith(
         s_end = end ? indices[end-1] : 0LL;
     }
 
-    PyObject *const *objects;
-    Py_ssize_t objcnt;
-    const char *err_fmt;
+    int matched = MoraStr_tailmatch_set_(
+        self, subobj, start, end, -1, tailmatch_tuple_err_fmt);
+    if (matched != -2) {
+        return matched == -1 ? NULL : PyBool_FromLong(matched);
+    }
     if (PyTuple_Check(subobj)) {
-        objects = PySequence_Fast_ITEMS(subobj);
-        objcnt = Py_SIZE(subobj);
-        err_fmt = tailmatch_tuple_err_fmt;
-    } else {
-        objects = args;
-        objcnt = 1;
-        err_fmt = tailmatch_err_fmt;
+        Py_ssize_t result = MoraStr_multi_search_(
+            self, subobj, 0, start, end, -1, true, tailmatch_tuple_err_fmt);
+        if (result == -2) {return NULL;}
+        return PyBool_FromLong(length >= start && result != -1);
     }
 
+    PyObject *const *objects = args;
+    Py_ssize_t objcnt = 1;
+    const char *err_fmt = tailmatch_err_fmt;
+
     PyObject *submora, *substr;
     Py_ssize_t submora_cnt, substr_len;
     Py_ssize_t result;
@@ -3269,8 +4793,8 @@ MoraStr_endswith(
         "tuple for endswith must only contain str or MoraStr, "
         "not %.100s";
     static const char *tailmatch_err_fmt = \
-        "endswith first arg must be a kana string "
-        "or a tuple of kana strings, not %.100s";
+        "endswith first arg must be a kana string, a tuple of "
+        "kana strings or a PrefixSet, not %.100s";
 
     PyObject *subobj;
     Py_ssize_t length, start = 0, end = PY_SSIZE_T_MAX;
@@ -3299,6 +4823,12 @@ MoraStr_endswith(
         s_end = end ? indices[end-1] : 0LL;
     }
 
+    int matched = MoraStr_tailmatch_set_(
+        self, subobj, start, end, +1, tailmatch_tuple_err_fmt);
+    if (matched != -2) {
+        return matched == -1 ? NULL : PyBool_FromLong(matched);
+    }
+
     PyObject *const *objects;
     Py_ssize_t objcnt;
     const char *err_fmt;
@@ -3369,12 +4899,6 @@ MoraStr_slice_with_step(MoraStrObject *self,
 
     PyObject *s_string = MoraStr_STRING(self);
     const Katakana *s = KatakanaArray_from_str(s_string);
-    if (step < 0 && small_kana_vowel(s[0])) {
-        PyErr_SetString(PyExc_ValueError,
-            "Can't instantiate a MoraStr slice; "
-            "base string starts with a small kana");
-        goto error;
-    }
 
     size_t i; Py_ssize_t j;
     MINDEX_T *indices = MoraStr_INDICES(self);
@@ -3515,6 +5039,13 @@ MoraStr_subscript(MoraStrObject *self, PyObject* arg) {
             return NULL;
         }
         if (step != 1) {
+            if (step < 0 && slicelength && small_kana_vowel(
+                    KATAKANA_STR_READ(MoraStr_STRING(self), 0))) {
+                PyErr_SetString(PyExc_ValueError,
+                    "Can't instantiate a MoraStr slice; "
+                    "base string starts with a small kana");
+                return NULL;
+            }
             return MoraStr_slice_with_step(self, start, step, slicelength);
         }
         PyTypeObject *type = Py_TYPE(self);
@@ -3568,6 +5099,73 @@ MoraStr_hash(MoraStrObject *self) {
 }
 
 
+/* Compares two katakana strings in gojuon order, one level at a time:
+   base kana with the marks skipped, then voicing, then size and marks.
+   Two strings compare equal only if they are identical. */
+static int
+collate_katakana_(const Katakana *a, Py_ssize_t a_len,
+        const Katakana *b, Py_ssize_t b_len)
+{
+    for (int level = COLLATE_PRIMARY; level < COLLATE_LEVELS; ++level) {
+        const unsigned char *weights = katakana_collation[level];
+        const unsigned char *skip = \
+            katakana_collation[level == COLLATE_TERTIARY ? level : 0];
+        Py_ssize_t i = 0, j = 0;
+        for (;; ++i, ++j) {
+            while (i < a_len && !skip[KANA_ID(a[i])]) {++i;}
+            while (j < b_len && !skip[KANA_ID(b[j])]) {++j;}
+            if (i == a_len || j == b_len) {break;}
+            int wa = weights[KANA_ID(a[i])], wb = weights[KANA_ID(b[j])];
+            if (wa != wb) {return wa < wb ? -1 : 1;}
+        }
+        if (i != a_len || j != b_len) {return i == a_len ? -1 : 1;}
+    }
+    return 0;
+}
+
+
+static PyObject *
+MoraStr_sort_key(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *string = MoraStr_STRING(self);
+    const Katakana *s = KatakanaArray_from_str(string);
+    Py_ssize_t length = PyUnicode_GET_LENGTH(string);
+
+    /* trailing minimal weights are dropped from the lower levels */
+    Py_ssize_t n_primary = 0, n_secondary = 0, n_tertiary = 0;
+    for (Py_ssize_t i = 0; i < length; ++i) {
+        Py_ssize_t k = KANA_ID(s[i]);
+        if (katakana_collation[COLLATE_PRIMARY][k]) {
+            ++n_primary;
+            if (katakana_collation[COLLATE_SECONDARY][k] != COLLATE_MIN) {
+                n_secondary = n_primary;
+            }
+        }
+        if (katakana_collation[COLLATE_TERTIARY][k] != COLLATE_MIN) {
+            n_tertiary = i + 1;
+        }
+    }
+
+    PyObject *key = PyBytes_FromStringAndSize(
+        NULL, n_primary + n_secondary + n_tertiary + 2);
+    if (!key) {return NULL;}
+    unsigned char *p = (unsigned char *)PyBytes_AS_STRING(key);
+    unsigned char *q = p + n_primary + 1, *r = q + n_secondary + 1;
+    Py_ssize_t j = 0;
+    for (Py_ssize_t i = 0; i < length; ++i) {
+        Py_ssize_t k = KANA_ID(s[i]);
+        if (katakana_collation[COLLATE_PRIMARY][k]) {
+            *p++ = katakana_collation[COLLATE_PRIMARY][k];
+            if (j++ < n_secondary) {
+                *q++ = katakana_collation[COLLATE_SECONDARY][k];
+            }
+        }
+        if (i < n_tertiary) {*r++ = katakana_collation[COLLATE_TERTIARY][k];}
+    }
+    *p = *q = COLLATE_SEP;
+    return key;
+}
+
+
 static PyObject *
 MoraStr_richcompare(PyObject *self, PyObject *other, int op) {
     assert(MoraStr_Check(self));
@@ -3581,7 +5179,10 @@ MoraStr_richcompare(PyObject *self, PyObject *other, int op) {
     if (op == Py_EQ || op == Py_NE) {
         return PyUnicode_RichCompare(left, right, op);
     }
-    return Py_NewRef(Py_NotImplemented);
+    int c = collate_katakana_(
+        KatakanaArray_from_str(left), PyUnicode_GET_LENGTH(left),
+        KatakanaArray_from_str(right), PyUnicode_GET_LENGTH(right));
+    Py_RETURN_RICHCOMPARE(c, 0, op);
 }
 
 static PyObject *
@@ -3592,787 +5193,6439 @@ MoraStr_tostr(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
 }
 
 
-static PyObject *
-MoraStr_fromstrs(PyTypeObject *type, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"ignore", NULL};
+/* Appends src[0:src_len], which has src_cnt morae ending at src_indices
+   (or one character each if NULL), to buf[0:*pos] whose morae end at
+   indices[0:*cnt]. Both buffers must have room for it. A leading small
+   kana that attaches to the last mora merges the two. */
+static int
+MoraStr_attach_(Katakana *buf, MINDEX_T *indices,
+        Py_ssize_t *pos, Py_ssize_t *cnt,
+        const Katakana *src, Py_ssize_t src_len,
+        const MINDEX_T *src_indices, Py_ssize_t src_cnt)
+{
+    if (!src_len) {return 0;}
+    Py_MEMCPY(buf + *pos, src, sizeof(Katakana)*src_len);
 
-    Py_ssize_t nargs = Py_SIZE(args);
-    PyObject *empty_str = PyUnicode_New(0, 0);
-    if (!empty_str) {return NULL;}
-    PyObject *seq = PyTuple_New(nargs), *string = NULL;
-{ /* got ownership */
-    if (!seq) {goto error;}
-    for (Py_ssize_t i = 0; i < nargs; ++i) {
-        PyObject *item = PyTuple_GET_ITEM(args, i);
-        if (PyUnicode_Check(item)) {
-            Py_INCREF(item);
-        } else if (MoraStr_CheckExact(item)) {
-            item = MoraStr_STRING(item);
-            Py_INCREF(item);
+    if (*pos && small_kana_attaches(buf[*pos-1], src[0])) {
+        Py_ssize_t head = *cnt > 1 ? indices[*cnt-2] : 0;
+        Py_ssize_t first = src_indices ? src_indices[0] : 1;
+        if (*pos - head + first > MORA_CONTENT_MAX) {
+            PyErr_SetString(PyExc_ValueError,
+                "each mora must have at most 3 characters");
+            return -1;
+        }
+        --*cnt;
+    }
+    INDICES_FILL_COPY(indices + *cnt,
+        (MINDEX_T *)src_indices, src_cnt, MINDEX(*pos));
+    *cnt += src_cnt;
+    *pos += src_len;
+    return 0;
+}
+
+
+/* Concatenates the MoraStr objects in parts, with sep (if not NULL)
+   between each pair, into a new MoraStr. The characters are copied once
+   and the indices of each part are spliced in with an offset; only a
+   part starting with a small kana that attaches to the preceding mora
+   changes the mora boundaries at its seam. */
+static PyObject *
+MoraStr_splice_(PyObject *const *parts, Py_ssize_t n, PyObject *sep) {
+    size_t length = 0, mora_cnt = 0;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        length += PyUnicode_GET_LENGTH(MoraStr_STRING(parts[i]));
+        mora_cnt += Py_SIZE(parts[i]);
+        if (length > MINDEX_MAX) {goto overflow;}
+    }
+    if (sep && n > 1) {
+        size_t sep_len = PyUnicode_GET_LENGTH(MoraStr_STRING(sep));
+        if (sep_len && (size_t)(n - 1) > (MINDEX_MAX - length) / sep_len) {
+            goto overflow;
+        }
+        length += sep_len * (n - 1);
+        mora_cnt += Py_SIZE(sep) * (n - 1);
+    }
+    if (!length) {return Empty_MoraStr();}
+
+    PyObject *string = PyUnicode_New((Py_ssize_t)length, 0xffff);
+    if (!string) {return NULL;}
+    MINDEX_T *indices = MoraStr_INDICES_ALLOC(mora_cnt);
+    if (!indices) {
+        Py_DECREF(string);
+        return NULL;
+    }
+{ /* got ownership */
+    Katakana *buf = KatakanaArray_from_str(string);
+    Py_ssize_t pos = 0, cnt = 0;
+    for (Py_ssize_t i = 0, k = 0; i < n; k ^= 1) {
+        PyObject *piece = k ? sep : parts[i++];
+        if (!piece || (k && i == n)) {continue;}
+        PyObject *piece_str = MoraStr_STRING(piece);
+        if (MoraStr_attach_(buf, indices, &pos, &cnt,
+                KatakanaArray_from_str(piece_str),
+                PyUnicode_GET_LENGTH(piece_str),
+                MoraStr_INDICES(piece), Py_SIZE(piece)) < 0) {goto error;}
+    }
+    MoraStr_assert(pos == (Py_ssize_t)length);
+
+    if ((size_t)cnt == length) {
+        MoraStr_INDICES_DEL(indices);
+    } else if ((size_t)cnt != mora_cnt) {
+        MINDEX_T *adjusted = indices;
+        MoraStr_RESIZE(adjusted, MINDEX_T, cnt);
+        if (adjusted) {indices = adjusted;}
+    }
+    MoraStrObject *morastr;
+    morastr = (MoraStrObject *)MoraStrType.tp_alloc(&MoraStrType, 0);
+    if (!morastr) {goto error;}
+    Py_SET_SIZE(morastr, cnt);
+    morastr->string = string;
+    morastr->indices = indices;
+    return (PyObject *)morastr;
+}
+
+error:
+    Py_DECREF(string);
+    MoraStr_INDICES_DEL(indices);
+    return NULL;
+
+overflow:
+    PyErr_SetString(PyExc_OverflowError, "base string is too long");
+    return NULL;
+}
+
+
+static PyObject *
+MoraStr_join(MoraStrObject *self, PyObject *iterable) {
+    PyObject *seq = PySequence_Fast(iterable, "can only join an iterable");
+    if (!seq) {return NULL;}
+
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(seq);
+    PyObject **items = PySequence_Fast_ITEMS(seq);
+    PyObject **parts = PyMem_New(PyObject *, n ? n : 1);
+    if (!parts) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    PyObject *result = NULL;
+    Py_ssize_t i;
+    for (i = 0; i < n; ++i) {
+        PyObject *item = items[i];
+        if (MoraStr_Check(item)) {
+            parts[i] = Py_NewRef(item);
+        } else if (PyUnicode_Check(item)) {
+            parts[i] = MoraStr_from_text_(item, true, !i);
+            if (!parts[i]) {goto done;}
         } else {
-            item = PyUnicode_Join(empty_str, item);
-            if (!item) {
-                if (nargs != 1 && PyErr_ExceptionMatches(PyExc_TypeError)) {
-                    PyErr_Clear();
-                    PyErr_Format(PyExc_TypeError,
-                        "non-string element found in argument %zd", i+1);
-                }
+            PyErr_Format(PyExc_TypeError,
+                "sequence item %zd: expected str or MoraStr instance, "
+                "%.80s found", i, Py_TYPE(item)->tp_name);
+            goto done;
+        }
+    }
+    result = MoraStr_splice_(parts, n, (PyObject *)self);
+
+done:
+    while (i--) {Py_DECREF(parts[i]);}
+    PyMem_Free(parts);
+    Py_DECREF(seq);
+    return result;
+}
+
+
+static PyObject *
+new_typed_array(const char *typecode, const void *data, Py_ssize_t nbytes);
+
+
+/* Returns a new reference to the str of a mora ID known to be valid. */
+static PyObject *
+mora_id_str_(uint16_t id) {
+    Katakana mora[MORA_CONTENT_MAX];
+    Py_ssize_t len = mora_id_chars_(id, mora);
+    MoraStr_assert(len);
+    return mora_str_lookup_(mora, len);
+}
+
+
+/* Writes the ID of each mora of s[0:len] (ending at indices, or one
+   character each if NULL) to ids. */
+static void
+mora_ids_fill_(uint16_t *ids, const Katakana *s, const MINDEX_T *indices,
+        Py_ssize_t mora_cnt)
+{
+    if (!indices) {
+        for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+            ids[i] = (uint16_t)KANA_ID(s[i]);
+        }
+        return;
+    }
+    Py_ssize_t prev = 0;
+    for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+        ids[i] = mora_id_of_(s + prev, indices[i] - prev);
+        prev = indices[i];
+    }
+}
+
+
+static uint16_t *
+MoraStr_mora_ids_(MoraStrObject *self) {
+    Py_ssize_t n = Py_SIZE(self);
+    uint16_t *ids = PyMem_New(uint16_t, n ? n : 1);
+    if (!ids) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    mora_ids_fill_(ids, KatakanaArray_from_str(MoraStr_STRING(self)),
+        MoraStr_INDICES(self), n);
+    return ids;
+}
+
+
+static PyObject *
+MoraStr_mora_ids(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
+    uint16_t *ids = MoraStr_mora_ids_(self);
+    if (!ids) {return NULL;}
+    PyObject *result = new_typed_array(
+        "H", ids, Py_SIZE(self) * (Py_ssize_t)sizeof(uint16_t));
+    PyMem_Free(ids);
+    return result;
+}
+
+
+/*********************** MoraBuffer **************************/
+/* A read-only buffer over memory kept alive by another object. It is
+ * never handed out itself: MoraBuffer_view_ wraps it in a memoryview,
+ * which unlike memoryview.cast() can also describe 2-D data with no
+ * rows. */
+typedef struct {
+    PyObject_HEAD
+    PyObject *owner;
+    void *buf;
+    const char *format;
+    Py_ssize_t itemsize;
+    int ndim;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} MoraBufferObject;
+
+static PyTypeObject MoraBufferType;
+
+
+/* Returns a memoryview of the rows x cols items (or rows items if cols
+   is 0) of the given format at buf, which owner keeps alive. */
+static PyObject *
+MoraBuffer_view_(PyObject *owner, void *buf, const char *format,
+        Py_ssize_t itemsize, Py_ssize_t rows, Py_ssize_t cols)
+{
+    MoraBufferObject *self = PyObject_New(MoraBufferObject, &MoraBufferType);
+    if (!self) {return NULL;}
+    self->owner = Py_NewRef(owner);
+    self->buf = buf;
+    self->format = format;
+    self->itemsize = itemsize;
+    self->ndim = cols ? 2 : 1;
+    self->shape[0] = rows;
+    self->shape[1] = cols;
+    self->strides[0] = cols ? itemsize * cols : itemsize;
+    self->strides[1] = itemsize;
+    PyObject *view = PyMemoryView_FromObject((PyObject *)self);
+    Py_DECREF(self);
+    return view;
+}
+
+
+static int
+MoraBuffer_getbuffer(MoraBufferObject *self, Py_buffer *view, int flags) {
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "buffer is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    Py_ssize_t len = self->itemsize * self->shape[0];
+    if (self->ndim == 2) {len *= self->shape[1];}
+    view->buf = self->buf;
+    view->obj = Py_NewRef(self);
+    view->len = len;
+    view->readonly = 1;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)self->format : NULL;
+    view->ndim = self->ndim;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = \
+        (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+
+static void
+MoraBuffer_dealloc(MoraBufferObject *self) {
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static PyBufferProcs morabuffer_as_buffer = {
+    .bf_getbuffer = (getbufferproc)MoraBuffer_getbuffer,
+};
+
+static PyTypeObject MoraBufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja._MoraBuffer",
+    .tp_basicsize = sizeof(MoraBufferObject),
+    .tp_dealloc = (destructor)MoraBuffer_dealloc,
+    .tp_as_buffer = &morabuffer_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+};
+
+
+/* Returns a memoryview of shape (len(ids) - n + 1, n) over the n-grams
+   of ids[0:len]; the rows overlap in ids but are copied out. */
+static PyObject *
+ngram_rows_view_(const uint16_t *ids, Py_ssize_t len, Py_ssize_t n) {
+    Py_ssize_t rows = len >= n ? len - n + 1 : 0;
+    if (rows && n > PY_SSIZE_T_MAX / (Py_ssize_t)sizeof(uint16_t) / rows) {
+        return PyErr_NoMemory();
+    }
+    PyObject *data = PyBytes_FromStringAndSize(
+        NULL, (Py_ssize_t)sizeof(uint16_t) * rows * n);
+    if (!data) {return NULL;}
+    uint16_t *out = (uint16_t *)PyBytes_AS_STRING(data);
+    for (Py_ssize_t r = 0; r < rows; ++r) {
+        memcpy(out + r*n, ids + r, sizeof(uint16_t)*n);
+    }
+    PyObject *view = MoraBuffer_view_(
+        data, out, "H", sizeof(uint16_t), rows, n);
+    Py_DECREF(data);
+    return view;
+}
+
+
+static int
+ngram_order_converter(PyObject *obj, Py_ssize_t *n) {
+    *n = PyNumber_AsSsize_t(obj, PyExc_OverflowError);
+    if (*n == -1 && PyErr_Occurred()) {return 0;}
+    if (*n < 1) {
+        PyErr_SetString(PyExc_ValueError, "n must be a positive integer");
+        return 0;
+    }
+    return 1;
+}
+
+
+static PyObject *
+MoraStr_ngrams(MoraStrObject *self, PyObject *arg) {
+    Py_ssize_t n;
+    if (!ngram_order_converter(arg, &n)) {return NULL;}
+    uint16_t *ids = MoraStr_mora_ids_(self);
+    if (!ids) {return NULL;}
+    PyObject *view = ngram_rows_view_(ids, Py_SIZE(self), n);
+    PyMem_Free(ids);
+    return view;
+}
+
+
+/* Returns a MoraStr of type made of string, whose n morae end at indices
+   (or are one character each if NULL), without checking them. Steals
+   both references; string is NULL for an empty MoraStr. */
+static PyObject *
+MoraStr_wrap_(PyTypeObject *type, PyObject *string, MINDEX_T *indices,
+        Py_ssize_t n)
+{
+    PyObject *morastr;
+    if (!string) {
+        morastr = Empty_MoraStr();
+    } else {
+        morastr = MoraStrType.tp_alloc(&MoraStrType, 0);
+        if (!morastr) {
+            Py_DECREF(string);
+            MoraStr_INDICES_DEL(indices);
+            return NULL;
+        }
+        Py_SET_SIZE(morastr, n);
+        ((MoraStrObject *)morastr)->string = string;
+        ((MoraStrObject *)morastr)->indices = indices;
+    }
+    if (!morastr || IS_MORASTR_TYPE(type)) {return morastr;}
+    PyObject *result = PyObject_CallFunctionObjArgs(
+        (PyObject *)type, morastr, NULL);
+    Py_DECREF(morastr);
+    return result;
+}
+
+
+static PyObject *
+MoraStr_code_units(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *string = MoraStr_STRING(self);
+    return MoraBuffer_view_((PyObject *)self, PyUnicode_DATA(string),
+        "H", sizeof(Katakana), PyUnicode_GET_LENGTH(string), 0);
+}
+
+
+static PyObject *
+MoraStr_end_offsets(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
+    Py_BUILD_ASSERT(sizeof(MINDEX_T) == sizeof(int));
+
+    Py_ssize_t n = Py_SIZE(self);
+    if (MoraStr_INDICES(self)) {
+        return MoraBuffer_view_((PyObject *)self, MoraStr_INDICES(self),
+            "i", sizeof(MINDEX_T), n, 0);
+    }
+    /* every mora is a single character and no offsets are stored */
+    PyObject *data = PyBytes_FromStringAndSize(
+        NULL, (Py_ssize_t)sizeof(MINDEX_T) * n);
+    if (!data) {return NULL;}
+    MINDEX_T *offsets = (MINDEX_T *)PyBytes_AS_STRING(data);
+    for (Py_ssize_t i = 0; i < n; ++i) {offsets[i] = MINDEX(i + 1);}
+    PyObject *view = MoraBuffer_view_(
+        data, offsets, "i", sizeof(MINDEX_T), n, 0);
+    Py_DECREF(data);
+    return view;
+}
+
+
+/* Gets a 1-D contiguous buffer of obj whose items are itemsize bytes
+   and whose format is one of the characters in formats. */
+static int
+MoraStr_get_typed_buffer_(PyObject *obj, Py_buffer *view,
+        const char *formats, Py_ssize_t itemsize, const char *what)
+{
+    if (PyObject_GetBuffer(obj, view, PyBUF_FORMAT | PyBUF_ND) < 0) {
+        return -1;
+    }
+    const char *fmt = view->format ? view->format : "B";
+    if (*fmt == '@' || *fmt == '=') {++fmt;}
+    if (!fmt[0] || fmt[1] || !strchr(formats, fmt[0]) ||
+            view->itemsize != itemsize || view->ndim > 1) {
+        PyErr_Format(PyExc_TypeError,
+            "%s must be a 1-D buffer of %zd-byte items, not '%s'",
+            what, itemsize, view->format ? view->format : "B");
+        PyBuffer_Release(view);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Builds a MoraStr of type from length UCS-2 code units and the end
+   offsets of its n morae (NULL if every mora is one character), both
+   byte-swapped first if swap. The mora boundaries are taken on trust;
+   only what keeps the object safe to use is checked. */
+static PyObject *
+MoraStr_from_raw_(PyTypeObject *type, const void *units, Py_ssize_t length,
+        const void *ends, Py_ssize_t n, bool swap)
+{
+    MoraStr_assert(ends || n == length);
+    if (length > MINDEX_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "base string is too long");
+        return NULL;
+    }
+
+    PyObject *string = NULL;
+    MINDEX_T *indices = NULL;
+    if (length) {
+        string = PyUnicode_New(length, 0xffff);
+        if (!string) {return NULL;}
+        Katakana *s = KatakanaArray_from_str(string);
+        Py_MEMCPY(s, units, sizeof(Katakana)*length);
+        for (Py_ssize_t i = 0; i < length; ++i) {
+            if (swap) {s[i] = MORAPACK_SWAP16(s[i]);}
+            if (!is_zenkaku_katakana(s[i])) {
+                PyErr_Format(PyExc_ValueError,
+                    "invalid code unit at %zd: 0x%x", i, (unsigned int)s[i]);
+                goto error;
+            }
+        }
+    }
+    if (ends && n) {
+        indices = MoraStr_INDICES_ALLOC(n);
+        if (!indices) {goto error;}
+        Py_MEMCPY(indices, ends, sizeof(MINDEX_T)*n);
+    }
+    MINDEX_T prev = 0;
+    for (Py_ssize_t i = 0; indices && i < n; ++i) {
+        if (swap) {indices[i] = (MINDEX_T)MORAPACK_SWAP32(indices[i]);}
+        if (indices[i] <= prev || indices[i] - prev > MORA_CONTENT_MAX) {
+            PyErr_Format(PyExc_ValueError,
+                "invalid end offset at %zd: %d", i, (int)indices[i]);
+            goto error;
+        }
+        prev = indices[i];
+    }
+    if (ends && prev != length) {
+        PyErr_SetString(PyExc_ValueError,
+            "end offsets do not cover the code units");
+        goto error;
+    }
+    if (n == length) {MoraStr_INDICES_DEL(indices);}
+    return MoraStr_wrap_(type, string, indices, n);
+
+error:
+    Py_XDECREF(string);
+    MoraStr_INDICES_DEL(indices);
+    return NULL;
+}
+
+
+static PyObject *
+MoraStr_from_buffers(PyTypeObject *type, PyObject *const *args,
+        Py_ssize_t nargs)
+{
+    if (nargs != 2) {
+        PyErr_Format(PyExc_TypeError,
+            "from_buffers() takes exactly 2 arguments (%zd given)", nargs);
+        return NULL;
+    }
+
+    Py_buffer units, offsets;
+    if (MoraStr_get_typed_buffer_(args[0], &units,
+            "Hu", sizeof(Katakana), "code units") < 0) {return NULL;}
+    if (MoraStr_get_typed_buffer_(args[1], &offsets,
+            "il", sizeof(MINDEX_T), "end offsets") < 0) {
+        PyBuffer_Release(&units);
+        return NULL;
+    }
+
+    PyObject *result = MoraStr_from_raw_(type,
+        units.buf, units.len / units.itemsize,
+        offsets.buf, offsets.len / offsets.itemsize, false);
+    PyBuffer_Release(&units);
+    PyBuffer_Release(&offsets);
+    return result;
+}
+
+
+static PyObject *
+MoraStr_to_bytes(MoraStrObject *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *string = MoraStr_STRING(self);
+    Py_ssize_t length = PyUnicode_GET_LENGTH(string), n = Py_SIZE(self);
+    Py_ssize_t n_lengths = n != length ? (n + 3) / 4 : 0;
+    PyObject *result = PyBytes_FromStringAndSize(NULL,
+        2 + mora_pack_varint_size(length) + mora_pack_varint_size(n) + \
+        length + n_lengths);
+    if (!result) {return NULL;}
+
+    unsigned char *p = (unsigned char *)PyBytes_AS_STRING(result);
+    *p++ = MORAPACK_STR;
+    *p++ = MORAPACK_VERSION;
+    p = mora_pack_varint(p, length);
+    p = mora_pack_varint(p, n);
+    if (length) {
+        p = mora_pack_codes(p, KatakanaArray_from_str(string), length);
+    }
+    if (n_lengths) {
+        memset(p, 0, n_lengths);
+        mora_pack_lengths(p, 0, MoraStr_INDICES(self), n);
+    }
+    return result;
+}
+
+
+static PyObject *
+MoraStr_from_bytes(PyTypeObject *type, PyObject *obj) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) < 0) {return NULL;}
+
+    PyObject *string = NULL, *result = NULL;
+    MINDEX_T *indices = NULL;
+    const unsigned char *p = (const unsigned char *)view.buf;
+    const unsigned char *end = p + view.len;
+    Py_ssize_t length, n;
+    if (!(p = mora_unpack_header(p, end, MORAPACK_STR)) ||
+        !(p = mora_unpack_varint(p, end, &length)) ||
+        !(p = mora_unpack_varint(p, end, &n))) {goto done;}
+    /* the lengths may only be left out if every mora is one character */
+    Py_ssize_t n_lengths = n != length ? (n + 3) / 4 : 0;
+    if (n > length || (n != length && !n_lengths) ||
+        end - p != length + n_lengths) {
+        PyErr_SetString(PyExc_ValueError, "malformed packed data");
+        goto done;
+    }
+
+    if (length) {
+        string = PyUnicode_New(length, 0xffff);
+        if (!string) {goto done;}
+        if (mora_unpack_codes(
+                KatakanaArray_from_str(string), p, length) < 0) {goto done;}
+    }
+    if (n_lengths) {
+        indices = MoraStr_INDICES_ALLOC(n);
+        if (!indices) {goto done;}
+        if (mora_unpack_lengths(
+                indices, p + length, 0, n, length) < 0) {goto done;}
+    }
+    result = MoraStr_wrap_(type, string, indices, n);
+    string = NULL;
+    indices = NULL;
+
+done:
+    PyBuffer_Release(&view);
+    Py_XDECREF(string);
+    MoraStr_INDICES_DEL(indices);
+    return result;
+}
+
+
+#if PY_VERSION_HEX >= 0x03080000
+/* in characters; shorter strings are cheaper to pickle in packed form */
+#define MORASTR_PICKLE_BUFFER_MIN 4096
+
+/* With protocol 5, a long MoraStr hands its code units and end offsets
+   to pickle as they are, so that they can be sent out of band. */
+static PyObject *
+MoraStr___reduce_ex__(MoraStrObject *self, PyObject *protocol_obj) {
+    /* one bound method for all, as in __reduce__() */
+    static PyObject *from_pickle_buffers = NULL;
+
+    long protocol = PyLong_AsLong(protocol_obj);
+    if (protocol == -1 && PyErr_Occurred()) {return NULL;}
+    PyTypeObject *type = Py_TYPE(self);
+    if (!IS_MORASTR_TYPE(type)) {
+        return PyObject_CallMethod((PyObject *)self, "__reduce__", NULL);
+    }
+    Py_ssize_t length = PyUnicode_GET_LENGTH(MoraStr_STRING(self));
+    if (protocol < 5 || length < MORASTR_PICKLE_BUFFER_MIN) {
+        return MoraStr___reduce__(self, NULL);
+    }
+
+    if (!from_pickle_buffers) {
+        from_pickle_buffers = PyObject_GetAttrString(
+            (PyObject *)type, "_from_pickle_buffers");
+        if (!from_pickle_buffers) {return NULL;}
+    }
+    PyObject *units = NULL, *offsets = NULL, *view;
+    if (!(view = MoraStr_code_units(self, NULL))) {return NULL;}
+    units = PyPickleBuffer_FromObject(view);
+    Py_DECREF(view);
+    if (!units) {return NULL;}
+    if (MoraStr_INDICES(self)) {
+        if (!(view = MoraStr_end_offsets(self, NULL))) {goto error;}
+        offsets = PyPickleBuffer_FromObject(view);
+        Py_DECREF(view);
+        if (!offsets) {goto error;}
+    } else {
+        offsets = Py_NewRef(Py_None);
+    }
+    return Py_BuildValue("O(NNN)", from_pickle_buffers,
+        PyBool_FromLong(PY_LITTLE_ENDIAN), units, offsets);
+
+error:
+    Py_DECREF(units);
+    return NULL;
+}
+#endif
+
+
+/* _from_pickle_buffers(little_endian, code_units, end_offsets)
+   end_offsets is None if every mora is a single character. The buffers
+   hold native integers of the byte order given by little_endian. */
+static PyObject *
+MoraStr__from_pickle_buffers(PyTypeObject *type, PyObject *const *args,
+        Py_ssize_t nargs)
+{
+    if (nargs != 3) {
+        PyErr_Format(PyExc_TypeError,
+            "_from_pickle_buffers expected 3 arguments, got %zd", nargs);
+        return NULL;
+    }
+    int little = PyObject_IsTrue(args[0]);
+    if (little < 0) {return NULL;}
+
+    PyObject *result = NULL;
+    Py_buffer units, offsets;
+    offsets.obj = NULL;
+    if (PyObject_GetBuffer(args[1], &units, PyBUF_SIMPLE) < 0) {return NULL;}
+    if (args[2] != Py_None &&
+        PyObject_GetBuffer(args[2], &offsets, PyBUF_SIMPLE) < 0) {goto done;}
+    if (units.len % sizeof(Katakana) ||
+        (offsets.obj && offsets.len % sizeof(MINDEX_T))) {
+        PyErr_SetString(PyExc_ValueError, "malformed pickle buffers");
+        goto done;
+    }
+
+    Py_ssize_t length = units.len / (Py_ssize_t)sizeof(Katakana);
+    result = MoraStr_from_raw_(type, units.buf, length,
+        offsets.obj ? offsets.buf : NULL,
+        offsets.obj ? offsets.len / (Py_ssize_t)sizeof(MINDEX_T) : length,
+        little != PY_LITTLE_ENDIAN);
+
+done:
+    PyBuffer_Release(&units);
+    if (offsets.obj) {PyBuffer_Release(&offsets);}
+    return result;
+}
+
+
+/* Reads the IDs in obj into a new array: a buffer of unsigned bytes or
+   unsigned shorts is used as is, anything else is iterated over. */
+static uint16_t *
+MoraStr_read_mora_ids_(PyObject *obj, Py_ssize_t *n) {
+    uint16_t *ids;
+    if (PyObject_CheckBuffer(obj)) {
+        Py_buffer view;
+        if (PyObject_GetBuffer(obj, &view, PyBUF_FORMAT | PyBUF_ND) < 0) {
+            return NULL;
+        }
+        const char *fmt = view.format ? view.format : "B";
+        if (*fmt == '@' || *fmt == '=') {++fmt;}
+        if ((strcmp(fmt, "B") && strcmp(fmt, "H")) || view.ndim > 1) {
+            PyErr_Format(PyExc_TypeError,
+                "mora IDs must be a 1-D buffer of format 'B' or 'H', "
+                "not '%s'", view.format ? view.format : "B");
+            PyBuffer_Release(&view);
+            return NULL;
+        }
+        *n = view.len / view.itemsize;
+        ids = PyMem_New(uint16_t, *n ? *n : 1);
+        if (ids) {
+            for (Py_ssize_t i = 0; i < *n; ++i) {
+                ids[i] = view.itemsize == 1 ? \
+                    ((const uint8_t *)view.buf)[i] : \
+                    ((const uint16_t *)view.buf)[i];
+            }
+        } else {
+            PyErr_NoMemory();
+        }
+        PyBuffer_Release(&view);
+        return ids;
+    }
+
+    PyObject *seq = PySequence_Fast(obj, "mora IDs must be iterable");
+    if (!seq) {return NULL;}
+    *n = PySequence_Fast_GET_SIZE(seq);
+    ids = PyMem_New(uint16_t, *n ? *n : 1);
+    if (!ids) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (Py_ssize_t i = 0; i < *n; ++i) {
+        Py_ssize_t id = PyNumber_AsSsize_t(
+            PySequence_Fast_GET_ITEM(seq, i), PyExc_OverflowError);
+        if (id == -1 && PyErr_Occurred()) {goto error;}
+        if (id < 0 || id > UINT16_MAX) {
+            PyErr_Format(PyExc_ValueError, "invalid mora ID: %zd", id);
+            goto error;
+        }
+        ids[i] = (uint16_t)id;
+    }
+    Py_DECREF(seq);
+    return ids;
+
+error:
+    Py_DECREF(seq);
+    PyMem_Free(ids);
+    return NULL;
+}
+
+
+static PyObject *
+MoraStr_from_mora_ids(PyTypeObject *type, PyObject *obj) {
+    Py_ssize_t n;
+    uint16_t *ids = MoraStr_read_mora_ids_(obj, &n);
+    if (!ids) {return NULL;}
+
+    PyObject *string = NULL, *result = NULL;
+    MINDEX_T *indices = NULL;
+    size_t length = 0;
+    Katakana mora[MORA_CONTENT_MAX];
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t len = mora_id_chars_(ids[i], mora);
+        if (!len) {
+            PyErr_Format(PyExc_ValueError, "invalid mora ID: %d", (int)ids[i]);
+            goto done;
+        }
+        length += len;
+        if (length > MINDEX_MAX) {
+            PyErr_SetString(PyExc_OverflowError, "base string is too long");
+            goto done;
+        }
+    }
+    if (!length) {
+        result = Empty_MoraStr();
+        goto done;
+    }
+    string = PyUnicode_New((Py_ssize_t)length, 0xffff);
+    if (!string) {goto done;}
+    if ((Py_ssize_t)length != n) {
+        indices = MoraStr_INDICES_ALLOC(n);
+        if (!indices) {goto done;}
+    }
+
+    Katakana *buf = KatakanaArray_from_str(string);
+    Py_ssize_t pos = 0;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t len = mora_id_chars_(ids[i], buf + pos);
+        if (pos && VALIDATE_MORA_BOUNDARY(
+                Bounds_KANA, buf[pos-1], buf[pos]) < 0) {goto done;}
+        pos += len;
+        if (indices) {indices[i] = MINDEX(pos);}
+    }
+
+    if (IS_MORASTR_TYPE(type)) {
+        MoraStrObject *morastr;
+        morastr = (MoraStrObject *)type->tp_alloc(type, 0);
+        if (!morastr) {goto done;}
+        Py_SET_SIZE(morastr, n);
+        morastr->string = string;
+        morastr->indices = indices;
+        string = NULL;
+        indices = NULL;
+        result = (PyObject *)morastr;
+    } else {
+        result = PyObject_CallFunctionObjArgs((PyObject *)type, string, NULL);
+    }
+
+done:
+    PyMem_Free(ids);
+    Py_XDECREF(string);
+    MoraStr_INDICES_DEL(indices);
+    return result;
+}
+
+
+/* Converts the run of strings seq[0:n] into one MoraStr at once, so
+   that the kana conversion sees them as a single string. */
+static PyObject *
+MoraStr_fromstrs_run_(PyObject *const *seq, Py_ssize_t n, BoolPred ignore,
+        bool head) {
+    PyObject *string;
+    if (n == 1) {
+        string = Py_NewRef(seq[0]);
+    } else {
+        PyObject *empty_str = PyUnicode_New(0, 0);
+        if (!empty_str) {return NULL;}
+        PyObject *tuple = PyTuple_New(n);
+        if (!tuple) {
+            Py_DECREF(empty_str);
+            return NULL;
+        }
+        for (Py_ssize_t i = 0; i < n; ++i) {
+            PyTuple_SET_ITEM(tuple, i, Py_NewRef(seq[i]));
+        }
+        string = PyUnicode_Join(empty_str, tuple);
+        Py_DECREF(empty_str);
+        Py_DECREF(tuple);
+        if (!string) {return NULL;}
+    }
+    PyObject *morastr = MoraStr_from_text_(string, !ignore, head);
+    Py_DECREF(string);
+    return morastr;
+}
+
+
+static PyObject *
+MoraStr_fromstrs(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"ignore", NULL};
+
+    Py_ssize_t nargs = Py_SIZE(args);
+    PyObject *empty_str = PyUnicode_New(0, 0);
+    if (!empty_str) {return NULL;}
+    PyObject *seq = PyTuple_New(nargs), *string = NULL;
+    PyObject **parts = NULL;
+    Py_ssize_t n_parts = 0;
+{ /* got ownership */
+    if (!seq) {goto error;}
+    for (Py_ssize_t i = 0; i < nargs; ++i) {
+        PyObject *item = PyTuple_GET_ITEM(args, i);
+        if (PyUnicode_Check(item) || MoraStr_CheckExact(item)) {
+            Py_INCREF(item);
+        } else {
+            item = PyUnicode_Join(empty_str, item);
+            if (!item) {
+                if (nargs != 1 && PyErr_ExceptionMatches(PyExc_TypeError)) {
+                    PyErr_Clear();
+                    PyErr_Format(PyExc_TypeError,
+                        "non-string element found in argument %zd", i+1);
+                }
+                goto error;
+            }
+        }
+        PyTuple_SET_ITEM(seq, i, item);
+    }
+
+    if (!IS_MORASTR_TYPE(type)) {
+        for (Py_ssize_t i = 0; i < nargs; ++i) {
+            PyObject *item = PyTuple_GET_ITEM(seq, i);
+            if (MoraStr_CheckExact(item)) {
+                PyTuple_SET_ITEM(seq, i, Py_NewRef(MoraStr_STRING(item)));
+                Py_DECREF(item);
+            }
+        }
+        if (nargs == 1) {
+            string = Py_NewRef(PyTuple_GET_ITEM(seq, 0));
+        } else {
+            string = PyUnicode_Join(empty_str, seq);
+            if (!string) {goto error;}
+        }
+        PyObject *new_args = PyTuple_Pack(1, string);
+        if (!new_args) {goto error;}
+        PyObject *morastr = PyObject_Call((PyObject *)type, new_args, kwds);
+        Py_DECREF(new_args);
+        if (!morastr) {goto error;}
+        Py_DECREF(empty_str);
+        Py_DECREF(seq);
+        Py_DECREF(string);
+        return morastr;
+    }
+
+    BoolPred ignore = false;
+    if (kwds) {
+        PyObject *dummy = PyTuple_New(0);
+        if (!dummy) {goto error;}
+        bool result = PyArg_ParseTupleAndKeywords(
+            dummy, kwds, "|$p", kwlist, &ignore);
+        Py_DECREF(dummy);
+        if (!result) {goto error;}
+    }
+
+    /* MoraStr arguments are spliced in as they are; runs of strings in
+       between are converted together. */
+    parts = PyMem_New(PyObject *, nargs ? nargs : 1);
+    if (!parts) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    PyObject **items = &PyTuple_GET_ITEM(seq, 0);
+    for (Py_ssize_t i = 0, run = 0; i <= nargs; ++i) {
+        if (i < nargs && !MoraStr_CheckExact(items[i])) {continue;}
+        if (run < i) {
+            parts[n_parts] = MoraStr_fromstrs_run_(
+                items + run, i - run, ignore, !run);
+            if (!parts[n_parts]) {goto error;}
+            n_parts++;
+        }
+        if (i < nargs) {parts[n_parts++] = Py_NewRef(items[i]);}
+        run = i + 1;
+    }
+    PyObject *morastr;
+    if (n_parts == 1) {
+        morastr = Py_NewRef(parts[0]);
+    } else {
+        morastr = MoraStr_splice_(parts, n_parts, NULL);
+    }
+    if (!morastr) {goto error;}
+    while (n_parts--) {Py_DECREF(parts[n_parts]);}
+    PyMem_Free(parts);
+    Py_DECREF(empty_str);
+    Py_DECREF(seq);
+    return morastr;
+}
+
+error:
+    while (n_parts-- > 0) {Py_DECREF(parts[n_parts]);}
+    PyMem_Free(parts);
+    Py_DECREF(empty_str);
+    Py_XDECREF(seq);
+    Py_XDECREF(string);
+    return NULL;
+}
+
+
+static PySequenceMethods morastr_as_sequence = {
+    .sq_length = (lenfunc)MoraStr_length,
+    .sq_concat = (binaryfunc)MoraStr_concat,
+    .sq_repeat = (ssizeargfunc)MoraStr_repeat,
+    .sq_item = (ssizeargfunc)MoraStr_sq_item,
+    .sq_contains = (objobjproc)MoraStr_contains,
+};
+
+static PyMappingMethods morastr_as_mapping = {
+    .mp_length = (lenfunc)MoraStr_length,
+    .mp_subscript = (binaryfunc)MoraStr_subscript,
+};
+
+static PyObject *MoraStr_finditer(PyObject *, PyObject *, PyObject *);
+static PyObject *MoraStr_rfinditer(PyObject *, PyObject *, PyObject *);
+static PyObject *MoraStr_find_all(PyObject *, PyObject *, PyObject *);
+static PyObject *MoraStr_find_approx(PyObject *, PyObject *, PyObject *);
+static PyObject *MoraStr_vowels(PyObject *, PyObject *);
+static PyObject *MoraStr_find_vowels(PyObject *, PyObject *);
+static PyObject *MoraStr_endswith_vowels(PyObject *, PyObject *);
+static PyObject *MoraStr_finditer_approx(PyObject *, PyObject *, PyObject *);
+
+static PyMethodDef MoraStr_methods[] = {
+    {"__getitem__", (PyCFunction)MoraStr_subscript,
+     METH_O | METH_COEXIST, PyDoc_STR(
+     "__getitem__($self, index, /)\n"
+     "--\n\n"
+     "Return self[index]")},
+    {"__getnewargs__", (PyCFunction)MoraStr___getnewargs__,
+     METH_NOARGS, PyDoc_STR(
+     "__getnewargs__($self, /)\n"
+     "--\n\n")},
+    {"__reduce__", (PyCFunction)MoraStr___reduce__,
+     METH_NOARGS, PyDoc_STR(
+     "__reduce__($self, /)\n"
+     "--\n\n"
+     "Return state information for pickling.")},
+#if PY_VERSION_HEX >= 0x03080000
+    {"__reduce_ex__", (PyCFunction)MoraStr___reduce_ex__,
+     METH_O, PyDoc_STR(
+     "__reduce_ex__($self, protocol, /)\n"
+     "--\n\n"
+     "Helper for pickle.")},
+#endif
+    {"char_indices", (PyCFunction)MoraStr_char_indices,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "char_indices($self, *, zero=False)\n"
+     "--\n\n"
+     "Returns a list of accumulative character counts of each mora. If \n"
+     "the keyword 'zero' is set to True, the list starts with 0 and thus \n"
+     "the total length of the returned list becomes len(self) + 1.")},
+    {"contains", (PyCFunction)MoraStr_contains_method,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "contains($self, sub_morastr, /, *, fold=None)\n"
+     "--\n\n"
+     "Same as 'sub_morastr in self', but accepts the 'fold' option. If \n"
+     "sub_morastr is a tuple, returns True if any of them is found; the \n"
+     "patterns are matched together in a single bit-parallel scan.\n"
+     "\n"
+     "'fold' is a string of letters that select equivalence classes \n"
+     "treated as the same character: 'd' ignores dakuten and handakuten, \n"
+     "'s' matches small kana with their large forms, 'a' matches archaic \n"
+     "or merged kana with their modern forms (ヰ/イ, ヱ/エ, ヲ/オ, ヴ/ブ, \n"
+     "ヂ/ジ, ヅ/ズ), and 'c' matches 'ー' with the vowel it lengthens. \n"
+     "Except for 'c', each letter maps characters one by one, and \n"
+     "combined letters join their classes (ヴ, ウ, ブ and フ are all the \n"
+     "same with 'ad'). 'c' replaces each 'ー' with the vowel kana of the \n"
+     "mora before it; a 'ー' at the start of sub_morastr matches any vowel \n"
+     "mora. Matches still have to start and end at mora boundaries of \n"
+     "both strings as written.")},
+    {"count", (PyCFunction)MoraStr_count,
+     METH_FASTCALL | METH_KEYWORDS, PyDoc_STR(
+     "count($self, sub_morastr, start=0, end=sys.maxsize, /, *, fold=None)\n"
+     "--\n\n"
+     "Returns the number of non-overlapping occurrences of sub_morastr in \n"
+     "the range of morastr[start:end]. If start exceeds len(morastr), 0 is \n"
+     "returned. The first argument sub_morastr must be a kana string or a \n"
+     "MoraStr object, or a tuple of them to count occurrences of any of \n"
+     "them in one pass; where those overlap, the one ending first is \n"
+     "counted. See contains() for the 'fold' option.")},
+    {"endswith", (PyCFunction)MoraStr_endswith,
+     METH_FASTCALL, PyDoc_STR(
+     "endswith($self, suffix, start=0, end=sys.maxsize, /)\n"
+     "--\n\n"
+     "Like str.endswith(), but mora-wise.")},
+    {"endswith_vowels", (PyCFunction)MoraStr_endswith_vowels,
+     METH_O, PyDoc_STR(
+     "endswith_vowels($self, vowels, /)\n"
+     "--\n\n"
+     "Returns True if self.vowels() ends with vowels. The argument may \n"
+     "also be a MoraStr object, in which case its vowels are used, or a \n"
+     "tuple of candidates.")},
+    {"find", (PyCFunction)MoraStr_find,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "find($self, sub_morastr, start=0, end=sys.maxsize, /, *, charwise=False, fold=None)\n"
+     "--\n\n"
+     "Returns the first mora index in the MoraStr object where sub_morastr \n"
+     "is found within the range of morastr[start:end]. The first argument \n"
+     "sub_morastr must be a kana string or a MoraStr object. The return \n"
+     "value points a position counting from the beginning of the whole mora \n"
+     "string, rather than counting from the index specified by the start \n"
+     "argument. If start exceeds len(morastr) or sub_morastr is not found, \n"
+     "-1 is returned. If keyword argument 'charwise' is set to True, the \n"
+     "index count is calculated based on the number of kana characters \n"
+     "instead of morae. The 'charwise' option is available only when \n"
+     "start/end arguments are not specified. See contains() for the \n"
+     "'fold' option.")},
+    {"finditer", (PyCFunction)MoraStr_finditer,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "finditer($self, sub_morastr, /, *, charwise=False, fold=None, overlapping=False)\n"
+     "--\n\n"
+     "Returns an iterator yielding indices that indicate non-overlapping \n"
+     "occurences for sub_morastr in self. The argument sub_morastr must be \n"
+     "a kana string or a MoraStr object. If sub_morastr contains more morae \n"
+     "than self, sub_morastr and self will be swapped and then searching \n"
+     "will be performed, leaving the original MoraStr object intact. If the \n"
+     "keyword argument 'charwise' is set to True, the index count is \n"
+     "calculated based on the number of kana characters instead of morae. \n"
+     "If 'overlapping' is set to True, occurrences may overlap. See \n"
+     "contains() for the 'fold' option.")},
+    {"rfinditer", (PyCFunction)MoraStr_rfinditer,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "rfinditer($self, sub_morastr, /, *, charwise=False, fold=None, overlapping=False)\n"
+     "--\n\n"
+     "Returns an iterator yielding the indices of occurrences for \n"
+     "sub_morastr in self from right to left. Non-overlapping occurrences \n"
+     "are chosen from the end of self, as repeated rfind() calls would. \n"
+     "Unlike finditer(), the arguments are never swapped. The keyword \n"
+     "arguments work as in finditer().")},
+    {"find_all", (PyCFunction)MoraStr_find_all,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "find_all($self, sub_morastr, /, *, charwise=False, overlapping=False)\n"
+     "--\n\n"
+     "Returns an array.array of type 'i' holding the indices of all \n"
+     "occurrences of sub_morastr in self, found in a single native scan. \n"
+     "Unlike finditer(), the arguments are never swapped. If the keyword \n"
+     "argument 'overlapping' is set to True, occurrences may overlap. \n"
+     "'charwise' works as in finditer().")},
+    {"find_approx", (PyCFunction)MoraStr_find_approx,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "find_approx($self, sub_morastr, max_dist, /, *, charwise=False)\n"
+     "--\n\n"
+     "Returns a (start, end, distance) tuple for the first occurrence of \n"
+     "sub_morastr in self that is at most max_dist edits away, or None if \n"
+     "there is no such occurrence. Edits replace, insert or delete a whole \n"
+     "mora, so replacing 'キ' with 'キャ' counts as one. The match ending \n"
+     "first is chosen, and it is extended as long as the distance does \n"
+     "not increase. self[start:end] is the matched part. sub_morastr must \n"
+     "have at most 64 morae, and max_dist must be less than its length.")},
+    {"finditer_approx", (PyCFunction)MoraStr_finditer_approx,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "finditer_approx($self, sub_morastr, max_dist, /, *, charwise=False)\n"
+     "--\n\n"
+     "Returns an iterator yielding (start, end, distance) tuples for \n"
+     "non-overlapping approximate occurrences of sub_morastr, found in the \n"
+     "same way as find_approx().")},
+    {"find_vowels", (PyCFunction)MoraStr_find_vowels,
+     METH_O, PyDoc_STR(
+     "find_vowels($self, vowels, /)\n"
+     "--\n\n"
+     "Returns the first mora index where the vowel sequence 'vowels' \n"
+     "occurs in self.vowels(), or -1 if it is not found. 'vowels' is a \n"
+     "string of the letters A, I, U, E, O, N, Q and R (case-insensitive), \n"
+     "or a MoraStr object whose vowels are searched for.")},
+    {"index", (PyCFunction)MoraStr_index,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "index($self, sub_morastr, start=0, end=sys.maxsize, / , *, charwise=False, fold=None)\n"
+     "--\n\n"
+     "Same as MoraStr.find() except to raise an IndexError instead of \n"
+     "returning -1 when sub_morastr is not found. The relationship of \n"
+     "MoraStr.find() and MoraStr.index() is parallel to that of str.find() \n"
+     "and str.index().")},
+    {"join", (PyCFunction)MoraStr_join,
+     METH_O, PyDoc_STR(
+     "join($self, iterable, /)\n"
+     "--\n\n"
+     "Concatenates the kana strings and MoraStr objects in iterable, \n"
+     "with self between each pair, into a new MoraStr. The characters are \n"
+     "copied and the mora boundaries of MoraStr items are reused as they \n"
+     "are, so only the seams where an item starts with a small kana are \n"
+     "looked at again.")},
+    {"removeprefix", (PyCFunction)MoraStr_removeprefix,
+     METH_O, PyDoc_STR(
+     "removeprefix($self, prefix, /)\n"
+     "--\n\n"
+     "If the MoraStr object starts with the prefix, returns \n"
+     "morastr[len(prefix):]. Otherwise, a copy of the original object \n"
+     "is returned.")},
+    {"removesuffix", (PyCFunction)MoraStr_removesuffix,
+     METH_O, PyDoc_STR(
+     "removesuffix($self, suffix, /)\n"
+     "--\n\n"
+     "If the MoraStr object ends with the suffix, returns \n"
+     "morastr[:len(morastr)-len(suffix)]. Otherwise, a copy of the \n"
+     "original object is returned.")},
+    {"replace", (PyCFunction)MoraStr_replace,
+     METH_FASTCALL, PyDoc_STR(
+     "replace($self, old, new, maxcount=-1, /)\n"
+     "--\n\n"
+     "Returns a copy of the MoraStr object with all occurrences of \n"
+     "submora-string 'old' replaced by 'new'. If 'maxcount' option is \n"
+     "set to a non-negative number, replacements are performed only \n"
+     "'maxcount' times starting from the left.")},
+    {"rfind", (PyCFunction)MoraStr_rfind,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "rfind($self, sub_morastr, start=0, end=sys.maxsize, / , *, charwise=False)\n"
+     "--\n\n"
+     "Returns the last mora index in the MoraStr object where sub_morastr \n"
+     "is found within the range of morastr[start:end]. The first argument \n"
+     "sub_morastr must be a kana string or a MoraStr object. If start \n"
+     "exceeds len(morastr) or sub_morastr is not found, -1 is returned. If \n"
+     "keyword argument 'charwise' is set to True, the index count is \n"
+     "calculated based on the number of kana characters instead of morae. \n"
+     "The 'charwise' option is available only when start/end arguments are \n"
+     "not specified.")},
+    {"rindex", (PyCFunction)MoraStr_rindex,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "rindex($self, sub_morastr, start=0, end=sys.maxsize, / , *, charwise=False)\n"
+     "--\n\n"
+     "Same as MoraStr.find() except to raise an IndexError instead of \n"
+     "returning -1 when sub_morastr is not found. The relationship of \n"
+     "MoraStr.rfind() and MoraStr.rindex() is parallel to that of \n"
+     "str.rfind() and str.rindex().")},
+    {"startswith", (PyCFunction)MoraStr_startswith,
+     METH_FASTCALL, PyDoc_STR(
+     "startswith($self, prefix, start=0, end=sys.maxsize, /)\n"
+     "--\n\n"
+     "Like str.startswith(), but mora-wise.")},
+    {"tostr", (PyCFunction)MoraStr_tostr,
+     METH_NOARGS, PyDoc_STR(
+     "tostr($self, /)\n"
+     "--\n\n"
+     "Returns the internal string representation of the MoraStr object.\n"
+     "\n"
+     "Note: In the current implementation, this method just returns the \n"
+     "value of the instance's 'string' member. It is intended to use it \n"
+     "with functions that require a callback as one of their arguments.\n")},
+    {"translate", (PyCFunction)MoraStr_translate,
+     METH_O, PyDoc_STR(
+     "translate($self, table, /)\n"
+     "--\n\n"
+     "Like str.translate(), but mora-wise. table must be a dict or the \n"
+     "result of MoraStr.maketrans(); each key is a single mora and each \n"
+     "value is a kana string, a MoraStr or None, which deletes the mora. \n"
+     "The result is built in a single pass over the morae.")},
+    {"vowels", (PyCFunction)MoraStr_vowels,
+     METH_NOARGS, PyDoc_STR(
+     "vowels($self, /)\n"
+     "--\n\n"
+     "Returns the vowel of each mora as a string of ASCII letters: A, I, \n"
+     "U, E and O for the five vowels, N for 'ン', Q for 'ッ', R for 'ー' \n"
+     "and '_' for anything else. The result is cached on the object.")},
+    {"mora_ids", (PyCFunction)MoraStr_mora_ids,
+     METH_NOARGS, PyDoc_STR(
+     "mora_ids($self, /)\n"
+     "--\n\n"
+     "Returns the ID of each mora as array('H'). A single character has \n"
+     "the ID ord(ch) - 0x30A0, a fixed list of longer morae (キャ, シュ, \n"
+     "ファ, ティ, ...) is numbered from 96 up, and any other mora gets an \n"
+     "ID from 256 up computed from its characters. The IDs are the same \n"
+     "in every process.")},
+    {"ngrams", (PyCFunction)MoraStr_ngrams,
+     METH_O, PyDoc_STR(
+     "ngrams($self, n, /)\n"
+     "--\n\n"
+     "Returns the mora n-grams of self as a read-only memoryview of \n"
+     "format 'H' and shape (len(self) - n + 1, n), whose rows are the \n"
+     "mora IDs of each n-gram as given by mora_ids().")},
+    {"to_bytes", (PyCFunction)MoraStr_to_bytes,
+     METH_NOARGS, PyDoc_STR(
+     "to_bytes($self, /)\n"
+     "--\n\n"
+     "Returns a compact, platform-independent binary form of self: a \n"
+     "byte per character and two bits per mora for its length. Pickling \n"
+     "uses this form.")},
+    {"sort_key", (PyCFunction)MoraStr_sort_key,
+     METH_NOARGS, PyDoc_STR(
+     "sort_key($self, /)\n"
+     "--\n\n"
+     "Returns a bytes object that orders like self under the gojuon \n"
+     "collation of the comparison operators, for use as the key of \n"
+     "sorted() and list.sort().")},
+    {"code_units", (PyCFunction)MoraStr_code_units,
+     METH_NOARGS, PyDoc_STR(
+     "code_units($self, /)\n"
+     "--\n\n"
+     "Returns a read-only memoryview of format 'H' over the UTF-16 code \n"
+     "units of the katakana string, without copying.")},
+    {"end_offsets", (PyCFunction)MoraStr_end_offsets,
+     METH_NOARGS, PyDoc_STR(
+     "end_offsets($self, /)\n"
+     "--\n\n"
+     "Returns a read-only memoryview of format 'i' holding the character \n"
+     "offset where each mora ends, the same values as char_indices(). \n"
+     "The offsets are not copied unless every mora is one character.")},
+    {"from_mora_ids", (PyCFunction)MoraStr_from_mora_ids,
+     METH_O | METH_CLASS, PyDoc_STR(
+     "from_mora_ids($cls, ids, /)\n"
+     "--\n\n"
+     "Alternate constructor for MoraStr(). Builds a MoraStr object from \n"
+     "the mora IDs returned by mora_ids(), given as a buffer of format 'B' \n"
+     "or 'H' or as an iterable of int.")},
+    {"from_buffers", (PyCFunction)MoraStr_from_buffers,
+     METH_FASTCALL | METH_CLASS, PyDoc_STR(
+     "from_buffers($cls, code_units, end_offsets, /)\n"
+     "--\n\n"
+     "Alternate constructor for MoraStr(). Builds a MoraStr object from \n"
+     "the buffers given by code_units() and end_offsets(), or any buffers \n"
+     "of 2-byte and 4-byte integers laid out the same way. The mora \n"
+     "boundaries are trusted and not checked against the kana; the code \n"
+     "units must be full-width katakana and the offsets must increase by \n"
+     "1 to 3 up to the length of the string.")},
+    {"from_bytes", (PyCFunction)MoraStr_from_bytes,
+     METH_O | METH_CLASS, PyDoc_STR(
+     "from_bytes($cls, data, /)\n"
+     "--\n\n"
+     "Alternate constructor for MoraStr(). Rebuilds a MoraStr object from \n"
+     "the bytes returned by to_bytes() without analyzing the kana again.")},
+    {"_from_pickle_buffers", (PyCFunction)MoraStr__from_pickle_buffers,
+     METH_FASTCALL | METH_CLASS, PyDoc_STR(
+     "_from_pickle_buffers($cls, *args)\n"
+     "--\n\n"
+     "Used by pickle protocol 5.")},
+    {"fromstrs", (PyCFunction)MoraStr_fromstrs,
+     METH_VARARGS | METH_KEYWORDS | METH_CLASS, PyDoc_STR(
+     "fromstrs($cls, *iterables, **kwargs)\n"
+     "--\n\n"
+     "Alternate constructor for MoraStr(). Returns a new MoraStr object \n"
+     "from multiple strings. This method takes an arbitrary number of \n"
+     "positional arguments, each of which must be an iterable of str \n"
+     "objects. Keyword arguments are treated in the same way as MoraStr(). \n"
+     "Roughly equivalent to:\n"
+     "\n"
+     "@classmethod\n"
+     "def fromstrs(cls, *iterables, **kwargs):\n"
+     "    return cls(''.join(''.join(it) for it in iterables), **kwargs)")},
+    {"count_all", (PyCFunction)MoraStr_count_all,
+     METH_VARARGS | METH_KEYWORDS | METH_STATIC,
+     morastr_count_all_docstring},
+    {"maketrans", (PyCFunction)MoraStr_maketrans,
+     METH_VARARGS | METH_STATIC, PyDoc_STR(
+     "maketrans(x, y=None, z=None, /)\n"
+     "--\n\n"
+     "Returns a translation table usable for MoraStr.translate(). \n"
+     "If there is only one argument, it must be a dict mapping single \n"
+     "morae to kana strings, MoraStr objects or None. If there are two \n"
+     "arguments, they must have equal mora length, and each mora of x \n"
+     "is mapped to the mora at the same position in y. The morae of a \n"
+     "third argument are mapped to None.")},
+    {NULL, NULL}
+};
+
+
+static PyMemberDef MoraStr_members[] = {
+    {"length", T_PYSSIZET, offsetof(PyVarObject, ob_size), READONLY, PyDoc_STR(
+     "morastr.length <==> len(morastr)")},
+    {"string", T_OBJECT_EX, offsetof(MoraStrObject, string), READONLY, PyDoc_STR(
+     "Underlying katakana representation of the MoraStr object as a plain \n"
+     "str object. All characters are guaranteed to be full-width (zenkaku) \n"
+     "and to not contain spaces.")},
+    {NULL}
+};
+
+static PyObject *MoraStr_iter(PyObject *);
+
+static PyTypeObject MoraStrType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraStr",
+    .tp_basicsize = sizeof(MoraStrObject),
+    .tp_itemsize = 0,
+    .tp_dealloc = (destructor)MoraStr_dealloc,
+    .tp_repr = (reprfunc)MoraStr_repr,
+    .tp_as_sequence = &morastr_as_sequence,
+    .tp_as_mapping = &morastr_as_mapping,
+    .tp_hash = (hashfunc)MoraStr_hash,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = PyDoc_STR(
+     "MoraStr(kana_string: str | MoraStr = '',\n" \
+     "        /, *,\n" \
+     "        ignore: bool = False) -> MoraStr\n" \
+     "\n" \
+     "Divides kana_string into fractions each of which corresponds to a \n"
+     "Japanese mora. kana_string must be a MoraStr object or a string \n"
+     "composed of Japanese kana syllabaries. Otherwise, the constructor \n"
+     "raises a ValueError unless 'ignore' parameter is set to True, in \n"
+     "which case, invalid characters are just skipped. All elements in \n"
+     "MoraStr objects are guaranteed to be full-width (zenkaku) katakana. \n"
+     "Hiragana and half-width (hankaku) katakana in the input string are \n"
+     "converted to proper forms.\n"
+     ""),
+    .tp_richcompare = (richcmpfunc)MoraStr_richcompare,
+    .tp_iter = MoraStr_iter,
+    .tp_methods = MoraStr_methods,
+    .tp_members = MoraStr_members,
+    .tp_new = (newfunc)MoraStr_new,
+};
+
+
+/*********************** MoraStr Iterator **************************/
+typedef struct {
+    PyObject_HEAD
+    Py_ssize_t it_index;
+    MoraStrObject *it_seq;
+} MoraStrIterObject;
+
+
+static void
+MoraStrIter_dealloc(MoraStrIterObject *it) {
+    PyObject_GC_UnTrack(it);
+    Py_XDECREF(it->it_seq);
+    PyObject_GC_Del(it);
+}
+
+
+static int
+MoraStrIter_traverse(MoraStrIterObject *it, visitproc visit, void *arg) {
+    Py_VISIT(it->it_seq);
+    return 0;
+}
+
+
+static PyObject *
+MoraStrIter_next(MoraStrIterObject *it) {
+    MoraStrObject *morastr = it->it_seq;
+    if (!morastr) {return NULL;}
+
+    Py_ssize_t index = it->it_index;
+    if (index < Py_SIZE(morastr)) {
+        PyObject *item = MoraStr_Item(morastr, index);
+        if (item) {++it->it_index;}
+        return item;
+    }
+    it->it_seq = NULL;
+    Py_DECREF(morastr);
+    return NULL;
+}
+
+
+static PyObject *
+MoraStrIter_len(MoraStrIterObject *it) {
+    MoraStrObject *obj = it->it_seq;
+    Py_ssize_t len = obj ? Py_SIZE(obj) - it->it_index : 0;
+    return PyLong_FromSsize_t(len);
+}
+
+
+static PyObject *
+MoraStrIter_reduce(MoraStrIterObject *it, PyObject *Py_UNUSED(ignored)) {
+#if defined(_Py_IDENTIFIER) && PY_VERSION_HEX < 0x030c0000
+    _Py_IDENTIFIER(iter);
+    if (!it->it_seq) {
+        return Py_BuildValue("N(())", _PyEval_GetBuiltinId(&PyId_iter));
+    }
+    return Py_BuildValue("N(O)n",
+        _PyEval_GetBuiltinId(&PyId_iter), it->it_seq, it->it_index);
+#else
+    PyObject *builtins_dict = PyEval_GetBuiltins();
+    if (!builtins_dict) {return NULL;}
+    PyObject *iter_func = PyDict_GetItemString(builtins_dict, "iter");
+    if (!iter_func) {
+        PyErr_SetString(PyExc_AttributeError, "iter");
+        return NULL;
+    }
+    if (!it->it_seq) {
+        return Py_BuildValue("O(())", iter_func);
+    }
+    return Py_BuildValue("O(O)n", iter_func, it->it_seq, it->it_index);
+#endif
+}
+
+
+static PyObject *
+MoraStrIter_setstate(MoraStrIterObject *it, PyObject *state) {
+    Py_ssize_t index = PyLong_AsSsize_t(state);
+    if (index == -1 && PyErr_Occurred()) {return NULL;}
+    if (it->it_seq) {
+        if (index < 0) {index = 0;}
+        it->it_index = index;
+    }
+    return Py_NewRef(Py_None);
+}
+
+
+static PyMethodDef MoraStrIter_methods[] = {
+    {"__length_hint__", (PyCFunction)MoraStrIter_len, METH_NOARGS, PyDoc_STR(
+     "Private method returning an estimate of len(list(it)).")},
+    {"__reduce__", (PyCFunction)MoraStrIter_reduce, METH_NOARGS, PyDoc_STR(
+     "Return state information for pickling.")},
+    {"__setstate__", (PyCFunction)MoraStrIter_setstate, METH_O, PyDoc_STR(
+     "Set state information for unpickling.")},
+    {NULL, NULL}
+};
+
+
+PyTypeObject MoraStrIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraStrIterator",
+    .tp_basicsize = sizeof(MoraStrIterObject),
+    .tp_dealloc = (destructor)MoraStrIter_dealloc,
+    .tp_getattro = PyObject_GenericGetAttr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc)MoraStrIter_traverse,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)MoraStrIter_next,
+    .tp_methods = MoraStrIter_methods,
+};
+
+
+static PyObject *
+MoraStr_iter(PyObject *obj) {
+    if (!MoraStr_Check(obj)) {
+        PyErr_BadInternalCall();
+        return NULL;
+    }
+    MoraStrObject *seq = (MoraStrObject *)obj;
+    MoraStrIterObject *it;
+    it = PyObject_GC_New(MoraStrIterObject, &MoraStrIterType);
+    if (!it) {return NULL;}
+    it->it_index = 0;
+    Py_INCREF(seq);
+    it->it_seq = (MoraStrObject *)seq;
+    PyObject_GC_Track(it);
+    return (PyObject *)it;
+}
+
+
+/*********************** MoraStr FindIter **************************/
+enum {FINDITER_POOL_LIMIT = 32};
+
+typedef struct {
+    PyObject_HEAD
+    MINDEX_T *ptr;
+    PyObject *morastr;
+    PyObject *substr;
+    void *needle_cache;
+    MINDEX_T submora_cnt;
+    MINDEX_T step;
+    union {
+        MINDEX_T pos;
+        MINDEX_T pool[FINDITER_POOL_LIMIT+1];
+    } state;
+} MoraStrFindIterObject;
+
+
+#define MoraStrFindIter_needle_DEL(needle) do { \
+    two_way_cache_dealloc(needle); \
+    (needle) = NULL; \
+} while (0)
+
+
+static void
+MoraStrFindIter_dealloc(MoraStrFindIterObject *it) {
+    PyObject_GC_UnTrack(it);
+    Py_CLEAR(it->morastr);
+    Py_CLEAR(it->substr);
+    MoraStrFindIter_needle_DEL(it->needle_cache);
+    PyObject_GC_Del(it);
+}
+
+
+static int
+MoraStrFindIter_traverse(
+    MoraStrFindIterObject *it, visitproc visit, void *arg)
+{
+    Py_VISIT(it->morastr);
+    Py_VISIT(it->substr);
+    return 0;
+}
+
+
+static MINDEX_T
+MoraStrFindIter_two_way(
+    const Katakana *s, Py_ssize_t s_len,
+    const Katakana *p, Py_ssize_t p_len,
+    Py_ssize_t start, MoraStrFindIterObject *it,
+    const MINDEX_T *indices, bool charwise)
+{
+    PyObject *morastr = it->morastr;
+    Py_ssize_t submora_cnt = ~(it->submora_cnt);
+    MINDEX_T *ptr = it->state.pool;
+
+    Py_ssize_t found, cap, end, mora_cnt = Py_SIZE(morastr);
+    cap = (Py_ssize_t)Py_MIN(
+        (uint64_t)submora_cnt * 2 + start + 2048,
+        (uint64_t)mora_cnt);
+    end = mora_cnt;
+    if (!indices) {
+        do {
+            found = two_way_search(
+                s, end, p, p_len, start, -1);
+            *ptr++ = MINDEX(found);
+            if (found == -1) {
+                start = (end == mora_cnt) ? \
+                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
+                break;
+            }
+            start = found + it->step;
+            end = cap;
+        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr &&
+                 start + submora_cnt <= cap);
+    } else {
+        do {
+            found = two_way_mora_search(
+                s, indices[end-1], p, p_len, start,
+                submora_cnt, indices, -1);
+            if (charwise) {
+                *ptr++ = 0 < found ? indices[found-1] : MINDEX(found);
+            } else {
+                *ptr++ = MINDEX(found);
+            }
+            if (found == -1) {
+                start = (end == mora_cnt) ? \
+                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
+                break;
+            }
+            start = found + it->step;
+            end = cap;
+        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr &&
+                 start + submora_cnt <= cap);
+    }
+
+    two_way_set_needle(NULL);
+    MINDEX_T result = it->state.pool[0];
+    MINDEX_T pos = MINDEX(start);
+    it->state.pos = charwise ? ~pos : pos;
+    return result;
+}
+
+
+static MINDEX_T
+MoraStrFindIter_with_cache(MoraStrFindIterObject *it)
+{
+    MINDEX_T pos = it->state.pos;
+    BoolPred charwise = false;
+    if (pos < 0) {
+        charwise = true; pos = ~pos;
+    }
+    if (pos == MINDEX_MAX) {return -1;}
+
+    PyObject *morastr = it->morastr;
+    PyObject *substr = it->substr;
+    MINDEX_T *ptr = it->state.pool + 1;
+    Py_ssize_t substr_len = PyUnicode_GET_LENGTH(substr);
+
+    PyObject *string = MoraStr_STRING(morastr);
+    MINDEX_T *indices = MoraStr_INDICES(morastr);
+    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
+    if (it->ptr != ptr) {
+        memset((void*)ptr, -1, sizeof(MINDEX_T)*(FINDITER_POOL_LIMIT));
+    }
+    it->ptr = --ptr;
+
+    const Katakana *s = KatakanaArray_from_str(string);
+    const Katakana *p = KatakanaArray_from_str(substr);
+
+    two_way_set_needle(it->needle_cache);
+    return MoraStrFindIter_two_way(
+        s, len, p, substr_len, (Py_ssize_t)pos, it, indices, charwise);
+}
+
+
+static MINDEX_T
+MoraStrFindIter_find_push(MoraStrFindIterObject *it) {
+    MINDEX_T pos = it->state.pos;
+    BoolPred charwise = false;
+    if (pos < 0) {
+        charwise = true; pos = ~pos;
+    }
+    if (pos == MINDEX_MAX) {return -1;}
+
+    PyObject *morastr = it->morastr;
+    PyObject *substr = it->substr;
+    Py_ssize_t submora_cnt = it->submora_cnt;
+    MINDEX_T *ptr = it->state.pool + 1;
+    Py_ssize_t substr_len = PyUnicode_GET_LENGTH(substr);
+
+    PyObject *string = MoraStr_STRING(morastr);
+    MINDEX_T *indices = MoraStr_INDICES(morastr);
+    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
+    if (it->ptr != ptr) {
+        memset((void*)ptr, -1, sizeof(MINDEX_T)*(FINDITER_POOL_LIMIT));
+    }
+    it->ptr = --ptr;
+
+    const Katakana *s = KatakanaArray_from_str(string);
+    const Katakana *p = KatakanaArray_from_str(substr);
+
+    
+    if (!pos) {
+        if (!indices && submora_cnt != substr_len) {return -1;}
+        MoraStr_assert(substr_len <= MINDEX_MAX);
+        int status = search_algorithm_prepare(
+            s, len, p, substr_len, 0, submora_cnt, indices);
+        if (status == -1) {
+            search_algorithm_disable_cache();
+            return -2;
+        }
+        if (status == SEARCH_TWOWAY) {
+            it->submora_cnt = ~(it->submora_cnt);
+            MINDEX_T result = MoraStrFindIter_two_way(
+                s, len, p, substr_len, (Py_ssize_t)pos,
+                it, indices, charwise);
+            pos = charwise ? ~(it->state.pos) : it->state.pos;
+            if (pos != MINDEX_MAX) {
+                void *needle_cache = two_way_cache_new();
+                if (!needle_cache) {
+                    PyErr_NoMemory();
+                    return -2;
+                }
+                it->needle_cache = needle_cache;
+            }
+            return result;
+        }
+    }
+
+    Py_ssize_t start = (Py_ssize_t)pos, found, cap, end;
+    Py_ssize_t mora_cnt = Py_SIZE(morastr);
+    cap = (Py_ssize_t)Py_MIN(
+        (uint64_t)submora_cnt * 2 + start + 2048,
+        (uint64_t)mora_cnt);
+    end = mora_cnt;
+    if (!indices) {
+        do {
+            found = generic_katakana_search(
+                s, end, p, substr_len, start, -1);
+            *ptr++ = MINDEX(found);
+            if (found == -1) {
+                start = (end == mora_cnt) ? \
+                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
+                break;
+            }
+            start = found + it->step;
+            end = cap;
+        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr &&
+                 start + submora_cnt <= cap);
+    } else {
+        do {
+            found = generic_mora_search(
+                s, indices[end-1], p, substr_len, start,
+                submora_cnt, indices, -1);
+            if (charwise) {
+                *ptr++ = 0 < found ? indices[found-1] : MINDEX(found);
+            } else {
+                *ptr++ = MINDEX(found);
+            }
+            if (found == -1) {
+                start = (end == mora_cnt) ? \
+                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
+                break;
+            }
+            start = found + it->step;
+            end = cap;
+        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr &&
+                 start + submora_cnt <= cap);
+    }
+
+    MINDEX_T result = it->state.pool[0];
+    pos = MINDEX(start);
+    it->state.pos = charwise ? ~pos : pos;
+    return result;
+}
+
+
+static PyObject *
+MoraStrFindIter_empty_needle_next(MoraStrFindIterObject *it) {
+    PyObject *morastr = it->morastr;
+    MINDEX_T pos = it->state.pos;
+    size_t limit = (size_t)Py_SIZE(morastr);
+    size_t val = (uint32_t)it->state.pool[2] + 1;
+    if (val > limit) {
+        it->ptr = NULL;
+        Py_CLEAR(it->morastr);
+        Py_CLEAR(it->substr);
+        MoraStrFindIter_needle_DEL(it->needle_cache);
+        return NULL;
+    }
+    BoolPred charwise = (pos < 0);
+    it->state.pool[2]++;
+    if (charwise) {
+        MINDEX_T *indices = MoraStr_INDICES(morastr);
+        if (val && indices) {val = (size_t)indices[val-1];}
+    }
+    return PyLong_FromLong((long)val);
+}
+
+
+static PyObject *
+MoraStrFindIter_next(MoraStrFindIterObject *it) {
+    MINDEX_T *ptr = it->ptr;
+    if (!ptr) {return NULL;}
+
+    MINDEX_T val = *ptr;
+    MINDEX_T submora_cnt = it->submora_cnt;
+    if (val != -1) {
+        it->ptr++;
+        return PyLong_FromLong(val);
+    }
+
+    if (!submora_cnt) {
+        return MoraStrFindIter_empty_needle_next(it);
+    } else if (submora_cnt < 0) {
+        val = MoraStrFindIter_with_cache(it);
+    } else {
+        val = MoraStrFindIter_find_push(it);
+    }
+    if (val < 0) {
+        it->ptr = NULL;
+        Py_CLEAR(it->morastr);
+        Py_CLEAR(it->substr);
+        MoraStrFindIter_needle_DEL(it->needle_cache);
+        return NULL;
+    }
+    it->ptr++;
+    return PyLong_FromLong(val);
+}
+
+
+PyTypeObject MoraStrFindIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.morastr_finditerator",
+    .tp_basicsize = sizeof(MoraStrFindIterObject),
+    .tp_dealloc = (destructor)MoraStrFindIter_dealloc,
+    .tp_getattro = PyObject_GenericGetAttr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc)MoraStrFindIter_traverse,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)MoraStrFindIter_next,
+};
+
+
+static PyObject *
+MoraStr_finditer(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "charwise", "fold", "overlapping", NULL};
+
+    PyObject *submora;
+    BoolPred charwise = false, overlapping = false;
+    int fold = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$pO&p", kwlist, &submora, &charwise,
+            MoraStr_fold_converter, &fold, &overlapping)) {
+        return NULL;
+    }
+
+    if (MoraPattern_check_fold_(submora, fold) < 0) {return NULL;}
+    if (Py_TYPE(submora) == &MoraPatternType) {
+        return MoraPattern_finditer_(self, submora, charwise, overlapping);
+    }
+    if (PyUnicode_Check(submora)) {
+        submora = MoraStr_from_unicode_(submora, true);
+        if (!submora) {return NULL;}
+    } else if (MoraStr_Check(submora)) {
+        Py_INCREF(submora);
+    } else {
+        PyErr_Format(PyExc_TypeError,
+            "argument 1 must be a kana string "
+            "or a MoraStr object, not '%.200s'",
+            Py_TYPE(submora)->tp_name);
+        return NULL;
+    }
+    if (fold) {
+        PyObject *folded = MoraStr_fold_(submora, fold);
+        Py_DECREF(submora);
+        if (!folded) {return NULL;}
+        submora = folded;
+        self = MoraStr_fold_(self, fold);
+        if (!self) {
+            Py_DECREF(submora);
+            return NULL;
+        }
+        if (MoraStr_choon_lead_(submora, fold)) {
+            PyObject *found = MoraStr_choon_positions_(
+                (MoraStrObject *)self, submora, charwise, overlapping, false);
+            Py_DECREF(self);
+            Py_DECREF(submora);
+            if (!found) {return NULL;}
+            Py_SETREF(found, PyObject_GetIter(found));
+            return found;
+        }
+    } else {
+        Py_INCREF(self);
+    }
+    PyObject *morastr, *substr;
+    Py_ssize_t mora_cnt, submora_cnt;
+    mora_cnt = Py_SIZE(self);
+    submora_cnt = Py_SIZE(submora);
+
+    if (mora_cnt < submora_cnt) {
+        morastr = submora;
+        substr = MoraStr_STRING(self);
+        submora_cnt = mora_cnt;
+        Py_INCREF(substr);
+        Py_DECREF(self);
+    } else {
+        morastr = self;
+        substr = MoraStr_STRING(submora);
+        Py_INCREF(substr);
+        Py_DECREF(submora);
+    }
+
+{ /* got ownership */
+    MoraStrFindIterObject *it;
+    it = PyObject_GC_New(MoraStrFindIterObject, &MoraStrFindIterType);
+    if (!it) {goto error;}
+
+    it->ptr = it->state.pool + 1;
+    it->morastr = morastr;
+    it->substr = substr;
+    it->needle_cache = NULL;
+    it->submora_cnt = MINDEX(submora_cnt);
+    it->step = overlapping ? 1 : MINDEX(submora_cnt);
+    it->state.pos = charwise ? -1 : 0;
+    memset((void*)(it->state.pool+1), -1,
+        sizeof(MINDEX_T)*(FINDITER_POOL_LIMIT));
+
+    PyObject_GC_Track(it);
+    return (PyObject *)it;
+}
+
+error:
+    Py_DECREF(morastr);
+    Py_DECREF(substr);
+    return NULL;
+}
+
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *morastr;
+    PyObject *substr;
+    Py_ssize_t submora_cnt;
+    Py_ssize_t end;
+    struct TwoWayRevNeedle needle;
+    void *bitap_table;
+    BoolPred charwise;
+    BoolPred overlapping;
+    int pool_len;
+    int pool_idx;
+    MINDEX_T pool[FINDITER_POOL_LIMIT];
+} MoraStrRFindIterObject;
+
+static PyTypeObject MoraStrRFindIterType;
+
+
+static void
+MoraStrRFindIter_dealloc(MoraStrRFindIterObject *it) {
+    PyObject_GC_UnTrack(it);
+    Py_CLEAR(it->morastr);
+    Py_CLEAR(it->substr);
+    PyMem_Free(it->bitap_table);
+    PyObject_GC_Del(it);
+}
+
+
+static int
+MoraStrRFindIter_traverse(
+    MoraStrRFindIterObject *it, visitproc visit, void *arg)
+{
+    Py_VISIT(it->morastr);
+    Py_VISIT(it->substr);
+    return 0;
+}
+
+
+/* Refills the pool with the next occurrences ending at or before the
+   mora it->end, walking leftwards. A negative end marks exhaustion. */
+static void
+MoraStrRFindIter_fill(MoraStrRFindIterObject *it) {
+    PyObject *morastr = it->morastr;
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(morastr));
+    const MINDEX_T *indices = MoraStr_INDICES(morastr);
+    Py_ssize_t submora_cnt = it->submora_cnt;
+    Py_ssize_t p_len = 0;
+    const Katakana *p = NULL;
+    if (submora_cnt) {
+        p = KatakanaArray_from_str(it->substr);
+        p_len = PyUnicode_GET_LENGTH(it->substr);
+    }
+
+    int n = 0;
+    while (n < FINDITER_POOL_LIMIT && it->end >= submora_cnt) {
+        Py_ssize_t end = it->end, found;
+        if (!submora_cnt) {
+            found = end;
+        } else {
+            Py_ssize_t len = !indices ? end : end ? indices[end-1] : 0;
+            int algorithm;
+            if (len < p_len) {
+                found = -1;
+            } else if ((algorithm = select_search_algorithm(
+                           len, p_len, 0, (bool)indices)) == SEARCH_TWOWAY) {
+                if (!it->needle.period) {
+                    two_way_rev_prepare(p, p_len, &it->needle);
+                }
+                found = two_way_mora_rev_search(
+                    s, len, end, p, p_len, submora_cnt, 0, indices,
+                    &it->needle);
+            } else {
+                /* the needle keeps its bitap variant as the text shrinks,
+                   so one table serves every hit */
+                if (!it->bitap_table) {
+                    it->bitap_table = bitap_rev_table_new(p, p_len, algorithm);
+                }
+                found = generic_mora_rev_search(
+                    s, len, end, p, p_len, submora_cnt, 0, indices,
+                    it->bitap_table);
+            }
+        }
+        if (found < 0) {
+            it->end = -1;
+            break;
+        }
+        it->pool[n++] = MINDEX(
+            it->charwise && indices && found ? indices[found-1] : found);
+        it->end = !submora_cnt ? found - 1 :
+                  it->overlapping ? found + submora_cnt - 1 : found;
+    }
+    it->pool_len = n;
+    it->pool_idx = 0;
+}
+
+
+static PyObject *
+MoraStrRFindIter_next(MoraStrRFindIterObject *it) {
+    if (!it->morastr) {return NULL;}
+    if (it->pool_idx == it->pool_len) {
+        MoraStrRFindIter_fill(it);
+        if (!it->pool_len) {
+            Py_CLEAR(it->morastr);
+            Py_CLEAR(it->substr);
+            return NULL;
+        }
+    }
+    return PyLong_FromLong(it->pool[it->pool_idx++]);
+}
+
+
+static PyTypeObject MoraStrRFindIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.morastr_rfinditerator",
+    .tp_basicsize = sizeof(MoraStrRFindIterObject),
+    .tp_dealloc = (destructor)MoraStrRFindIter_dealloc,
+    .tp_getattro = PyObject_GenericGetAttr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc)MoraStrRFindIter_traverse,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)MoraStrRFindIter_next,
+};
+
+
+static PyObject *
+MoraStr_rfinditer(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "charwise", "fold", "overlapping", NULL};
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *submora;
+    BoolPred charwise = false, overlapping = false;
+    int fold = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$pO&p", kwlist, &submora, &charwise,
+            MoraStr_fold_converter, &fold, &overlapping)) {
+        return NULL;
+    }
+    if (fold) {
+        if (MoraStr_fold_operands_(&self, &submora, fold, err_fmt) == -1) {
+            return NULL;
+        }
+        if (MoraStr_choon_lead_(submora, fold)) {
+            PyObject *found = MoraStr_choon_positions_(
+                (MoraStrObject *)self, submora, charwise, overlapping, true);
+            Py_DECREF(self);
+            Py_DECREF(submora);
+            if (!found) {return NULL;}
+            Py_SETREF(found, PyObject_GetIter(found));
+            return found;
+        }
+    } else {
+        submora = MoraStr_from_object_(submora, err_fmt);
+        if (!submora) {return NULL;}
+        Py_INCREF(self);
+    }
+
+    MoraStrRFindIterObject *it = PyObject_GC_New(
+        MoraStrRFindIterObject, &MoraStrRFindIterType);
+    if (!it) {
+        Py_DECREF(self);
+        Py_DECREF(submora);
+        return NULL;
+    }
+    Py_ssize_t submora_cnt = Py_SIZE(submora);
+    PyObject *substr = MoraStr_STRING(submora);
+    it->morastr = self;
+    it->substr = Py_NewRef(substr);
+    Py_DECREF(submora);
+    it->submora_cnt = submora_cnt;
+    it->end = Py_SIZE(self);
+    if (!MoraStr_INDICES(self)
+        && submora_cnt != PyUnicode_GET_LENGTH(substr))
+    {
+        it->end = -1;
+    }
+    it->needle.period = 0;
+    it->bitap_table = NULL;
+    it->charwise = charwise;
+    it->overlapping = overlapping;
+    it->pool_len = it->pool_idx = 0;
+    PyObject_GC_Track(it);
+    return (PyObject *)it;
+}
+
+
+static PyObject *
+new_typed_array(const char *typecode, const void *data, Py_ssize_t nbytes);
+
+
+static PyObject *
+MoraStr_find_all(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "charwise", "overlapping", NULL};
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *submora;
+    BoolPred charwise = false, overlapping = false;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$pp", kwlist, &submora, &charwise, &overlapping)) {
+        return NULL;
+    }
+    Py_ssize_t submora_cnt, substr_len;
+    PyObject *substr = parse_submora(
+        submora, &submora_cnt, &substr_len, err_fmt);
+    if (!substr && submora_cnt) {return NULL;}
+
+    PyObject *string = MoraStr_STRING(self);
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    Py_ssize_t mora_cnt = Py_SIZE(self);
+    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
+    MINDEX_T *buf = NULL;
+    Py_ssize_t n = 0, cap = 0;
+    PyObject *result = NULL;
+
+    if (!substr) {
+        if (MoraStrArray_grow_((void **)&buf, &cap,
+                               mora_cnt + 1, sizeof(MINDEX_T)) == -1) {
+            return NULL;
+        }
+        for (; n <= mora_cnt; ++n) {buf[n] = MINDEX(n);}
+    } else if (substr_len <= len && (indices || submora_cnt == substr_len)) {
+        const Katakana *s = KatakanaArray_from_str(string);
+        const Katakana *p = KatakanaArray_from_str(substr);
+        if (search_algorithm_prepare(
+                s, len, p, substr_len, 0, submora_cnt, indices) == -1) {
+            goto error;
+        }
+        Py_ssize_t step = overlapping ? 1 : submora_cnt, pos = 0;
+        while (pos + submora_cnt <= mora_cnt) {
+            Py_ssize_t found = indices ?
+                generic_mora_search(s, len, p, substr_len, pos,
+                                    submora_cnt, indices, -1) :
+                generic_katakana_search(s, len, p, substr_len, pos, -1);
+            if (found == -1) {break;}
+            if (MoraStrArray_grow_((void **)&buf, &cap,
+                                   n + 1, sizeof(MINDEX_T)) == -1) {
+                search_algorithm_disable_cache();
+                goto error;
+            }
+            buf[n++] = MINDEX(found);
+            pos = found + step;
+        }
+        search_algorithm_disable_cache();
+    }
+    if (charwise && indices) {
+        for (Py_ssize_t i = 0; i < n; ++i) {
+            buf[i] = buf[i] ? indices[buf[i]-1] : 0;
+        }
+    }
+    result = new_typed_array("i", buf, sizeof(MINDEX_T) * n);
+
+error:
+    Py_XDECREF(substr);
+    MoraStr_Free(buf);
+    return result;
+}
+
+
+/*********************** MoraStr Vowels **************************/
+static PyObject *
+MoraStr_vowels_(PyObject *self) {
+    MoraStrObject *morastr = (MoraStrObject *)self;
+    if (morastr->vowels) {return morastr->vowels;}
+
+    Py_ssize_t mora_cnt = Py_SIZE(self);
+    PyObject *vowels = PyUnicode_New(mora_cnt, 127);
+    if (!vowels) {return NULL;}
+    Py_UCS1 *v = PyUnicode_1BYTE_DATA(vowels);
+    if (mora_cnt) {
+        const Katakana *s = KatakanaArray_from_str(morastr->string);
+        const MINDEX_T *indices = morastr->indices;
+        for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+            Katakana k = s[indices ? indices[i] - 1 : i];
+            v[i] = (Py_UCS1)katakana_vowel_letters[KANA_ID(k)];
+        }
+    }
+    morastr->vowels = vowels;
+    return vowels;
+}
+
+
+static PyObject *
+MoraStr_vowels(PyObject *self, PyObject *Py_UNUSED(ignored)) {
+    PyObject *vowels = MoraStr_vowels_(self);
+    return vowels ? Py_NewRef(vowels) : NULL;
+}
+
+
+static PyObject *
+MoraStr_parse_vowels_(PyObject *obj, const char *err_fmt) {
+    if (MoraStr_Check(obj)) {
+        PyObject *vowels = MoraStr_vowels_(obj);
+        return vowels ? Py_NewRef(vowels) : NULL;
+    }
+    if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, err_fmt, Py_TYPE(obj)->tp_name);
+        return NULL;
+    }
+    Py_ssize_t len = PyUnicode_GET_LENGTH(obj);
+    PyObject *vowels = PyUnicode_New(len, 127);
+    if (!vowels) {return NULL;}
+    Py_UCS1 *v = PyUnicode_1BYTE_DATA(vowels);
+    int kind = PyUnicode_KIND(obj);
+    const void *data = PyUnicode_DATA(obj);
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        Py_UCS4 ch = PyUnicode_READ(kind, data, i);
+        if (ch < 128) {ch = (Py_UCS4)Py_TOUPPER(ch);}
+        if (!ch || ch >= 128 || !strchr(VOWEL_LETTERS, (int)ch)) {
+            PyErr_Format(PyExc_ValueError,
+                "vowels must consist of the letters %s, not %R",
+                VOWEL_LETTERS, obj);
+            Py_DECREF(vowels);
+            return NULL;
+        }
+        v[i] = (Py_UCS1)ch;
+    }
+    return vowels;
+}
+
+
+static Py_ssize_t
+vowel_search_(PyObject *vowels, PyObject *pattern) {
+    Py_ssize_t s_len = PyUnicode_GET_LENGTH(vowels);
+    Py_ssize_t p_len = PyUnicode_GET_LENGTH(pattern);
+    const Py_UCS1 *s = PyUnicode_1BYTE_DATA(vowels);
+    const Py_UCS1 *p = PyUnicode_1BYTE_DATA(pattern);
+
+    if (!p_len) {return 0;}
+    if (p_len > s_len) {return -1;}
+    if (p_len == 1) {
+        const Py_UCS1 *found = memchr(s, p[0], (size_t)s_len);
+        return found ? found - s : -1;
+    }
+    if (p_len <= 32) {
+        return bitap_search_uint32_t_ucs1(s, s_len, p, p_len, 0, -1);
+    }
+    if (p_len <= 64) {
+        return bitap_search_uint64_t_ucs1(s, s_len, p, p_len, 0, -1);
+    }
+    /* str.find() switches to the two-way algorithm for long needles */
+    return PyUnicode_Find(vowels, pattern, 0, s_len, 1);
+}
+
+
+static PyObject *
+MoraStr_find_vowels(PyObject *self, PyObject *arg) {
+    PyObject *vowels = MoraStr_vowels_(self);
+    if (!vowels) {return NULL;}
+    PyObject *pattern = MoraStr_parse_vowels_(
+        arg, "find_vowels() argument must be str or MoraStr, not %.100s");
+    if (!pattern) {return NULL;}
+
+    Py_ssize_t idx = vowel_search_(vowels, pattern);
+    Py_DECREF(pattern);
+    if (idx == -2) {return NULL;}
+    return PyLong_FromSsize_t(idx);
+}
+
+
+static int
+vowel_tailmatch_(PyObject *vowels, PyObject *obj) {
+    PyObject *pattern = MoraStr_parse_vowels_(obj,
+        "endswith_vowels first arg must be str, MoraStr "
+        "or a tuple of them, not %.100s");
+    if (!pattern) {return -1;}
+
+    Py_ssize_t s_len = PyUnicode_GET_LENGTH(vowels);
+    Py_ssize_t p_len = PyUnicode_GET_LENGTH(pattern);
+    int result = p_len <= s_len && !memcmp(
+        PyUnicode_1BYTE_DATA(vowels) + (s_len - p_len),
+        PyUnicode_1BYTE_DATA(pattern), (size_t)p_len);
+    Py_DECREF(pattern);
+    return result;
+}
+
+
+static PyObject *
+MoraStr_endswith_vowels(PyObject *self, PyObject *arg) {
+    PyObject *vowels = MoraStr_vowels_(self);
+    if (!vowels) {return NULL;}
+
+    if (!PyTuple_Check(arg)) {
+        int result = vowel_tailmatch_(vowels, arg);
+        return result == -1 ? NULL : PyBool_FromLong(result);
+    }
+    for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(arg); ++i) {
+        int result = vowel_tailmatch_(vowels, PyTuple_GET_ITEM(arg, i));
+        if (result) {
+            return result == -1 ? NULL : Py_NewRef(Py_True);
+        }
+    }
+    Py_RETURN_FALSE;
+}
+
+
+/*********************** MoraStr ApproxIter **************************/
+typedef struct {
+    PyObject_HEAD
+    PyObject *morastr;
+    uint32_t *p_keys;
+    Py_ssize_t p_moracnt;
+    Py_ssize_t pos;
+    int max_dist;
+    BoolPred charwise;
+} MoraStrApproxIterObject;
+
+static PyTypeObject MoraStrApproxIterType;
+
+
+static uint32_t *
+MoraStr_mora_keys_(PyObject *morastr) {
+    Py_ssize_t mora_cnt = Py_SIZE(morastr);
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(morastr));
+    const MINDEX_T *indices = MoraStr_INDICES(morastr);
+    uint32_t *keys = MoraStr_Malloc(sizeof(uint32_t) * (mora_cnt + 1));
+    if (!keys) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    Py_ssize_t head = 0;
+    for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+        Py_ssize_t tail = indices ? indices[i] : i + 1;
+        keys[i] = mora_key_(s + head, tail - head);
+        head = tail;
+    }
+    return keys;
+}
+
+
+/* Returns the leftmost start (not before lower) of a match that ends at
+   mora index end with exactly dist edits. */
+static Py_ssize_t
+approx_match_start_(
+    const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t lower, Py_ssize_t end,
+    const uint32_t *p_keys, Py_ssize_t p_moracnt, int dist)
+{
+    int dp[64 + 1];
+    for (Py_ssize_t j = 0; j <= p_moracnt; ++j) {dp[j] = (int)j;}
+
+    Py_ssize_t start = end, limit = end - (p_moracnt + dist);
+    if (limit < lower) {limit = lower;}
+    for (Py_ssize_t i = end - 1; i >= limit; --i) {
+        Py_ssize_t head = i ? (indices ? indices[i-1] : i) : 0;
+        Py_ssize_t tail = indices ? indices[i] : i + 1;
+        uint32_t key = mora_key_(s + head, tail - head);
+
+        int diag = dp[0], lowest;
+        lowest = dp[0] = (int)(end - i);
+        for (Py_ssize_t j = 1; j <= p_moracnt; ++j) {
+            int cost = diag + (p_keys[p_moracnt-j] != key);
+            diag = dp[j];
+            if (cost > dp[j] + 1) {cost = dp[j] + 1;}
+            if (cost > dp[j-1] + 1) {cost = dp[j-1] + 1;}
+            dp[j] = cost;
+            if (lowest > cost) {lowest = cost;}
+        }
+        if (dp[p_moracnt] == dist) {start = i;}
+        if (lowest > dist) {break;}
+    }
+    return start;
+}
+
+
+/* Finds the next approximate match at or after *pos. Returns 1 and
+   stores the match in *start, *end and *dist, or returns 0. */
+static int
+MoraStr_approx_next_(
+    PyObject *morastr, const uint32_t *p_keys, Py_ssize_t p_moracnt,
+    int max_dist, Py_ssize_t *pos,
+    Py_ssize_t *start, Py_ssize_t *end, int *dist)
+{
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(morastr));
+    const MINDEX_T *indices = MoraStr_INDICES(morastr);
+    Py_ssize_t mora_cnt = Py_SIZE(morastr);
+    Py_ssize_t lower = *pos;
+
+    if (lower >= mora_cnt) {return 0;}
+    if (p_moracnt <= 32) {
+        *end = bitap_approx_search_uint32_t(
+            s, indices, lower, mora_cnt, p_keys, p_moracnt, max_dist, dist);
+    } else {
+        *end = bitap_approx_search_uint64_t(
+            s, indices, lower, mora_cnt, p_keys, p_moracnt, max_dist, dist);
+    }
+    if (*end < 0) {
+        *pos = mora_cnt;
+        return 0;
+    }
+    *start = approx_match_start_(
+        s, indices, lower, *end, p_keys, p_moracnt, *dist);
+    *pos = *end;
+    return 1;
+}
+
+
+static PyObject *
+MoraStr_approx_result_(
+    PyObject *morastr, Py_ssize_t start, Py_ssize_t end, int dist,
+    BoolPred charwise)
+{
+    const MINDEX_T *indices = MoraStr_INDICES(morastr);
+    if (charwise && indices) {
+        start = start ? indices[start-1] : 0LL;
+        end = end ? indices[end-1] : 0LL;
+    }
+    return Py_BuildValue("(nni)", start, end, dist);
+}
+
+
+static PyObject *
+MoraStr_approx_parse_(
+    PyObject *submora, int max_dist, uint32_t **p_keys)
+{
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *pattern = MoraStr_from_object_(submora, err_fmt);
+    if (!pattern) {return NULL;}
+    Py_ssize_t p_moracnt = Py_SIZE(pattern);
+    if (!p_moracnt) {
+        PyErr_SetString(PyExc_ValueError, "empty pattern");
+        goto error;
+    }
+    if (p_moracnt > 64) {
+        PyErr_SetString(PyExc_ValueError,
+            "approximate matching supports at most 64 morae");
+        goto error;
+    }
+    if (max_dist < 0 || max_dist >= p_moracnt) {
+        PyErr_SetString(PyExc_ValueError,
+            "max_dist must be non-negative and less than "
+            "the number of morae in sub_morastr");
+        goto error;
+    }
+    *p_keys = MoraStr_mora_keys_(pattern);
+    if (!*p_keys) {goto error;}
+    return pattern;
+
+error:
+    Py_DECREF(pattern);
+    return NULL;
+}
+
+
+static PyObject *
+MoraStr_find_approx(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "", "charwise", NULL};
+
+    PyObject *submora;
+    int max_dist;
+    BoolPred charwise = false;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "Oi|$p", kwlist, &submora, &max_dist, &charwise)) {
+        return NULL;
+    }
+    uint32_t *p_keys;
+    PyObject *pattern = MoraStr_approx_parse_(submora, max_dist, &p_keys);
+    if (!pattern) {return NULL;}
+
+    Py_ssize_t pos = 0, start, end;
+    int dist;
+    int found = MoraStr_approx_next_(self, p_keys, Py_SIZE(pattern),
+                                     max_dist, &pos, &start, &end, &dist);
+    MoraStr_Free(p_keys);
+    Py_DECREF(pattern);
+    if (!found) {return Py_NewRef(Py_None);}
+    return MoraStr_approx_result_(self, start, end, dist, charwise);
+}
+
+
+static PyObject *
+MoraStr_finditer_approx(PyObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "", "charwise", NULL};
+
+    PyObject *submora;
+    int max_dist;
+    BoolPred charwise = false;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "Oi|$p", kwlist, &submora, &max_dist, &charwise)) {
+        return NULL;
+    }
+    uint32_t *p_keys;
+    PyObject *pattern = MoraStr_approx_parse_(submora, max_dist, &p_keys);
+    if (!pattern) {return NULL;}
+    Py_ssize_t p_moracnt = Py_SIZE(pattern);
+    Py_DECREF(pattern);
+
+    MoraStrApproxIterObject *it = PyObject_GC_New(
+        MoraStrApproxIterObject, &MoraStrApproxIterType);
+    if (!it) {
+        MoraStr_Free(p_keys);
+        return NULL;
+    }
+    it->morastr = Py_NewRef(self);
+    it->p_keys = p_keys;
+    it->p_moracnt = p_moracnt;
+    it->pos = 0;
+    it->max_dist = max_dist;
+    it->charwise = charwise;
+    PyObject_GC_Track(it);
+    return (PyObject *)it;
+}
+
+
+static void
+MoraStrApproxIter_dealloc(MoraStrApproxIterObject *it) {
+    PyObject_GC_UnTrack(it);
+    Py_CLEAR(it->morastr);
+    MoraStr_Free(it->p_keys);
+    PyObject_GC_Del(it);
+}
+
+
+static int
+MoraStrApproxIter_traverse(
+    MoraStrApproxIterObject *it, visitproc visit, void *arg)
+{
+    Py_VISIT(it->morastr);
+    return 0;
+}
+
+
+static PyObject *
+MoraStrApproxIter_next(MoraStrApproxIterObject *it) {
+    PyObject *morastr = it->morastr;
+    if (!morastr) {return NULL;}
+
+    Py_ssize_t start, end;
+    int dist;
+    if (!MoraStr_approx_next_(morastr, it->p_keys, it->p_moracnt,
+                              it->max_dist, &it->pos, &start, &end, &dist))
+    {
+        Py_CLEAR(it->morastr);
+        return NULL;
+    }
+    return MoraStr_approx_result_(morastr, start, end, dist, it->charwise);
+}
+
+
+static PyTypeObject MoraStrApproxIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.morastr_approx_iterator",
+    .tp_basicsize = sizeof(MoraStrApproxIterObject),
+    .tp_dealloc = (destructor)MoraStrApproxIter_dealloc,
+    .tp_getattro = PyObject_GenericGetAttr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc)MoraStrApproxIter_traverse,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)MoraStrApproxIter_next,
+};
+
+
+/*********************** MoraMatcher **************************/
+typedef struct {
+    PyObject_HEAD
+    PyObject *patterns;
+    struct ACAutomaton *automaton;
+} MoraMatcherObject;
+
+
+static PyObject *
+MoraMatcher_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+    static const char *err_fmt = \
+        "patterns must be kana strings or MoraStr objects, not '%.200s'";
+
+    PyObject *iterable;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O", kwlist, &iterable)) {
+        return NULL;
+    }
+
+    PyObject *it = PyObject_GetIter(iterable);
+    if (!it) {return NULL;}
+    PyObject *patterns = PyList_New(0);
+    struct ACAutomaton *automaton = NULL;
+{ /* got ownership */
+    if (!patterns) {goto error;}
+    automaton = ac_automaton_new();
+    if (!automaton) {goto error;}
+
+    PyObject *item;
+    while ((item = PyIter_Next(it))) {
+        PyObject *morastr = MoraStr_from_object_(item, err_fmt);
+        Py_DECREF(item);
+        if (!morastr) {goto error;}
+        int status = PyList_Append(patterns, morastr);
+        Py_DECREF(morastr);
+        if (status < 0) {goto error;}
+
+        Py_ssize_t mora_cnt = Py_SIZE(morastr);
+        if (!mora_cnt) {
+            PyErr_SetString(PyExc_ValueError, "empty pattern");
+            goto error;
+        }
+        PyObject *string = MoraStr_STRING(morastr);
+        if (ac_automaton_add(automaton,
+                KatakanaArray_from_str(string),
+                PyUnicode_GET_LENGTH(string), mora_cnt) < 0) {goto error;}
+    }
+    if (PyErr_Occurred()) {goto error;}
+    Py_CLEAR(it);
+    if (ac_automaton_compile(automaton) < 0) {goto error;}
+
+    MoraMatcherObject *self = (MoraMatcherObject *)type->tp_alloc(type, 0);
+    if (!self) {goto error;}
+    self->patterns = PyList_AsTuple(patterns);
+    Py_DECREF(patterns);
+    self->automaton = automaton;
+    if (!self->patterns) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+error:
+    Py_XDECREF(it);
+    Py_XDECREF(patterns);
+    ac_automaton_dealloc(automaton);
+    return NULL;
+}
+
+
+static void
+MoraMatcher_dealloc(MoraMatcherObject *self) {
+    Py_XDECREF(self->patterns);
+    ac_automaton_dealloc(self->automaton);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static Py_ssize_t
+MoraMatcher_length(MoraMatcherObject *self) {
+    return PyTuple_GET_SIZE(self->patterns);
+}
+
+
+static int
+MoraMatcher_scan_(MoraMatcherObject *self, PyObject *arg,
+        ACMatchHandler handler, void *context)
+{
+    static const char *err_fmt = \
+        "argument must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *morastr = MoraStr_from_object_(arg, err_fmt);
+    if (!morastr) {return -1;}
+    PyObject *string = MoraStr_STRING(morastr);
+    int status = ac_automaton_scan(
+        self->automaton, KatakanaArray_from_str(string),
+        Py_SIZE(morastr), MoraStr_INDICES(morastr), handler, context);
+    Py_DECREF(morastr);
+    return status;
+}
+
+
+typedef struct {
+    Py_ssize_t index;
+    int32_t pid;
+    PyObject *list;
+    Py_ssize_t *counts;
+    bool charwise;
+} MoraMatcherContext;
+
+
+static int
+MoraMatcher_on_first_(
+    void *context, Py_ssize_t mora_idx, Py_ssize_t char_idx, int32_t pid)
+{
+    MoraMatcherContext *ctx = (MoraMatcherContext *)context;
+    ctx->index = ctx->charwise ? char_idx : mora_idx;
+    ctx->pid = pid;
+    return 1;
+}
+
+static int
+MoraMatcher_on_each_(
+    void *context, Py_ssize_t mora_idx, Py_ssize_t char_idx, int32_t pid)
+{
+    MoraMatcherContext *ctx = (MoraMatcherContext *)context;
+    PyObject *item = Py_BuildValue("(ni)",
+        ctx->charwise ? char_idx : mora_idx, (int)pid);
+    if (!item) {return -1;}
+    int status = PyList_Append(ctx->list, item);
+    Py_DECREF(item);
+    return status;
+}
+
+static int
+MoraMatcher_on_count_(
+    void *context, Py_ssize_t Py_UNUSED(mora_idx),
+    Py_ssize_t Py_UNUSED(char_idx), int32_t pid)
+{
+    MoraMatcherContext *ctx = (MoraMatcherContext *)context;
+    ctx->counts[pid]++;
+    return 0;
+}
+
+
+static PyObject *
+MoraMatcher_search(MoraMatcherObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "charwise", NULL};
+
+    PyObject *arg;
+    BoolPred charwise = false;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$p", kwlist, &arg, &charwise)) {
+        return NULL;
+    }
+    MoraMatcherContext ctx = {.index = -1, .pid = -1, .charwise = charwise};
+    int status = MoraMatcher_scan_(self, arg, MoraMatcher_on_first_, &ctx);
+    if (status < 0) {return NULL;}
+    if (!status) {return Py_NewRef(Py_None);}
+    return Py_BuildValue("(ni)", ctx.index, (int)ctx.pid);
+}
+
+
+static PyObject *
+MoraMatcher_findall(MoraMatcherObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "charwise", NULL};
+
+    PyObject *arg;
+    BoolPred charwise = false;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$p", kwlist, &arg, &charwise)) {
+        return NULL;
+    }
+    MoraMatcherContext ctx = {.charwise = charwise};
+    ctx.list = PyList_New(0);
+    if (!ctx.list) {return NULL;}
+    if (MoraMatcher_scan_(self, arg, MoraMatcher_on_each_, &ctx) < 0) {
+        Py_DECREF(ctx.list);
+        return NULL;
+    }
+    return ctx.list;
+}
+
+
+static PyObject *
+MoraMatcher_count_each(MoraMatcherObject *self, PyObject *arg) {
+    Py_ssize_t n = PyTuple_GET_SIZE(self->patterns);
+    MoraMatcherContext ctx = {0};
+    ctx.counts = PyMem_Calloc(n ? n : 1, sizeof(Py_ssize_t));
+    if (!ctx.counts) {return PyErr_NoMemory();}
+
+    PyObject *result = NULL;
+    if (MoraMatcher_scan_(self, arg, MoraMatcher_on_count_, &ctx) < 0) {
+        goto done;
+    }
+    result = PyList_New(n);
+    if (!result) {goto done;}
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        PyObject *item = PyLong_FromSsize_t(ctx.counts[i]);
+        if (!item) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+done:
+    PyMem_Free(ctx.counts);
+    return result;
+}
+
+
+static PySequenceMethods moramatcher_as_sequence = {
+    .sq_length = (lenfunc)MoraMatcher_length,
+};
+
+static PyMethodDef MoraMatcher_methods[] = {
+    {"count_each", (PyCFunction)MoraMatcher_count_each,
+     METH_O, PyDoc_STR(
+     "count_each($self, morastr, /)\n"
+     "--\n\n"
+     "Returns a list whose i-th element is the number of non-overlapping \n"
+     "occurrences of patterns[i] in morastr. The result is the same as \n"
+     "[morastr.count(p) for p in self.patterns], but the haystack is \n"
+     "scanned only once.")},
+    {"findall", (PyCFunction)MoraMatcher_findall,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "findall($self, morastr, /, *, charwise=False)\n"
+     "--\n\n"
+     "Returns a list of (index, pattern_id) pairs for every occurrence of \n"
+     "the patterns in morastr. Occurrences of the same pattern never \n"
+     "overlap each other, while those of different patterns may. Pairs are \n"
+     "ordered by the position where each occurrence ends; ties are broken \n"
+     "by the start index. If the keyword argument 'charwise' is set to \n"
+     "True, the index count is calculated based on the number of kana \n"
+     "characters instead of morae.")},
+    {"search", (PyCFunction)MoraMatcher_search,
+     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
+     "search($self, morastr, /, *, charwise=False)\n"
+     "--\n\n"
+     "Returns an (index, pattern_id) pair for the occurrence that ends \n"
+     "first in morastr, or None if no pattern is found. When several \n"
+     "patterns end at the same position, the longest one is chosen.")},
+    {NULL, NULL}
+};
+
+static PyMemberDef MoraMatcher_members[] = {
+    {"patterns", T_OBJECT_EX, offsetof(MoraMatcherObject, patterns),
+     READONLY, PyDoc_STR(
+     "Tuple of MoraStr objects the matcher was built from. Pattern ids \n"
+     "are indices into this tuple.")},
+    {NULL}
+};
+
+static PyTypeObject MoraMatcherType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraMatcher",
+    .tp_basicsize = sizeof(MoraMatcherObject),
+    .tp_dealloc = (destructor)MoraMatcher_dealloc,
+    .tp_as_sequence = &moramatcher_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "MoraMatcher(patterns: Iterable[str | MoraStr]) -> MoraMatcher\n" \
+     "\n" \
+     "Compiles many sub-mora-strings into a single Aho-Corasick automaton \n"
+     "over katakana so that all of them can be searched for in one pass \n"
+     "over a haystack. Occurrences are reported only when they start and \n"
+     "end on mora boundaries, just like MoraStr.find(). Small pattern sets \n"
+     "use a dense transition table; large ones switch to a compressed \n"
+     "one."),
+    .tp_methods = MoraMatcher_methods,
+    .tp_members = MoraMatcher_members,
+    .tp_new = (newfunc)MoraMatcher_new,
+};
+
+
+/*********************** PrefixSet **************************/
+static PyObject *
+PrefixSet_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+    static const char *err_fmt = \
+        "patterns must be kana strings or MoraStr objects, not '%.200s'";
+
+    PyObject *iterable;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O", kwlist, &iterable)) {
+        return NULL;
+    }
+
+    PyObject *it = PyObject_GetIter(iterable);
+    if (!it) {return NULL;}
+    PyObject *patterns = PyList_New(0);
+    struct PrefixTrie *head = NULL, *tail = NULL;
+{ /* got ownership */
+    if (!patterns) {goto error;}
+    head = prefix_trie_new(false);
+    if (!head) {goto error;}
+    tail = prefix_trie_new(true);
+    if (!tail) {goto error;}
+
+    PyObject *item;
+    while ((item = PyIter_Next(it))) {
+        PyObject *morastr = MoraStr_from_object_(item, err_fmt);
+        Py_DECREF(item);
+        if (!morastr) {goto error;}
+        int status = PyList_Append(patterns, morastr);
+        Py_DECREF(morastr);
+        if (status < 0) {goto error;}
+
+        PyObject *string = MoraStr_STRING(morastr);
+        const Katakana *p = KatakanaArray_from_str(string);
+        Py_ssize_t p_len = PyUnicode_GET_LENGTH(string);
+        Py_ssize_t mora_cnt = Py_SIZE(morastr);
+        if (prefix_trie_add(head, p, p_len, mora_cnt) < 0 ||
+            prefix_trie_add(tail, p, p_len, mora_cnt) < 0) {goto error;}
+    }
+    if (PyErr_Occurred()) {goto error;}
+    Py_CLEAR(it);
+
+    PrefixSetObject *self = (PrefixSetObject *)type->tp_alloc(type, 0);
+    if (!self) {goto error;}
+    self->patterns = PyList_AsTuple(patterns);
+    Py_DECREF(patterns);
+    self->head = head;
+    self->tail = tail;
+    if (!self->patterns) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+error:
+    Py_XDECREF(it);
+    Py_XDECREF(patterns);
+    prefix_trie_dealloc(head);
+    prefix_trie_dealloc(tail);
+    return NULL;
+}
+
+
+static void
+PrefixSet_dealloc(PrefixSetObject *self) {
+    Py_XDECREF(self->patterns);
+    prefix_trie_dealloc(self->head);
+    prefix_trie_dealloc(self->tail);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static Py_ssize_t
+PrefixSet_length(PrefixSetObject *self) {
+    return PyTuple_GET_SIZE(self->patterns);
+}
+
+
+static PySequenceMethods prefixset_as_sequence = {
+    .sq_length = (lenfunc)PrefixSet_length,
+};
+
+static PyMemberDef PrefixSet_members[] = {
+    {"patterns", T_OBJECT_EX, offsetof(PrefixSetObject, patterns),
+     READONLY, PyDoc_STR(
+     "Tuple of MoraStr objects the set was built from.")},
+    {NULL}
+};
+
+static PyTypeObject PrefixSetType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.PrefixSet",
+    .tp_basicsize = sizeof(PrefixSetObject),
+    .tp_dealloc = (destructor)PrefixSet_dealloc,
+    .tp_as_sequence = &prefixset_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "PrefixSet(patterns: Iterable[str | MoraStr]) -> PrefixSet\n" \
+     "\n" \
+     "Compiles sub-mora-strings into katakana tries for \n"
+     "MoraStr.startswith() and MoraStr.endswith(). Passing a PrefixSet \n"
+     "instead of a tuple costs one walk over the head or tail of the \n"
+     "haystack however many patterns it holds, and the compiled tries \n"
+     "are reused across calls."),
+    .tp_members = PrefixSet_members,
+    .tp_new = (newfunc)PrefixSet_new,
+};
+
+
+/*********************** MoraPattern **************************/
+/* Parsed form of one pattern element before it is expanded into
+   positions. */
+struct MoraPatternAtom {
+    PyObject *morae;       /* MoraStr of accepted morae, or NULL */
+    Py_ssize_t mora_idx;   /* the one mora of morae meant, or -1 for all */
+    bool any;
+    unsigned int vowels;   /* bits over VOWEL_LETTERS */
+    unsigned int glides;   /* bits over MORAPATTERN_GLIDES */
+    Py_ssize_t min, max;
+};
+
+static const Katakana MoraPattern_glides[] = {
+    L'ァ', L'ィ', L'ゥ', L'ェ', L'ォ', L'ャ', L'ュ', L'ョ', L'ヮ', 0};
+#define MORAPATTERN_SPECIALS "?[]<>{}"
+#define MORAPATTERN_REPEAT_MAX 1000
+
+
+static PyObject *
+MoraPattern_error_(PyObject *pattern, const char *reason) {
+    PyErr_Format(PyExc_ValueError,
+        "invalid mora pattern %R: %s", pattern, reason);
+    return NULL;
+}
+
+
+/* Reads "m}" or "m,n}" at *i, just after a '{'. */
+static int
+MoraPattern_parse_repeat_(
+    PyObject *pattern, Py_ssize_t *i, Py_ssize_t *min, Py_ssize_t *max)
+{
+    Py_ssize_t len = PyUnicode_GET_LENGTH(pattern), n[2] = {-1, -1};
+    int k = 0;
+    for (; *i < len; ++*i) {
+        Py_UCS4 ch = PyUnicode_READ_CHAR(pattern, *i);
+        if ('0' <= ch && ch <= '9') {
+            n[k] = (n[k] < 0 ? 0 : n[k] * 10) + (Py_ssize_t)(ch - '0');
+            if (n[k] > MORAPATTERN_REPEAT_MAX) {
+                MoraPattern_error_(pattern, "repeat count is too large");
+                return -1;
+            }
+        } else if (ch == ',' && !k && n[0] >= 0) {
+            k = 1;
+        } else if (ch == '}' && n[k] >= 0) {
+            break;
+        } else {
+            MoraPattern_error_(pattern, "bad repeat count");
+            return -1;
+        }
+    }
+    if (*i == len) {
+        MoraPattern_error_(pattern, "missing '}'");
+        return -1;
+    }
+    *min = n[0];
+    *max = k ? n[1] : n[0];
+    if (*max < *min || !*max) {
+        MoraPattern_error_(pattern, "bad repeat count");
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Reads the letters and small kana of a class at *i, just after a '<'. */
+static int
+MoraPattern_parse_class_(
+    PyObject *pattern, Py_ssize_t *i, struct MoraPatternAtom *atom)
+{
+    Py_ssize_t len = PyUnicode_GET_LENGTH(pattern);
+    for (; *i < len; ++*i) {
+        Py_UCS4 ch = PyUnicode_READ_CHAR(pattern, *i);
+        if (ch == '>') {break;}
+        if (is_hiragana(ch)) {ch += 0x60;}
+        const char *v = ch && ch < 128 ? strchr(VOWEL_LETTERS, (int)ch) : NULL;
+        int g = 0;
+        while (MoraPattern_glides[g] && MoraPattern_glides[g] != ch) {++g;}
+        if (v) {
+            atom->vowels |= 1u << (v - VOWEL_LETTERS);
+        } else if (MoraPattern_glides[g]) {
+            atom->glides |= 1u << g;
+        } else {
+            MoraPattern_error_(pattern,
+                "classes may only contain the letters 'AIUEONQR' "
+                "and small kana");
+            return -1;
+        }
+    }
+    if (*i == len) {
+        MoraPattern_error_(pattern, "missing '>'");
+        return -1;
+    }
+    if (!atom->vowels && !atom->glides) {
+        MoraPattern_error_(pattern, "empty class");
+        return -1;
+    }
+    return 0;
+}
+
+
+static PyObject *
+MoraPattern_kana_(PyObject *pattern, Py_ssize_t from, Py_ssize_t to) {
+    PyObject *sub = PyUnicode_Substring(pattern, from, to);
+    if (!sub) {return NULL;}
+    PyObject *morastr = MoraStr_from_unicode_(sub, true);
+    Py_DECREF(sub);
+    return morastr;
+}
+
+
+static int
+MoraPattern_push_atom_(
+    struct MoraPatternAtom **atoms, Py_ssize_t *n, Py_ssize_t *cap,
+    const struct MoraPatternAtom *atom)
+{
+    if (*n == *cap) {
+        Py_ssize_t new_cap = *cap ? *cap * 2 : 16;
+        struct MoraPatternAtom *p = PyMem_Resize(
+            *atoms, struct MoraPatternAtom, new_cap);
+        if (!p) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        *atoms = p;
+        *cap = new_cap;
+    }
+    (*atoms)[(*n)++] = *atom;
+    Py_XINCREF(atom->morae);
+    return 0;
+}
+
+
+/* Splits pattern into atoms. Literal kana become one atom per mora;
+   a repeat count applies to the atom right before it. */
+static Py_ssize_t
+MoraPattern_parse_(PyObject *pattern, struct MoraPatternAtom **atoms) {
+    Py_ssize_t len = PyUnicode_GET_LENGTH(pattern), n = 0, cap = 0;
+    Py_ssize_t i = 0;
+    *atoms = NULL;
+    while (i < len) {
+        Py_UCS4 ch = PyUnicode_READ_CHAR(pattern, i);
+        struct MoraPatternAtom atom = {.mora_idx = -1, .min = 1, .max = 1};
+        if (ch == '{') {
+            if (!n || (*atoms)[n-1].min != 1 || (*atoms)[n-1].max != 1) {
+                MoraPattern_error_(pattern, "nothing to repeat");
+                goto error;
+            }
+            ++i;
+            if (MoraPattern_parse_repeat_(pattern, &i,
+                    &(*atoms)[n-1].min, &(*atoms)[n-1].max) < 0) {
+                goto error;
+            }
+            ++i;
+            continue;
+        }
+        if (ch == '?') {
+            atom.any = true;
+            ++i;
+        } else if (ch == '<') {
+            ++i;
+            if (MoraPattern_parse_class_(pattern, &i, &atom) < 0) {goto error;}
+            ++i;
+        } else if (ch == '[') {
+            Py_ssize_t j = PyUnicode_FindChar(pattern, ']', i + 1, len, 1);
+            if (j == -2) {goto error;}
+            if (j == -1) {
+                MoraPattern_error_(pattern, "missing ']'");
+                goto error;
+            }
+            atom.morae = MoraPattern_kana_(pattern, i + 1, j);
+            if (!atom.morae) {goto error;}
+            if (!Py_SIZE(atom.morae)) {
+                Py_DECREF(atom.morae);
+                MoraPattern_error_(pattern, "empty set");
+                goto error;
+            }
+            i = j + 1;
+        } else if (ch < 128 && strchr(MORAPATTERN_SPECIALS, (int)ch)) {
+            MoraPattern_error_(pattern, "unbalanced brackets");
+            goto error;
+        } else {
+            Py_ssize_t j = i;
+            while (j < len) {
+                Py_UCS4 c = PyUnicode_READ_CHAR(pattern, j);
+                if (c < 128 && strchr(MORAPATTERN_SPECIALS, (int)c)) {break;}
+                ++j;
+            }
+            atom.morae = MoraPattern_kana_(pattern, i, j);
+            if (!atom.morae) {goto error;}
+            for (Py_ssize_t k = 0; k < Py_SIZE(atom.morae); ++k) {
+                atom.mora_idx = k;
+                if (MoraPattern_push_atom_(atoms, &n, &cap, &atom) < 0) {
+                    Py_DECREF(atom.morae);
+                    goto error;
+                }
+            }
+            Py_DECREF(atom.morae);
+            i = j;
+            continue;
+        }
+        int status = MoraPattern_push_atom_(atoms, &n, &cap, &atom);
+        Py_XDECREF(atom.morae);
+        if (status < 0) {goto error;}
+    }
+    if (!n) {
+        MoraPattern_error_(pattern, "empty pattern");
+        goto error;
+    }
+    return n;
+
+error:
+    for (Py_ssize_t k = 0; k < n; ++k) {Py_XDECREF((*atoms)[k].morae);}
+    PyMem_Free(*atoms);
+    *atoms = NULL;
+    return -1;
+}
+
+
+static int
+MoraPattern_set_atom_(
+    struct MoraPattern *mp, Py_ssize_t pos, const struct MoraPatternAtom *atom)
+{
+    for (int c = 0; c < KATAKANA_RNG; ++c) {
+        char letter = katakana_vowel_letters[c];
+        const char *v = letter ? strchr(VOWEL_LETTERS, letter) : NULL;
+        if (atom->any || (v && (atom->vowels >> (v - VOWEL_LETTERS)) & 1)) {
+            mora_pattern_set_single(mp, pos, (Katakana)(KATAKANA_OFF + c));
+            mora_pattern_set_last(mp, pos, (Katakana)(KATAKANA_OFF + c));
+        }
+    }
+    for (int g = 0; MoraPattern_glides[g]; ++g) {
+        if ((atom->glides >> g) & 1) {
+            /* a lone small kana is a mora of its own */
+            mora_pattern_set_single(mp, pos, MoraPattern_glides[g]);
+            mora_pattern_set_last(mp, pos, MoraPattern_glides[g]);
+        }
+    }
+    if (!atom->morae) {return 0;}
+
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(atom->morae));
+    const MINDEX_T *indices = MoraStr_INDICES(atom->morae);
+    Py_ssize_t first = 0, last = Py_SIZE(atom->morae);
+    if (atom->mora_idx != -1) {
+        first = atom->mora_idx;
+        last = first + 1;
+    }
+    for (Py_ssize_t k = first; k < last; ++k) {
+        Py_ssize_t a = !k ? 0 : indices ? indices[k-1] : k;
+        Py_ssize_t b = indices ? indices[k] : k + 1;
+        if (mora_pattern_set_mora(mp, pos, s + a, b - a) < 0) {return -1;}
+    }
+    return 0;
+}
+
+
+static PyObject *
+MoraPattern_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+
+    PyObject *pattern;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "U", kwlist, &pattern)) {
+        return NULL;
+    }
+
+    struct MoraPatternAtom *atoms;
+    Py_ssize_t n_atoms = MoraPattern_parse_(pattern, &atoms);
+    if (n_atoms < 0) {return NULL;}
+    struct MoraPattern *mp = NULL;
+{ /* got ownership */
+    Py_ssize_t n_pos = 0;
+    for (Py_ssize_t k = 0; k < n_atoms; ++k) {n_pos += atoms[k].max;}
+    mp = mora_pattern_new(n_pos);
+    if (!mp) {goto error;}
+
+    Py_ssize_t pos = 0;
+    for (Py_ssize_t k = 0; k < n_atoms; ++k) {
+        for (Py_ssize_t r = 0; r < atoms[k].max; ++r, ++pos) {
+            if (MoraPattern_set_atom_(mp, pos, atoms + k) < 0) {goto error;}
+            if (r >= atoms[k].min) {mora_pattern_set_optional(mp, pos);}
+        }
+    }
+    if (mora_pattern_compile(mp) < 0) {goto error;}
+
+    MoraPatternObject *self = (MoraPatternObject *)type->tp_alloc(type, 0);
+    if (!self) {goto error;}
+    self->pattern = Py_NewRef(pattern);
+    self->mp = mp;
+    for (Py_ssize_t k = 0; k < n_atoms; ++k) {Py_XDECREF(atoms[k].morae);}
+    PyMem_Free(atoms);
+    return (PyObject *)self;
+}
+
+error:
+    for (Py_ssize_t k = 0; k < n_atoms; ++k) {Py_XDECREF(atoms[k].morae);}
+    PyMem_Free(atoms);
+    mora_pattern_dealloc(mp);
+    return NULL;
+}
+
+
+static void
+MoraPattern_dealloc(MoraPatternObject *self) {
+    Py_XDECREF(self->pattern);
+    mora_pattern_dealloc(self->mp);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static PyObject *
+MoraPattern_repr(MoraPatternObject *self) {
+    return PyUnicode_FromFormat("MoraPattern(%R)", self->pattern);
+}
+
+
+static int
+MoraPattern_check_fold_(PyObject *submora, int fold) {
+    if (fold && Py_TYPE(submora) == &MoraPatternType) {
+        PyErr_SetString(PyExc_TypeError,
+            "keyword argument 'fold' is not available for a MoraPattern");
+        return -1;
+    }
+    return 0;
+}
+
+
+static Py_ssize_t
+MoraPattern_find_(MoraStrObject *self, PyObject *pattern,
+        Py_ssize_t start, Py_ssize_t end)
+{
+    BoolPred charwise = false;
+    if (start == -1) {
+        charwise = true; start = 0;
+    }
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(self));
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    Py_ssize_t match_end;
+    Py_ssize_t result = mora_pattern_search(
+        ((MoraPatternObject *)pattern)->mp, s, indices,
+        start, end, &match_end);
+    if (charwise && indices && 0 < result) {
+        result = indices[result-1];
+    }
+    return result;
+}
+
+
+/* Counts non-overlapping matches; an empty match moves on by one mora. */
+static PyObject *
+MoraPattern_count_(MoraStrObject *self, PyObject *pattern,
+        Py_ssize_t start, Py_ssize_t end)
+{
+    const struct MoraPattern *mp = ((MoraPatternObject *)pattern)->mp;
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(self));
+    MINDEX_T *indices = MoraStr_INDICES(self);
+    Py_ssize_t count = 0, match_end;
+    while (start <= end) {
+        Py_ssize_t found = mora_pattern_search(
+            mp, s, indices, start, end, &match_end);
+        if (found == -2) {return NULL;}
+        if (found == -1) {break;}
+        count++;
+        start = match_end > found ? match_end : found + 1;
+    }
+    return PyLong_FromSsize_t(count);
+}
+
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *morastr;
+    PyObject *pattern;
+    Py_ssize_t pos;
+    BoolPred charwise;
+    BoolPred overlapping;
+} MoraPatternIterObject;
+
+
+static void
+MoraPatternIter_dealloc(MoraPatternIterObject *it) {
+    PyObject_GC_UnTrack(it);
+    Py_CLEAR(it->morastr);
+    Py_CLEAR(it->pattern);
+    PyObject_GC_Del(it);
+}
+
+
+static int
+MoraPatternIter_traverse(
+    MoraPatternIterObject *it, visitproc visit, void *arg)
+{
+    Py_VISIT(it->morastr);
+    Py_VISIT(it->pattern);
+    return 0;
+}
+
+
+static PyObject *
+MoraPatternIter_next(MoraPatternIterObject *it) {
+    Py_ssize_t mora_cnt = Py_SIZE(it->morastr);
+    if (it->pos > mora_cnt) {return NULL;}
+
+    const Katakana *s = KatakanaArray_from_str(MoraStr_STRING(it->morastr));
+    MINDEX_T *indices = MoraStr_INDICES(it->morastr);
+    Py_ssize_t match_end;
+    Py_ssize_t found = mora_pattern_search(
+        ((MoraPatternObject *)it->pattern)->mp, s, indices,
+        it->pos, mora_cnt, &match_end);
+    if (found < 0) {
+        it->pos = PY_SSIZE_T_MAX;
+        return NULL;
+    }
+    it->pos = (it->overlapping || match_end == found) ? found + 1 : match_end;
+    if (it->charwise && indices && found) {found = indices[found-1];}
+    return PyLong_FromSsize_t(found);
+}
+
+
+static PyTypeObject MoraPatternIterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.morapattern_iterator",
+    .tp_basicsize = sizeof(MoraPatternIterObject),
+    .tp_dealloc = (destructor)MoraPatternIter_dealloc,
+    .tp_getattro = PyObject_GenericGetAttr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .tp_traverse = (traverseproc)MoraPatternIter_traverse,
+    .tp_iter = PyObject_SelfIter,
+    .tp_iternext = (iternextfunc)MoraPatternIter_next,
+};
+
+
+static PyObject *
+MoraPattern_finditer_(PyObject *self, PyObject *pattern,
+        BoolPred charwise, BoolPred overlapping)
+{
+    MoraPatternIterObject *it;
+    it = PyObject_GC_New(MoraPatternIterObject, &MoraPatternIterType);
+    if (!it) {return NULL;}
+    it->morastr = Py_NewRef(self);
+    it->pattern = Py_NewRef(pattern);
+    it->pos = 0;
+    it->charwise = charwise;
+    it->overlapping = overlapping;
+    PyObject_GC_Track(it);
+    return (PyObject *)it;
+}
+
+
+static PyMemberDef MoraPattern_members[] = {
+    {"pattern", T_OBJECT_EX, offsetof(MoraPatternObject, pattern),
+     READONLY, PyDoc_STR(
+     "The pattern string the object was compiled from.")},
+    {NULL}
+};
+
+static PyTypeObject MoraPatternType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraPattern",
+    .tp_basicsize = sizeof(MoraPatternObject),
+    .tp_dealloc = (destructor)MoraPattern_dealloc,
+    .tp_repr = (reprfunc)MoraPattern_repr,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "MoraPattern(pattern: str) -> MoraPattern\n" \
+     "\n" \
+     "Compiles a pattern over morae for MoraStr.find(), index(), count() \n"
+     "and finditer(). Kana stand for themselves, one mora at a time; \n"
+     "'?' matches any mora; '[...]' matches any one of the morae inside; \n"
+     "'<...>' matches a mora whose vowel is one of the letters AIUEONQR \n"
+     "(as in MoraStr.vowels()) or which ends with one of the small kana \n"
+     "inside; '{m}' and '{m,n}' repeat the preceding element. Patterns \n"
+     "of at most 64 morae without optional parts run as a shift-and over \n"
+     "the morae; the others run as an NFA."),
+    .tp_members = MoraPattern_members,
+    .tp_new = (newfunc)MoraPattern_new,
+};
+
+
+/*********************** MoraIndex **************************/
+typedef struct {
+    PyObject_HEAD
+    struct MoraIndexView view;
+    Py_buffer buffer;
+} MoraIndexObject;
+
+
+/* a read-only view of a bytearray can still change under us;
+   only bytes (directly or through a memoryview) is trusted in place */
+static int
+MoraIndex_owner_is_immutable_(PyObject *owner) {
+    if (PyMemoryView_Check(owner)) {
+        owner = PyMemoryView_GET_BUFFER(owner)->obj;
+    }
+    return owner && PyBytes_CheckExact(owner);
+}
+
+
+static PyObject *
+MoraIndex_from_owner_(PyTypeObject *type, PyObject *owner, int trusted) {
+    Py_buffer buffer;
+    if (PyObject_GetBuffer(owner, &buffer, PyBUF_SIMPLE) < 0) {return NULL;}
+    if (!buffer.readonly ||
+        !(trusted || MoraIndex_owner_is_immutable_(owner)) ||
+        (uintptr_t)buffer.buf % sizeof(MINDEX_T))
+    {
+        /* the image must stay valid and aligned as long as we live */
+        PyObject *copy = PyBytes_FromStringAndSize(buffer.buf, buffer.len);
+        PyBuffer_Release(&buffer);
+        if (!copy) {return NULL;}
+        int status = PyObject_GetBuffer(copy, &buffer, PyBUF_SIMPLE);
+        Py_DECREF(copy);
+        if (status < 0) {return NULL;}
+    }
+{ /* got ownership */
+    MoraIndexObject *self = (MoraIndexObject *)type->tp_alloc(type, 0);
+    if (!self) {goto error;}
+    if (mora_index_bind(&self->view, buffer.buf, buffer.len) < 0) {
+        Py_DECREF(self);
+        goto error;
+    }
+    self->buffer = buffer;
+    return (PyObject *)self;
+}
+
+error:
+    PyBuffer_Release(&buffer);
+    return NULL;
+}
+
+
+static PyObject *
+MoraIndex_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+    static const char *err_fmt = \
+        "documents must be kana strings or MoraStr objects, not '%.200s'";
+
+    PyObject *iterable;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O", kwlist, &iterable)) {
+        return NULL;
+    }
+
+    PyObject *it = PyObject_GetIter(iterable);
+    if (!it) {return NULL;}
+    PyObject *docs = PyList_New(0);
+    PyObject *image = NULL;
+{ /* got ownership */
+    if (!docs) {goto error;}
+
+    Py_ssize_t text_len = 0, n_suffixes = 0;
+    PyObject *item;
+    while ((item = PyIter_Next(it))) {
+        PyObject *morastr = MoraStr_from_object_(item, err_fmt);
+        Py_DECREF(item);
+        if (!morastr) {goto error;}
+        int status = PyList_Append(docs, morastr);
+        Py_DECREF(morastr);
+        if (status < 0) {goto error;}
+
+        text_len += PyUnicode_GET_LENGTH(MoraStr_STRING(morastr)) + 1;
+        n_suffixes += Py_SIZE(morastr);
+        if (text_len > MINDEX_MAX) {
+            PyErr_SetString(PyExc_OverflowError, "documents are too long");
+            goto error;
+        }
+    }
+    if (PyErr_Occurred()) {goto error;}
+    Py_CLEAR(it);
+
+    Py_ssize_t n_docs = PyList_GET_SIZE(docs);
+    Py_ssize_t size = mora_index_nbytes(n_docs, text_len, n_suffixes);
+    if (size < 0) {
+        PyErr_SetString(PyExc_OverflowError, "documents are too long");
+        goto error;
+    }
+    image = PyBytes_FromStringAndSize(NULL, size);
+    if (!image) {goto error;}
+
+    struct MoraIndexBuilder builder;
+    mora_index_builder_init(&builder, PyBytes_AS_STRING(image),
+                            n_docs, text_len, n_suffixes);
+    for (Py_ssize_t i = 0; i < n_docs; ++i) {
+        PyObject *morastr = PyList_GET_ITEM(docs, i);
+        PyObject *string = MoraStr_STRING(morastr);
+        mora_index_builder_append(&builder,
+            KatakanaArray_from_str(string), PyUnicode_GET_LENGTH(string),
+            Py_SIZE(morastr), MoraStr_INDICES(morastr));
+    }
+    Py_CLEAR(docs);
+    if (mora_index_builder_finish(&builder) < 0) {goto error;}
+
+    PyObject *self = MoraIndex_from_owner_(type, image, 1);
+    Py_DECREF(image);
+    return self;
+}
+
+error:
+    Py_XDECREF(it);
+    Py_XDECREF(docs);
+    Py_XDECREF(image);
+    return NULL;
+}
+
+
+static void
+MoraIndex_dealloc(MoraIndexObject *self) {
+    if (self->buffer.obj) {PyBuffer_Release(&self->buffer);}
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static Py_ssize_t
+MoraIndex_length(MoraIndexObject *self) {
+    return self->view.header->n_docs;
+}
+
+
+static PyObject *
+MoraIndex_pattern_(PyObject *arg) {
+    static const char *err_fmt = \
+        "argument must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *morastr = MoraStr_from_object_(arg, err_fmt);
+    if (morastr && !Py_SIZE(morastr)) {
+        Py_DECREF(morastr);
+        PyErr_SetString(PyExc_ValueError, "empty pattern");
+        return NULL;
+    }
+    return morastr;
+}
+
+
+static PyObject *
+MoraIndex_count(MoraIndexObject *self, PyObject *arg) {
+    PyObject *morastr = MoraIndex_pattern_(arg);
+    if (!morastr) {return NULL;}
+    PyObject *string = MoraStr_STRING(morastr);
+    Py_ssize_t count = mora_index_count(&self->view,
+        KatakanaArray_from_str(string), PyUnicode_GET_LENGTH(string));
+    Py_DECREF(morastr);
+    return PyLong_FromSsize_t(count);
+}
+
+
+static PyObject *
+MoraIndex_locate(MoraIndexObject *self, PyObject *arg) {
+    PyObject *morastr = MoraIndex_pattern_(arg);
+    if (!morastr) {return NULL;}
+    PyObject *string = MoraStr_STRING(morastr);
+    MINDEX_T *positions;
+    Py_ssize_t n = mora_index_locate(&self->view,
+        KatakanaArray_from_str(string), PyUnicode_GET_LENGTH(string),
+        &positions);
+    Py_DECREF(morastr);
+    if (n < 0) {return NULL;}
+
+    const struct MoraIndexView *v = &self->view;
+    PyObject *result = PyList_New(n);
+    if (!result) {goto done;}
+    Py_ssize_t doc = n ? mora_index_doc_of(v, positions[0]) : 0;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        MINDEX_T pos = positions[i];
+        while (v->doc_off[doc+1] <= pos) {doc++;}
+        MINDEX_T offset = mora_index_rank(v, pos) - \
+                          mora_index_rank(v, v->doc_off[doc]);
+        PyObject *item = Py_BuildValue("(nn)", doc, (Py_ssize_t)offset);
+        if (!item) {
+            Py_CLEAR(result);
+            goto done;
+        }
+        PyList_SET_ITEM(result, i, item);
+    }
+
+done:
+    MoraStr_Free(positions);
+    return result;
+}
+
+
+static PyObject *
+MoraIndex_save(MoraIndexObject *self, PyObject *file) {
+    PyObject *view = PyMemoryView_FromObject(self->buffer.obj);
+    if (!view) {return NULL;}
+
+    PyObject *result;
+    if (PyObject_HasAttrString(file, "write")) {
+        result = PyObject_CallMethod(file, "write", "O", view);
+        Py_DECREF(view);
+        if (!result) {return NULL;}
+        Py_DECREF(result);
+        Py_RETURN_NONE;
+    }
+
+    PyObject *io = PyImport_ImportModule("io");
+    if (!io) {
+        Py_DECREF(view);
+        return NULL;
+    }
+    PyObject *fp = PyObject_CallMethod(io, "open", "Os", file, "wb");
+    Py_DECREF(io);
+    if (!fp) {
+        Py_DECREF(view);
+        return NULL;
+    }
+    result = PyObject_CallMethod(fp, "write", "O", view);
+    Py_DECREF(view);
+    if (!result) {
+        PyObject *exc_type, *exc_value, *exc_tb;
+        PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+        Py_XDECREF(PyObject_CallMethod(fp, "close", NULL));
+        PyErr_Restore(exc_type, exc_value, exc_tb);
+        Py_DECREF(fp);
+        return NULL;
+    }
+    Py_DECREF(result);
+    result = PyObject_CallMethod(fp, "close", NULL);
+    Py_DECREF(fp);
+    if (!result) {return NULL;}
+    Py_DECREF(result);
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+MoraIndex_load(PyTypeObject *type, PyObject *source) {
+    if (PyObject_CheckBuffer(source)) {
+        return MoraIndex_from_owner_(type, source, 0);
+    }
+
+    PyObject *io = PyImport_ImportModule("io");
+    if (!io) {return NULL;}
+    PyObject *fp = PyObject_CallMethod(io, "open", "Os", source, "rb");
+    Py_DECREF(io);
+    if (!fp) {return NULL;}
+
+    PyObject *mapping = NULL;
+    PyObject *mmap = PyImport_ImportModule("mmap");
+    PyObject *fileno = PyObject_CallMethod(fp, "fileno", NULL);
+    if (mmap && fileno) {
+        PyObject *access = PyObject_GetAttrString(mmap, "ACCESS_READ");
+        PyObject *kwargs = access ? \
+            Py_BuildValue("{sO}", "access", access) : NULL;
+        PyObject *args = Py_BuildValue("(Oi)", fileno, 0);
+        PyObject *mmap_type = PyObject_GetAttrString(mmap, "mmap");
+        if (kwargs && args && mmap_type) {
+            mapping = PyObject_Call(mmap_type, args, kwargs);
+        }
+        Py_XDECREF(access);
+        Py_XDECREF(kwargs);
+        Py_XDECREF(args);
+        Py_XDECREF(mmap_type);
+    }
+    Py_XDECREF(mmap);
+    Py_XDECREF(fileno);
+
+    /* the mapping stays valid after the file is closed */
+    PyObject *exc_type, *exc_value, *exc_tb;
+    PyErr_Fetch(&exc_type, &exc_value, &exc_tb);
+    PyObject *result = PyObject_CallMethod(fp, "close", NULL);
+    Py_DECREF(fp);
+    if (exc_type) {
+        Py_XDECREF(result);
+        PyErr_Restore(exc_type, exc_value, exc_tb);
+        Py_XDECREF(mapping);
+        return NULL;
+    }
+    if (!result) {
+        Py_XDECREF(mapping);
+        return NULL;
+    }
+    Py_DECREF(result);
+
+    /* nobody else holds the mapping, so it can be indexed in place */
+    PyObject *self = MoraIndex_from_owner_(type, mapping, 1);
+    Py_DECREF(mapping);
+    return self;
+}
+
+
+static PySequenceMethods moraindex_as_sequence = {
+    .sq_length = (lenfunc)MoraIndex_length,
+};
+
+static PyMethodDef MoraIndex_methods[] = {
+    {"count", (PyCFunction)MoraIndex_count,
+     METH_O, PyDoc_STR(
+     "count($self, morastr, /)\n"
+     "--\n\n"
+     "Returns the number of occurrences of morastr in all the documents. \n"
+     "Unlike MoraStr.count(), overlapping occurrences are counted as well.")},
+    {"load", (PyCFunction)MoraIndex_load,
+     METH_O | METH_CLASS, PyDoc_STR(
+     "load($type, source, /)\n"
+     "--\n\n"
+     "Returns an index from the image written by MoraIndex.save(). If \n"
+     "source is a path, the file is memory-mapped read-only instead of \n"
+     "being read into memory. A bytes-like object is also accepted; it is \n"
+     "copied unless it is backed by bytes.")},
+    {"locate", (PyCFunction)MoraIndex_locate,
+     METH_O, PyDoc_STR(
+     "locate($self, morastr, /)\n"
+     "--\n\n"
+     "Returns a sorted list of (doc_id, index) pairs, where doc_id is the \n"
+     "position of the document in the original iterable and index is the \n"
+     "mora offset of the occurrence within that document.")},
+    {"save", (PyCFunction)MoraIndex_save,
+     METH_O, PyDoc_STR(
+     "save($self, file, /)\n"
+     "--\n\n"
+     "Writes the index image to file, which may be a path or a binary \n"
+     "file object. The image uses the native byte order.")},
+    {NULL, NULL}
+};
+
+static PyTypeObject MoraIndexType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraIndex",
+    .tp_basicsize = sizeof(MoraIndexObject),
+    .tp_dealloc = (destructor)MoraIndex_dealloc,
+    .tp_as_sequence = &moraindex_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "MoraIndex(documents: Iterable[str | MoraStr]) -> MoraIndex\n" \
+     "\n" \
+     "Builds a suffix array over the mora boundaries of many documents so \n"
+     "that occurrences of a sub-morastr can be counted and located without \n"
+     "scanning the documents. A query takes O(m log n) time, where m is \n"
+     "the length of the pattern and n is the total number of morae."),
+    .tp_methods = MoraIndex_methods,
+    .tp_new = (newfunc)MoraIndex_new,
+};
+
+
+/*********************** MoraStrArray **************************/
+typedef struct {
+    PyObject_VAR_HEAD
+    uint8_t *text;
+    MINDEX_T *char_off;
+    MINDEX_T *mora_off;
+    MINDEX_T *bounds;
+    PyObject *owner;    /* of the four arrays above if not NULL */
+} MoraStrArrayObject;
+
+static PyTypeObject MoraStrArrayType;
+
+
+/* Each element i occupies text[char_off[i]:char_off[i+1]] and has
+   mora_off[i+1] - mora_off[i] morae. bounds[mora_off[i]:mora_off[i+1]]
+   holds the end offset of each mora relative to the element, i.e. what
+   MoraStrObject.indices would be, but it is never omitted.
+   Every character of a MoraStr lies in the KATAKANA_RNG block, so text
+   keeps one byte per character, its KANA_ID, instead of UCS-2. Elements
+   are decoded when they are taken out, and searches encode the pattern
+   instead. */
+
+#define MoraStrArray_CHARS(a, i) ((a)->text + (a)->char_off[(i)])
+#define MoraStrArray_CHAR_LEN(a, i) \
+    ((Py_ssize_t)((a)->char_off[(i)+1] - (a)->char_off[(i)]))
+#define MoraStrArray_BOUNDS(a, i) ((a)->bounds + (a)->mora_off[(i)])
+#define MoraStrArray_MORA_CNT(a, i) \
+    ((Py_ssize_t)((a)->mora_off[(i)+1] - (a)->mora_off[(i)]))
+
+
+typedef struct {
+    uint8_t *text;
+    MINDEX_T *char_off;
+    MINDEX_T *mora_off;
+    MINDEX_T *bounds;
+    Py_ssize_t n, n_cap;
+    Py_ssize_t text_len, text_cap;
+    Py_ssize_t bounds_len, bounds_cap;
+} MoraStrArrayBuilder;
+
+
+static int
+MoraStrArray_grow_(void **p, Py_ssize_t *cap, Py_ssize_t need, size_t size) {
+    if (need <= *cap) {return 0;}
+    if (need > MINDEX_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "array is too large");
+        return -1;
+    }
+    Py_ssize_t new_cap = *cap ? *cap : 16;
+    while (new_cap < need) {new_cap *= 2;}
+    if (new_cap > MINDEX_MAX) {new_cap = MINDEX_MAX;}
+    char *q = *p;
+    MoraStr_RESIZE(q, char, size * (size_t)(new_cap + 1));
+    if (!q) {  /* *p is left intact */
+        PyErr_NoMemory();
+        return -1;
+    }
+    *p = q;
+    *cap = new_cap;
+    return 0;
+}
+
+
+static int
+MoraStrArrayBuilder_init(MoraStrArrayBuilder *b, Py_ssize_t n_hint) {
+    memset(b, 0, sizeof(MoraStrArrayBuilder));
+    Py_ssize_t cap = 0;
+    n_hint = n_hint > 0 ? n_hint : 1;
+    if (MoraStrArray_grow_((void **)&b->char_off, &cap,
+                           n_hint, sizeof(MINDEX_T)) < 0) {return -1;}
+    cap = 0;
+    if (MoraStrArray_grow_((void **)&b->mora_off, &cap,
+                           n_hint, sizeof(MINDEX_T)) < 0) {return -1;}
+    b->n_cap = cap;
+    b->char_off[0] = b->mora_off[0] = 0;
+    return 0;
+}
+
+
+static void
+MoraStrArrayBuilder_clear(MoraStrArrayBuilder *b) {
+    MoraStr_Free(b->text);
+    MoraStr_Free(b->char_off);
+    MoraStr_Free(b->mora_off);
+    MoraStr_Free(b->bounds);
+    memset(b, 0, sizeof(MoraStrArrayBuilder));
+}
+
+
+/* Appends an element of s_len characters, which the caller then writes
+   to *codes. */
+static int
+MoraStrArrayBuilder_add_(
+    MoraStrArrayBuilder *b, Py_ssize_t s_len,
+    Py_ssize_t mora_cnt, const MINDEX_T *indices, uint8_t **codes)
+{
+    Py_ssize_t cap = b->n_cap;
+    if (MoraStrArray_grow_((void **)&b->char_off, &cap,
+                           b->n + 1, sizeof(MINDEX_T)) < 0) {return -1;}
+    cap = b->n_cap;
+    if (MoraStrArray_grow_((void **)&b->mora_off, &cap,
+                           b->n + 1, sizeof(MINDEX_T)) < 0) {return -1;}
+    b->n_cap = cap;
+    if (MoraStrArray_grow_((void **)&b->text, &b->text_cap,
+            b->text_len + s_len, sizeof(uint8_t)) < 0) {return -1;}
+    if (MoraStrArray_grow_((void **)&b->bounds, &b->bounds_cap,
+            b->bounds_len + mora_cnt, sizeof(MINDEX_T)) < 0) {return -1;}
+
+    if (s_len) {
+        INDICES_FILL_COPY(b->bounds + b->bounds_len,
+                          (MINDEX_T *)indices, mora_cnt, 0);
+    }
+    *codes = b->text + b->text_len;
+    b->text_len += s_len;
+    b->bounds_len += mora_cnt;
+    b->n++;
+    b->char_off[b->n] = MINDEX(b->text_len);
+    b->mora_off[b->n] = MINDEX(b->bounds_len);
+    return 0;
+}
+
+
+static int
+MoraStrArrayBuilder_append(
+    MoraStrArrayBuilder *b, const Katakana *s, Py_ssize_t s_len,
+    Py_ssize_t mora_cnt, const MINDEX_T *indices)
+{
+    uint8_t *codes;
+    if (MoraStrArrayBuilder_add_(b, s_len, mora_cnt, indices, &codes) < 0) {
+        return -1;
+    }
+    for (Py_ssize_t i = 0; i < s_len; ++i) {
+        MoraStr_assert(is_zenkaku_katakana(s[i]));
+        codes[i] = (uint8_t)KANA_ID(s[i]);
+    }
+    return 0;
+}
+
+
+static int
+MoraStrArrayBuilder_append_codes(
+    MoraStrArrayBuilder *b, const uint8_t *s, Py_ssize_t s_len,
+    Py_ssize_t mora_cnt, const MINDEX_T *indices)
+{
+    uint8_t *codes;
+    if (MoraStrArrayBuilder_add_(b, s_len, mora_cnt, indices, &codes) < 0) {
+        return -1;
+    }
+    if (s_len) {memcpy(codes, s, s_len);}
+    return 0;
+}
+
+
+static PyObject *
+MoraStrArrayBuilder_finish(MoraStrArrayBuilder *b, PyTypeObject *type) {
+    MoraStrArrayObject *self = (MoraStrArrayObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        MoraStrArrayBuilder_clear(b);
+        return NULL;
+    }
+    Py_SET_SIZE(self, b->n);
+    self->text = b->text;
+    self->char_off = b->char_off;
+    self->mora_off = b->mora_off;
+    self->bounds = b->bounds;
+    memset(b, 0, sizeof(MoraStrArrayBuilder));
+    return (PyObject *)self;
+}
+
+
+static int
+MoraStrArrayBuilder_append_object(MoraStrArrayBuilder *b, PyObject *obj) {
+    static const char *err_fmt = \
+        "elements must be kana strings or MoraStr objects, not '%.200s'";
+
+    if (MoraStr_Check(obj)) {
+        PyObject *string = MoraStr_STRING(obj);
+        Py_ssize_t length = PyUnicode_GET_LENGTH(string);
+        return MoraStrArrayBuilder_append(b,
+            length ? KatakanaArray_from_str(string) : NULL, length,
+            Py_SIZE(obj), MoraStr_INDICES(obj));
+    } else if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, err_fmt, Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+
+    PyObject *string = normalize_text(obj, true);
+    if (!string) {return -1;}
+    MINDEX_T *indices = NULL;
+    Py_ssize_t length = PyUnicode_GET_LENGTH(string), mora_cnt;
+    mora_cnt = length ? count_morae(string, length, &indices) : 0LL;
+    int status = -1;
+    if (mora_cnt != -1) {
+        status = MoraStrArrayBuilder_append(b,
+            length ? KatakanaArray_from_str(string) : NULL, length,
+            mora_cnt, indices);
+    }
+    MoraStr_INDICES_DEL(indices);
+    Py_DECREF(string);
+    return status;
+}
+
+
+static PyObject *
+MoraStrArray_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+
+    PyObject *iterable = NULL;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "|O", kwlist, &iterable)) {
+        return NULL;
+    }
+
+    MoraStrArrayBuilder builder;
+    Py_ssize_t n_hint = iterable ? PyObject_LengthHint(iterable, 16) : 0;
+    if (n_hint < 0) {return NULL;}
+    if (MoraStrArrayBuilder_init(&builder, n_hint) < 0) {
+        MoraStrArrayBuilder_clear(&builder);
+        return NULL;
+    }
+    if (iterable) {
+        PyObject *it = PyObject_GetIter(iterable);
+        if (!it) {goto error;}
+        PyObject *item;
+        while ((item = PyIter_Next(it))) {
+            int status = MoraStrArrayBuilder_append_object(&builder, item);
+            Py_DECREF(item);
+            if (status < 0) {
+                Py_DECREF(it);
                 goto error;
             }
         }
-        PyTuple_SET_ITEM(seq, i, item);
+        Py_DECREF(it);
+        if (PyErr_Occurred()) {goto error;}
     }
-    if (nargs == 1) {
-        string = PyTuple_GET_ITEM(seq, 0);
-        Py_INCREF(string);
+    return MoraStrArrayBuilder_finish(&builder, type);
+
+error:
+    MoraStrArrayBuilder_clear(&builder);
+    return NULL;
+}
+
+
+static void
+MoraStrArray_dealloc(MoraStrArrayObject *self) {
+    if (self->owner) {
+        Py_DECREF(self->owner);
     } else {
-        string = PyUnicode_Join(empty_str, seq);
-        if (!string) {goto error;}
+        MoraStr_Free(self->text);
+        MoraStr_Free(self->char_off);
+        MoraStr_Free(self->mora_off);
+        MoraStr_Free(self->bounds);
     }
-    Py_CLEAR(seq);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
 
-    PyObject *morastr;
-    BoolPred ignore = false;
-    if (IS_MORASTR_TYPE(type)) {
-        if (kwds) {
-            PyObject *dummy = PyTuple_New(0);
-            if (!dummy) {goto error;}
-            bool result = PyArg_ParseTupleAndKeywords(
-                dummy, kwds, "|$p", kwlist, &ignore);
-            Py_DECREF(dummy);
-            if (!result) {goto error;}
-        }
-        morastr = MoraStr_from_unicode_(string, !ignore);
+
+static Py_ssize_t
+MoraStrArray_length(MoraStrArrayObject *self) {
+    return Py_SIZE(self);
+}
+
+
+static PyObject *
+MoraStrArray_item(MoraStrArrayObject *self, Py_ssize_t i) {
+    if (i < 0 || i >= Py_SIZE(self)) {
+        PyErr_SetString(PyExc_IndexError,
+            "MoraStrArray index out of range");
+        return NULL;
+    }
+    Py_ssize_t mora_cnt = MoraStrArray_MORA_CNT(self, i);
+    if (!mora_cnt) {return Empty_MoraStr();}
+
+    Py_ssize_t length = MoraStrArray_CHAR_LEN(self, i);
+    PyObject *string = PyUnicode_New(length, 0xffff);
+    if (!string) {return NULL;}
+    Katakana *buf = KatakanaArray_from_str(string);
+    const uint8_t *codes = MoraStrArray_CHARS(self, i);
+    for (Py_ssize_t k = 0; k < length; ++k) {
+        buf[k] = (Katakana)(KATAKANA_OFF + codes[k]);
+    }
+    MINDEX_T *indices = NULL;
+    if (length != mora_cnt) {
+        indices = MoraStr_INDICES_ALLOC(mora_cnt);
+        if (!indices) {
+            Py_DECREF(string);
+            return NULL;
+        }
+        memcpy(indices, MoraStrArray_BOUNDS(self, i),
+               sizeof(MINDEX_T)*mora_cnt);
+    }
+    MoraStrObject *morastr = \
+        (MoraStrObject *)MoraStrType.tp_alloc(&MoraStrType, 0);
+    if (!morastr) {
+        Py_DECREF(string);
+        MoraStr_INDICES_DEL(indices);
+        return NULL;
+    }
+    Py_SET_SIZE(morastr, mora_cnt);
+    morastr->string = string;
+    morastr->indices = indices;
+    return (PyObject *)morastr;
+}
+
+
+static PyObject *
+new_typed_array(const char *typecode, const void *data, Py_ssize_t nbytes) {
+    PyObject *module = PyImport_ImportModule("array");
+    if (!module) {return NULL;}
+    PyObject *result = PyObject_CallMethod(module, "array", "s", typecode);
+    Py_DECREF(module);
+    if (!result || !nbytes) {return result;}
+
+    PyObject *view = PyMemoryView_FromMemory(
+        (char *)data, nbytes, PyBUF_READ);
+    if (!view) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    PyObject *status = PyObject_CallMethod(result, "frombytes", "O", view);
+    Py_DECREF(view);
+    if (!status) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    Py_DECREF(status);
+    return result;
+}
+
+
+/* Searches element i for the encoded pattern p with the same engines as
+   generic_katakana_search and generic_mora_search, instantiated over the
+   codes. Like them, returns the mora index of the first match (or -1) if
+   count is negative, and otherwise count minus the number of
+   non-overlapping matches. */
+static Py_ssize_t
+MoraStrArray_search_(
+    MoraStrArrayObject *self, Py_ssize_t i,
+    const uint8_t *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t count)
+{
+    Py_ssize_t s_len = MoraStrArray_CHAR_LEN(self, i);
+    Py_ssize_t mora_cnt = MoraStrArray_MORA_CNT(self, i);
+    if (s_len < p_len || mora_cnt < p_moracnt) {return count;}
+    const uint8_t *s = MoraStrArray_CHARS(self, i);
+    const MINDEX_T *bounds = MoraStrArray_BOUNDS(self, i);
+
+    if (s_len == mora_cnt) {
+        if (p_len != p_moracnt) {return count;}
+        int algorithm = select_search_algorithm(
+            s_len, p_len, 0, USING_KANA_SEARCH);
+        if (algorithm == SEARCH_TWOWAY) {
+            return two_way_search_code(s, s_len, p, p_len, 0, count);
+        }
+        if (algorithm == SEARCH_BITAP) {
+            return bitap_search_uint32_t_code(s, s_len, p, p_len, 0, count);
+        }
+        if (algorithm == SEARCH_BITAP64) {
+            return bitap_search_uint64_t_code(s, s_len, p, p_len, 0, count);
+        }
+        if (algorithm == SEARCH_BITAP128) {
+            return bitap_search_bitvec128_t_code(
+                s, s_len, p, p_len, 0, count);
+        }
+        if (algorithm == SEARCH_BITAP256) {
+            return bitap_search_bitvec256_t_code(
+                s, s_len, p, p_len, 0, count);
+        }
     } else {
-        PyObject *new_args = PyTuple_Pack(1, string);
-        if (!new_args) {goto error;}
-        morastr = PyObject_Call((PyObject *)type, new_args, kwds);
-        Py_DECREF(new_args);
+        int algorithm = select_search_algorithm(
+            s_len, p_len, 0, USING_MORA_SEARCH);
+        if (algorithm == SEARCH_TWOWAY) {
+            return two_way_mora_search_code(
+                s, s_len, p, p_len, 0, p_moracnt, bounds, count);
+        }
+        if (algorithm == SEARCH_BITAP) {
+            return bitap_mora_search_uint32_t_code(
+                s, s_len, p, p_len, 0, p_moracnt, bounds, count);
+        }
+        if (algorithm == SEARCH_BITAP64) {
+            return bitap_mora_search_uint64_t_code(
+                s, s_len, p, p_len, 0, p_moracnt, bounds, count);
+        }
+        if (algorithm == SEARCH_BITAP128) {
+            return bitap_mora_search_bitvec128_t_code(
+                s, s_len, p, p_len, 0, p_moracnt, bounds, count);
+        }
+        if (algorithm == SEARCH_BITAP256) {
+            return bitap_mora_search_bitvec256_t_code(
+                s, s_len, p, p_len, 0, p_moracnt, bounds, count);
+        }
     }
-    if (!morastr) {goto error;}
-    Py_DECREF(empty_str);
-    Py_DECREF(string);
-    return morastr;
+
+    /* short patterns or elements: only mora starts can begin a match,
+       and bounds tells at once whether the candidate spans exactly
+       p_moracnt morae, so the codes are compared only there */
+
+    uint8_t head = p[0];
+    Py_ssize_t k = 0, last = mora_cnt - p_moracnt;
+    while (k <= last) {
+        Py_ssize_t j = k ? bounds[k-1] : 0;
+        if (s[j] == head && bounds[k+p_moracnt-1] - j == p_len &&
+                !memcmp(s + j, p, p_len)) {
+            if (count < 0) {return k;}
+            if (!--count) {return 0;}
+            k += p_moracnt;
+        } else {
+            ++k;
+        }
+    }
+    return count < 0 ? -1 : count;
+}
+
+
+enum {
+    MoraStrArray_CONTAINS,
+    MoraStrArray_STARTSWITH,
+    MoraStrArray_FIND,
+    MoraStrArray_FIND_CHARWISE,
+    MoraStrArray_COUNT,
+};
+
+static PyObject *
+MoraStrArray_map_(MoraStrArrayObject *self, PyObject *submora, int op) {
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
+    Py_ssize_t submora_cnt, substr_len;
+    PyObject *substr = parse_submora(
+        submora, &submora_cnt, &substr_len, err_fmt);
+    if (!substr && submora_cnt) {return NULL;}
+
+    Py_ssize_t n = Py_SIZE(self);
+    bool is_bool = (op == MoraStrArray_CONTAINS ||
+                    op == MoraStrArray_STARTSWITH);
+    size_t itemsize = is_bool ? sizeof(unsigned char) : sizeof(MINDEX_T);
+    void *out = MoraStr_Malloc(itemsize * (size_t)(n ? n : 1));
+    if (!out) {
+        Py_XDECREF(substr);
+        return PyErr_NoMemory();
+    }
+    unsigned char *flags = (unsigned char *)out;
+    MINDEX_T *values = (MINDEX_T *)out;
+
+    if (!submora_cnt) {
+        for (Py_ssize_t i = 0; i < n; ++i) {
+            if (is_bool) {
+                flags[i] = 1;
+            } else {
+                values[i] = op == MoraStrArray_COUNT ? \
+                    MINDEX(MoraStrArray_MORA_CNT(self, i) + 1) : 0;
+            }
+        }
+        goto done;
+    }
+
+    const Katakana *substr_data = KatakanaArray_from_str(substr);
+    uint8_t *p = PyMem_Malloc(substr_len);
+    if (!p) {
+        MoraStr_Free(out);
+        Py_DECREF(substr);
+        return PyErr_NoMemory();
+    }
+    for (Py_ssize_t k = 0; k < substr_len; ++k) {
+        p[k] = (uint8_t)KANA_ID(substr_data[k]);
+    }
+    Py_ssize_t max_len = 0;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t len = MoraStrArray_CHAR_LEN(self, i);
+        if (max_len < len) {max_len = len;}
+    }
+    /* the needle is factorized once for all the elements */
+    if (op != MoraStrArray_STARTSWITH && select_search_algorithm(
+            max_len, substr_len, 0, USING_MORA_SEARCH) == SEARCH_TWOWAY &&
+            !two_way_prepare_code(p, substr_len, submora_cnt)) {
+        PyErr_SetString(PyExc_OverflowError, "substring is too long");
+        PyMem_Free(p);
+        MoraStr_Free(out);
+        Py_DECREF(substr);
+        return NULL;
+    }
+
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t result;
+        switch (op) {
+            case MoraStrArray_CONTAINS:
+                flags[i] = MoraStrArray_search_(
+                    self, i, p, substr_len, submora_cnt, -1) != -1;
+                break;
+            case MoraStrArray_STARTSWITH:
+                flags[i] = (
+                    MoraStrArray_MORA_CNT(self, i) >= submora_cnt &&
+                    MoraStrArray_BOUNDS(self, i)[submora_cnt-1] == \
+                        MINDEX(substr_len) &&
+                    !memcmp(MoraStrArray_CHARS(self, i), p, substr_len));
+                break;
+            case MoraStrArray_FIND:
+            case MoraStrArray_FIND_CHARWISE:
+                result = MoraStrArray_search_(
+                    self, i, p, substr_len, submora_cnt, -1);
+                if (op == MoraStrArray_FIND_CHARWISE && 0 < result) {
+                    result = MoraStrArray_BOUNDS(self, i)[result-1];
+                }
+                values[i] = MINDEX(result);
+                break;
+            case MoraStrArray_COUNT:
+                result = MoraStrArray_search_(
+                    self, i, p, substr_len, submora_cnt, PY_SSIZE_T_MAX);
+                values[i] = MINDEX(PY_SSIZE_T_MAX - result);
+                break;
+            default: MoraStr_assert(false);
+        }
+    }
+    two_way_set_needle_code(NULL);
+    PyMem_Free(p);
+
+done:
+    Py_XDECREF(substr);
+    PyObject *result = new_typed_array(
+        is_bool ? "B" : "i", out, (Py_ssize_t)itemsize * n);
+    MoraStr_Free(out);
+    return result;
+}
+
+
+static PyObject *
+MoraStrArray_contains(MoraStrArrayObject *self, PyObject *submora) {
+    return MoraStrArray_map_(self, submora, MoraStrArray_CONTAINS);
+}
+
+static PyObject *
+MoraStrArray_startswith(MoraStrArrayObject *self, PyObject *prefix) {
+    return MoraStrArray_map_(self, prefix, MoraStrArray_STARTSWITH);
+}
+
+static PyObject *
+MoraStrArray_count(MoraStrArrayObject *self, PyObject *submora) {
+    return MoraStrArray_map_(self, submora, MoraStrArray_COUNT);
+}
+
+static PyObject *
+MoraStrArray_find(MoraStrArrayObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", "charwise", NULL};
+
+    PyObject *submora;
+    BoolPred charwise = false;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "O|$p", kwlist, &submora, &charwise)) {
+        return NULL;
+    }
+    return MoraStrArray_map_(self, submora,
+        charwise ? MoraStrArray_FIND_CHARWISE : MoraStrArray_FIND);
+}
+
+
+static PyObject *
+MoraStrArray_lengths(MoraStrArrayObject *self, PyObject *Py_UNUSED(ignored)) {
+    Py_ssize_t n = Py_SIZE(self);
+    MINDEX_T *out = MoraStr_Malloc(sizeof(MINDEX_T) * (size_t)(n ? n : 1));
+    if (!out) {return PyErr_NoMemory();}
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        out[i] = self->mora_off[i+1] - self->mora_off[i];
+    }
+    PyObject *result = new_typed_array("i", out, sizeof(MINDEX_T) * n);
+    MoraStr_Free(out);
+    return result;
 }
 
+
+static PyObject *
+MoraStrArray_slice(MoraStrArrayObject *self, PyObject *args) {
+    PyObject *arg_x = Py_None, *arg_y = Py_None;
+    if (!PyArg_ParseTuple(args, "|OO:slice", &arg_x, &arg_y)) {return NULL;}
+
+    Py_ssize_t start = 0, end = PY_SSIZE_T_MAX;
+    if (!MoraStr_SliceIndex(arg_x, &start)) {return NULL;}
+    if (!MoraStr_SliceIndex(arg_y, &end)) {return NULL;}
+
+    Py_ssize_t n = Py_SIZE(self);
+    MoraStrArrayBuilder builder;
+    if (MoraStrArrayBuilder_init(&builder, n) < 0) {
+        MoraStrArrayBuilder_clear(&builder);
+        return NULL;
+    }
+    /* reserve the exact sizes so that appending never reallocates */
+    Py_ssize_t text_len = 0, bounds_len = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (Py_ssize_t i = 0; i < n; ++i) {
+            Py_ssize_t a = start, b = end;
+            PySlice_AdjustIndices(MoraStrArray_MORA_CNT(self, i), &a, &b, 1);
+            if (b < a) {b = a;}
+            const MINDEX_T *bounds = MoraStrArray_BOUNDS(self, i);
+            Py_ssize_t s_a = a ? bounds[a-1] : 0LL;
+            Py_ssize_t s_b = b ? bounds[b-1] : 0LL;
+            if (!pass) {
+                text_len += s_b - s_a;
+                bounds_len += b - a;
+                continue;
+            }
+            Py_ssize_t pos = builder.bounds_len;
+            if (MoraStrArrayBuilder_append_codes(&builder,
+                    MoraStrArray_CHARS(self, i) + s_a, s_b - s_a,
+                    b - a, bounds + a) < 0) {goto error;}
+            for (Py_ssize_t k = pos; k < builder.bounds_len; ++k) {
+                builder.bounds[k] -= MINDEX(s_a);
+            }
+        }
+        if (!pass) {
+            if (MoraStrArray_grow_((void **)&builder.text,
+                    &builder.text_cap, text_len, sizeof(uint8_t)) < 0 ||
+                MoraStrArray_grow_((void **)&builder.bounds,
+                    &builder.bounds_cap, bounds_len, sizeof(MINDEX_T)) < 0)
+            {
+                goto error;
+            }
+        }
+    }
+    return MoraStrArrayBuilder_finish(&builder, Py_TYPE(self));
+
 error:
-    Py_DECREF(empty_str);
-    Py_XDECREF(seq);
-    Py_XDECREF(string);
+    MoraStrArrayBuilder_clear(&builder);
     return NULL;
 }
 
 
-static PySequenceMethods morastr_as_sequence = {
-    .sq_length = (lenfunc)MoraStr_length,
-    .sq_concat = (binaryfunc)MoraStr_concat,
-    .sq_repeat = (ssizeargfunc)MoraStr_repeat,
-    .sq_item = (ssizeargfunc)MoraStr_sq_item,
-    .sq_contains = (objobjproc)MoraStr_contains,
-};
+static PyObject *
+MoraStrArray_to_bytes(MoraStrArrayObject *self, PyObject *Py_UNUSED(ignored)) {
+    Py_ssize_t n = Py_SIZE(self);
+    Py_ssize_t text_len = self->char_off[n], n_morae = self->mora_off[n];
+    Py_ssize_t size = 2 + mora_pack_varint_size(n) + \
+        mora_pack_varint_size(text_len) + mora_pack_varint_size(n_morae) + \
+        text_len + (n_morae + 3) / 4;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        size += mora_pack_varint_size(MoraStrArray_CHAR_LEN(self, i)) + \
+                mora_pack_varint_size(MoraStrArray_MORA_CNT(self, i));
+    }
+    PyObject *result = PyBytes_FromStringAndSize(NULL, size);
+    if (!result) {return NULL;}
 
-static PyMappingMethods morastr_as_mapping = {
-    .mp_length = (lenfunc)MoraStr_length,
-    .mp_subscript = (binaryfunc)MoraStr_subscript,
-};
+    unsigned char *p = (unsigned char *)PyBytes_AS_STRING(result);
+    *p++ = MORAPACK_ARRAY;
+    *p++ = MORAPACK_VERSION;
+    p = mora_pack_varint(p, n);
+    p = mora_pack_varint(p, text_len);
+    p = mora_pack_varint(p, n_morae);
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        p = mora_pack_varint(p, MoraStrArray_CHAR_LEN(self, i));
+        p = mora_pack_varint(p, MoraStrArray_MORA_CNT(self, i));
+    }
+    /* the text is already kept as one code per character */
+    if (text_len) {memcpy(p, self->text, text_len);}
+    p += text_len;
+    memset(p, 0, (n_morae + 3) / 4);
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        mora_pack_lengths(p, self->mora_off[i],
+            MoraStrArray_BOUNDS(self, i), MoraStrArray_MORA_CNT(self, i));
+    }
+    return result;
+}
 
-static PyObject *MoraStr_finditer(PyObject *, PyObject *, PyObject *);
 
-static PyMethodDef MoraStr_methods[] = {
-    {"__getitem__", (PyCFunction)MoraStr_subscript,
-     METH_O | METH_COEXIST, PyDoc_STR(
-     "__getitem__($self, index, /)\n"
-     "--\n\n"
-     "Return self[index]")},
-    {"__getnewargs__", (PyCFunction)MoraStr___getnewargs__,
-     METH_NOARGS, PyDoc_STR(
-     "__getnewargs__($self, /)\n"
-     "--\n\n")},
-    {"__reduce__", (PyCFunction)MoraStr___reduce__,
+static PyObject *
+MoraStrArray_from_bytes(PyTypeObject *type, PyObject *obj) {
+    Py_buffer view;
+    if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) < 0) {return NULL;}
+
+    MoraStrArrayBuilder builder;
+    memset(&builder, 0, sizeof(MoraStrArrayBuilder));
+    const unsigned char *p = (const unsigned char *)view.buf;
+    const unsigned char *end = p + view.len;
+    Py_ssize_t n, text_len, n_morae;
+    if (!(p = mora_unpack_header(p, end, MORAPACK_ARRAY)) ||
+        !(p = mora_unpack_varint(p, end, &n)) ||
+        !(p = mora_unpack_varint(p, end, &text_len)) ||
+        !(p = mora_unpack_varint(p, end, &n_morae))) {goto error;}
+    /* each element takes two bytes at least */
+    if (n > (end - p) / 2 || text_len + (n_morae + 3) / 4 > end - p) {
+        goto malformed;
+    }
+    if (MoraStrArrayBuilder_init(&builder, n) < 0 ||
+        MoraStrArray_grow_((void **)&builder.text, &builder.text_cap,
+            text_len, sizeof(uint8_t)) < 0 ||
+        MoraStrArray_grow_((void **)&builder.bounds, &builder.bounds_cap,
+            n_morae, sizeof(MINDEX_T)) < 0) {goto error;}
+
+    const unsigned char *sizes = p;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t len, cnt;
+        if (!(p = mora_unpack_varint(p, end, &len)) ||
+            !(p = mora_unpack_varint(p, end, &cnt))) {goto error;}
+    }
+    const unsigned char *codes = p, *lengths = p + text_len;
+    if (end - p != text_len + (n_morae + 3) / 4) {goto malformed;}
+    if (mora_check_codes(codes, text_len) < 0) {goto error;}
+
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        Py_ssize_t len, cnt;
+        sizes = mora_unpack_varint(sizes, end, &len);
+        sizes = mora_unpack_varint(sizes, end, &cnt);
+        if (len > text_len - builder.text_len ||
+            cnt > n_morae - builder.bounds_len) {goto malformed;}
+        Py_ssize_t first = builder.bounds_len;
+        if (MoraStrArrayBuilder_append_codes(&builder,
+                codes + builder.text_len, len, cnt, NULL) < 0) {goto error;}
+        if (mora_unpack_lengths(builder.bounds + first,
+                lengths, first, cnt, len) < 0) {goto error;}
+    }
+    if (builder.text_len != text_len || builder.bounds_len != n_morae) {
+        goto malformed;
+    }
+    PyBuffer_Release(&view);
+    return MoraStrArrayBuilder_finish(&builder, type);
+
+malformed:
+    PyErr_SetString(PyExc_ValueError, "malformed packed data");
+error:
+    PyBuffer_Release(&view);
+    MoraStrArrayBuilder_clear(&builder);
+    return NULL;
+}
+
+
+static PyObject *
+MoraStrArray___reduce__(MoraStrArrayObject *self,
+        PyObject *Py_UNUSED(ignored))
+{
+    PyObject *from_bytes = \
+        PyObject_GetAttrString((PyObject *)Py_TYPE(self), "from_bytes");
+    if (!from_bytes) {return NULL;}
+    PyObject *data = MoraStrArray_to_bytes(self, NULL);
+    if (!data) {
+        Py_DECREF(from_bytes);
+        return NULL;
+    }
+    return Py_BuildValue("N(N)", from_bytes, data);
+}
+
+
+#if PY_VERSION_HEX >= 0x03080000
+/* With protocol 5, the four arrays are handed to pickle as they are, so
+   that they can be sent out of band and shared on load. */
+static PyObject *
+MoraStrArray___reduce_ex__(MoraStrArrayObject *self, PyObject *protocol_obj) {
+    /* stands in for the arrays that are not allocated when empty */
+    static MINDEX_T empty[1];
+
+    long protocol = PyLong_AsLong(protocol_obj);
+    if (protocol == -1 && PyErr_Occurred()) {return NULL;}
+    if (protocol < 5) {return MoraStrArray___reduce__(self, NULL);}
+
+    Py_ssize_t n = Py_SIZE(self);
+    struct {
+        void *buf;
+        const char *format;
+        Py_ssize_t itemsize, len;
+    } arrays[] = {
+        {self->text, "B", 1, self->char_off[n]},
+        {self->char_off, "i", sizeof(MINDEX_T), n + 1},
+        {self->mora_off, "i", sizeof(MINDEX_T), n + 1},
+        {self->bounds, "i", sizeof(MINDEX_T), self->mora_off[n]},
+    };
+    PyObject *args = PyTuple_New(5);
+    if (!args) {return NULL;}
+    PyTuple_SET_ITEM(args, 0, PyBool_FromLong(PY_LITTLE_ENDIAN));
+    for (int k = 0; k < 4; ++k) {
+        PyObject *view = MoraBuffer_view_((PyObject *)self,
+            arrays[k].buf ? arrays[k].buf : empty, arrays[k].format,
+            arrays[k].itemsize, arrays[k].len, 0);
+        if (!view) {goto error;}
+        PyObject *buffer = PyPickleBuffer_FromObject(view);
+        Py_DECREF(view);
+        if (!buffer) {goto error;}
+        PyTuple_SET_ITEM(args, k + 1, buffer);
+    }
+    PyObject *from_pickle_buffers = PyObject_GetAttrString(
+        (PyObject *)Py_TYPE(self), "_from_pickle_buffers");
+    if (!from_pickle_buffers) {goto error;}
+    return Py_BuildValue("NN", from_pickle_buffers, args);
+
+error:
+    Py_DECREF(args);
+    return NULL;
+}
+#endif
+
+
+/* Checks that the arrays of n elements, text_len characters and n_morae
+   morae make a valid MoraStrArray. As in MoraStr.from_buffers(), the
+   mora boundaries are trusted as long as they are in range. */
+static int
+MoraStrArray_check_arrays_(const uint8_t *text, const MINDEX_T *char_off,
+        const MINDEX_T *mora_off, const MINDEX_T *bounds, Py_ssize_t n,
+        Py_ssize_t text_len, Py_ssize_t n_morae)
+{
+    if (char_off[0] || mora_off[0] ||
+        char_off[n] != text_len || mora_off[n] != n_morae) {goto malformed;}
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        if (char_off[i+1] < char_off[i] || mora_off[i+1] < mora_off[i]) {
+            goto malformed;
+        }
+    }
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        MINDEX_T prev = 0;
+        for (MINDEX_T j = mora_off[i]; j < mora_off[i+1]; ++j) {
+            if (bounds[j] <= prev || bounds[j] - prev > MORA_CONTENT_MAX) {
+                goto malformed;
+            }
+            prev = bounds[j];
+        }
+        if (prev != char_off[i+1] - char_off[i]) {goto malformed;}
+    }
+    return mora_check_codes(text, text_len);
+
+malformed:
+    PyErr_SetString(PyExc_ValueError, "malformed pickle buffers");
+    return -1;
+}
+
+
+/* _from_pickle_buffers(little_endian, text, char_off, mora_off, bounds)
+   The arrays are used in place when they are read-only, suitably
+   aligned and of the native byte order; otherwise they are copied. */
+static PyObject *
+MoraStrArray__from_pickle_buffers(PyTypeObject *type, PyObject *const *args,
+        Py_ssize_t nargs)
+{
+    if (nargs != 5) {
+        PyErr_Format(PyExc_TypeError,
+            "_from_pickle_buffers expected 5 arguments, got %zd", nargs);
+        return NULL;
+    }
+    int little = PyObject_IsTrue(args[0]);
+    if (little < 0) {return NULL;}
+
+    /* the memoryviews keep the buffers exported while they are shared */
+    MoraStrArrayBuilder copy;
+    memset(&copy, 0, sizeof(MoraStrArrayBuilder));
+    PyObject *views = PyTuple_New(4);
+    if (!views) {return NULL;}
+    Py_buffer *bufs[4];
+    bool swap = little != PY_LITTLE_ENDIAN, shared = !swap;
+    for (int k = 0; k < 4; ++k) {
+        PyObject *view = PyMemoryView_FromObject(args[k+1]);
+        if (!view) {goto error;}
+        PyTuple_SET_ITEM(views, k, view);
+        bufs[k] = PyMemoryView_GET_BUFFER(view);
+        Py_ssize_t itemsize = k ? (Py_ssize_t)sizeof(MINDEX_T) : 1;
+        if (!PyBuffer_IsContiguous(bufs[k], 'C') || bufs[k]->len % itemsize) {
+            goto malformed;
+        }
+        if (!bufs[k]->readonly || (uintptr_t)bufs[k]->buf % itemsize) {
+            shared = false;
+        }
+    }
+    Py_ssize_t n = bufs[1]->len / (Py_ssize_t)sizeof(MINDEX_T) - 1;
+    Py_ssize_t text_len = bufs[0]->len;
+    Py_ssize_t n_morae = bufs[3]->len / (Py_ssize_t)sizeof(MINDEX_T);
+    if (n < 0 || bufs[2]->len != bufs[1]->len ||
+        text_len > MINDEX_MAX || n_morae > MINDEX_MAX) {goto malformed;}
+
+    if (shared) {
+        copy.text = (uint8_t *)bufs[0]->buf;
+        copy.char_off = (MINDEX_T *)bufs[1]->buf;
+        copy.mora_off = (MINDEX_T *)bufs[2]->buf;
+        copy.bounds = (MINDEX_T *)bufs[3]->buf;
+    } else {
+        void **dst[4] = {(void **)&copy.text, (void **)&copy.char_off,
+                         (void **)&copy.mora_off, (void **)&copy.bounds};
+        for (int k = 0; k < 4; ++k) {
+            /* one byte more, since an empty malloc() may give NULL */
+            *dst[k] = MoraStr_Malloc(bufs[k]->len + 1);
+            if (!*dst[k]) {
+                PyErr_NoMemory();
+                MoraStrArrayBuilder_clear(&copy);
+                goto error;
+            }
+            memcpy(*dst[k], bufs[k]->buf, bufs[k]->len);
+        }
+        if (swap) {
+            uint32_t *words[3] = {(uint32_t *)copy.char_off,
+                (uint32_t *)copy.mora_off, (uint32_t *)copy.bounds};
+            for (int k = 0; k < 3; ++k) {
+                Py_ssize_t cnt = bufs[k+1]->len / (Py_ssize_t)sizeof(uint32_t);
+                for (Py_ssize_t i = 0; i < cnt; ++i) {
+                    words[k][i] = MORAPACK_SWAP32(words[k][i]);
+                }
+            }
+        }
+    }
+    if (MoraStrArray_check_arrays_(copy.text, copy.char_off, copy.mora_off,
+            copy.bounds, n, text_len, n_morae) < 0) {
+        if (!shared) {MoraStrArrayBuilder_clear(&copy);}
+        goto error;
+    }
+
+    copy.n = n;
+    MoraStrArrayObject *self;
+    if (shared) {
+        self = (MoraStrArrayObject *)type->tp_alloc(type, 0);
+        if (!self) {goto error;}
+        Py_SET_SIZE(self, n);
+        self->text = copy.text;
+        self->char_off = copy.char_off;
+        self->mora_off = copy.mora_off;
+        self->bounds = copy.bounds;
+        self->owner = views;
+        return (PyObject *)self;
+    }
+    Py_DECREF(views);
+    return MoraStrArrayBuilder_finish(&copy, type);
+
+malformed:
+    PyErr_SetString(PyExc_ValueError, "malformed pickle buffers");
+error:
+    Py_DECREF(views);
+    return NULL;
+}
+
+
+static PySequenceMethods morastrarray_as_sequence = {
+    .sq_length = (lenfunc)MoraStrArray_length,
+    .sq_item = (ssizeargfunc)MoraStrArray_item,
+};
+
+static PyMethodDef MoraStrArray_methods[] = {
+    {"__reduce__", (PyCFunction)MoraStrArray___reduce__,
      METH_NOARGS, PyDoc_STR(
      "__reduce__($self, /)\n"
      "--\n\n"
      "Return state information for pickling.")},
-    {"char_indices", (PyCFunction)MoraStr_char_indices,
-     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
-     "char_indices($self, *, zero=False)\n"
-     "--\n\n"
-     "Returns a list of accumulative character counts of each mora. If \n"
-     "the keyword 'zero' is set to True, the list starts with 0 and thus \n"
-     "the total length of the returned list becomes len(self) + 1.")},
-    {"count", (PyCFunction)MoraStr_count,
-     METH_FASTCALL, PyDoc_STR(
-     "count($self, sub_morastr, start=0, end=sys.maxsize, /)\n"
-     "--\n\n"
-     "Returns the number of non-overlapping occurrences of sub_morastr in \n"
-     "the range of morastr[start:end]. If start exceeds len(morastr), 0 is \n"
-     "returned. The first argument sub_morastr must be a kana string or a \n"
-     "MoraStr object.")},
-    {"endswith", (PyCFunction)MoraStr_endswith,
-     METH_FASTCALL, PyDoc_STR(
-     "endswith($self, suffix, start=0, end=sys.maxsize, /)\n"
-     "--\n\n"
-     "Like str.endswith(), but mora-wise.")},
-    {"find", (PyCFunction)MoraStr_find,
-     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
-     "find($self, sub_morastr, start=0, end=sys.maxsize, /, *, charwise=False)\n"
-     "--\n\n"
-     "Returns the first mora index in the MoraStr object where sub_morastr \n"
-     "is found within the range of morastr[start:end]. The first argument \n"
-     "sub_morastr must be a kana string or a MoraStr object. The return \n"
-     "value points a position counting from the beginning of the whole mora \n"
-     "string, rather than counting from the index specified by the start \n"
-     "argument. If start exceeds len(morastr) or sub_morastr is not found, \n"
-     "-1 is returned. If keyword argument 'charwise' is set to True, the \n"
-     "index count is calculated based on the number of kana characters \n"
-     "instead of morae. The 'charwise' option is available only when \n"
-     "start/end arguments are not specified.")},
-    {"finditer", (PyCFunction)MoraStr_finditer,
-     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
-     "finditer($self, sub_morastr, /, *, charwise=False)\n"
+#if PY_VERSION_HEX >= 0x03080000
+    {"__reduce_ex__", (PyCFunction)MoraStrArray___reduce_ex__,
+     METH_O, PyDoc_STR(
+     "__reduce_ex__($self, protocol, /)\n"
      "--\n\n"
-     "Returns an iterator yielding indices that indicate non-overlapping \n"
-     "occurences for sub_morastr in self. The argument sub_morastr must be \n"
-     "a kana string or a MoraStr object. If sub_morastr contains more morae \n"
-     "than self, sub_morastr and self will be swapped and then searching \n"
-     "will be performed, leaving the original MoraStr object intact. If the \n"
-     "keyword argument 'charwise' is set to True, the index count is \n"
-     "calculated based on the number of kana characters instead of morae.\n")},
-    {"index", (PyCFunction)MoraStr_index,
-     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
-     "index($self, sub_morastr, start=0, end=sys.maxsize, / , *, charwise=False)\n"
+     "Helper for pickle.")},
+#endif
+    {"_from_pickle_buffers", (PyCFunction)MoraStrArray__from_pickle_buffers,
+     METH_FASTCALL | METH_CLASS, PyDoc_STR(
+     "_from_pickle_buffers($cls, *args)\n"
      "--\n\n"
-     "Same as MoraStr.find() except to raise an IndexError instead of \n"
-     "returning -1 when sub_morastr is not found. The relationship of \n"
-     "MoraStr.find() and MoraStr.index() is parallel to that of str.find() \n"
-     "and str.index().")},
-    {"removeprefix", (PyCFunction)MoraStr_removeprefix,
+     "Used by pickle protocol 5.")},
+    {"contains", (PyCFunction)MoraStrArray_contains,
      METH_O, PyDoc_STR(
-     "removeprefix($self, prefix, /)\n"
+     "contains($self, sub_morastr, /)\n"
      "--\n\n"
-     "If the MoraStr object starts with the prefix, returns \n"
-     "morastr[len(prefix):]. Otherwise, a copy of the original object \n"
-     "is returned.")},
-    {"removesuffix", (PyCFunction)MoraStr_removesuffix,
+     "Returns an array('B') whose i-th element is 1 if sub_morastr is \n"
+     "in self[i] and 0 otherwise.")},
+    {"count", (PyCFunction)MoraStrArray_count,
      METH_O, PyDoc_STR(
-     "removesuffix($self, suffix, /)\n"
-     "--\n\n"
-     "If the MoraStr object ends with the suffix, returns \n"
-     "morastr[:len(morastr)-len(suffix)]. Otherwise, a copy of the \n"
-     "original object is returned.")},
-    {"replace", (PyCFunction)MoraStr_replace,
-     METH_FASTCALL, PyDoc_STR(
-     "replace($self, old, new, maxcount=-1, /)\n"
+     "count($self, sub_morastr, /)\n"
      "--\n\n"
-     "Returns a copy of the MoraStr object with all occurrences of \n"
-     "submora-string 'old' replaced by 'new'. If 'maxcount' option is \n"
-     "set to a non-negative number, replacements are performed only \n"
-     "'maxcount' times starting from the left.")},
-    {"rfind", (PyCFunction)MoraStr_rfind,
+     "Returns an array('i') of self[i].count(sub_morastr).")},
+    {"find", (PyCFunction)MoraStrArray_find,
      METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
-     "rfind($self, sub_morastr, start=0, end=sys.maxsize, / , *, charwise=False)\n"
+     "find($self, sub_morastr, /, *, charwise=False)\n"
      "--\n\n"
-     "Returns the last mora index in the MoraStr object where sub_morastr \n"
-     "is found within the range of morastr[start:end]. The first argument \n"
-     "sub_morastr must be a kana string or a MoraStr object. If start \n"
-     "exceeds len(morastr) or sub_morastr is not found, -1 is returned. If \n"
-     "keyword argument 'charwise' is set to True, the index count is \n"
-     "calculated based on the number of kana characters instead of morae. \n"
-     "The 'charwise' option is available only when start/end arguments are \n"
-     "not specified.")},
-    {"rindex", (PyCFunction)MoraStr_rindex,
-     METH_VARARGS | METH_KEYWORDS, PyDoc_STR(
-     "rindex($self, sub_morastr, start=0, end=sys.maxsize, / , *, charwise=False)\n"
+     "Returns an array('i') of self[i].find(sub_morastr, charwise=charwise).")},
+    {"lengths", (PyCFunction)MoraStrArray_lengths,
+     METH_NOARGS, PyDoc_STR(
+     "lengths($self, /)\n"
      "--\n\n"
-     "Same as MoraStr.find() except to raise an IndexError instead of \n"
-     "returning -1 when sub_morastr is not found. The relationship of \n"
-     "MoraStr.rfind() and MoraStr.rindex() is parallel to that of \n"
-     "str.rfind() and str.rindex().")},
-    {"startswith", (PyCFunction)MoraStr_startswith,
-     METH_FASTCALL, PyDoc_STR(
-     "startswith($self, prefix, start=0, end=sys.maxsize, /)\n"
+     "Returns an array('i') of the number of morae in each element.")},
+    {"slice", (PyCFunction)MoraStrArray_slice,
+     METH_VARARGS, PyDoc_STR(
+     "slice($self, start=None, end=None, /)\n"
      "--\n\n"
-     "Like str.startswith(), but mora-wise.")},
-    {"tostr", (PyCFunction)MoraStr_tostr,
+     "Returns a new MoraStrArray whose i-th element is self[i][start:end].")},
+    {"startswith", (PyCFunction)MoraStrArray_startswith,
+     METH_O, PyDoc_STR(
+     "startswith($self, prefix, /)\n"
+     "--\n\n"
+     "Returns an array('B') whose i-th element is 1 if self[i] starts \n"
+     "with prefix and 0 otherwise.")},
+    {"to_bytes", (PyCFunction)MoraStrArray_to_bytes,
      METH_NOARGS, PyDoc_STR(
-     "tostr($self, /)\n"
+     "to_bytes($self, /)\n"
      "--\n\n"
-     "Returns the internal string representation of the MoraStr object.\n"
-     "\n"
-     "Note: In the current implementation, this method just returns the \n"
-     "value of the instance's 'string' member. It is intended to use it \n"
-     "with functions that require a callback as one of their arguments.\n")},
-    {"fromstrs", (PyCFunction)MoraStr_fromstrs,
-     METH_VARARGS | METH_KEYWORDS | METH_CLASS, PyDoc_STR(
-     "fromstrs($cls, *iterables, **kwargs)\n"
+     "Returns all the elements in the binary form of MoraStr.to_bytes(), \n"
+     "with their sizes gathered in front. Pickling uses this form.")},
+    {"from_bytes", (PyCFunction)MoraStrArray_from_bytes,
+     METH_O | METH_CLASS, PyDoc_STR(
+     "from_bytes($cls, data, /)\n"
      "--\n\n"
-     "Alternate constructor for MoraStr(). Returns a new MoraStr object \n"
-     "from multiple strings. This method takes an arbitrary number of \n"
-     "positional arguments, each of which must be an iterable of str \n"
-     "objects. Keyword arguments are treated in the same way as MoraStr(). \n"
-     "Roughly equivalent to:\n"
-     "\n"
-     "@classmethod\n"
-     "def fromstrs(cls, *iterables, **kwargs):\n"
-     "    return cls(''.join(''.join(it) for it in iterables), **kwargs)")},
-    {"count_all", (PyCFunction)MoraStr_count_all,
-     METH_VARARGS | METH_KEYWORDS | METH_STATIC,
-     morastr_count_all_docstring},
+     "Rebuilds a MoraStrArray from the bytes returned by to_bytes() \n"
+     "without analyzing the kana again.")},
     {NULL, NULL}
 };
 
-
-static PyMemberDef MoraStr_members[] = {
-    {"length", T_PYSSIZET, offsetof(PyVarObject, ob_size), READONLY, PyDoc_STR(
-     "morastr.length <==> len(morastr)")},
-    {"string", T_OBJECT_EX, offsetof(MoraStrObject, string), READONLY, PyDoc_STR(
-     "Underlying katakana representation of the MoraStr object as a plain \n"
-     "str object. All characters are guaranteed to be full-width (zenkaku) \n"
-     "and to not contain spaces.")},
-    {NULL}
+static PyTypeObject MoraStrArrayType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraStrArray",
+    .tp_basicsize = sizeof(MoraStrArrayObject),
+    .tp_dealloc = (destructor)MoraStrArray_dealloc,
+    .tp_as_sequence = &morastrarray_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "MoraStrArray(iterable: Iterable[str | MoraStr] = (), /) -> MoraStrArray\n" \
+     "\n" \
+     "A columnar sequence of mora strings. All elements share a single \n"
+     "katakana buffer, together with character and mora offset arrays, so \n"
+     "no Python object is kept per element. Indexing returns a MoraStr; \n"
+     "the vectorized methods return array.array objects."),
+    .tp_methods = MoraStrArray_methods,
+    .tp_new = (newfunc)MoraStrArray_new,
 };
 
-static PyObject *MoraStr_iter(PyObject *);
 
-static PyTypeObject MoraStrType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "morastrja.MoraStr",
-    .tp_basicsize = sizeof(MoraStrObject),
-    .tp_itemsize = 0,
-    .tp_dealloc = (destructor)MoraStr_dealloc,
-    .tp_repr = (reprfunc)MoraStr_repr,
-    .tp_as_sequence = &morastr_as_sequence,
-    .tp_as_mapping = &morastr_as_mapping,
-    .tp_hash = (hashfunc)MoraStr_hash,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+/*********************** MoraStrBuilder **************************/
+typedef struct {
+    PyObject_HEAD
+    PyObject *string;   /* UCS-2 str of length cap, filled up to len */
+    Py_ssize_t len, cap;
+    MINDEX_T *indices;
+    Py_ssize_t mora_cnt, indices_cap;
+} MoraStrBuilderObject;
+
+static PyTypeObject MoraStrBuilderType;
+
+
+/* Makes room for n more characters and morae. The str object is never
+   shared until build(), so it can be resized in place. */
+static int
+MoraStrBuilder_reserve_(MoraStrBuilderObject *self, Py_ssize_t n) {
+    Py_ssize_t need = self->len + n;
+    if (need > MINDEX_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "base string is too long");
+        return -1;
+    }
+    if (need > self->cap) {
+        Py_ssize_t new_cap = self->cap ? self->cap : 16;
+        while (new_cap < need) {new_cap *= 2;}
+        if (new_cap > MINDEX_MAX) {new_cap = MINDEX_MAX;}
+        if (!self->string) {
+            self->string = PyUnicode_New(new_cap, 0xffff);
+            if (!self->string) {return -1;}
+        } else if (PyUnicode_Resize(&self->string, new_cap) < 0) {
+            return -1;
+        }
+        self->cap = new_cap;
+    }
+    return MoraStrArray_grow_((void **)&self->indices, &self->indices_cap,
+                              self->mora_cnt + n, sizeof(MINDEX_T));
+}
+
+
+static int
+MoraStrBuilder_attach_(MoraStrBuilderObject *self,
+        const Katakana *src, Py_ssize_t src_len,
+        const MINDEX_T *src_indices, Py_ssize_t src_cnt)
+{
+    if (!src_len) {return 0;}
+    if (MoraStrBuilder_reserve_(self, src_len) < 0) {return -1;}
+    return MoraStr_attach_(
+        KatakanaArray_from_str(self->string), self->indices,
+        &self->len, &self->mora_cnt, src, src_len, src_indices, src_cnt);
+}
+
+
+/* Appends obj and returns the number of morae it consists of on its own,
+   or -1 on error. */
+static Py_ssize_t
+MoraStrBuilder_append_object_(MoraStrBuilderObject *self, PyObject *obj) {
+    static const char *err_fmt = \
+        "argument must be a kana string or a MoraStr object, not '%.200s'";
+
+    if (MoraStr_Check(obj)) {
+        PyObject *string = MoraStr_STRING(obj);
+        if (MoraStrBuilder_attach_(self, KatakanaArray_from_str(string),
+                PyUnicode_GET_LENGTH(string),
+                MoraStr_INDICES(obj), Py_SIZE(obj)) < 0) {return -1;}
+        return Py_SIZE(obj);
+    } else if (!PyUnicode_Check(obj)) {
+        PyErr_Format(PyExc_TypeError, err_fmt, Py_TYPE(obj)->tp_name);
+        return -1;
+    }
+
+    PyObject *string = normalize_text(obj, true);
+    if (!string) {return -1;}
+    MINDEX_T *indices = NULL;
+    Py_ssize_t length = PyUnicode_GET_LENGTH(string), mora_cnt;
+    mora_cnt = length ? \
+        count_morae_(string, length, &indices, !self->len) : 0LL;
+    if (mora_cnt != -1 && MoraStrBuilder_attach_(self,
+            length ? KatakanaArray_from_str(string) : NULL, length,
+            indices, mora_cnt) < 0) {
+        mora_cnt = -1;
+    }
+    MoraStr_INDICES_DEL(indices);
+    Py_DECREF(string);
+    return mora_cnt;
+}
+
+
+static PyObject *
+MoraStrBuilder_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+
+    PyObject *initial = NULL;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "|O", kwlist, &initial)) {
+        return NULL;
+    }
+    MoraStrBuilderObject *self;
+    self = (MoraStrBuilderObject *)type->tp_alloc(type, 0);
+    if (!self) {return NULL;}
+    if (initial && MoraStrBuilder_append_object_(self, initial) < 0) {
+        Py_DECREF(self);
+        return NULL;
+    }
+    return (PyObject *)self;
+}
+
+
+static void
+MoraStrBuilder_dealloc(MoraStrBuilderObject *self) {
+    Py_XDECREF(self->string);
+    MoraStr_Free(self->indices);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
+
+
+static Py_ssize_t
+MoraStrBuilder_length(MoraStrBuilderObject *self) {
+    return self->mora_cnt;
+}
+
+
+static PyObject *
+MoraStrBuilder_append(MoraStrBuilderObject *self, PyObject *obj) {
+    if (MoraStrBuilder_append_object_(self, obj) < 0) {return NULL;}
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+MoraStrBuilder_append_mora(MoraStrBuilderObject *self, PyObject *obj) {
+    if (PyUnicode_Check(obj) && PyUnicode_GET_LENGTH(obj) == 1) {
+        Py_UCS4 ch = PyUnicode_READ_CHAR(obj, 0);
+        if (is_zenkaku_katakana(ch)) {
+            Katakana k = (Katakana)ch;
+            if (!self->len && small_kana_vowel(k) && PyErr_WarnEx(
+                    PyExc_Warning,
+                    "base string starts with a small kana", 1) < 0) {
+                return NULL;
+            }
+            if (MoraStrBuilder_attach_(self, &k, 1, NULL, 1) < 0) {
+                return NULL;
+            }
+            Py_RETURN_NONE;
+        }
+    }
+
+    /* check before appending so that a failure leaves self untouched */
+    PyObject *mora = MoraStr_Check(obj) ? \
+        Py_NewRef(obj) : MoraStr_from_object_(obj,
+            "argument must be a kana string or a MoraStr object, "
+            "not '%.200s'");
+    if (!mora) {return NULL;}
+    if (Py_SIZE(mora) != 1) {
+        PyErr_Format(PyExc_ValueError,
+            "append_mora() expected a single mora, got %zd morae",
+            Py_SIZE(mora));
+        Py_DECREF(mora);
+        return NULL;
+    }
+    Py_ssize_t result = MoraStrBuilder_append_object_(self, mora);
+    Py_DECREF(mora);
+    if (result < 0) {return NULL;}
+    Py_RETURN_NONE;
+}
+
+
+static PyObject *
+MoraStrBuilder_extend(MoraStrBuilderObject *self, PyObject *iterable) {
+    PyObject *it = PyObject_GetIter(iterable);
+    if (!it) {return NULL;}
+    PyObject *item;
+    while ((item = PyIter_Next(it))) {
+        Py_ssize_t result = MoraStrBuilder_append_object_(self, item);
+        Py_DECREF(item);
+        if (result < 0) {
+            Py_DECREF(it);
+            return NULL;
+        }
+    }
+    Py_DECREF(it);
+    if (PyErr_Occurred()) {return NULL;}
+    Py_RETURN_NONE;
+}
+
+
+/* Hands the buffers over to a new MoraStr and leaves self empty. */
+static PyObject *
+MoraStrBuilder_build(MoraStrBuilderObject *self, PyObject *Py_UNUSED(ignored)) {
+    if (!self->mora_cnt) {return Empty_MoraStr();}
+
+    if (self->len != self->cap &&
+            PyUnicode_Resize(&self->string, self->len) < 0) {return NULL;}
+    self->cap = self->len;
+    MoraStrObject *morastr;
+    morastr = (MoraStrObject *)MoraStrType.tp_alloc(&MoraStrType, 0);
+    if (!morastr) {return NULL;}
+
+    MINDEX_T *indices = self->indices;
+    if (self->mora_cnt == self->len) {
+        MoraStr_INDICES_DEL(indices);
+    } else if (self->mora_cnt != self->indices_cap) {
+        MINDEX_T *adjusted = indices;
+        MoraStr_RESIZE(adjusted, MINDEX_T, self->mora_cnt);
+        if (adjusted) {indices = adjusted;}
+    }
+    Py_SET_SIZE(morastr, self->mora_cnt);
+    morastr->string = self->string;
+    morastr->indices = indices;
+
+    self->string = NULL;
+    self->indices = NULL;
+    self->len = self->cap = 0;
+    self->mora_cnt = self->indices_cap = 0;
+    return (PyObject *)morastr;
+}
+
+
+static PyObject *
+MoraStrBuilder_repr(MoraStrBuilderObject *self) {
+    PyObject *string = self->string ? \
+        PyUnicode_Substring(self->string, 0, self->len) : PyUnicode_New(0, 0);
+    if (!string) {return NULL;}
+    PyObject *repr = PyUnicode_FromFormat("MoraStrBuilder(%R)", string);
+    Py_DECREF(string);
+    return repr;
+}
+
+
+static PySequenceMethods morastrbuilder_as_sequence = {
+    .sq_length = (lenfunc)MoraStrBuilder_length,
+};
+
+static PyMethodDef MoraStrBuilder_methods[] = {
+    {"append", (PyCFunction)MoraStrBuilder_append,
+     METH_O, PyDoc_STR(
+     "append($self, morastr, /)\n"
+     "--\n\n"
+     "Appends a kana string or a MoraStr object. A leading small kana \n"
+     "attaches to the last mora, as it would in MoraStr(a + b).")},
+    {"append_mora", (PyCFunction)MoraStrBuilder_append_mora,
+     METH_O, PyDoc_STR(
+     "append_mora($self, mora, /)\n"
+     "--\n\n"
+     "Same as append(), but the argument must be a single mora. A single \n"
+     "katakana character is appended without any intermediate object.")},
+    {"build", (PyCFunction)MoraStrBuilder_build,
+     METH_NOARGS, PyDoc_STR(
+     "build($self, /)\n"
+     "--\n\n"
+     "Returns the accumulated morae as a MoraStr object. The buffers are \n"
+     "handed over to the result without copying, and the builder is left \n"
+     "empty.")},
+    {"extend", (PyCFunction)MoraStrBuilder_extend,
+     METH_O, PyDoc_STR(
+     "extend($self, iterable, /)\n"
+     "--\n\n"
+     "Appends each kana string or MoraStr object in iterable.")},
+    {NULL, NULL}
+};
+
+static PyTypeObject MoraStrBuilderType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraStrBuilder",
+    .tp_basicsize = sizeof(MoraStrBuilderObject),
+    .tp_dealloc = (destructor)MoraStrBuilder_dealloc,
+    .tp_repr = (reprfunc)MoraStrBuilder_repr,
+    .tp_as_sequence = &morastrbuilder_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
     .tp_doc = PyDoc_STR(
-     "MoraStr(kana_string: str | MoraStr = '',\n" \
-     "        /, *,\n" \
-     "        ignore: bool = False) -> MoraStr\n" \
+     "MoraStrBuilder(initial: str | MoraStr = '', /) -> MoraStrBuilder\n" \
      "\n" \
-     "Divides kana_string into fractions each of which corresponds to a \n"
-     "Japanese mora. kana_string must be a MoraStr object or a string \n"
-     "composed of Japanese kana syllabaries. Otherwise, the constructor \n"
-     "raises a ValueError unless 'ignore' parameter is set to True, in \n"
-     "which case, invalid characters are just skipped. All elements in \n"
-     "MoraStr objects are guaranteed to be full-width (zenkaku) katakana. \n"
-     "Hiragana and half-width (hankaku) katakana in the input string are \n"
-     "converted to proper forms.\n"
-     ""),
-    .tp_richcompare = (richcmpfunc)MoraStr_richcompare,
-    .tp_iter = MoraStr_iter,
-    .tp_methods = MoraStr_methods,
-    .tp_members = MoraStr_members,
-    .tp_new = (newfunc)MoraStr_new,
+     "A mutable buffer for assembling a MoraStr piece by piece. The \n"
+     "characters and mora boundaries grow geometrically, so appending is \n"
+     "amortized O(1) per character, and build() turns them into a MoraStr \n"
+     "without copying. len() returns the number of morae so far."),
+    .tp_methods = MoraStrBuilder_methods,
+    .tp_new = (newfunc)MoraStrBuilder_new,
 };
 
 
-/*********************** MoraStr Iterator **************************/
-typedef struct {
+/*********************** MoraRope **************************/
+/* An immutable rope over MoraStr leaves. Inner nodes cache the mora and
+ * character counts of their subtree and are kept height-balanced (AVL),
+ * so indexing, slicing and concatenation only touch O(log n) nodes. All
+ * nodes are shared between ropes; an edit allocates new nodes along the
+ * affected paths only. Leaves hold at most MORAROPE_LEAF_MAX morae so that
+ * splitting one never copies much. Mora boundaries of the rope are those
+ * of its leaves; a concatenation whose right side would start with a
+ * small kana attaching to the left side is rejected as ill-formed. */
+#define MORAROPE_LEAF_MAX 256
+
+typedef struct MoraRopeObject {
     PyObject_HEAD
-    Py_ssize_t it_index;
-    MoraStrObject *it_seq;
-} MoraStrIterObject;
+    PyObject *leaf;     /* MoraStr, or NULL for an inner node */
+    struct MoraRopeObject *left;
+    struct MoraRopeObject *right;
+    Py_ssize_t n_morae;
+    Py_ssize_t n_chars;
+    int height;
+} MoraRopeObject;
+
+static PyTypeObject MoraRopeType;
+
+#define MoraRope_Check(op) PyObject_TypeCheck(op, &MoraRopeType)
+
+
+static MoraRopeObject *
+MoraRope_leaf_(PyObject *morastr) {
+    MoraRopeObject *t = PyObject_New(MoraRopeObject, &MoraRopeType);
+    if (!t) {return NULL;}
+    t->leaf = Py_NewRef(morastr);
+    t->left = t->right = NULL;
+    t->n_morae = Py_SIZE(morastr);
+    t->n_chars = PyUnicode_GET_LENGTH(MoraStr_STRING(morastr));
+    t->height = 0;
+    return t;
+}
 
 
-static void
-MoraStrIter_dealloc(MoraStrIterObject *it) {
-    PyObject_GC_UnTrack(it);
-    Py_XDECREF(it->it_seq);
-    PyObject_GC_Del(it);
+static MoraRopeObject *
+MoraRope_empty_(void) {
+    PyObject *empty = Empty_MoraStr();
+    if (!empty) {return NULL;}
+    MoraRopeObject *t = MoraRope_leaf_(empty);
+    Py_DECREF(empty);
+    return t;
+}
+
+
+static MoraRopeObject *
+MoraRope_node_(MoraRopeObject *left, MoraRopeObject *right) {
+    MoraRopeObject *t = PyObject_New(MoraRopeObject, &MoraRopeType);
+    if (!t) {return NULL;}
+    t->leaf = NULL;
+    t->left = (MoraRopeObject *)Py_NewRef(left);
+    t->right = (MoraRopeObject *)Py_NewRef(right);
+    t->n_morae = left->n_morae + right->n_morae;
+    t->n_chars = left->n_chars + right->n_chars;
+    t->height = 1 + Py_MAX(left->height, right->height);
+    return t;
+}
+
+
+/* Same as MoraRope_node_, but consumes the references to its arguments. */
+static MoraRopeObject *
+MoraRope_node_steal_(MoraRopeObject *left, MoraRopeObject *right) {
+    MoraRopeObject *t = NULL;
+    if (left && right) {t = MoraRope_node_(left, right);}
+    Py_XDECREF(left);
+    Py_XDECREF(right);
+    return t;
+}
+
+
+/* (x, (y, z)) -> ((x, y), z); consumes t */
+static MoraRopeObject *
+MoraRope_rotate_left_(MoraRopeObject *t) {
+    MoraRopeObject *r = t->right;
+    MoraRopeObject *t2 = MoraRope_node_steal_(
+        MoraRope_node_(t->left, r->left), (MoraRopeObject *)Py_NewRef(r->right));
+    Py_DECREF(t);
+    return t2;
+}
+
+
+/* ((x, y), z) -> (x, (y, z)); consumes t */
+static MoraRopeObject *
+MoraRope_rotate_right_(MoraRopeObject *t) {
+    MoraRopeObject *l = t->left;
+    MoraRopeObject *t2 = MoraRope_node_steal_(
+        (MoraRopeObject *)Py_NewRef(l->left), MoraRope_node_(l->right, t->right));
+    Py_DECREF(t);
+    return t2;
+}
+
+
+static MoraRopeObject *MoraRope_join_(MoraRopeObject *a, MoraRopeObject *b);
+
+/* joins a taller a with b by descending its right spine */
+static MoraRopeObject *
+MoraRope_join_right_(MoraRopeObject *a, MoraRopeObject *b) {
+    MoraRopeObject *l = a->left, *c = a->right, *t;
+    if (c->height <= b->height + 1) {
+        t = MoraRope_node_(c, b);
+    } else {
+        t = MoraRope_join_right_(c, b);
+    }
+    if (!t) {return NULL;}
+    if (t->height > l->height + 1 && c->height <= b->height + 1) {
+        t = MoraRope_rotate_right_(t);
+        if (!t) {return NULL;}
+    }
+    t = MoraRope_node_steal_((MoraRopeObject *)Py_NewRef(l), t);
+    if (t && t->right->height > t->left->height + 1) {
+        t = MoraRope_rotate_left_(t);
+    }
+    return t;
+}
+
+
+static MoraRopeObject *
+MoraRope_join_left_(MoraRopeObject *a, MoraRopeObject *b) {
+    MoraRopeObject *c = b->left, *r = b->right, *t;
+    if (c->height <= a->height + 1) {
+        t = MoraRope_node_(a, c);
+    } else {
+        t = MoraRope_join_left_(a, c);
+    }
+    if (!t) {return NULL;}
+    if (t->height > r->height + 1 && c->height <= a->height + 1) {
+        t = MoraRope_rotate_left_(t);
+        if (!t) {return NULL;}
+    }
+    t = MoraRope_node_steal_(t, (MoraRopeObject *)Py_NewRef(r));
+    if (t && t->left->height > t->right->height + 1) {
+        t = MoraRope_rotate_right_(t);
+    }
+    return t;
 }
 
 
+/* Concatenates a and b, whose seam must already be known to be valid. */
+static MoraRopeObject *
+MoraRope_join_(MoraRopeObject *a, MoraRopeObject *b) {
+    if (!a->n_morae) {return (MoraRopeObject *)Py_NewRef(b);}
+    if (!b->n_morae) {return (MoraRopeObject *)Py_NewRef(a);}
+    if (a->leaf && b->leaf && a->n_morae + b->n_morae <= MORAROPE_LEAF_MAX) {
+        PyObject *parts[2] = {a->leaf, b->leaf};
+        PyObject *morastr = MoraStr_splice_(parts, 2, NULL);
+        if (!morastr) {return NULL;}
+        MoraRopeObject *t = MoraRope_leaf_(morastr);
+        Py_DECREF(morastr);
+        return t;
+    }
+    if (a->height > b->height + 1) {return MoraRope_join_right_(a, b);}
+    if (b->height > a->height + 1) {return MoraRope_join_left_(a, b);}
+    return MoraRope_node_(a, b);
+}
+
+
+/* inner nodes never have an empty child */
+static Katakana
+MoraRope_edge_char_(MoraRopeObject *t, bool last) {
+    while (!t->leaf) {t = last ? t->right : t->left;}
+    PyObject *string = MoraStr_STRING(t->leaf);
+    return KATAKANA_STR_READ(string, last ? t->n_chars - 1 : 0);
+}
+
+
+/* Concatenates a and b, rejecting a seam where b starts with a small
+   kana that would attach to the last mora of a. */
+static MoraRopeObject *
+MoraRope_concat_(MoraRopeObject *a, MoraRopeObject *b) {
+    if (a->n_morae && b->n_morae) {
+        if (a->n_chars > MINDEX_MAX - b->n_chars) {
+            PyErr_SetString(PyExc_OverflowError, "base string is too long");
+            return NULL;
+        }
+        if (VALIDATE_MORA_BOUNDARY(Bounds_KANA,
+                MoraRope_edge_char_(a, true),
+                MoraRope_edge_char_(b, false)) < 0) {return NULL;}
+    }
+    return MoraRope_join_(a, b);
+}
+
+
+/* Splits t into t[:k] and t[k:]. */
 static int
-MoraStrIter_traverse(MoraStrIterObject *it, visitproc visit, void *arg) {
-    Py_VISIT(it->it_seq);
-    return 0;
+MoraRope_split_(MoraRopeObject *t, Py_ssize_t k,
+        MoraRopeObject **left, MoraRopeObject **right)
+{
+    *left = *right = NULL;
+    if (k <= 0 || k >= t->n_morae) {
+        MoraRopeObject *empty = MoraRope_empty_();
+        if (!empty) {return -1;}
+        *left = k <= 0 ? empty : (MoraRopeObject *)Py_NewRef(t);
+        *right = k <= 0 ? (MoraRopeObject *)Py_NewRef(t) : empty;
+        return 0;
+    }
+    if (t->leaf) {
+        PyObject *l = MoraStr_SubMoraStr(
+            (MoraStrObject *)t->leaf, 0, k);
+        if (!l) {return -1;}
+        PyObject *r = MoraStr_SubMoraStr(
+            (MoraStrObject *)t->leaf, k, t->n_morae);
+        if (r) {
+            *left = MoraRope_leaf_(l);
+            *right = *left ? MoraRope_leaf_(r) : NULL;
+        }
+        Py_DECREF(l);
+        Py_XDECREF(r);
+        if (*right) {return 0;}
+        Py_CLEAR(*left);
+        return -1;
+    }
+    MoraRopeObject *a, *b;
+    Py_ssize_t n_left = t->left->n_morae;
+    if (k == n_left) {
+        *left = (MoraRopeObject *)Py_NewRef(t->left);
+        *right = (MoraRopeObject *)Py_NewRef(t->right);
+        return 0;
+    }
+    if (k < n_left) {
+        if (MoraRope_split_(t->left, k, &a, &b) < 0) {return -1;}
+        *left = a;
+        *right = MoraRope_join_(b, t->right);
+        Py_DECREF(b);
+    } else {
+        if (MoraRope_split_(t->right, k - n_left, &a, &b) < 0) {return -1;}
+        *left = MoraRope_join_(t->left, a);
+        *right = b;
+        Py_DECREF(a);
+    }
+    if (*left && *right) {return 0;}
+    Py_CLEAR(*left);
+    Py_CLEAR(*right);
+    return -1;
 }
 
 
-static PyObject *
-MoraStrIter_next(MoraStrIterObject *it) {
-    MoraStrObject *morastr = it->it_seq;
+/* Builds a balanced rope over morastr[start:end], cut into leaves of at
+   most MORAROPE_LEAF_MAX morae. */
+static MoraRopeObject *
+MoraRope_from_morastr_(PyObject *morastr, Py_ssize_t start, Py_ssize_t end) {
+    if (end - start <= MORAROPE_LEAF_MAX) {
+        if (!start && end == Py_SIZE(morastr) && MoraStr_CheckExact(morastr)) {
+            return MoraRope_leaf_(morastr);
+        }
+        PyObject *leaf = MoraStr_SubMoraStr(
+            (MoraStrObject *)morastr, start, end);
+        if (!leaf) {return NULL;}
+        MoraRopeObject *t = MoraRope_leaf_(leaf);
+        Py_DECREF(leaf);
+        return t;
+    }
+    Py_ssize_t n_leaves = (end - start + MORAROPE_LEAF_MAX - 1) / \
+        MORAROPE_LEAF_MAX;
+    Py_ssize_t mid = start + n_leaves / 2 * MORAROPE_LEAF_MAX;
+    return MoraRope_node_steal_(
+        MoraRope_from_morastr_(morastr, start, mid),
+        MoraRope_from_morastr_(morastr, mid, end));
+}
+
+
+/* Converts a kana string, a MoraStr or a MoraRope into a new reference
+   to a MoraRope. A string that is not at the head of the text (head is
+   false) may start with a small kana without a warning. */
+static MoraRopeObject *
+MoraRope_from_object_(PyObject *obj, bool head) {
+    static const char *err_fmt = \
+        "expected a kana string, a MoraStr or a MoraRope, not '%.200s'";
+
+    if (MoraRope_Check(obj)) {return (MoraRopeObject *)Py_NewRef(obj);}
+    PyObject *morastr = PyUnicode_Check(obj) ? \
+        MoraStr_from_text_(obj, true, head) : \
+        MoraStr_from_object_(obj, err_fmt);
     if (!morastr) {return NULL;}
+    MoraRopeObject *t = MoraRope_from_morastr_(morastr, 0, Py_SIZE(morastr));
+    Py_DECREF(morastr);
+    return t;
+}
 
-    Py_ssize_t index = it->it_index;
-    if (index < Py_SIZE(morastr)) {
-        PyObject *string = MoraStr_STRING(morastr), *item;
-        MINDEX_T *indices = MoraStr_INDICES(morastr);
-        if (!indices) {
-            Katakana k = KATAKANA_STR_READ(string, index);
-            item = PyUnicode_FromOrdinal(k);
-        } else {
-            Py_ssize_t s_start, s_end;
-            s_start = index ? indices[index-1] : 0LL;
-            s_end = indices[index];
-            const Katakana *buf = KatakanaArray_from_str(string);
-            item = PyUnicode_FromKindAndData(
-                KATAKANA_KIND, (const void*)(buf+s_start), s_end - s_start);
+
+static int
+MoraRope_flatten_into_(MoraRopeObject *t, Katakana *buf, MINDEX_T *indices,
+        Py_ssize_t *pos, Py_ssize_t *cnt)
+{
+    if (!t->leaf) {
+        if (MoraRope_flatten_into_(t->left, buf, indices, pos, cnt) < 0) {
+            return -1;
         }
-        if (item) {++it->it_index;}
-        return item;
+        return MoraRope_flatten_into_(t->right, buf, indices, pos, cnt);
     }
-    it->it_seq = NULL;
-    Py_DECREF(morastr);
-    return NULL;
+    PyObject *string = MoraStr_STRING(t->leaf);
+    return MoraStr_attach_(buf, indices, pos, cnt,
+        KatakanaArray_from_str(string), t->n_chars,
+        MoraStr_INDICES(t->leaf), t->n_morae);
 }
 
 
 static PyObject *
-MoraStrIter_len(MoraStrIterObject *it) {
-    MoraStrObject *obj = it->it_seq;
-    Py_ssize_t len = obj ? Py_SIZE(obj) - it->it_index : 0;
-    return PyLong_FromSsize_t(len);
+MoraRope_flatten_(MoraRopeObject *t) {
+    if (t->leaf) {return Py_NewRef(t->leaf);}
+
+    PyObject *string = PyUnicode_New(t->n_chars, 0xffff);
+    if (!string) {return NULL;}
+    MINDEX_T *indices = MoraStr_INDICES_ALLOC(t->n_morae);
+    if (!indices) {
+        Py_DECREF(string);
+        return NULL;
+    }
+    Py_ssize_t pos = 0, cnt = 0;
+    if (MoraRope_flatten_into_(t, KatakanaArray_from_str(string),
+            indices, &pos, &cnt) < 0) {goto error;}
+    MoraStr_assert(pos == t->n_chars && cnt == t->n_morae);
+    if (cnt == pos) {MoraStr_INDICES_DEL(indices);}
+
+    MoraStrObject *morastr;
+    morastr = (MoraStrObject *)MoraStrType.tp_alloc(&MoraStrType, 0);
+    if (!morastr) {goto error;}
+    Py_SET_SIZE(morastr, cnt);
+    morastr->string = string;
+    morastr->indices = indices;
+    return (PyObject *)morastr;
+
+error:
+    Py_DECREF(string);
+    MoraStr_INDICES_DEL(indices);
+    return NULL;
 }
 
 
-static PyObject *
-MoraStrIter_reduce(MoraStrIterObject *it, PyObject *Py_UNUSED(ignored)) {
-#if defined(_Py_IDENTIFIER) && PY_VERSION_HEX < 0x030c0000
-    _Py_IDENTIFIER(iter);
-    if (!it->it_seq) {
-        return Py_BuildValue("N(())", _PyEval_GetBuiltinId(&PyId_iter));
+/* State of a left-to-right search over the leaves. Matches that cross a
+   leaf boundary are looked for in pending[pending_start:], the last
+   sub_cnt-1 morae seen so far (or more, after leaves shorter than that),
+   followed by the head of the next leaf. The positions of the
+   non-overlapping matches, leftmost first, are stored in found until
+   max_found of them have been seen. */
+struct MoraRopeSearch {
+    PyObject *sub;
+    Py_ssize_t sub_cnt;
+    PyObject *pending;
+    Py_ssize_t pending_start;
+    Py_ssize_t pending_off;     /* position of pending[pending_start] */
+    Py_ssize_t off;
+    Py_ssize_t from;    /* no match may start before this */
+    Py_ssize_t *found;
+    Py_ssize_t n_found;
+    Py_ssize_t max_found;   /* -1 for no limit */
+    Py_ssize_t found_cap;
+};
+
+
+/* Returns 1 if enough matches have been found, 0 if not, or -1 on error. */
+static int
+MoraRope_search_add_(struct MoraRopeSearch *st, Py_ssize_t pos) {
+    if (st->n_found == st->found_cap) {
+        Py_ssize_t cap = st->found_cap * 2 + 8;
+        Py_ssize_t *found = PyMem_Resize(st->found, Py_ssize_t, cap);
+        if (!found) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        st->found = found;
+        st->found_cap = cap;
     }
-    return Py_BuildValue("N(O)n",
-        _PyEval_GetBuiltinId(&PyId_iter), it->it_seq, it->it_index);
-#else
-    PyObject *builtins_dict = PyEval_GetBuiltins();
-    if (!builtins_dict) {return NULL;}
-    PyObject *iter_func = PyDict_GetItemString(builtins_dict, "iter");
-    if (!iter_func) {
-        PyErr_SetString(PyExc_AttributeError, "iter");
-        return NULL;
+    st->found[st->n_found++] = pos;
+    st->from = pos + st->sub_cnt;
+    return st->n_found == st->max_found;
+}
+
+
+/* Looks for the matches in morastr, whose first mora is at base.
+   Returns as MoraRope_search_add_ does. */
+static int
+MoraRope_search_in_(struct MoraRopeSearch *st, PyObject *morastr,
+        Py_ssize_t base)
+{
+    Py_ssize_t len = Py_SIZE(morastr);
+    while (1) {
+        Py_ssize_t start = Py_MAX(st->from - base, 0);
+        if (len - start < st->sub_cnt) {return 0;}
+        Py_ssize_t r = MoraStr_findindex(
+            (MoraStrObject *)morastr, st->sub, start, len);
+        if (r == -2) {return -1;}
+        if (r == -1) {return 0;}
+        int status = MoraRope_search_add_(st, base + r);
+        if (status) {return status;}
     }
-    if (!it->it_seq) {
-        return Py_BuildValue("O(())", iter_func);
+}
+
+
+/* Looks for the matches that start in pending and end either there or
+   in leaf, which has at least sub_cnt-1 morae. The text is compared in
+   place, so that no window over the seam has to be built. */
+static int
+MoraRope_search_seam_(struct MoraRopeSearch *st, PyObject *leaf) {
+    PyObject *sub_str = MoraStr_STRING(st->sub);
+    PyObject *a_str = MoraStr_STRING(st->pending);
+    const Katakana *p = KatakanaArray_from_str(sub_str);
+    const Katakana *a = KatakanaArray_from_str(a_str);
+    const Katakana *b = KatakanaArray_from_str(MoraStr_STRING(leaf));
+    const MINDEX_T *a_indices = MoraStr_INDICES(st->pending);
+    const MINDEX_T *b_indices = MoraStr_INDICES(leaf);
+    Py_ssize_t p_len = PyUnicode_GET_LENGTH(sub_str), p_cnt = st->sub_cnt;
+    Py_ssize_t a_len = PyUnicode_GET_LENGTH(a_str), a_cnt = Py_SIZE(st->pending);
+    Py_ssize_t base = st->pending_off - st->pending_start;
+
+    for (Py_ssize_t j = Py_MAX(st->pending_start, st->from - base); j < a_cnt;) {
+        Py_ssize_t head = !j ? 0 : a_indices ? a_indices[j-1] : j;
+        Py_ssize_t k = a_cnt - j, n = a_len - head, end;
+        bool hit = a[head] == p[0];
+        if (hit && k >= p_cnt) {
+            end = a_indices ? a_indices[j+p_cnt-1] : j + p_cnt;
+            hit = end - head == p_len && \
+                !memcmp(a + head, p, sizeof(Katakana)*p_len);
+        } else if (hit) {
+            end = b_indices ? b_indices[p_cnt-k-1] : p_cnt - k;
+            hit = n < p_len && end == p_len - n && \
+                !memcmp(a + head, p, sizeof(Katakana)*n) && \
+                !memcmp(b, p + n, sizeof(Katakana)*(p_len - n));
+        }
+        if (!hit) {
+            ++j;
+            continue;
+        }
+        int status = MoraRope_search_add_(st, base + j);
+        if (status) {return status;}
+        j += p_cnt;
     }
-    return Py_BuildValue("O(O)n", iter_func, it->it_seq, it->it_index);
-#endif
+    return 0;
+}
+
+
+/* Walks the leaves of t. Returns as MoraRope_search_add_ does. */
+static int
+MoraRope_search_(MoraRopeObject *t, struct MoraRopeSearch *st) {
+    if (!t->leaf) {
+        int status = MoraRope_search_(t->left, st);
+        return status ? status : MoraRope_search_(t->right, st);
+    }
+    PyObject *leaf = t->leaf;
+    Py_ssize_t len = t->n_morae, tail = st->sub_cnt - 1, start;
+    int status;
+    if (!len) {return 0;}
+
+    if (len < tail) {
+        /* a match may run past this leaf; keep it all for later */
+        if (st->pending) {
+            PyObject *rest = MoraStr_SubMoraStr(
+                (MoraStrObject *)st->pending,
+                st->pending_start, Py_SIZE(st->pending));
+            if (!rest) {return -1;}
+            Py_SETREF(st->pending,
+                MoraStr_concat((MoraStrObject *)rest, leaf));
+            Py_DECREF(rest);
+            if (!st->pending) {return -1;}
+            st->pending_start = 0;
+        } else if ((start = Py_MAX(st->from - st->off, 0)) < len) {
+            st->pending = Py_NewRef(leaf);
+            st->pending_start = start;
+            st->pending_off = st->off + start;
+        }
+        st->off += len;
+        return 0;
+    }
+    if (st->pending) {
+        status = MoraRope_search_seam_(st, leaf);
+        Py_CLEAR(st->pending);
+        if (status) {return status;}
+    }
+    status = MoraRope_search_in_(st, leaf, st->off);
+    if (status) {return status;}
+    start = Py_MAX(len - tail, st->from - st->off);
+    if (tail && start < len) {
+        st->pending = Py_NewRef(leaf);
+        st->pending_start = start;
+        st->pending_off = st->off + start;
+    }
+    st->off += len;
+    return 0;
+}
+
+
+/* Fills st->found with the matches of st->sub in t. st->found must be
+   freed by the caller even on error. */
+static int
+MoraRope_search_all_(MoraRopeObject *t, struct MoraRopeSearch *st) {
+    int status = 0;
+    if (st->sub_cnt <= t->n_morae && st->max_found) {
+        status = MoraRope_search_(t, st);
+        if (!status && st->pending) {
+            st->from = Py_MAX(st->from, st->pending_off);
+            status = MoraRope_search_in_(st, st->pending,
+                st->pending_off - st->pending_start);
+        }
+        Py_CLEAR(st->pending);
+    }
+    return status < 0 ? -1 : 0;
+}
+
+
+static Py_ssize_t
+MoraRope_find_(MoraRopeObject *t, PyObject *sub) {
+    Py_ssize_t sub_cnt = Py_SIZE(sub);
+    if (!sub_cnt) {return 0;}
+
+    Py_ssize_t found = -1;
+    struct MoraRopeSearch st = {
+        sub, sub_cnt, NULL, 0, 0, 0, 0, &found, 0, 1, 1};
+    if (MoraRope_search_all_(t, &st) < 0) {return -2;}
+    return found;
 }
 
 
 static PyObject *
-MoraStrIter_setstate(MoraStrIterObject *it, PyObject *state) {
-    Py_ssize_t index = PyLong_AsSsize_t(state);
-    if (index == -1 && PyErr_Occurred()) {return NULL;}
-    if (it->it_seq) {
-        if (index < 0) {index = 0;}
-        it->it_index = index;
+MoraRope_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+
+    PyObject *obj = NULL;
+    if (!PyArg_ParseTupleAndKeywords(
+            args, kwds, "|O:MoraRope", kwlist, &obj)) {
+        return NULL;
     }
-    return Py_NewRef(Py_None);
+    if (!obj) {return (PyObject *)MoraRope_empty_();}
+    return (PyObject *)MoraRope_from_object_(obj, true);
 }
 
 
-static PyMethodDef MoraStrIter_methods[] = {
-    {"__length_hint__", (PyCFunction)MoraStrIter_len, METH_NOARGS, PyDoc_STR(
-     "Private method returning an estimate of len(list(it)).")},
-    {"__reduce__", (PyCFunction)MoraStrIter_reduce, METH_NOARGS, PyDoc_STR(
-     "Return state information for pickling.")},
-    {"__setstate__", (PyCFunction)MoraStrIter_setstate, METH_O, PyDoc_STR(
-     "Set state information for unpickling.")},
-    {NULL, NULL}
-};
+static void
+MoraRope_dealloc(MoraRopeObject *self) {
+    Py_XDECREF(self->leaf);
+    Py_XDECREF(self->left);
+    Py_XDECREF(self->right);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
 
 
-PyTypeObject MoraStrIterType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "morastrja.MoraStrIterator",
-    .tp_basicsize = sizeof(MoraStrIterObject),
-    .tp_dealloc = (destructor)MoraStrIter_dealloc,
-    .tp_getattro = PyObject_GenericGetAttr,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
-    .tp_traverse = (traverseproc)MoraStrIter_traverse,
-    .tp_iter = PyObject_SelfIter,
-    .tp_iternext = (iternextfunc)MoraStrIter_next,
-    .tp_methods = MoraStrIter_methods,
-};
+static Py_ssize_t
+MoraRope_length(MoraRopeObject *self) {
+    return self->n_morae;
+}
 
 
 static PyObject *
-MoraStr_iter(PyObject *obj) {
-    if (!MoraStr_Check(obj)) {
-        PyErr_BadInternalCall();
+MoraRope_item(MoraRopeObject *self, Py_ssize_t i) {
+    if (i < 0 || i >= self->n_morae) {
+        PyErr_SetString(PyExc_IndexError, "MoraRope index out of range");
         return NULL;
     }
-    MoraStrObject *seq = (MoraStrObject *)obj;
-    MoraStrIterObject *it;
-    it = PyObject_GC_New(MoraStrIterObject, &MoraStrIterType);
-    if (!it) {return NULL;}
-    it->it_index = 0;
-    Py_INCREF(seq);
-    it->it_seq = (MoraStrObject *)seq;
-    PyObject_GC_Track(it);
-    return (PyObject *)it;
+    MoraRopeObject *t = self;
+    while (!t->leaf) {
+        if (i < t->left->n_morae) {
+            t = t->left;
+        } else {
+            i -= t->left->n_morae;
+            t = t->right;
+        }
+    }
+    return MoraStr_Item((MoraStrObject *)t->leaf, i);
+}
+
+
+static MoraRopeObject *
+MoraRope_slice_(MoraRopeObject *self, Py_ssize_t start, Py_ssize_t end) {
+    MoraRopeObject *a, *b, *c, *d;
+    if (start >= end) {return MoraRope_empty_();}
+    if (MoraRope_split_(self, end, &a, &b) < 0) {return NULL;}
+    Py_DECREF(b);
+    int status = MoraRope_split_(a, start, &c, &d);
+    Py_DECREF(a);
+    if (status < 0) {return NULL;}
+    Py_DECREF(c);
+    return d;
+}
+
+
+/* Splices the MoraStr parts into one, rejecting a seam where a part starts
+   with a small kana that would attach to the part before it, as
+   MoraRope_concat_ does. */
+static PyObject *
+MoraRope_splice_parts_(PyObject *const *parts, Py_ssize_t n) {
+    PyObject *prev = NULL;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        if (!Py_SIZE(parts[i])) {continue;}
+        if (prev && VALIDATE_MORA_BOUNDARY(Bounds_KANA,
+                KATAKANA_STR_READ(MoraStr_STRING(prev),
+                    PyUnicode_GET_LENGTH(MoraStr_STRING(prev)) - 1),
+                KATAKANA_STR_READ(MoraStr_STRING(parts[i]), 0)) < 0) {
+            return NULL;
+        }
+        prev = parts[i];
+    }
+    return MoraStr_splice_(parts, n, NULL);
 }
 
 
-/*********************** MoraStr FindIter **************************/
-enum {FINDITER_POOL_LIMIT = 32};
+/* Extended slice of a rope: the morae at lo, lo+|step|, ..., hi, taken in
+   the direction of step. */
+struct MoraRopeStep {
+    Py_ssize_t step;
+    Py_ssize_t lo;
+    Py_ssize_t hi;
+    PyObject *parts;
+};
 
-typedef struct {
-    PyObject_HEAD
-    MINDEX_T *ptr;
-    PyObject *morastr;
-    PyObject *substr;
-    void *needle_cache;
-    MINDEX_T submora_cnt;
-    union {
-        MINDEX_T pos;
-        MINDEX_T pool[FINDITER_POOL_LIMIT+1];
-    } state;
-} MoraStrFindIterObject;
 
+/* Appends to st->parts the slices of the leaves of t, which starts at
+   mora off, that hold the selected morae. Subtrees outside [lo, hi] are
+   skipped. */
+static int
+MoraRope_step_into_(MoraRopeObject *t, Py_ssize_t off, struct MoraRopeStep *st) {
+    if (off > st->hi || off + t->n_morae <= st->lo) {return 0;}
+    if (!t->leaf) {
+        MoraRopeObject *first = st->step > 0 ? t->left : t->right;
+        MoraRopeObject *second = st->step > 0 ? t->right : t->left;
+        Py_ssize_t first_off = st->step > 0 ? off : off + t->left->n_morae;
+        Py_ssize_t second_off = st->step > 0 ? off + t->left->n_morae : off;
+        if (MoraRope_step_into_(first, first_off, st) < 0) {return -1;}
+        return MoraRope_step_into_(second, second_off, st);
+    }
+    Py_ssize_t a = Py_MAX(off, st->lo), b = Py_MIN(off + t->n_morae - 1, st->hi);
+    Py_ssize_t stride = st->step > 0 ? st->step : -st->step;
+    Py_ssize_t first = a + (stride - (a - st->lo) % stride) % stride;
+    if (first > b) {return 0;}
+    Py_ssize_t cnt = (b - first) / stride + 1;
+    Py_ssize_t head = st->step > 0 ? first : first + (cnt - 1) * stride;
+    PyObject *part = MoraStr_slice_with_step(
+        (MoraStrObject *)t->leaf, head - off, st->step, cnt);
+    if (!part) {return -1;}
+    int status = PyList_Append(st->parts, part);
+    Py_DECREF(part);
+    return status;
+}
 
-#define MoraStrFindIter_needle_DEL(needle) do { \
-    two_way_cache_dealloc(needle); \
-    (needle) = NULL; \
-} while (0)
+
+static PyObject *
+MoraRope_subscript(MoraRopeObject *self, PyObject *arg) {
+    if (PySlice_Check(arg)) {
+        Py_ssize_t start, stop, step, slicelength;
+        if (PySlice_GetIndicesEx(arg, self->n_morae,
+                &start, &stop, &step, &slicelength) < 0) {return NULL;}
+        if (step == 1) {
+            return (PyObject *)MoraRope_slice_(self, start, stop);
+        }
+        if (!slicelength) {return (PyObject *)MoraRope_empty_();}
+        if (step < 0 && small_kana_vowel(MoraRope_edge_char_(self, false))) {
+            PyErr_SetString(PyExc_ValueError,
+                "Can't instantiate a MoraRope slice; "
+                "base string starts with a small kana");
+            return NULL;
+        }
+        struct MoraRopeStep st = {step, start, start, NULL};
+        if (step > 0) {
+            st.hi += (slicelength - 1) * step;
+        } else {
+            st.lo += (slicelength - 1) * step;
+        }
+        st.parts = PyList_New(0);
+        if (!st.parts) {return NULL;}
+        PyObject *sliced = NULL;
+        if (MoraRope_step_into_(self, 0, &st) == 0) {
+            sliced = MoraRope_splice_parts_(PySequence_Fast_ITEMS(st.parts),
+                PyList_GET_SIZE(st.parts));
+        }
+        Py_DECREF(st.parts);
+        if (!sliced) {return NULL;}
+        MoraRopeObject *t = MoraRope_from_morastr_(sliced, 0, Py_SIZE(sliced));
+        Py_DECREF(sliced);
+        return (PyObject *)t;
+    }
+    Py_ssize_t i = PyNumber_AsSsize_t(arg, PyExc_IndexError);
+    if (i == -1 && PyErr_Occurred()) {return NULL;}
+    if (i < 0) {i += self->n_morae;}
+    return MoraRope_item(self, i);
+}
 
 
-static void
-MoraStrFindIter_dealloc(MoraStrFindIterObject *it) {
-    PyObject_GC_UnTrack(it);
-    Py_CLEAR(it->morastr);
-    Py_CLEAR(it->substr);
-    MoraStrFindIter_needle_DEL(it->needle_cache);
-    PyObject_GC_Del(it);
+static PyObject *
+MoraRope_concat(MoraRopeObject *self, PyObject *arg) {
+    MoraRopeObject *other = MoraRope_from_object_(arg, false);
+    if (!other) {return NULL;}
+    MoraRopeObject *t = MoraRope_concat_(self, other);
+    Py_DECREF(other);
+    return (PyObject *)t;
+}
+
+
+static PyObject *
+MoraRope_find(MoraRopeObject *self, PyObject *args) {
+    static const char *err_fmt = \
+        "argument 1 must be a kana string or a MoraStr object, not '%.200s'";
+
+    PyObject *subobj, *arg_x = NULL, *arg_y = NULL;
+    if (!PyArg_ParseTuple(args, "O|OO:find", &subobj, &arg_x, &arg_y)) {
+        return NULL;
+    }
+    Py_ssize_t start = 0, end = PY_SSIZE_T_MAX;
+    if (arg_x && !MoraStr_SliceIndex(arg_x, &start)) {return NULL;}
+    if (arg_y && !MoraStr_SliceIndex(arg_y, &end)) {return NULL;}
+    if (self->n_morae < start) {return PyLong_FromLong(-1);}
+    PySlice_AdjustIndices(self->n_morae, &start, &end, 1);
+    if (end < start) {return PyLong_FromLong(-1);}
+
+    PyObject *sub = MoraRope_Check(subobj) ? \
+        MoraRope_flatten_((MoraRopeObject *)subobj) : \
+        MoraStr_from_object_(subobj, err_fmt);
+    if (!sub) {return NULL;}
+    MoraRopeObject *t = self;
+    if (start || end != self->n_morae) {
+        t = MoraRope_slice_(self, start, end);
+        if (!t) {
+            Py_DECREF(sub);
+            return NULL;
+        }
+    } else {
+        Py_INCREF(t);
+    }
+    Py_ssize_t r = MoraRope_find_(t, sub);
+    Py_DECREF(t);
+    Py_DECREF(sub);
+    if (r == -2) {return NULL;}
+    return PyLong_FromSsize_t(r < 0 ? r : start + r);
 }
 
 
+/* The matches found by a search over a rope, and what to put in their
+   place. new_flat is new as a MoraStr when it is short enough to be
+   copied into the leaves, or NULL. */
+struct MoraRopeReplace {
+    const Py_ssize_t *found;
+    Py_ssize_t old_cnt;
+    MoraRopeObject *new;
+    PyObject *new_flat;
+};
+
+
+/* Appends src[0:src_len], whose src_cnt morae end at src_indices less
+   shift (or one character each if NULL), to buf[0:*pos] whose morae end
+   at indices[0:*cnt]. Unlike MoraStr_attach_, a leading small kana that
+   would attach to the last mora is rejected, as MoraRope_concat_ does. */
 static int
-MoraStrFindIter_traverse(
-    MoraStrFindIterObject *it, visitproc visit, void *arg)
+MoraRope_append_(Katakana *buf, MINDEX_T *indices,
+        Py_ssize_t *pos, Py_ssize_t *cnt,
+        const Katakana *src, Py_ssize_t src_len,
+        const MINDEX_T *src_indices, Py_ssize_t src_cnt, Py_ssize_t shift)
 {
-    Py_VISIT(it->morastr);
-    Py_VISIT(it->substr);
+    if (!src_len) {return 0;}
+    if (*pos && VALIDATE_MORA_BOUNDARY(
+            Bounds_KANA, buf[*pos-1], src[0]) < 0) {return -1;}
+    Py_MEMCPY(buf + *pos, src, sizeof(Katakana)*src_len);
+    for (Py_ssize_t i = 0; i < src_cnt; ++i) {
+        indices[*cnt + i] = MINDEX(*pos + (src_indices ? \
+            (Py_ssize_t)src_indices[i] - shift : i + 1));
+    }
+    *cnt += src_cnt;
+    *pos += src_len;
     return 0;
 }
 
 
-static MINDEX_T
-MoraStrFindIter_two_way(
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len,
-    Py_ssize_t start, MoraStrFindIterObject *it,
-    const MINDEX_T *indices, bool charwise)
+/* Rebuilds the leaf t, which starts at mora off, with the matches
+   rp->found[lo:hi] replaced by rp->new_flat. The kept morae and the
+   replacer are copied straight into the buffers of the new leaf. */
+static MoraRopeObject *
+MoraRope_replace_leaf_(MoraRopeObject *t, Py_ssize_t off,
+        Py_ssize_t lo, Py_ssize_t hi, struct MoraRopeReplace *rp)
 {
-    PyObject *morastr = it->morastr;
-    Py_ssize_t submora_cnt = ~(it->submora_cnt);
-    MINDEX_T *ptr = it->state.pool;
+#define LEAF_CHAR_AT(m) ((m) ? s_indices ? (Py_ssize_t)s_indices[(m)-1] : (m) : 0)
+    PyObject *s_str = MoraStr_STRING(t->leaf);
+    PyObject *r_str = MoraStr_STRING(rp->new_flat);
+    const Katakana *s = KatakanaArray_from_str(s_str);
+    const Katakana *r = KatakanaArray_from_str(r_str);
+    const MINDEX_T *s_indices = MoraStr_INDICES(t->leaf);
+    const MINDEX_T *r_indices = MoraStr_INDICES(rp->new_flat);
+    Py_ssize_t n = t->n_morae, r_len = PyUnicode_GET_LENGTH(r_str);
+    Py_ssize_t r_cnt = Py_SIZE(rp->new_flat);
+
+    Py_ssize_t length = t->n_chars, mora_cnt = n;
+    for (Py_ssize_t i = lo; i < hi; ++i) {
+        Py_ssize_t pos = rp->found[i] - off;
+        Py_ssize_t b = Py_MAX(pos, 0), e = Py_MIN(pos + rp->old_cnt, n);
+        length -= LEAF_CHAR_AT(e) - LEAF_CHAR_AT(b);
+        mora_cnt -= e - b;
+        if (pos >= 0) {
+            if (length > MINDEX_MAX - r_len) {
+                PyErr_SetString(PyExc_OverflowError,
+                    "base string is too long");
+                return NULL;
+            }
+            length += r_len;
+            mora_cnt += r_cnt;
+        }
+    }
+    if (!length) {return MoraRope_empty_();}
 
-    Py_ssize_t cap, end, mora_cnt = Py_SIZE(morastr);
-    cap = (Py_ssize_t)Py_MIN(
-        (uint64_t)submora_cnt * 2 + start + 2048,
-        (uint64_t)mora_cnt);
-    end = mora_cnt;
+    PyObject *string = PyUnicode_New(length, 0xffff);
+    if (!string) {return NULL;}
+    MINDEX_T *indices = MoraStr_INDICES_ALLOC(mora_cnt);
     if (!indices) {
-        do {
-            start = two_way_search(
-                s, end, p, p_len, start, -1);
-            *ptr++ = MINDEX(start);
-            if (start == -1) {
-                start = (end == mora_cnt) ? \
-                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
-                break;
-            }
-            start += submora_cnt;
-            end = cap;
-        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr);
-    } else {
-        do {
-            start = two_way_mora_search(
-                s, indices[end-1], p, p_len, start,
-                submora_cnt, indices, -1);
-            if (charwise) {
-                *ptr++ = 0 < start ? indices[start-1] : MINDEX(start);
-            } else {
-                *ptr++ = MINDEX(start);
-            }
-            if (start == -1) {
-                start = (end == mora_cnt) ? \
-                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
-                break;
-            }
-            start += submora_cnt;
-            end = cap;
-        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr);
+        Py_DECREF(string);
+        return NULL;
+    }
+    Katakana *buf = KatakanaArray_from_str(string);
+    Py_ssize_t w = 0, c = 0, cur = 0;
+    for (Py_ssize_t i = lo; i <= hi; ++i) {
+        Py_ssize_t pos = i < hi ? rp->found[i] - off : n;
+        if (pos > cur) {
+            Py_ssize_t shift = LEAF_CHAR_AT(cur);
+            if (MoraRope_append_(buf, indices, &w, &c,
+                    s + shift, LEAF_CHAR_AT(pos) - shift,
+                    s_indices ? s_indices + cur : NULL, pos - cur,
+                    shift) < 0) {goto error;}
+        }
+        if (i == hi) {break;}
+        if (pos >= 0 && MoraRope_append_(buf, indices, &w, &c,
+                r, r_len, r_indices, r_cnt, 0) < 0) {goto error;}
+        cur = Py_MIN(Py_MAX(cur, pos + rp->old_cnt), n);
     }
+#undef LEAF_CHAR_AT
+    MoraStr_assert(w == length && c == mora_cnt);
+    if (c == w) {MoraStr_INDICES_DEL(indices);}
 
-    two_way_set_needle(NULL);
-    MINDEX_T result = it->state.pool[0];
-    MINDEX_T pos = MINDEX(start);
-    it->state.pos = charwise ? ~pos : pos;
+    MoraStrObject *morastr;
+    morastr = (MoraStrObject *)MoraStrType.tp_alloc(&MoraStrType, 0);
+    if (!morastr) {goto error;}
+    Py_SET_SIZE(morastr, c);
+    morastr->string = string;
+    morastr->indices = indices;
+    MoraRopeObject *result = MoraRope_from_morastr_(
+        (PyObject *)morastr, 0, c);
+    Py_DECREF(morastr);
     return result;
+
+error:
+    Py_DECREF(string);
+    MoraStr_INDICES_DEL(indices);
+    return NULL;
 }
 
 
-static MINDEX_T
-MoraStrFindIter_with_cache(MoraStrFindIterObject *it)
+/* Same as MoraRope_replace_leaf_, for a replacer too long to be copied
+   into a leaf: the kept parts of t are concatenated with new itself. */
+static MoraRopeObject *
+MoraRope_replace_leaf_shared_(MoraRopeObject *t, Py_ssize_t off,
+        Py_ssize_t lo, Py_ssize_t hi, struct MoraRopeReplace *rp)
 {
-    MINDEX_T pos = it->state.pos;
-    BoolPred charwise = false;
-    if (pos < 0) {
-        charwise = true; pos = ~pos;
+    MoraRopeObject *result = MoraRope_empty_(), *part;
+    Py_ssize_t n = t->n_morae, cur = 0;
+    for (Py_ssize_t i = lo; result && i <= hi; ++i) {
+        Py_ssize_t pos = i < hi ? rp->found[i] - off : n;
+        if (pos > cur) {
+            part = MoraRope_slice_(t, cur, pos);
+            if (!part) {
+                Py_CLEAR(result);
+                break;
+            }
+            Py_SETREF(result, MoraRope_concat_(result, part));
+            Py_DECREF(part);
+            if (!result) {break;}
+        }
+        if (i == hi) {break;}
+        if (pos >= 0) {Py_SETREF(result, MoraRope_concat_(result, rp->new));}
+        cur = Py_MIN(Py_MAX(cur, pos + rp->old_cnt), n);
     }
-    if (pos == MINDEX_MAX) {return -1;}
+    return result;
+}
 
-    PyObject *morastr = it->morastr;
-    PyObject *substr = it->substr;
-    MINDEX_T *ptr = it->state.pool + 1;
-    Py_ssize_t substr_len = PyUnicode_GET_LENGTH(substr);
 
-    PyObject *string = MoraStr_STRING(morastr);
-    MINDEX_T *indices = MoraStr_INDICES(morastr);
-    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
-    if (it->ptr != ptr) {
-        memset((void*)ptr, -1, sizeof(MINDEX_T)*(FINDITER_POOL_LIMIT));
+/* Returns t, which starts at mora off, with the matches rp->found[lo:hi]
+   replaced. These are the matches that overlap t; each is put in the
+   leaf where it starts. Subtrees that no match touches are shared. */
+static MoraRopeObject *
+MoraRope_replace_(MoraRopeObject *t, Py_ssize_t off,
+        Py_ssize_t lo, Py_ssize_t hi, struct MoraRopeReplace *rp)
+{
+    if (lo == hi) {return (MoraRopeObject *)Py_NewRef(t);}
+    if (!t->leaf) {
+        /* mid: first match starting in the right subtree */
+        Py_ssize_t mid_off = off + t->left->n_morae, mid = lo, end = hi;
+        while (mid < end) {
+            Py_ssize_t i = mid + (end - mid) / 2;
+            if (rp->found[i] < mid_off) {
+                mid = i + 1;
+            } else {
+                end = i;
+            }
+        }
+        bool straddle = mid > lo && rp->found[mid-1] + rp->old_cnt > mid_off;
+        MoraRopeObject *left = MoraRope_replace_(t->left, off, lo, mid, rp);
+        if (!left) {return NULL;}
+        MoraRopeObject *right = MoraRope_replace_(
+            t->right, mid_off, straddle ? mid - 1 : mid, hi, rp);
+        if (!right) {
+            Py_DECREF(left);
+            return NULL;
+        }
+        MoraRopeObject *joined = MoraRope_concat_(left, right);
+        Py_DECREF(left);
+        Py_DECREF(right);
+        return joined;
     }
-    it->ptr = --ptr;
-
-    const Katakana *s = KatakanaArray_from_str(string);
-    const Katakana *p = KatakanaArray_from_str(substr);
 
-    two_way_set_needle(it->needle_cache);
-    return MoraStrFindIter_two_way(
-        s, len, p, substr_len, (Py_ssize_t)pos, it, indices, charwise);
+    return rp->new_flat ? \
+        MoraRope_replace_leaf_(t, off, lo, hi, rp) : \
+        MoraRope_replace_leaf_shared_(t, off, lo, hi, rp);
 }
 
 
-static MINDEX_T
-MoraStrFindIter_find_push(MoraStrFindIterObject *it) {
-    MINDEX_T pos = it->state.pos;
-    BoolPred charwise = false;
-    if (pos < 0) {
-        charwise = true; pos = ~pos;
+static PyObject *
+MoraRope_replace(MoraRopeObject *self, PyObject *args) {
+    static const char *err_fmt = \
+        "replace() argument must be str or MoraStr, not '%.200s'";
+
+    PyObject *old_obj, *new_obj;
+    Py_ssize_t count = -1;
+    if (!PyArg_ParseTuple(args, "OO|n:replace", &old_obj, &new_obj, &count)) {
+        return NULL;
+    }
+    PyObject *old = MoraStr_from_object_(old_obj, err_fmt);
+    if (!old) {return NULL;}
+    MoraRopeObject *new = MoraRope_from_object_(new_obj, true);
+    if (!new) {
+        Py_DECREF(old);
+        return NULL;
+    }
+    if (!count) {
+        Py_DECREF(old);
+        Py_DECREF(new);
+        return Py_NewRef(self);
+    }
+    if (new->n_morae && small_kana_vowel(MoraRope_edge_char_(new, false))) {
+        PyErr_SetString(PyExc_ValueError,
+            "replacer must not start with a small kana");
+        Py_DECREF(old);
+        Py_DECREF(new);
+        return NULL;
+    }
+    PyObject *flat = NULL;
+    MoraRopeObject *result = NULL;
+
+    Py_ssize_t old_cnt = Py_SIZE(old);
+    if (!old_cnt) {
+        /* insertions between every mora rebuild the whole text anyway;
+           leave that to MoraStr */
+        flat = MoraRope_flatten_(self);
+        if (!flat) {goto done;}
+        PyObject *new_flat = MoraRope_flatten_(new);
+        if (!new_flat) {goto done;}
+        PyObject *replaced = PyObject_CallMethod(
+            flat, "replace", "OOn", old, new_flat, count);
+        Py_DECREF(new_flat);
+        if (!replaced) {goto done;}
+        result = MoraRope_from_morastr_(replaced, 0, Py_SIZE(replaced));
+        Py_DECREF(replaced);
+        goto done;
     }
-    if (pos == MINDEX_MAX) {return -1;}
 
-    PyObject *morastr = it->morastr;
-    PyObject *substr = it->substr;
-    Py_ssize_t submora_cnt = it->submora_cnt;
-    MINDEX_T *ptr = it->state.pool + 1;
-    Py_ssize_t substr_len = PyUnicode_GET_LENGTH(substr);
+    /* find every match in one walk over the leaves, then rebuild only the
+       leaves they touch */
+    struct MoraRopeSearch st = {
+        old, old_cnt, NULL, 0, 0, 0, 0, NULL, 0, count, 0};
+    if (MoraRope_search_all_(self, &st) < 0) {goto search_done;}
+    struct MoraRopeReplace rp = {st.found, old_cnt, new, NULL};
+    if (new->n_morae <= MORAROPE_LEAF_MAX) {
+        /* spliced into the leaves as they are rebuilt */
+        rp.new_flat = MoraRope_flatten_(new);
+        if (!rp.new_flat) {goto search_done;}
+    }
+    result = MoraRope_replace_(self, 0, 0, st.n_found, &rp);
+    Py_XDECREF(rp.new_flat);
+search_done:
+    PyMem_Free(st.found);
+done:
+    Py_XDECREF(flat);
+    Py_DECREF(old);
+    Py_DECREF(new);
+    return (PyObject *)result;
+}
 
-    PyObject *string = MoraStr_STRING(morastr);
-    MINDEX_T *indices = MoraStr_INDICES(morastr);
-    Py_ssize_t len = PyUnicode_GET_LENGTH(string);
-    if (it->ptr != ptr) {
-        memset((void*)ptr, -1, sizeof(MINDEX_T)*(FINDITER_POOL_LIMIT));
-    }
-    it->ptr = --ptr;
 
-    const Katakana *s = KatakanaArray_from_str(string);
-    const Katakana *p = KatakanaArray_from_str(substr);
+static PyObject *
+MoraRope_tomorastr(MoraRopeObject *self, PyObject *Py_UNUSED(ignored)) {
+    return MoraRope_flatten_(self);
+}
 
-    
-    if (!pos) {
-        if (!indices && submora_cnt != substr_len) {return -1;}
-        MoraStr_assert(substr_len <= MINDEX_MAX);
-        int status = search_algorithm_prepare(
-            s, len, p, substr_len, 0, submora_cnt, indices);
-        if (status == -1) {
-            search_algorithm_disable_cache();
-            return -2;
-        }
-        if (status == SEARCH_TWOWAY) {
-            it->submora_cnt = ~(it->submora_cnt);
-            MINDEX_T result = MoraStrFindIter_two_way(
-                s, len, p, substr_len, (Py_ssize_t)pos,
-                it, indices, charwise);
-            pos = charwise ? ~(it->state.pos) : it->state.pos;
-            if (pos != MINDEX_MAX) {
-                void *needle_cache = two_way_cache_new();
-                if (!needle_cache) {
-                    PyErr_NoMemory();
-                    return -2;
-                }
-                it->needle_cache = needle_cache;
-            }
-            return result;
-        }
-    }
 
-    Py_ssize_t start = (Py_ssize_t)pos, cap, end;
-    Py_ssize_t mora_cnt = Py_SIZE(morastr);
-    cap = (Py_ssize_t)Py_MIN(
-        (uint64_t)submora_cnt * 2 + start + 2048,
-        (uint64_t)mora_cnt);
-    end = mora_cnt;
-    if (!indices) {
-        do {
-            start = generic_katakana_search(
-                s, end, p, substr_len, start, -1);
-            *ptr++ = MINDEX(start);
-            if (start == -1) {
-                start = (end == mora_cnt) ? \
-                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
-                break;
-            }
-            start += submora_cnt;
-            end = cap;
-        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr);
-    } else {
-        do {
-            start = generic_mora_search(
-                s, indices[end-1], p, substr_len, start,
-                submora_cnt, indices, -1);
-            if (charwise) {
-                *ptr++ = 0 < start ? indices[start-1] : MINDEX(start);
-            } else {
-                *ptr++ = MINDEX(start);
-            }
-            if (start == -1) {
-                start = (end == mora_cnt) ? \
-                    (Py_ssize_t)MINDEX_MAX : end - submora_cnt + 1;
-                break;
-            }
-            start += submora_cnt;
-            end = cap;
-        } while (it->state.pool + FINDITER_POOL_LIMIT != ptr);
-    }
+static void
+MoraRope_copy_chars_(MoraRopeObject *t, Katakana *buf) {
+    while (!t->leaf) {
+        MoraRope_copy_chars_(t->left, buf);
+        buf += t->left->n_chars;
+        t = t->right;
+    }
+    Py_MEMCPY(buf, KatakanaArray_from_str(MoraStr_STRING(t->leaf)),
+        sizeof(Katakana)*t->n_chars);
+}
+
+
+static PyObject *
+MoraRope_tostr(MoraRopeObject *self, PyObject *Py_UNUSED(ignored)) {
+    if (self->leaf) {return Py_NewRef(MoraStr_STRING(self->leaf));}
+    /* only the characters are needed; skip building the mora indices */
+    PyObject *string = PyUnicode_New(self->n_chars, 0xffff);
+    if (!string) {return NULL;}
+    MoraRope_copy_chars_(self, KatakanaArray_from_str(string));
+    return string;
+}
+
+
+static PyObject *
+MoraRope_repr(MoraRopeObject *self) {
+    PyObject *string = MoraRope_tostr(self, NULL);
+    if (!string) {return NULL;}
+    PyObject *repr = PyUnicode_FromFormat("MoraRope(%R)", string);
+    Py_DECREF(string);
+    return repr;
+}
 
-    MINDEX_T result = it->state.pool[0];
-    pos = MINDEX(start);
-    it->state.pos = charwise ? ~pos : pos;
-    return result;
+
+static PyObject *
+MoraRope_get_height(MoraRopeObject *self, void *Py_UNUSED(closure)) {
+    return PyLong_FromLong(self->height);
 }
 
 
+static PySequenceMethods morarope_as_sequence = {
+    .sq_length = (lenfunc)MoraRope_length,
+    .sq_concat = (binaryfunc)MoraRope_concat,
+    .sq_item = (ssizeargfunc)MoraRope_item,
+};
+
+static PyMappingMethods morarope_as_mapping = {
+    .mp_length = (lenfunc)MoraRope_length,
+    .mp_subscript = (binaryfunc)MoraRope_subscript,
+};
+
+static PyMethodDef MoraRope_methods[] = {
+    {"find", (PyCFunction)MoraRope_find,
+     METH_VARARGS, PyDoc_STR(
+     "find($self, sub_morastr, start=0, end=sys.maxsize, /)\n"
+     "--\n\n"
+     "Returns the lowest mora index where sub_morastr is found within \n"
+     "self[start:end], or -1. The range is cut out in O(log n), and the \n"
+     "leaves are then searched one by one without flattening the rope.")},
+    {"replace", (PyCFunction)MoraRope_replace,
+     METH_VARARGS, PyDoc_STR(
+     "replace($self, old, new, maxcount=-1, /)\n"
+     "--\n\n"
+     "Returns a new rope with occurrences of old replaced by new. The \n"
+     "matches are searched for leaf by leaf and only the leaves holding \n"
+     "them are rebuilt; the rest is shared with self, not copied.")},
+    {"tomorastr", (PyCFunction)MoraRope_tomorastr,
+     METH_NOARGS, PyDoc_STR(
+     "tomorastr($self, /)\n"
+     "--\n\n"
+     "Flattens the rope into a MoraStr object.")},
+    {"tostr", (PyCFunction)MoraRope_tostr,
+     METH_NOARGS, PyDoc_STR(
+     "tostr($self, /)\n"
+     "--\n\n"
+     "Returns the katakana string of the rope.")},
+    {NULL, NULL}
+};
+
+static PyGetSetDef MoraRope_getset[] = {
+    {"height", (getter)MoraRope_get_height, NULL, PyDoc_STR(
+     "Height of the balanced tree; 0 for a rope made of a single leaf."),
+     NULL},
+    {NULL}
+};
+
+static PyTypeObject MoraRopeType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.MoraRope",
+    .tp_basicsize = sizeof(MoraRopeObject),
+    .tp_dealloc = (destructor)MoraRope_dealloc,
+    .tp_repr = (reprfunc)MoraRope_repr,
+    .tp_as_sequence = &morarope_as_sequence,
+    .tp_as_mapping = &morarope_as_mapping,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "MoraRope(morastr: str | MoraStr | MoraRope = '', /) -> MoraRope\n" \
+     "\n" \
+     "An immutable sequence of morae stored as a balanced tree of MoraStr \n"
+     "leaves. Indexing, slicing and concatenation take O(log n) time and \n"
+     "share the untouched parts with the original rope, which makes it \n"
+     "suited to editing long texts. tomorastr() flattens it."),
+    .tp_methods = MoraRope_methods,
+    .tp_getset = MoraRope_getset,
+    .tp_new = (newfunc)MoraRope_new,
+};
+
+
+/*********************** NgramCounter **************************/
+typedef struct {
+    PyObject_HEAD
+    struct NgramTable *table;
+    Py_ssize_t n;
+} NgramCounterObject;
+
+static PyTypeObject NgramCounterType;
+
+
 static PyObject *
-MoraStrFindIter_empty_needle_next(MoraStrFindIterObject *it) {
-    PyObject *morastr = it->morastr;
-    MINDEX_T pos = it->state.pos;
-    size_t limit = (size_t)Py_SIZE(morastr);
-    size_t val = (uint32_t)it->state.pool[2] + 1;
-    if (val > limit) {
-        it->ptr = NULL;
-        Py_CLEAR(it->morastr);
-        Py_CLEAR(it->substr);
-        MoraStrFindIter_needle_DEL(it->needle_cache);
+NgramCounter_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"", NULL};
+
+    Py_ssize_t n;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O&:NgramCounter", kwlist,
+            ngram_order_converter, &n)) {
         return NULL;
     }
-    BoolPred charwise = (pos < 0);
-    it->state.pool[2]++;
-    if (charwise) {
-        MINDEX_T *indices = MoraStr_INDICES(morastr);
-        if (val && indices) {val = (size_t)indices[val-1];}
+    struct NgramTable *table = ngram_table_new(n);
+    if (!table) {return NULL;}
+    NgramCounterObject *self = (NgramCounterObject *)type->tp_alloc(type, 0);
+    if (!self) {
+        ngram_table_dealloc(table);
+        return NULL;
     }
-    return PyLong_FromLong((long)val);
+    self->table = table;
+    self->n = n;
+    return (PyObject *)self;
 }
 
 
-static PyObject *
-MoraStrFindIter_next(MoraStrFindIterObject *it) {
-    MINDEX_T *ptr = it->ptr;
-    if (!ptr) {return NULL;}
+static void
+NgramCounter_dealloc(NgramCounterObject *self) {
+    ngram_table_dealloc(self->table);
+    Py_TYPE(self)->tp_free((PyObject *) self);
+}
 
-    MINDEX_T val = *ptr;
-    MINDEX_T submora_cnt = it->submora_cnt;
-    if (val != -1) {
-        it->ptr++;
-        return PyLong_FromLong(val);
+
+/* Counts the n-grams of each element of the array. Mora IDs are found
+   from the one-byte codes directly; only longer morae are looked up. */
+static int
+NgramCounter_add_array_(NgramCounterObject *self, MoraStrArrayObject *arr) {
+    Py_ssize_t n_items = Py_SIZE(arr), max_cnt = 0;
+    for (Py_ssize_t i = 0; i < n_items; ++i) {
+        Py_ssize_t cnt = MoraStrArray_MORA_CNT(arr, i);
+        if (max_cnt < cnt) {max_cnt = cnt;}
+    }
+    uint16_t *ids = PyMem_New(uint16_t, max_cnt ? max_cnt : 1);
+    if (!ids) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    int status = 0;
+    for (Py_ssize_t i = 0; i < n_items && !status; ++i) {
+        Py_ssize_t cnt = MoraStrArray_MORA_CNT(arr, i), prev = 0;
+        if (cnt < self->n) {continue;}
+        const uint8_t *codes = MoraStrArray_CHARS(arr, i);
+        const MINDEX_T *bounds = MoraStrArray_BOUNDS(arr, i);
+        for (Py_ssize_t k = 0; k < cnt; prev = bounds[k++]) {
+            Py_ssize_t len = bounds[k] - prev;
+            if (len == 1) {
+                ids[k] = codes[prev];
+                continue;
+            }
+            Katakana mora[MORA_CONTENT_MAX];
+            for (Py_ssize_t j = 0; j < len; ++j) {
+                mora[j] = (Katakana)(KATAKANA_OFF + codes[prev+j]);
+            }
+            ids[k] = mora_id_of_(mora, len);
+        }
+        if (!status) {status = ngram_table_add(self->table, ids, cnt);}
     }
+    PyMem_Free(ids);
+    return status;
+}
 
-    if (!submora_cnt) {
-        return MoraStrFindIter_empty_needle_next(it);
-    } else if (submora_cnt < 0) {
-        val = MoraStrFindIter_with_cache(it);
-    } else {
-        val = MoraStrFindIter_find_push(it);
+
+static int
+NgramCounter_add_(NgramCounterObject *self, PyObject *obj) {
+    static const char *err_fmt = \
+        "expected a kana string, a MoraStr or a MoraStrArray, not '%.200s'";
+
+    if (PyObject_TypeCheck(obj, &MoraStrArrayType)) {
+        return NgramCounter_add_array_(self, (MoraStrArrayObject *)obj);
     }
-    if (val < 0) {
-        it->ptr = NULL;
-        Py_CLEAR(it->morastr);
-        Py_CLEAR(it->substr);
-        MoraStrFindIter_needle_DEL(it->needle_cache);
-        return NULL;
+    PyObject *morastr = MoraStr_from_object_(obj, err_fmt);
+    if (!morastr) {return -1;}
+    uint16_t *ids = MoraStr_mora_ids_((MoraStrObject *)morastr);
+    int status = -1;
+    if (ids) {
+        status = ngram_table_add(self->table, ids, Py_SIZE(morastr));
+        PyMem_Free(ids);
     }
-    it->ptr++;
-    return PyLong_FromLong(val);
+    Py_DECREF(morastr);
+    return status;
 }
 
 
-PyTypeObject MoraStrFindIterType = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    .tp_name = "morastrja.morastr_finditerator",
-    .tp_basicsize = sizeof(MoraStrFindIterObject),
-    .tp_dealloc = (destructor)MoraStrFindIter_dealloc,
-    .tp_getattro = PyObject_GenericGetAttr,
-    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
-    .tp_traverse = (traverseproc)MoraStrFindIter_traverse,
-    .tp_iter = PyObject_SelfIter,
-    .tp_iternext = (iternextfunc)MoraStrFindIter_next,
-};
+static PyObject *
+NgramCounter_add(NgramCounterObject *self, PyObject *obj) {
+    if (NgramCounter_add_(self, obj) < 0) {return NULL;}
+    Py_RETURN_NONE;
+}
 
 
 static PyObject *
-MoraStr_finditer(PyObject *self, PyObject *args, PyObject *kwds) {
-    static char *kwlist[] = {"", "charwise", NULL};
+NgramCounter_update(NgramCounterObject *self, PyObject *iterable) {
+    PyObject *it = PyObject_GetIter(iterable);
+    if (!it) {return NULL;}
+    PyObject *item;
+    while ((item = PyIter_Next(it))) {
+        int status = NgramCounter_add_(self, item);
+        Py_DECREF(item);
+        if (status < 0) {
+            Py_DECREF(it);
+            return NULL;
+        }
+    }
+    Py_DECREF(it);
+    if (PyErr_Occurred()) {return NULL;}
+    Py_RETURN_NONE;
+}
 
-    PyObject *submora;
-    BoolPred charwise = false;
 
-    if (!PyArg_ParseTupleAndKeywords(
-            args, kwds, "O|$p", kwlist, &submora, &charwise)) {
+static Py_ssize_t
+NgramCounter_length(NgramCounterObject *self) {
+    return ngram_table_size(self->table);
+}
+
+
+static PyObject *
+NgramCounter_subscript(NgramCounterObject *self, PyObject *key) {
+    static const char *err_fmt = \
+        "n-gram must be a kana string or a MoraStr, not '%.200s'";
+
+    PyObject *morastr = MoraStr_from_object_(key, err_fmt);
+    if (!morastr) {return NULL;}
+    if (Py_SIZE(morastr) != self->n) {
+        PyErr_Format(PyExc_ValueError,
+            "expected %zd morae, got %zd", self->n, Py_SIZE(morastr));
+        Py_DECREF(morastr);
         return NULL;
     }
+    uint16_t *ids = MoraStr_mora_ids_((MoraStrObject *)morastr);
+    Py_DECREF(morastr);
+    if (!ids) {return NULL;}
+    uint64_t count = ngram_table_get(self->table, ids);
+    PyMem_Free(ids);
+    return PyLong_FromUnsignedLongLong(count);
+}
 
-    if (PyUnicode_Check(submora)) {
-        submora = MoraStr_from_unicode_(submora, true);
-        if (!submora) {return NULL;}
-    } else if (MoraStr_Check(submora)) {
-        Py_INCREF(submora);
-    } else {
-        PyErr_Format(PyExc_TypeError,
-            "argument 1 must be a kana string "
-            "or a MoraStr object, not '%.200s'",
-            Py_TYPE(submora)->tp_name);
-        return NULL;
+
+/* Exports the table into new arrays; *k is the number of n-grams. */
+static int
+NgramCounter_export_(NgramCounterObject *self,
+        uint16_t **grams, uint64_t **counts, Py_ssize_t *k)
+{
+    *k = ngram_table_size(self->table);
+    *grams = PyMem_New(uint16_t, (size_t)(*k ? *k : 1) * self->n);
+    *counts = PyMem_New(uint64_t, *k ? *k : 1);
+    if (!*grams || !*counts) {
+        PyMem_Free(*grams);
+        PyMem_Free(*counts);
+        PyErr_NoMemory();
+        return -1;
     }
-    PyObject *morastr, *substr;
-    Py_ssize_t mora_cnt, submora_cnt;
-    mora_cnt = Py_SIZE(self);
-    submora_cnt = Py_SIZE(submora);
+    ngram_table_export(self->table, *grams, *counts);
+    return 0;
+}
 
-    if (mora_cnt < submora_cnt) {
-        morastr = submora;
-        substr = MoraStr_STRING(self);
-        submora_cnt = mora_cnt;
-        Py_INCREF(substr);
-    } else {
-        morastr = self;
-        Py_INCREF(morastr);
-        substr = MoraStr_STRING(submora);
-        Py_INCREF(substr);
-        Py_DECREF(submora);
+
+static PyObject *
+NgramCounter_todict(NgramCounterObject *self, PyObject *Py_UNUSED(ignored)) {
+    uint16_t *grams;
+    uint64_t *counts;
+    Py_ssize_t k, n = self->n;
+    if (NgramCounter_export_(self, &grams, &counts, &k) < 0) {return NULL;}
+
+    PyObject *result = PyDict_New();
+    if (!result) {goto done;}
+    for (Py_ssize_t i = 0; i < k; ++i) {
+        PyObject *key = PyTuple_New(n), *value;
+        if (!key) {goto error;}
+        for (Py_ssize_t j = 0; j < n; ++j) {
+            PyObject *mora = mora_id_str_(grams[i*n+j]);
+            if (!mora) {
+                Py_DECREF(key);
+                goto error;
+            }
+            PyTuple_SET_ITEM(key, j, mora);
+        }
+        value = PyLong_FromUnsignedLongLong(counts[i]);
+        int status = value ? PyDict_SetItem(result, key, value) : -1;
+        Py_DECREF(key);
+        Py_XDECREF(value);
+        if (status < 0) {goto error;}
     }
+    goto done;
 
-{ /* got ownership */
-    MoraStrFindIterObject *it;
-    it = PyObject_GC_New(MoraStrFindIterObject, &MoraStrFindIterType);
-    if (!it) {goto error;}
+error:
+    Py_CLEAR(result);
+done:
+    PyMem_Free(grams);
+    PyMem_Free(counts);
+    return result;
+}
 
-    it->ptr = it->state.pool + 1;
-    it->morastr = morastr;
-    it->substr = substr;
-    it->needle_cache = NULL;
-    it->submora_cnt = MINDEX(submora_cnt);
-    it->state.pos = charwise ? -1 : 0;
-    memset((void*)(it->state.pool+1), -1,
-        sizeof(MINDEX_T)*(FINDITER_POOL_LIMIT));
 
-    PyObject_GC_Track(it);
-    return (PyObject *)it;
+static PyObject *
+NgramCounter_toarrays(NgramCounterObject *self, PyObject *Py_UNUSED(ignored)) {
+    uint16_t *grams;
+    uint64_t *counts;
+    Py_ssize_t k, n = self->n;
+    if (NgramCounter_export_(self, &grams, &counts, &k) < 0) {return NULL;}
+
+    PyObject *result = NULL, *grams_view = NULL, *counts_array = NULL;
+    PyObject *data = PyBytes_FromStringAndSize(
+        (const char *)grams, (Py_ssize_t)sizeof(uint16_t) * k * n);
+    if (!data) {goto done;}
+    grams_view = MoraBuffer_view_(data, PyBytes_AS_STRING(data),
+        "H", sizeof(uint16_t), k, n);
+    Py_DECREF(data);
+    if (!grams_view) {goto done;}
+    counts_array = new_typed_array(
+        "Q", counts, (Py_ssize_t)sizeof(uint64_t) * k);
+    if (!counts_array) {goto done;}
+    result = PyTuple_Pack(2, grams_view, counts_array);
+
+done:
+    Py_XDECREF(grams_view);
+    Py_XDECREF(counts_array);
+    PyMem_Free(grams);
+    PyMem_Free(counts);
+    return result;
 }
 
-error:
-    Py_DECREF(morastr);
-    Py_DECREF(substr);
-    return NULL;
+
+static PyObject *
+NgramCounter_get_total(NgramCounterObject *self, void *Py_UNUSED(closure)) {
+    return PyLong_FromUnsignedLongLong(ngram_table_total(self->table));
+}
+
+
+static PyObject *
+NgramCounter_repr(NgramCounterObject *self) {
+    return PyUnicode_FromFormat("NgramCounter(%zd)", self->n);
 }
 
 
+static PyMappingMethods ngramcounter_as_mapping = {
+    .mp_length = (lenfunc)NgramCounter_length,
+    .mp_subscript = (binaryfunc)NgramCounter_subscript,
+};
+
+static PyMethodDef NgramCounter_methods[] = {
+    {"add", (PyCFunction)NgramCounter_add,
+     METH_O, PyDoc_STR(
+     "add($self, morastr, /)\n"
+     "--\n\n"
+     "Counts the n-grams of a kana string or a MoraStr object. A \n"
+     "MoraStrArray counts those of each element; no n-gram spans two \n"
+     "elements.")},
+    {"update", (PyCFunction)NgramCounter_update,
+     METH_O, PyDoc_STR(
+     "update($self, iterable, /)\n"
+     "--\n\n"
+     "Calls add() on each item of iterable.")},
+    {"todict", (PyCFunction)NgramCounter_todict,
+     METH_NOARGS, PyDoc_STR(
+     "todict($self, /)\n"
+     "--\n\n"
+     "Returns a dict mapping each n-gram, as a tuple of mora strings, to \n"
+     "its count.")},
+    {"toarrays", (PyCFunction)NgramCounter_toarrays,
+     METH_NOARGS, PyDoc_STR(
+     "toarrays($self, /)\n"
+     "--\n\n"
+     "Returns a pair (grams, counts): a read-only memoryview of format \n"
+     "'H' and shape (len(self), n) holding the mora IDs of each n-gram, \n"
+     "and an array('Q') of their counts.")},
+    {NULL, NULL}
+};
+
+static PyMemberDef NgramCounter_members[] = {
+    {"n", T_PYSSIZET, offsetof(NgramCounterObject, n), READONLY, PyDoc_STR(
+     "Number of morae in each n-gram.")},
+    {NULL}
+};
+
+static PyGetSetDef NgramCounter_getset[] = {
+    {"total", (getter)NgramCounter_get_total, NULL, PyDoc_STR(
+     "Number of n-grams counted so far, with repetitions."), NULL},
+    {NULL}
+};
+
+static PyTypeObject NgramCounterType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "morastrja.NgramCounter",
+    .tp_basicsize = sizeof(NgramCounterObject),
+    .tp_dealloc = (destructor)NgramCounter_dealloc,
+    .tp_repr = (reprfunc)NgramCounter_repr,
+    .tp_as_mapping = &ngramcounter_as_mapping,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR(
+     "NgramCounter(n, /) -> NgramCounter\n" \
+     "\n" \
+     "Counts mora n-grams over many kana strings, MoraStr objects or \n"
+     "MoraStrArray objects. n-grams of common morae are counted in a dense \n"
+     "array for n <= 2, and the rest in a hash table keyed by mora IDs. \n"
+     "counter[ngram] returns the count of an n-gram given as a string of \n"
+     "n morae, and len(counter) the number of distinct n-grams."),
+    .tp_methods = NgramCounter_methods,
+    .tp_members = NgramCounter_members,
+    .tp_getset = NgramCounter_getset,
+    .tp_new = (newfunc)NgramCounter_new,
+};
+
+
 static PyObject *
 Empty_MoraStr_make(void) {
     static PyTypeObject *type = &MoraStrType;
@@ -4482,6 +11735,32 @@ PyInit__morastr(void) {
 
     if (PyType_Ready(&MoraStrIterType) < 0) {return NULL;}
 
+    if (PyType_Ready(&MoraStrRFindIterType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraTransTableType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraStrApproxIterType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraMatcherType) < 0) {return NULL;}
+
+    if (PyType_Ready(&PrefixSetType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraPatternType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraPatternIterType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraIndexType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraStrArrayType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraStrBuilderType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraRopeType) < 0) {return NULL;}
+
+    if (PyType_Ready(&NgramCounterType) < 0) {return NULL;}
+
+    if (PyType_Ready(&MoraBufferType) < 0) {return NULL;}
+
     m = PyModule_Create(&morastrmodule);
     if (m == NULL) {return NULL;}
     Py_INCREF(&MoraStrType);
@@ -4489,10 +11768,59 @@ PyInit__morastr(void) {
     if (PyModule_AddObject(m, "MoraStr", (PyObject *) &MoraStrType) < 0) {
         goto error;
     }
+    Py_INCREF(&MoraMatcherType);
+    if (PyModule_AddObject(
+            m, "MoraMatcher", (PyObject *) &MoraMatcherType) < 0) {
+        Py_DECREF(&MoraMatcherType);
+        goto error;
+    }
+    Py_INCREF(&PrefixSetType);
+    if (PyModule_AddObject(
+            m, "PrefixSet", (PyObject *) &PrefixSetType) < 0) {
+        Py_DECREF(&PrefixSetType);
+        goto error;
+    }
+    Py_INCREF(&MoraPatternType);
+    if (PyModule_AddObject(
+            m, "MoraPattern", (PyObject *) &MoraPatternType) < 0) {
+        Py_DECREF(&MoraPatternType);
+        goto error;
+    }
+    Py_INCREF(&MoraIndexType);
+    if (PyModule_AddObject(
+            m, "MoraIndex", (PyObject *) &MoraIndexType) < 0) {
+        Py_DECREF(&MoraIndexType);
+        goto error;
+    }
+    Py_INCREF(&MoraStrArrayType);
+    if (PyModule_AddObject(
+            m, "MoraStrArray", (PyObject *) &MoraStrArrayType) < 0) {
+        Py_DECREF(&MoraStrArrayType);
+        goto error;
+    }
+    Py_INCREF(&MoraStrBuilderType);
+    if (PyModule_AddObject(
+            m, "MoraStrBuilder", (PyObject *) &MoraStrBuilderType) < 0) {
+        Py_DECREF(&MoraStrBuilderType);
+        goto error;
+    }
+    Py_INCREF(&MoraRopeType);
+    if (PyModule_AddObject(
+            m, "MoraRope", (PyObject *) &MoraRopeType) < 0) {
+        Py_DECREF(&MoraRopeType);
+        goto error;
+    }
+    Py_INCREF(&NgramCounterType);
+    if (PyModule_AddObject(
+            m, "NgramCounter", (PyObject *) &NgramCounterType) < 0) {
+        Py_DECREF(&NgramCounterType);
+        goto error;
+    }
 
     hankaku_pair_map = PyDict_New();
     if (!hankaku_pair_map) {goto error;}
     init_katakana_table();
+    if (init_mora_ids() < 0) {goto error;}
 
     return m;
 }
@@ -0,0 +1,354 @@
+#include "cmorastr_acmatch.h"
+
+// size_t ACMATCH_TABLE_SIZE
+// size_t CHAR_INDEX(Katakana ch)
+// size_t ACMATCH_DENSE_LIMIT
+
+
+struct ACAutomaton {
+    int32_t n_states;
+    int32_t n_patterns;
+    int32_t state_cap;
+    int32_t pattern_cap;
+    bool dense;
+    /* dense: full transition table (n_states x ACMATCH_TABLE_SIZE) */
+    int32_t *delta;
+    /* compressed: sorted edges per state + root row */
+    int32_t *edge_off;
+    unsigned char *edge_sym;
+    int32_t *edge_dst;
+    int32_t root[ACMATCH_TABLE_SIZE];
+    /* shared */
+    int32_t *fail;
+    int32_t *term;
+    int32_t *dict;
+    int32_t *dup;
+    MINDEX_T *p_len;
+    MINDEX_T *p_moracnt;
+    /* trie under construction */
+    int32_t *child;
+    int32_t *sibling;
+    unsigned char *sym;
+};
+
+
+#define AC_GROW_ARRAY(p, TYPE, n) ac_grow_array_((void **)&(p), sizeof(TYPE), (n))
+
+static inline int
+ac_grow_array_(void **p, size_t size, int32_t n) {
+    char *q = *p;
+    if ((size_t)n > PY_SSIZE_T_MAX / size) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    MoraStr_RESIZE(q, char, size * (size_t)n);
+    if (!q) {  /* *p is left intact */
+        PyErr_NoMemory();
+        return -1;
+    }
+    *p = q;
+    return 0;
+}
+
+
+static int
+ac_automaton_grow_states_(struct ACAutomaton *ac) {
+    int32_t cap = ac->state_cap ? ac->state_cap : 64;
+    if (ac->state_cap) {
+        if (cap > MINDEX_MAX / 2) {
+            PyErr_SetString(PyExc_OverflowError, "too many patterns");
+            return -1;
+        }
+        cap *= 2;
+    }
+    if (AC_GROW_ARRAY(ac->child, int32_t, cap) < 0 ||
+        AC_GROW_ARRAY(ac->sibling, int32_t, cap) < 0 ||
+        AC_GROW_ARRAY(ac->term, int32_t, cap) < 0 ||
+        AC_GROW_ARRAY(ac->sym, unsigned char, cap) < 0) {return -1;}
+    ac->state_cap = cap;
+    return 0;
+}
+
+
+static int
+ac_automaton_grow_patterns_(struct ACAutomaton *ac) {
+    int32_t cap = ac->pattern_cap ? ac->pattern_cap * 2 : 16;
+    if (ac->pattern_cap > MINDEX_MAX / 2) {
+        PyErr_SetString(PyExc_OverflowError, "too many patterns");
+        return -1;
+    }
+    if (AC_GROW_ARRAY(ac->dup, int32_t, cap) < 0 ||
+        AC_GROW_ARRAY(ac->p_len, MINDEX_T, cap) < 0 ||
+        AC_GROW_ARRAY(ac->p_moracnt, MINDEX_T, cap) < 0) {return -1;}
+    ac->pattern_cap = cap;
+    return 0;
+}
+
+
+static struct ACAutomaton *
+ac_automaton_new(void) {
+    struct ACAutomaton *ac;
+    ac = (struct ACAutomaton *)PyMem_Calloc(1, sizeof(struct ACAutomaton));
+    if (!ac) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    ac->n_states = 1;
+    ac->state_cap = 0;
+    if (ac_automaton_grow_states_(ac) < 0) {
+        PyMem_Free(ac);
+        return NULL;
+    }
+    ac->child[0] = ac->sibling[0] = 0;
+    ac->term[0] = -1;
+    return ac;
+}
+
+
+static inline int32_t
+ac_trie_child_(const struct ACAutomaton *ac, int32_t state, unsigned int c) {
+    int32_t v = ac->child[state];
+    while (v) {
+        if (ac->sym[v] == c) {return v;}
+        v = ac->sibling[v];
+    }
+    return 0;
+}
+
+
+static int
+ac_automaton_add(
+    struct ACAutomaton *ac, const Katakana *p, Py_ssize_t p_len,
+    Py_ssize_t p_moracnt)
+{
+    MoraStr_assert(p_len > 0 && ac->child);
+    if (p_len > MINDEX_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "pattern is too long");
+        return -1;
+    }
+    if (ac->n_patterns == ac->pattern_cap) {
+        if (ac_automaton_grow_patterns_(ac) < 0) {return -1;}
+    }
+
+    int32_t state = 0;
+    for (Py_ssize_t i = 0; i < p_len; ++i) {
+        unsigned int c = (unsigned int)CHAR_INDEX(p[i]);
+        int32_t next = ac_trie_child_(ac, state, c);
+        if (!next) {
+            if (ac->n_states == ac->state_cap) {
+                if (ac_automaton_grow_states_(ac) < 0) {return -1;}
+            }
+            next = ac->n_states++;
+            ac->child[next] = 0;
+            ac->term[next] = -1;
+            ac->sym[next] = (unsigned char)c;
+            ac->sibling[next] = ac->child[state];
+            ac->child[state] = next;
+        }
+        state = next;
+    }
+
+    int32_t pid = ac->n_patterns++;
+    ac->p_len[pid] = MINDEX(p_len);
+    ac->p_moracnt[pid] = MINDEX(p_moracnt);
+    ac->dup[pid] = -1;
+    if (ac->term[state] == -1) {
+        ac->term[state] = pid;
+    } else {
+        /* keep duplicates in ascending order of pattern ids */
+        int32_t q = ac->term[state];
+        while (ac->dup[q] != -1) {q = ac->dup[q];}
+        ac->dup[q] = pid;
+    }
+    return 0;
+}
+
+
+static int
+ac_automaton_compile(struct ACAutomaton *ac) {
+    int32_t n = ac->n_states;
+    int32_t *queue = NULL;
+
+    ac->fail = (int32_t *)MoraStr_Malloc(sizeof(int32_t)*n);
+    ac->dict = (int32_t *)MoraStr_Malloc(sizeof(int32_t)*n);
+    queue = (int32_t *)MoraStr_Malloc(sizeof(int32_t)*n);
+    if (!ac->fail || !ac->dict || !queue) {goto nomemory;}
+
+    ac->dense = (n <= ACMATCH_DENSE_LIMIT);
+    if (ac->dense) {
+        size_t size = sizeof(int32_t) * ACMATCH_TABLE_SIZE * (size_t)n;
+        ac->delta = (int32_t *)MoraStr_Malloc(size);
+        if (!ac->delta) {goto nomemory;}
+    } else {
+        ac->edge_off = (int32_t *)MoraStr_Malloc(sizeof(int32_t)*(n + 1));
+        ac->edge_sym = (unsigned char *)MoraStr_Malloc(n);
+        ac->edge_dst = (int32_t *)MoraStr_Malloc(sizeof(int32_t)*n);
+        if (!ac->edge_off || !ac->edge_sym || !ac->edge_dst) {
+            goto nomemory;
+        }
+    }
+
+    /* breadth-first traversal; failure links of shallower states */
+    /* are always resolved before deeper ones */
+    int32_t head = 0, tail = 0;
+    ac->fail[0] = ac->dict[0] = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        int32_t u = queue[head++];
+        for (int32_t v = ac->child[u]; v; v = ac->sibling[v]) {
+            unsigned int c = ac->sym[v];
+            int32_t f = 0;
+            if (u) {
+                f = ac->fail[u];
+                while (true) {
+                    int32_t w = ac_trie_child_(ac, f, c);
+                    if (w) {f = w; break;}
+                    if (!f) {break;}
+                    f = ac->fail[f];
+                }
+            }
+            ac->fail[v] = f;
+            ac->dict[v] = (ac->term[f] != -1) ? f : ac->dict[f];
+            queue[tail++] = v;
+        }
+    }
+    MoraStr_assert(tail == n);
+
+    if (ac->dense) {
+        for (int32_t i = 0; i < n; ++i) {
+            int32_t u = queue[i];
+            int32_t *row = ac->delta + (size_t)u * ACMATCH_TABLE_SIZE;
+            if (u) {
+                const int32_t *frow = \
+                    ac->delta + (size_t)ac->fail[u] * ACMATCH_TABLE_SIZE;
+                memcpy(row, frow, sizeof(int32_t) * ACMATCH_TABLE_SIZE);
+            } else {
+                memset(row, 0, sizeof(int32_t) * ACMATCH_TABLE_SIZE);
+            }
+            for (int32_t v = ac->child[u]; v; v = ac->sibling[v]) {
+                row[ac->sym[v]] = v;
+            }
+        }
+    } else {
+        int32_t k = 0;
+        for (int32_t u = 0; u < n; ++u) {
+            ac->edge_off[u] = k;
+            int32_t first = k;
+            for (int32_t v = ac->child[u]; v; v = ac->sibling[v]) {
+                /* insertion sort; out-degrees are tiny on average */
+                unsigned char c = ac->sym[v];
+                int32_t j = k++;
+                while (j > first && ac->edge_sym[j-1] > c) {
+                    ac->edge_sym[j] = ac->edge_sym[j-1];
+                    ac->edge_dst[j] = ac->edge_dst[j-1];
+                    --j;
+                }
+                ac->edge_sym[j] = c;
+                ac->edge_dst[j] = v;
+            }
+        }
+        ac->edge_off[n] = k;
+        memset(ac->root, 0, sizeof(ac->root));
+        for (int32_t v = ac->child[0]; v; v = ac->sibling[v]) {
+            ac->root[ac->sym[v]] = v;
+        }
+    }
+
+    MoraStr_Free(queue);
+    MoraStr_Free(ac->child); ac->child = NULL;
+    MoraStr_Free(ac->sibling); ac->sibling = NULL;
+    MoraStr_Free(ac->sym); ac->sym = NULL;
+    return 0;
+
+nomemory:
+    MoraStr_Free(queue);
+    PyErr_NoMemory();
+    return -1;
+}
+
+
+static inline int32_t
+ac_automaton_next_(const struct ACAutomaton *ac, int32_t state, unsigned int c) {
+    if (ac->dense) {
+        return ac->delta[(size_t)state * ACMATCH_TABLE_SIZE + c];
+    }
+    while (state) {
+        int32_t lo = ac->edge_off[state], hi = ac->edge_off[state+1];
+        while (lo < hi) {
+            int32_t mid = (lo + hi) >> 1;
+            if (ac->edge_sym[mid] < c) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < ac->edge_off[state+1] && ac->edge_sym[lo] == c) {
+            return ac->edge_dst[lo];
+        }
+        state = ac->fail[state];
+    }
+    return ac->root[c];
+}
+
+
+static int
+ac_automaton_scan(
+    const struct ACAutomaton *ac, const Katakana *s, Py_ssize_t mora_cnt,
+    const MINDEX_T *indices, ACMatchHandler handler, void *context)
+{
+    MINDEX_T *last_end = (MINDEX_T *)PyMem_Calloc(
+        ac->n_patterns ? ac->n_patterns : 1, sizeof(MINDEX_T));
+    if (!last_end) {
+        PyErr_NoMemory();
+        return -1;
+    }
+
+    int status = 0;
+    int32_t state = 0;
+    Py_ssize_t i = 0;
+    for (Py_ssize_t k = 0; k < mora_cnt; ++k) {
+        Py_ssize_t end = indices ? indices[k] : k + 1;
+        for (; i < end; ++i) {
+            state = ac_automaton_next_(
+                ac, state, (unsigned int)CHAR_INDEX(s[i]));
+        }
+        int32_t t = (ac->term[state] != -1) ? state : ac->dict[state];
+        while (t) {
+            for (int32_t pid = ac->term[t]; pid != -1; pid = ac->dup[pid]) {
+                Py_ssize_t m_idx = k + 1 - ac->p_moracnt[pid];
+                if (m_idx < last_end[pid]) {continue;}
+                Py_ssize_t s_idx = !m_idx ? 0LL :
+                    indices ? indices[m_idx-1] : m_idx;
+                if (s_idx != end - ac->p_len[pid]) {continue;}
+                last_end[pid] = MINDEX(k + 1);
+                status = handler(context, m_idx, s_idx, pid);
+                if (status) {goto done;}
+            }
+            t = ac->dict[t];
+        }
+    }
+
+done:
+    PyMem_Free(last_end);
+    return status < 0 ? -1 : status;
+}
+
+
+static void
+ac_automaton_dealloc(struct ACAutomaton *ac) {
+    if (!ac) {return;}
+    MoraStr_Free(ac->delta);
+    MoraStr_Free(ac->edge_off);
+    MoraStr_Free(ac->edge_sym);
+    MoraStr_Free(ac->edge_dst);
+    MoraStr_Free(ac->fail);
+    MoraStr_Free(ac->term);
+    MoraStr_Free(ac->dict);
+    MoraStr_Free(ac->dup);
+    MoraStr_Free(ac->p_len);
+    MoraStr_Free(ac->p_moracnt);
+    MoraStr_Free(ac->child);
+    MoraStr_Free(ac->sibling);
+    MoraStr_Free(ac->sym);
+    PyMem_Free(ac);
+}
@@ -0,0 +1,37 @@
+#include "cmorastr_pre.h"
+
+
+#ifndef ACMATCH_TABLE_SIZE
+  #define ACMATCH_TABLE_SIZE KATAKANA_RNG
+#endif
+#ifndef CHAR_INDEX
+  #define CHAR_INDEX(ch) KANA_ID(ch)
+#endif
+#ifndef ACMATCH_DENSE_LIMIT
+  #define ACMATCH_DENSE_LIMIT 8192
+#endif
+
+
+struct ACAutomaton;
+
+typedef int (*ACMatchHandler)(
+    void *context, Py_ssize_t mora_idx, Py_ssize_t char_idx, int32_t pid);
+
+static struct ACAutomaton *
+ac_automaton_new(void);
+
+static int
+ac_automaton_add(
+    struct ACAutomaton *ac, const Katakana *p, Py_ssize_t p_len,
+    Py_ssize_t p_moracnt);
+
+static int
+ac_automaton_compile(struct ACAutomaton *ac);
+
+static int
+ac_automaton_scan(
+    const struct ACAutomaton *ac, const Katakana *s, Py_ssize_t mora_cnt,
+    const MINDEX_T *indices, ACMatchHandler handler, void *context);
+
+static void
+ac_automaton_dealloc(struct ACAutomaton *ac);
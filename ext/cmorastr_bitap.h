@@ -4,22 +4,307 @@
 // size_t BITAP_TABLE_SIZE
 // type BITAP_UINT_T
 // type BITAP_VAR_UINT_T
+// type BITAP_CHAR_T (optional, Katakana by default)
+// BITAP_NAME_SUFFIX (optional, appended to the function names)
+// BITAP_PLAIN_ONLY (optional, only defines bitap_search_)
+// BITAP_FORWARD_ONLY (optional, leaves out the reverse and approximate
+//                     searches)
+// BITAP_WORDS (optional, BITAP_UINT_T is a struct of uint64_t w[BITAP_WORDS])
+// BITAP_MULTI (optional, also defines the packed multi-needle search)
+
+
+#ifdef BITAP_CHAR_T
+  #define BITAP_CHAR BITAP_CHAR_T
+#else
+  #define BITAP_CHAR Katakana
+#endif
+
+#ifdef BITAP_NAME_SUFFIX
+  #define MORASTR_SEARCH(name) \
+    JOIN(JOIN(name, BITAP_UINT_T), BITAP_NAME_SUFFIX)
+#else
+  #define MORASTR_SEARCH(name) JOIN(name, BITAP_UINT_T)
+#endif
+
+#ifdef BITAP_WORDS
+/* Multi-word state for needles longer than 64 characters. The needle
+ * occupies the top p_len bits, so shifting left drops finished states
+ * without masking. The word loops have fixed trip counts and compile to
+ * SSE2/AVX2 (or NEON) lanes where the target has them. */
 
+static Py_ssize_t
+MORASTR_SEARCH(bitap_search_) (
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len,
+    Py_ssize_t mora_off, Py_ssize_t count);
+
+static Py_ssize_t
+MORASTR_SEARCH(bitap_mora_search_) (
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len, Py_ssize_t mora_off,
+    Py_ssize_t p_moracnt, const MINDEX_T *indices, Py_ssize_t count);
+
+#ifndef BITAP_FORWARD_ONLY
+static void
+MORASTR_SEARCH(bitap_rev_prepare_) (
+    const Katakana *p, Py_ssize_t p_len, BITAP_UINT_T *table);
+
+static Py_ssize_t
+MORASTR_SEARCH(bitap_mora_rev_search_) (
+    const Katakana *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const Katakana *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const MINDEX_T *indices,
+    const BITAP_UINT_T *prepared);
+#endif
+
+
+static BITAP_UINT_T MORASTR_SEARCH(bitap_table_)[BITAP_TABLE_SIZE];
+#define BITAP_TABLE MORASTR_SEARCH(bitap_table_)
+#define BITAP_BITS (64 * BITAP_WORDS)
+
+#define BITVEC_SET(v, bit) \
+    ((v).w[(bit) / 64] |= (uint64_t)1 << ((bit) % 64))
+#define BITVEC_HIGH(v) ((v).w[BITAP_WORDS-1] >> 63)
+
+static inline bool
+MORASTR_SEARCH(bitvec_and_) (BITAP_UINT_T *d, const BITAP_UINT_T *b) {
+    uint64_t any = 0;
+    for (int i = 0; i < BITAP_WORDS; ++i) {
+        d->w[i] &= b->w[i];
+        any |= d->w[i];
+    }
+    return any != 0;
+}
+
+static inline void
+MORASTR_SEARCH(bitvec_shift_) (BITAP_UINT_T *d) {
+    for (int i = BITAP_WORDS - 1; i > 0; --i) {
+        d->w[i] = (d->w[i] << 1) | (d->w[i-1] >> 63);
+    }
+    d->w[0] <<= 1;
+}
+
+#define BITVEC_AND(d, b) MORASTR_SEARCH(bitvec_and_)(&(d), &(b))
+#define BITVEC_SHIFT(d) MORASTR_SEARCH(bitvec_shift_)(&(d))
+#define BITVEC_ONES(d) memset(&(d), 0xff, sizeof(BITAP_UINT_T))
+
+#define RESET_BITAP_TABLE() \
+    memset(BITAP_TABLE, 0, sizeof(BITAP_UINT_T) * BITAP_TABLE_SIZE)
+
+
+/* BNDM over the window [pos, pos+p_len). Returns the start of the first
+ * full match at or after *pos, advancing *pos past the examined windows,
+ * or -1 if limit is reached. */
+static inline Py_ssize_t
+MORASTR_SEARCH(bndm_next_) (
+    const BITAP_CHAR *s, Py_ssize_t p_len, Py_ssize_t *pos_p,
+    Py_ssize_t limit)
+{
+    Py_ssize_t pos = *pos_p;
+    while (pos < limit) {
+        BITAP_UINT_T d;
+        BITVEC_ONES(d);
+        Py_ssize_t j = p_len, last = p_len;
+        while (BITVEC_AND(d, BITAP_TABLE[CHAR_INDEX(s[pos+j-1])])) {
+            --j;
+            if (BITVEC_HIGH(d)) {
+                if (j > 0) {
+                    last = j;
+                } else {
+                    *pos_p = pos + last;
+                    return pos;
+                }
+            }
+            BITVEC_SHIFT(d);
+        }
+        pos += last;
+    }
+    *pos_p = pos;
+    return -1;
+}
+
+
+static Py_ssize_t
+MORASTR_SEARCH(bitap_search_) (
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len,
+    Py_ssize_t mora_off, Py_ssize_t count)
+{
+    MoraStr_assert(0 < p_len && p_len <= BITAP_BITS && count != 0);
+
+    s += mora_off; s_len -= mora_off;
+    Py_ssize_t limit = s_len - p_len + 1;
+    if (limit < 1) {return count;}
+
+    for (Py_ssize_t i = 0; i < p_len; ++i) {
+        BITVEC_SET(BITAP_TABLE[CHAR_INDEX(p[i])], BITAP_BITS - 1 - i);
+    }
+    Py_ssize_t pos = 0, found;
+    while ((found = MORASTR_SEARCH(bndm_next_)(s, p_len, &pos, limit)) >= 0) {
+        if (count == -1) {
+            count = mora_off + found;
+            break;
+        }
+        if (!(--count)) {break;}
+        pos = found + p_len;
+    }
+    RESET_BITAP_TABLE();
+    return count;
+}
+
+
+#ifndef BITAP_PLAIN_ONLY
+static Py_ssize_t
+MORASTR_SEARCH(bitap_mora_search_) (
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len, Py_ssize_t mora_off,
+    Py_ssize_t p_moracnt, const MINDEX_T *indices, Py_ssize_t count)
+{
+    MoraStr_assert(0 < p_len && p_len <= BITAP_BITS && count != 0);
+
+    Py_ssize_t pos = mora_off ? indices[mora_off-1] : 0LL;
+    Py_ssize_t limit = s_len - p_len + 1;
+    if (pos >= limit) {return count;}
+
+    for (Py_ssize_t i = 0; i < p_len; ++i) {
+        BITVEC_SET(BITAP_TABLE[CHAR_INDEX(p[i])], BITAP_BITS - 1 - i);
+    }
+    Py_ssize_t m_idx = mora_off, found;
+    while ((found = MORASTR_SEARCH(bndm_next_)(s, p_len, &pos, limit)) >= 0) {
+        while ((m_idx ? indices[m_idx-1] : 0) < found) {++m_idx;}
+        if ((m_idx ? indices[m_idx-1] : 0) != found
+            || indices[m_idx+p_moracnt-1] != MINDEX(found + p_len))
+        {
+            continue;
+        }
+        if (count == -1) {
+            count = m_idx;
+            break;
+        }
+        if (!(--count)) {break;}
+        pos = found + p_len;
+    }
+    RESET_BITAP_TABLE();
+    return count;
+}
+
+
+#ifndef BITAP_FORWARD_ONLY
+/* Fills a zeroed table for bitap_mora_rev_search_. */
+static void
+MORASTR_SEARCH(bitap_rev_prepare_) (
+    const Katakana *p, Py_ssize_t p_len, BITAP_UINT_T *table)
+{
+    for (Py_ssize_t j = 0; j < p_len; ++j) {
+        BITVEC_SET(table[CHAR_INDEX(p[j])], BITAP_BITS - p_len + j);
+    }
+}
+
+
+/* prepared is a table filled by bitap_rev_prepare_ for p, or NULL to
+   build one for this call only. */
+static Py_ssize_t
+MORASTR_SEARCH(bitap_mora_rev_search_) (
+    const Katakana *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const Katakana *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const MINDEX_T *indices,
+    const BITAP_UINT_T *prepared)
+{
+    MoraStr_assert(0 < p_len && p_len <= BITAP_BITS);
+
+    Py_ssize_t begin = (!indices || !mora_off) ? \
+        mora_off : (Py_ssize_t)indices[mora_off-1];
+    Py_ssize_t pos = s_len - p_len;
+    if (pos < begin) {return -1;}
+
+    const BITAP_UINT_T *table = prepared;
+    if (!table) {
+        MORASTR_SEARCH(bitap_rev_prepare_)(p, p_len, BITAP_TABLE);
+        table = BITAP_TABLE;
+    }
 
-#define MORASTR_SEARCH(name) JOIN(name, BITAP_UINT_T)
+    Py_ssize_t m_idx = s_moracnt - 1, result = -1;
+    while (pos >= begin) {
+        BITAP_UINT_T d;
+        BITVEC_ONES(d);
+        Py_ssize_t k = 0, shift = p_len;
+        while (BITVEC_AND(d, table[CHAR_INDEX(s[pos+k])])) {
+            ++k;
+            if (BITVEC_HIGH(d)) {
+                if (k < p_len) {
+                    shift = p_len - k;
+                } else if (!indices) {
+                    result = pos;
+                    goto post_process;
+                } else {
+                    Py_ssize_t end = pos + p_len;
+                    while (m_idx >= 0 && indices[m_idx] > end) {--m_idx;}
+                    Py_ssize_t m_start = m_idx - p_moracnt + 1;
+                    if (m_idx >= 0 && indices[m_idx] == end && m_start >= 0
+                        && (m_start ? indices[m_start-1] : 0) == pos)
+                    {
+                        result = m_start;
+                        goto post_process;
+                    }
+                }
+            }
+            BITVEC_SHIFT(d);
+        }
+        pos -= shift;
+    }
+
+post_process:
+    if (!prepared) {RESET_BITAP_TABLE();}
+    return result;
+}
+#endif /* BITAP_FORWARD_ONLY */
+#endif
+
+#undef BITAP_TABLE
+#undef BITAP_BITS
+#undef BITVEC_SET
+#undef BITVEC_HIGH
+#undef BITVEC_AND
+#undef BITVEC_SHIFT
+#undef BITVEC_ONES
+#undef RESET_BITAP_TABLE
+#else /* !BITAP_WORDS */
 
 static Py_ssize_t
 MORASTR_SEARCH(bitap_search_) (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len,
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len,
     Py_ssize_t mora_off, Py_ssize_t count);
 
+#ifndef BITAP_PLAIN_ONLY
+
 static Py_ssize_t
 MORASTR_SEARCH(bitap_mora_search_) (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len, Py_ssize_t mora_off,
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len, Py_ssize_t mora_off,
     Py_ssize_t p_moracnt, const MINDEX_T *indices, Py_ssize_t count);
 
+#ifndef BITAP_FORWARD_ONLY
+static void
+MORASTR_SEARCH(bitap_rev_prepare_) (
+    const Katakana *p, Py_ssize_t p_len, BITAP_UINT_T *table);
+
+static Py_ssize_t
+MORASTR_SEARCH(bitap_mora_rev_search_) (
+    const Katakana *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const Katakana *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const MINDEX_T *indices,
+    const BITAP_UINT_T *prepared);
+
+static Py_ssize_t
+MORASTR_SEARCH(bitap_approx_search_) (
+    const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t mora_off, Py_ssize_t mora_cnt,
+    const uint32_t *p_keys, Py_ssize_t p_moracnt,
+    int max_dist, int *dist_p);
+#endif
+#endif
+
 
 static BITAP_UINT_T MORASTR_SEARCH(bitap_table_)[BITAP_TABLE_SIZE];
 #define BITAP_TABLE MORASTR_SEARCH(bitap_table_)
@@ -37,8 +322,8 @@ static BITAP_UINT_T MORASTR_SEARCH(bitap_table_)[BITAP_TABLE_SIZE];
 
 static Py_ssize_t
 MORASTR_SEARCH(bitap_search_) (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len,
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len,
     Py_ssize_t mora_off, Py_ssize_t count)
 {
     MoraStr_assert(0 < p_len && count != 0);
@@ -52,10 +337,10 @@ MORASTR_SEARCH(bitap_search_) (
     Py_ssize_t gap;
 #define START_BIT() ((BITAP_UINT_T)1 << last_idx)
     for (uint32_t i = 0; i < last_idx; ++i) {
-        Katakana k = p[i];
+        BITAP_CHAR k = p[i];
         BITAP_TABLE[CHAR_INDEX(k)] |= START_BIT() >> i;
     }
-    Katakana last = p[last_idx];
+    BITAP_CHAR last = p[last_idx];
     bit_state = BITAP_TABLE[CHAR_INDEX(last)];
     BITAP_TABLE[CHAR_INDEX(last)] |= 1;
     gap = bit_state ? TZCNT(bit_state) : p_len;
@@ -63,14 +348,14 @@ MORASTR_SEARCH(bitap_search_) (
     Py_ssize_t i = 0, k = -1;
     while (i < limit) {
         BITAP_UINT_T bits;
-        Katakana kana = s[i+last_idx];
+        BITAP_CHAR kana = s[i+last_idx];
 
         if (kana != last) {
             bits = BITAP_TABLE[CHAR_INDEX(kana)];
             do {
                 i += bits ? TZCNT(bits) : last_idx + 1;
                 if (i >= limit) {goto post_process;}
-                Katakana prev = kana;
+                BITAP_CHAR prev = kana;
                 kana = s[i+last_idx];
                 if (prev == kana) {continue;}
                 bits = BITAP_TABLE[CHAR_INDEX(kana)];
@@ -135,10 +420,11 @@ post_process:
 }
 
 
+#ifndef BITAP_PLAIN_ONLY
 static Py_ssize_t
 MORASTR_SEARCH(bitap_mora_search_) (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len, Py_ssize_t mora_off,
+    const BITAP_CHAR *s, Py_ssize_t s_len,
+    const BITAP_CHAR *p, Py_ssize_t p_len, Py_ssize_t mora_off,
     Py_ssize_t p_moracnt, const MINDEX_T *indices, Py_ssize_t count)
 {
     MoraStr_assert(0 < p_len && count != 0);
@@ -152,10 +438,10 @@ MORASTR_SEARCH(bitap_mora_search_) (
     Py_ssize_t gap;
 #define START_BIT() ((BITAP_UINT_T)1 << last_idx)
     for (uint32_t i = 0; i < last_idx; ++i) {
-        Katakana k = p[i];
+        BITAP_CHAR k = p[i];
         BITAP_TABLE[CHAR_INDEX(k)] |= START_BIT() >> i;
     }
-    Katakana last = p[last_idx];
+    BITAP_CHAR last = p[last_idx];
     bit_state = BITAP_TABLE[CHAR_INDEX(last)];
     BITAP_TABLE[CHAR_INDEX(last)] |= 1;
     gap = bit_state ? TZCNT(bit_state) : p_len;
@@ -164,14 +450,14 @@ MORASTR_SEARCH(bitap_mora_search_) (
     Py_ssize_t k = -1;
     while (i < limit) {
         BITAP_UINT_T bits;
-        Katakana kana = s[i+last_idx];
+        BITAP_CHAR kana = s[i+last_idx];
 
         if (kana != last) {
             bits = BITAP_TABLE[CHAR_INDEX(kana)];
             do {
                 i += bits ? TZCNT(bits) : last_idx + 1;
                 if (i >= limit) {goto post_process;}
-                Katakana prev = kana;
+                BITAP_CHAR prev = kana;
                 kana = s[i+last_idx];
                 if (prev == kana) {continue;}
                 bits = BITAP_TABLE[CHAR_INDEX(kana)];
@@ -248,6 +534,322 @@ post_process:
     return count;
 }
 
+
+#ifndef BITAP_FORWARD_ONLY
+/* Fills a zeroed table for bitap_mora_rev_search_. */
+static void
+MORASTR_SEARCH(bitap_rev_prepare_) (
+    const Katakana *p, Py_ssize_t p_len, BITAP_UINT_T *table)
+{
+    for (Py_ssize_t j = 0; j < p_len; ++j) {
+        table[CHAR_INDEX(p[j])] |= (BITAP_UINT_T)1 << j;
+    }
+}
+
+
+/* Mirror of BNDM for the last occurrence: windows are tried from the right
+ * and each one is read forward, so the table holds the needle as is. A
+ * prefix of the window that is a suffix of the needle bounds the shift.
+ * prepared is a table filled by bitap_rev_prepare_ for p, or NULL to
+ * build one for this call only. */
+static Py_ssize_t
+MORASTR_SEARCH(bitap_mora_rev_search_) (
+    const Katakana *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const Katakana *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const MINDEX_T *indices,
+    const BITAP_UINT_T *prepared)
+{
+    MoraStr_assert(0 < p_len &&
+        p_len <= (Py_ssize_t)(sizeof(BITAP_UINT_T) * CHAR_BIT));
+
+    Py_ssize_t begin = (!indices || !mora_off) ? \
+        mora_off : (Py_ssize_t)indices[mora_off-1];
+    Py_ssize_t pos = s_len - p_len;
+    if (pos < begin) {return -1;}
+
+    const BITAP_UINT_T *table = prepared;
+    if (!table) {
+        MORASTR_SEARCH(bitap_rev_prepare_)(p, p_len, BITAP_TABLE);
+        table = BITAP_TABLE;
+    }
+    const BITAP_UINT_T high = (BITAP_UINT_T)1 << (p_len - 1);
+
+    Py_ssize_t m_idx = s_moracnt - 1, result = -1;
+    while (pos >= begin) {
+        BITAP_UINT_T state = ~(BITAP_UINT_T)0;
+        Py_ssize_t k = 0, shift = p_len;
+        do {
+            state &= table[CHAR_INDEX(s[pos+k])];
+            ++k;
+            if (state & high) {
+                if (k < p_len) {
+                    shift = p_len - k;
+                } else if (!indices) {
+                    result = pos;
+                    goto post_process;
+                } else {
+                    Py_ssize_t end = pos + p_len;
+                    while (m_idx >= 0 && indices[m_idx] > end) {--m_idx;}
+                    Py_ssize_t m_start = m_idx - p_moracnt + 1;
+                    if (m_idx >= 0 && indices[m_idx] == end && m_start >= 0
+                        && (m_start ? indices[m_start-1] : 0) == pos)
+                    {
+                        result = m_start;
+                        goto post_process;
+                    }
+                }
+            }
+            state <<= 1;
+        } while (state && k < p_len);
+        pos -= shift;
+    }
+
+post_process:
+    if (!prepared) {RESET_BITAP_TABLE();}
+    return result;
+}
+
+
+/* Wu-Manber: bit j of states[d] is set if p[0..j] matches a suffix of
+   the text read so far with at most d edits, each of which replaces,
+   inserts or deletes a whole mora. Returns the mora index where the
+   first match ends, extended as long as the distance does not increase,
+   or -1. */
+static Py_ssize_t
+MORASTR_SEARCH(bitap_approx_search_) (
+    const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t mora_off, Py_ssize_t mora_cnt,
+    const uint32_t *p_keys, Py_ssize_t p_moracnt,
+    int max_dist, int *dist_p)
+{
+    enum {N_SLOTS = 2 * sizeof(BITAP_UINT_T) * CHAR_BIT};
+    MoraStr_assert(0 < p_moracnt &&
+                   p_moracnt <= (Py_ssize_t)sizeof(BITAP_UINT_T) * CHAR_BIT);
+    MoraStr_assert(0 <= max_dist && max_dist < p_moracnt);
+
+    uint32_t slot_keys[N_SLOTS] = {0};
+    BITAP_UINT_T slot_masks[N_SLOTS];
+#define MORA_SLOT(key) ((uint32_t)((key) * 0x9E3779B1U) % N_SLOTS)
+    for (Py_ssize_t j = 0; j < p_moracnt; ++j) {
+        uint32_t key = p_keys[j], h = MORA_SLOT(key);
+        while (slot_keys[h] && slot_keys[h] != key) {h = (h + 1) % N_SLOTS;}
+        if (!slot_keys[h]) {
+            slot_keys[h] = key;
+            slot_masks[h] = 0;
+        }
+        slot_masks[h] |= (BITAP_UINT_T)1 << j;
+    }
+
+    BITAP_UINT_T states[sizeof(BITAP_UINT_T) * CHAR_BIT];
+    BITAP_UINT_T goal = (BITAP_UINT_T)1 << (p_moracnt - 1);
+    for (int d = 0; d <= max_dist; ++d) {
+        states[d] = ((BITAP_UINT_T)1 << d) - 1;
+    }
+
+    int best = -1;
+    Py_ssize_t best_end = -1;
+    Py_ssize_t head = mora_off ? (indices ? indices[mora_off-1] : mora_off) : 0;
+    for (Py_ssize_t i = mora_off; i < mora_cnt; ++i) {
+        Py_ssize_t tail = indices ? indices[i] : i + 1;
+        uint32_t key = mora_key_(s + head, tail - head), h = MORA_SLOT(key);
+        head = tail;
+        while (slot_keys[h] && slot_keys[h] != key) {h = (h + 1) % N_SLOTS;}
+        BITAP_UINT_T mask = slot_keys[h] ? slot_masks[h] : 0;
+
+        BITAP_UINT_T prev = states[0];
+        states[0] = ((prev << 1) | 1) & mask;
+        int dist = (states[0] & goal) ? 0 : -1;
+        for (int d = 1; d <= max_dist; ++d) {
+            BITAP_UINT_T cur = states[d];
+            states[d] = (((cur << 1) | 1) & mask)   /* match */
+                      | (prev << 1) | prev          /* replace, insert */
+                      | (states[d-1] << 1) | 1;     /* delete */
+            prev = cur;
+            if (dist < 0 && (states[d] & goal)) {dist = d;}
+        }
+
+        if (best >= 0) {
+            if (dist < 0 || dist > best) {break;}
+        } else if (dist < 0) {
+            continue;
+        }
+        best = dist;
+        best_end = i + 1;
+        if (!best) {break;}
+    }
+#undef MORA_SLOT
+
+    *dist_p = best;
+    return best_end;
+}
+#endif /* BITAP_FORWARD_ONLY */
+#endif
+
+
+#ifdef BITAP_MULTI
+/* Packed shift-and over several needles at once. Each needle takes a run
+ * of consecutive bits, with its start bit in start_bits and its last bit
+ * in end_bits. A carry from one run into the next is harmless since the
+ * start bits are set again on every step. Short needles share a single
+ * word; longer sets spill over into more words with carries between
+ * them. */
+struct MORASTR_SEARCH(bitap_multi_) {
+    Py_ssize_t n_words;
+    Py_ssize_t used;
+    BITAP_UINT_T *table;        /* BITAP_TABLE_SIZE rows of n_words */
+    BITAP_UINT_T *start_bits;
+    BITAP_UINT_T *end_bits;
+    BITAP_UINT_T *state;
+    int32_t *p_len;             /* by end bit */
+    int32_t *p_moracnt;         /* by end bit */
+};
+
+#define BITAP_WORD_BITS ((Py_ssize_t)(sizeof(BITAP_UINT_T) * CHAR_BIT))
+
+
+static int
+MORASTR_SEARCH(bitap_multi_init_) (
+    struct MORASTR_SEARCH(bitap_multi_) *bm, Py_ssize_t n_bits)
+{
+    Py_ssize_t n_words = n_bits ? (n_bits - 1) / BITAP_WORD_BITS + 1 : 1;
+    n_bits = n_words * BITAP_WORD_BITS;
+    size_t size = sizeof(BITAP_UINT_T) * n_words * (BITAP_TABLE_SIZE + 3)
+                + sizeof(int32_t) * n_bits * 2;
+    BITAP_UINT_T *buf = (BITAP_UINT_T *)PyMem_Calloc(1, size);
+    if (!buf) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    bm->n_words = n_words;
+    bm->used = 0;
+    bm->table = buf;
+    bm->start_bits = buf + n_words * BITAP_TABLE_SIZE;
+    bm->end_bits = bm->start_bits + n_words;
+    bm->state = bm->end_bits + n_words;
+    bm->p_len = (int32_t *)(bm->state + n_words);
+    bm->p_moracnt = bm->p_len + n_bits;
+    return 0;
+}
+
+
+static void
+MORASTR_SEARCH(bitap_multi_add_) (
+    struct MORASTR_SEARCH(bitap_multi_) *bm,
+    const Katakana *p, Py_ssize_t p_len, Py_ssize_t p_moracnt)
+{
+    MoraStr_assert(0 < p_len);
+#define SET_BIT(v, bit) \
+    ((v)[(bit) / BITAP_WORD_BITS] |= (BITAP_UINT_T)1 << ((bit) % BITAP_WORD_BITS))
+
+    Py_ssize_t off = bm->used;
+    for (Py_ssize_t j = 0; j < p_len; ++j) {
+        SET_BIT(bm->table + CHAR_INDEX(p[j]) * bm->n_words, off + j);
+    }
+    SET_BIT(bm->start_bits, off);
+    SET_BIT(bm->end_bits, off + p_len - 1);
+    bm->p_len[off+p_len-1] = (int32_t)p_len;
+    bm->p_moracnt[off+p_len-1] = (int32_t)p_moracnt;
+    bm->used = off + p_len;
+#undef SET_BIT
+}
+
+
+/* Lets the character at bit of the packed needles also match c. */
+static void
+MORASTR_SEARCH(bitap_multi_accept_) (
+    struct MORASTR_SEARCH(bitap_multi_) *bm, Py_ssize_t bit, Katakana c)
+{
+    MoraStr_assert(bit < bm->used);
+    bm->table[CHAR_INDEX(c) * bm->n_words + bit / BITAP_WORD_BITS] |= \
+        (BITAP_UINT_T)1 << (bit % BITAP_WORD_BITS);
+}
+
+
+static void
+MORASTR_SEARCH(bitap_multi_dealloc_) (struct MORASTR_SEARCH(bitap_multi_) *bm)
+{
+    PyMem_Free(bm->table);
+    bm->table = NULL;
+}
+
+
+/* Scans the characters of morae [mora_off, ...) up to s_len. Matches are
+ * reported at their last character; among those ending at the same place
+ * the leftmost one is taken, and the scan then restarts after it. If
+ * anchored, only matches starting at mora_off are considered. Returns the
+ * mora index of the first match if count is -1, otherwise the count left
+ * after subtracting the matches. indices may be NULL only if every mora
+ * is a single character and so is every needle. */
+static Py_ssize_t
+MORASTR_SEARCH(bitap_multi_search_) (
+    struct MORASTR_SEARCH(bitap_multi_) *bm,
+    const Katakana *s, Py_ssize_t s_len, Py_ssize_t mora_off,
+    const MINDEX_T *indices, Py_ssize_t count, bool anchored)
+{
+    MoraStr_assert(count != 0);
+
+    Py_ssize_t n_words = bm->n_words;
+    BITAP_UINT_T *d = bm->state;
+    const BITAP_UINT_T *starts = bm->start_bits, *ends = bm->end_bits;
+    memset(d, 0, sizeof(BITAP_UINT_T) * n_words);
+
+    Py_ssize_t i = (!indices || !mora_off) ? \
+        mora_off : (Py_ssize_t)indices[mora_off-1];
+    Py_ssize_t m = mora_off, rem = count;
+    BITAP_UINT_T seed = ~(BITAP_UINT_T)0;
+    for (; i < s_len; ++i) {
+        const BITAP_UINT_T *row = bm->table + CHAR_INDEX(s[i]) * n_words;
+        BITAP_UINT_T carry = 0, alive = 0, hits = 0;
+        for (Py_ssize_t w = 0; w < n_words; ++w) {
+            BITAP_UINT_T next = d[w] >> (BITAP_WORD_BITS - 1);
+            d[w] = ((d[w] << 1) | carry | (starts[w] & seed)) & row[w];
+            carry = next;
+            alive |= d[w];
+            hits |= d[w] & ends[w];
+        }
+        if (anchored) {
+            if (!alive) {break;}
+            seed = 0;
+        }
+        if (!hits) {continue;}
+        if (indices) {
+            while (indices[m] <= i) {++m;}
+            if (indices[m] != i + 1) {continue;}
+        }
+
+        Py_ssize_t best = -1;
+        for (Py_ssize_t w = 0; w < n_words; ++w) {
+            BITAP_UINT_T bits = d[w] & ends[w];
+            while (bits) {
+                Py_ssize_t b = w * BITAP_WORD_BITS + TZCNT(bits);
+                bits &= bits - 1;
+                Py_ssize_t head = i + 1 - bm->p_len[b], k;
+                if (!indices) {
+                    k = head;
+                } else {
+                    k = m + 1 - bm->p_moracnt[b];
+                    if (k < mora_off ||
+                        (k ? (Py_ssize_t)indices[k-1] : 0) != head) {continue;}
+                }
+                if (best == -1 || k < best) {best = k;}
+            }
+        }
+        if (best == -1) {continue;}
+        if (count == -1) {return best;}
+        if (!(--rem)) {break;}
+        memset(d, 0, sizeof(BITAP_UINT_T) * n_words);
+    }
+    return rem;
+}
+
+#undef BITAP_WORD_BITS
+#endif
+
+
 #undef BITAP_TABLE
 #undef BITAP_NEXT_STATE
 #undef RESET_BITAP_TABLE
+#endif /* BITAP_WORDS */
+
+#undef BITAP_CHAR
+#undef MORASTR_SEARCH
@@ -0,0 +1,405 @@
+#include "cmorastr_moraindex.h"
+
+// Katakana MORAINDEX_SEPARATOR
+
+
+#define MORAINDEX_MAGIC "MORAIDX"
+#define MORAINDEX_BYTEORDER 0x01020304U
+#define MORAINDEX_VERSION 1U
+
+#define MORAINDEX_ALIGN4(n) (((n) + 3) & ~(size_t)3)
+#define MORAINDEX_N_WORDS(text_len) (((size_t)(text_len) + 31) / 32)
+
+
+static Py_ssize_t
+mora_index_nbytes(
+    Py_ssize_t n_docs, Py_ssize_t text_len, Py_ssize_t n_suffixes)
+{
+    if (text_len > MINDEX_MAX || n_docs >= MINDEX_MAX) {return -1;}
+    size_t n_words = MORAINDEX_N_WORDS(text_len);
+    size_t size = sizeof(MoraIndexHeader);
+    size += MORAINDEX_ALIGN4((size_t)text_len * sizeof(Katakana));
+    size += ((size_t)n_suffixes + (size_t)n_docs + 1) * sizeof(MINDEX_T);
+    size += n_words * (sizeof(uint32_t) + sizeof(MINDEX_T));
+    if (size > (size_t)PY_SSIZE_T_MAX) {return -1;}
+    return (Py_ssize_t)size;
+}
+
+
+static void
+mora_index_layout_(struct MoraIndexView *v, char *buf) {
+    MoraIndexHeader *h = (MoraIndexHeader *)buf;
+    size_t n_words = MORAINDEX_N_WORDS(h->text_len);
+    buf += sizeof(MoraIndexHeader);
+    v->header = h;
+    v->text = (Katakana *)buf;
+    buf += MORAINDEX_ALIGN4((size_t)h->text_len * sizeof(Katakana));
+    v->sa = (MINDEX_T *)buf;
+    buf += (size_t)h->n_suffixes * sizeof(MINDEX_T);
+    v->doc_off = (MINDEX_T *)buf;
+    buf += ((size_t)h->n_docs + 1) * sizeof(MINDEX_T);
+    v->bitmap = (uint32_t *)buf;
+    buf += n_words * sizeof(uint32_t);
+    v->rank = (MINDEX_T *)buf;
+}
+
+
+static void
+mora_index_builder_init(
+    struct MoraIndexBuilder *b, char *buf,
+    Py_ssize_t n_docs, Py_ssize_t text_len, Py_ssize_t n_suffixes)
+{
+    Py_ssize_t size = mora_index_nbytes(n_docs, text_len, n_suffixes);
+    MoraStr_assert(size >= 0);
+    memset(buf, 0, (size_t)size);
+
+    MoraIndexHeader *h = (MoraIndexHeader *)buf;
+    memcpy(h->magic, MORAINDEX_MAGIC, sizeof(MORAINDEX_MAGIC));
+    h->byteorder = MORAINDEX_BYTEORDER;
+    h->version = MORAINDEX_VERSION;
+    h->n_docs = (int32_t)n_docs;
+    h->text_len = (int32_t)text_len;
+    h->n_suffixes = (int32_t)n_suffixes;
+
+    mora_index_layout_(&b->view, buf);
+    b->view.size = size;
+    b->text_pos = b->sa_pos = b->doc = 0;
+}
+
+
+static void
+mora_index_builder_append(
+    struct MoraIndexBuilder *b, const Katakana *s, Py_ssize_t s_len,
+    Py_ssize_t mora_cnt, const MINDEX_T *indices)
+{
+    struct MoraIndexView *v = &b->view;
+    MINDEX_T base = MINDEX(b->text_pos);
+
+    memcpy(v->text + base, s, (size_t)s_len * sizeof(Katakana));
+    v->text[base + s_len] = MORAINDEX_SEPARATOR;
+    v->doc_off[b->doc++] = base;
+
+    for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+        MINDEX_T pos = base + (i ? (indices ? indices[i-1] : MINDEX(i)) : 0);
+        v->sa[b->sa_pos++] = pos;
+        v->bitmap[pos >> 5] |= 1U << (pos & 31);
+    }
+    b->text_pos += s_len + 1;
+}
+
+
+/* suffixes in the same bucket share their first two characters */
+static inline int
+mora_index_suffix_less_(const Katakana *text, MINDEX_T a, MINDEX_T b) {
+    const Katakana *s = text + a + 2;
+    const Katakana *t = text + b + 2;
+    for (;; ++s, ++t) {
+        if (*s != *t) {return *s < *t;}
+        if (*s == MORAINDEX_SEPARATOR) {return a < b;}
+    }
+}
+
+
+/* bottom-up merge sort of one bucket; the text is passed along instead of
+   being kept in a global, so concurrent builds don't interfere */
+static void
+mora_index_sort_bucket_(
+    const Katakana *text, MINDEX_T *sa, MINDEX_T *tmp, Py_ssize_t n)
+{
+    enum {RUN = 16};
+
+    for (Py_ssize_t lo = 0; lo < n; lo += RUN) {
+        Py_ssize_t hi = Py_MIN(lo + RUN, n);
+        for (Py_ssize_t i = lo + 1; i < hi; ++i) {
+            MINDEX_T pos = sa[i];
+            Py_ssize_t j = i;
+            while (j > lo && mora_index_suffix_less_(text, pos, sa[j-1])) {
+                sa[j] = sa[j-1];
+                --j;
+            }
+            sa[j] = pos;
+        }
+    }
+
+    MINDEX_T *src = sa, *dst = tmp;
+    for (Py_ssize_t width = RUN; width < n; width *= 2) {
+        for (Py_ssize_t lo = 0; lo < n; lo += 2 * width) {
+            Py_ssize_t mid = Py_MIN(lo + width, n);
+            Py_ssize_t hi = Py_MIN(lo + 2 * width, n);
+            Py_ssize_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                dst[k++] = mora_index_suffix_less_(text, src[j], src[i]) ? \
+                    src[j++] : src[i++];
+            }
+            while (i < mid) {dst[k++] = src[i++];}
+            while (j < hi) {dst[k++] = src[j++];}
+        }
+        MINDEX_T *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != sa) {memcpy(sa, src, (size_t)n * sizeof(MINDEX_T));}
+}
+
+
+static int
+mora_index_builder_finish(struct MoraIndexBuilder *b) {
+    enum {N_BUCKETS = KATAKANA_RNG * KATAKANA_RNG};
+
+    struct MoraIndexView *v = &b->view;
+    const MoraIndexHeader *h = v->header;
+    MoraStr_assert(b->doc == h->n_docs);
+    MoraStr_assert(b->text_pos == h->text_len);
+    MoraStr_assert(b->sa_pos == h->n_suffixes);
+    v->doc_off[h->n_docs] = h->text_len;
+
+    size_t n_words = MORAINDEX_N_WORDS(h->text_len);
+    MINDEX_T acc = 0;
+    for (size_t w = 0; w < n_words; ++w) {
+        v->rank[w] = acc;
+        acc += (MINDEX_T)POPCNT32(v->bitmap[w]);
+    }
+
+    Py_ssize_t n = h->n_suffixes;
+    if (n < 2) {return 0;}
+
+    /* bucket by the first two characters, then sort each bucket */
+    MINDEX_T *tmp = MoraStr_Malloc((size_t)n * sizeof(MINDEX_T));
+    MINDEX_T *bucket = MoraStr_Malloc((N_BUCKETS + 1) * sizeof(MINDEX_T));
+    if (!tmp || !bucket) {
+        MoraStr_Free(tmp);
+        MoraStr_Free(bucket);
+        PyErr_NoMemory();
+        return -1;
+    }
+    const Katakana *text = v->text;
+#define BUCKET_KEY(pos) \
+    (KANA_ID(text[(pos)]) * KATAKANA_RNG + KANA_ID(text[(pos)+1]))
+
+    memset(bucket, 0, (N_BUCKETS + 1) * sizeof(MINDEX_T));
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        bucket[BUCKET_KEY(v->sa[i]) + 1]++;
+    }
+    for (int k = 0; k < N_BUCKETS; ++k) {bucket[k+1] += bucket[k];}
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        MINDEX_T pos = v->sa[i];
+        tmp[bucket[BUCKET_KEY(pos)]++] = pos;
+    }
+    memcpy(v->sa, tmp, (size_t)n * sizeof(MINDEX_T));
+#undef BUCKET_KEY
+
+    /* the buckets are now shifted by one; buckets whose second character
+       is the separator are already in position order */
+    MINDEX_T start = 0;
+    for (int k = 0; k < N_BUCKETS; ++k) {
+        MINDEX_T end = bucket[k];
+        if (end - start > 1 && k % KATAKANA_RNG) {
+            mora_index_sort_bucket_(
+                text, v->sa + start, tmp + start, end - start);
+        }
+        start = end;
+    }
+
+    MoraStr_Free(tmp);
+    MoraStr_Free(bucket);
+    return 0;
+}
+
+
+static int
+mora_index_bind(struct MoraIndexView *v, char *buf, Py_ssize_t size) {
+    const MoraIndexHeader *h = (const MoraIndexHeader *)buf;
+    if ((size_t)size < sizeof(MoraIndexHeader) ||
+        memcmp(h->magic, MORAINDEX_MAGIC, sizeof(MORAINDEX_MAGIC)))
+    {
+        PyErr_SetString(PyExc_ValueError, "not a MoraIndex image");
+        return -1;
+    }
+    if (h->byteorder != MORAINDEX_BYTEORDER) {
+        PyErr_SetString(PyExc_ValueError,
+            "MoraIndex image has a different byte order");
+        return -1;
+    }
+    if (h->version != MORAINDEX_VERSION) {
+        PyErr_Format(PyExc_ValueError,
+            "unsupported MoraIndex version: %u", (unsigned int)h->version);
+        return -1;
+    }
+    if (h->n_docs < 0 || h->text_len < 0 || h->n_suffixes < 0 ||
+        h->n_suffixes > h->text_len ||
+        mora_index_nbytes(h->n_docs, h->text_len, h->n_suffixes) != size)
+    {
+        goto corrupted;
+    }
+    mora_index_layout_(v, buf);
+    v->size = size;
+
+    /* the search routines rely on these invariants for memory safety */
+    const Katakana *text = v->text;
+    MINDEX_T text_len = h->text_len;
+    if (v->doc_off[0] || v->doc_off[h->n_docs] != text_len) {
+        goto corrupted;
+    }
+    for (MINDEX_T d = 0; d < h->n_docs; ++d) {
+        MINDEX_T end = v->doc_off[d+1];
+        if (end <= v->doc_off[d] || end > text_len ||
+            text[end-1] != MORAINDEX_SEPARATOR) {goto corrupted;}
+    }
+    for (MINDEX_T i = 0; i < text_len; ++i) {
+        if ((size_t)KANA_ID(text[i]) >= KATAKANA_RNG) {goto corrupted;}
+    }
+    for (MINDEX_T i = 0; i < h->n_suffixes; ++i) {
+        MINDEX_T pos = v->sa[i];
+        if (pos < 0 || pos >= text_len ||
+            text[pos] == MORAINDEX_SEPARATOR) {goto corrupted;}
+    }
+    return 0;
+
+corrupted:
+    PyErr_SetString(PyExc_ValueError, "MoraIndex image is corrupted");
+    return -1;
+}
+
+
+static inline int
+mora_index_prefix_cmp_(
+    const Katakana *s, const Katakana *p, Py_ssize_t p_len)
+{
+    for (Py_ssize_t i = 0; i < p_len; ++i) {
+        if (s[i] != p[i]) {return s[i] < p[i] ? -1 : 1;}
+    }
+    return 0;
+}
+
+
+/* [*lo, *hi) is the range of suffixes starting with p */
+static void
+mora_index_range_(
+    const struct MoraIndexView *v, const Katakana *p, Py_ssize_t p_len,
+    Py_ssize_t *lo, Py_ssize_t *hi)
+{
+    const Katakana *text = v->text;
+    const MINDEX_T *sa = v->sa;
+    Py_ssize_t l = 0, r = v->header->n_suffixes;
+    while (l < r) {
+        Py_ssize_t mid = l + (r - l) / 2;
+        if (mora_index_prefix_cmp_(text + sa[mid], p, p_len) < 0) {
+            l = mid + 1;
+        } else {
+            r = mid;
+        }
+    }
+    *lo = l;
+    r = v->header->n_suffixes;
+    while (l < r) {
+        Py_ssize_t mid = l + (r - l) / 2;
+        if (mora_index_prefix_cmp_(text + sa[mid], p, p_len) <= 0) {
+            l = mid + 1;
+        } else {
+            r = mid;
+        }
+    }
+    *hi = l;
+}
+
+
+/* within a range of suffixes sharing a prefix of length depth,
+   find the sub-range whose next character is ch */
+static void
+mora_index_char_range_(
+    const struct MoraIndexView *v, Py_ssize_t depth, Katakana ch,
+    Py_ssize_t *lo, Py_ssize_t *hi)
+{
+    const Katakana *text = v->text + depth;
+    const MINDEX_T *sa = v->sa;
+    Py_ssize_t l = *lo, r = *hi, end = *hi;
+    while (l < r) {
+        Py_ssize_t mid = l + (r - l) / 2;
+        if (text[sa[mid]] < ch) {l = mid + 1;} else {r = mid;}
+    }
+    *lo = l;
+    r = end;
+    while (l < r) {
+        Py_ssize_t mid = l + (r - l) / 2;
+        if (text[sa[mid]] <= ch) {l = mid + 1;} else {r = mid;}
+    }
+    *hi = l;
+}
+
+
+static Py_ssize_t
+mora_index_count(
+    const struct MoraIndexView *v, const Katakana *p, Py_ssize_t p_len)
+{
+    MoraStr_assert(p_len > 0);
+    Py_ssize_t lo, hi;
+    mora_index_range_(v, p, p_len, &lo, &hi);
+    if (lo == hi) {return 0;}
+
+    /* drop matches whose last mora goes on with a small kana */
+    Py_ssize_t count = hi - lo;
+    Katakana last = p[p_len-1];
+    for (int code = 1; code < 16 && mora_small_chars[code]; ++code) {
+        Katakana ch = mora_small_chars[code];
+        if (!small_kana_attaches(last, ch)) {continue;}
+        Py_ssize_t l = lo, h = hi;
+        mora_index_char_range_(v, p_len, ch, &l, &h);
+        count -= h - l;
+    }
+    return count;
+}
+
+
+static int
+mora_index_pos_cmp_(const void *x, const void *y) {
+    MINDEX_T a = *(const MINDEX_T *)x, b = *(const MINDEX_T *)y;
+    return (a > b) - (a < b);
+}
+
+
+static Py_ssize_t
+mora_index_locate(
+    const struct MoraIndexView *v, const Katakana *p, Py_ssize_t p_len,
+    MINDEX_T **positions)
+{
+    MoraStr_assert(p_len > 0);
+    Py_ssize_t lo, hi;
+    mora_index_range_(v, p, p_len, &lo, &hi);
+
+    MINDEX_T *out = MoraStr_Malloc((size_t)(hi - lo + 1) * sizeof(MINDEX_T));
+    if (!out) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    const Katakana *text = v->text;
+    Katakana last = p[p_len-1];
+    Py_ssize_t n = 0;
+    for (Py_ssize_t i = lo; i < hi; ++i) {
+        MINDEX_T pos = v->sa[i];
+        if (!small_kana_attaches(last, text[pos + p_len])) {
+            out[n++] = pos;
+        }
+    }
+    qsort(out, (size_t)n, sizeof(MINDEX_T), mora_index_pos_cmp_);
+    *positions = out;
+    return n;
+}
+
+
+static Py_ssize_t
+mora_index_doc_of(const struct MoraIndexView *v, MINDEX_T pos) {
+    /* the last document whose offset is not greater than pos */
+    Py_ssize_t l = 0, r = v->header->n_docs;
+    while (r - l > 1) {
+        Py_ssize_t mid = l + (r - l) / 2;
+        if (v->doc_off[mid] <= pos) {l = mid;} else {r = mid;}
+    }
+    return l;
+}
+
+
+static MINDEX_T
+mora_index_rank(const struct MoraIndexView *v, MINDEX_T pos) {
+    uint32_t word = v->bitmap[pos >> 5] & ((1U << (pos & 31)) - 1U);
+    return v->rank[pos >> 5] + (MINDEX_T)POPCNT32(word);
+}
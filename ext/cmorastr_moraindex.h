@@ -0,0 +1,78 @@
+#include "cmorastr_pre.h"
+
+
+#ifndef MORAINDEX_SEPARATOR
+  #define MORAINDEX_SEPARATOR ((Katakana)KATAKANA_OFF)
+#endif
+
+
+/* Serialized layout (native byte order, every section 4-byte aligned):
+ *   MoraIndexHeader
+ *   Katakana text[text_len]      documents, each followed by a separator
+ *   MINDEX_T sa[n_suffixes]      sorted positions of mora starts
+ *   MINDEX_T doc_off[n_docs+1]   position of each document in text
+ *   uint32_t bitmap[n_words]     mora starts in text
+ *   MINDEX_T rank[n_words]       number of mora starts before each word
+ */
+typedef struct {
+    char magic[8];
+    uint32_t byteorder;
+    uint32_t version;
+    int32_t n_docs;
+    int32_t text_len;
+    int32_t n_suffixes;
+    int32_t reserved;
+} MoraIndexHeader;
+
+struct MoraIndexView {
+    MoraIndexHeader *header;
+    Katakana *text;
+    MINDEX_T *sa;
+    MINDEX_T *doc_off;
+    uint32_t *bitmap;
+    MINDEX_T *rank;
+    Py_ssize_t size;
+};
+
+struct MoraIndexBuilder {
+    struct MoraIndexView view;
+    Py_ssize_t text_pos;
+    Py_ssize_t sa_pos;
+    Py_ssize_t doc;
+};
+
+
+static Py_ssize_t
+mora_index_nbytes(
+    Py_ssize_t n_docs, Py_ssize_t text_len, Py_ssize_t n_suffixes);
+
+static void
+mora_index_builder_init(
+    struct MoraIndexBuilder *b, char *buf,
+    Py_ssize_t n_docs, Py_ssize_t text_len, Py_ssize_t n_suffixes);
+
+static void
+mora_index_builder_append(
+    struct MoraIndexBuilder *b, const Katakana *s, Py_ssize_t s_len,
+    Py_ssize_t mora_cnt, const MINDEX_T *indices);
+
+static int
+mora_index_builder_finish(struct MoraIndexBuilder *b);
+
+static int
+mora_index_bind(struct MoraIndexView *v, char *buf, Py_ssize_t size);
+
+static Py_ssize_t
+mora_index_count(
+    const struct MoraIndexView *v, const Katakana *p, Py_ssize_t p_len);
+
+static Py_ssize_t
+mora_index_locate(
+    const struct MoraIndexView *v, const Katakana *p, Py_ssize_t p_len,
+    MINDEX_T **positions);
+
+static Py_ssize_t
+mora_index_doc_of(const struct MoraIndexView *v, MINDEX_T pos);
+
+static MINDEX_T
+mora_index_rank(const struct MoraIndexView *v, MINDEX_T pos);
@@ -0,0 +1,318 @@
+#include "cmorastr_morapattern.h"
+
+// size_t MORAPATTERN_TABLE_SIZE
+// size_t CHAR_INDEX(Katakana ch)
+// size_t MORAPATTERN_MORA_MAX
+
+
+/* A mora pattern is a sequence of positions, each accepting a set of
+ * morae; optional positions may also be skipped. What a position
+ * accepts is kept as bit masks over positions, keyed by
+ *   single[c]   morae consisting of the one character c,
+ *   last[c]     longer morae ending with c (classes and wildcards),
+ *   literal[r]  longer morae spelled out in the pattern, found through
+ *               an open-addressing table of their packed characters.
+ * Patterns of at most 64 positions without optional ones are run as a
+ * plain shift-and over the mora stream; the rest go through an NFA that
+ * keeps, for every position, the leftmost start of a partial match. */
+struct MoraPattern {
+    Py_ssize_t n_pos;
+    Py_ssize_t n_words;
+    bool has_optional;
+    uint64_t *single;
+    uint64_t *last;
+    uint64_t *optional;
+    /* literal morae: (key, pos) pairs until compiled */
+    Py_ssize_t n_lit;
+    Py_ssize_t lit_cap;
+    uint32_t *lit_keys;
+    int32_t *lit_pos;
+    /* compiled literal table */
+    uint32_t *keys;
+    int32_t *rows;
+    uint32_t mask;
+    uint64_t *literal;
+};
+
+
+#define MORAPATTERN_ROW(table, mp, i) ((table) + (size_t)(mp)->n_words*(i))
+#define MORAPATTERN_SET(row, pos) \
+    ((row)[(pos) / 64] |= (uint64_t)1 << ((pos) % 64))
+#define MORAPATTERN_TEST(row, pos) \
+    (((row)[(pos) / 64] >> ((pos) % 64)) & 1)
+
+
+static inline uint32_t
+mora_pattern_key_(const Katakana *p, Py_ssize_t len) {
+    uint32_t key = (uint32_t)len;
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        key = (key << 7) | (uint32_t)CHAR_INDEX(p[i]);
+    }
+    return key;
+}
+
+
+static inline uint32_t
+mora_pattern_hash_(uint32_t key) {
+    uint32_t h = key * 2654435761u;
+    return h ^ (h >> 15);
+}
+
+
+static struct MoraPattern *
+mora_pattern_new(Py_ssize_t n_pos) {
+    MoraStr_assert(n_pos > 0);
+    if (n_pos > MINDEX_MAX / 2) {
+        PyErr_SetString(PyExc_OverflowError, "pattern is too long");
+        return NULL;
+    }
+    struct MoraPattern *mp;
+    mp = (struct MoraPattern *)PyMem_Calloc(1, sizeof(struct MoraPattern));
+    if (!mp) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    mp->n_pos = n_pos;
+    mp->n_words = (n_pos + 63) / 64;
+    size_t n = (size_t)mp->n_words * MORAPATTERN_TABLE_SIZE;
+    mp->single = (uint64_t *)PyMem_Calloc(n, sizeof(uint64_t));
+    mp->last = (uint64_t *)PyMem_Calloc(n, sizeof(uint64_t));
+    mp->optional = (uint64_t *)PyMem_Calloc(mp->n_words, sizeof(uint64_t));
+    if (!mp->single || !mp->last || !mp->optional) {
+        mora_pattern_dealloc(mp);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    return mp;
+}
+
+
+static void
+mora_pattern_set_optional(struct MoraPattern *mp, Py_ssize_t pos) {
+    MORAPATTERN_SET(mp->optional, pos);
+    mp->has_optional = true;
+}
+
+
+/* accepts the mora consisting of the single character c */
+static void
+mora_pattern_set_single(struct MoraPattern *mp, Py_ssize_t pos, Katakana c) {
+    MORAPATTERN_SET(MORAPATTERN_ROW(mp->single, mp, CHAR_INDEX(c)), pos);
+}
+
+
+/* accepts every mora of two or more characters ending with c */
+static void
+mora_pattern_set_last(struct MoraPattern *mp, Py_ssize_t pos, Katakana c) {
+    MORAPATTERN_SET(MORAPATTERN_ROW(mp->last, mp, CHAR_INDEX(c)), pos);
+}
+
+
+/* accepts the mora m */
+static int
+mora_pattern_set_mora(
+    struct MoraPattern *mp, Py_ssize_t pos, const Katakana *m, Py_ssize_t len)
+{
+    MoraStr_assert(len > 0);
+    if (len == 1) {
+        mora_pattern_set_single(mp, pos, *m);
+        return 0;
+    }
+    if (len > MORAPATTERN_MORA_MAX) {
+        PyErr_Format(PyExc_ValueError,
+            "morae in a pattern must be at most %d characters long",
+            MORAPATTERN_MORA_MAX);
+        return -1;
+    }
+    if (mp->n_lit == mp->lit_cap) {
+        Py_ssize_t cap = mp->lit_cap ? mp->lit_cap * 2 : 16;
+        if (AC_GROW_ARRAY(mp->lit_keys, uint32_t, cap) < 0 ||
+            AC_GROW_ARRAY(mp->lit_pos, int32_t, cap) < 0) {return -1;}
+        mp->lit_cap = cap;
+    }
+    mp->lit_keys[mp->n_lit] = mora_pattern_key_(m, len);
+    mp->lit_pos[mp->n_lit] = (int32_t)pos;
+    mp->n_lit++;
+    return 0;
+}
+
+
+static int
+mora_pattern_compile(struct MoraPattern *mp) {
+    if (!mp->n_lit) {return 0;}
+    uint32_t cap = 8;
+    while (cap < 2 * (size_t)mp->n_lit) {cap *= 2;}
+    mp->keys = (uint32_t *)PyMem_Calloc(cap, sizeof(uint32_t));
+    mp->rows = (int32_t *)PyMem_Malloc(sizeof(int32_t) * cap);
+    mp->literal = (uint64_t *)PyMem_Calloc(
+        (size_t)mp->n_lit * mp->n_words, sizeof(uint64_t));
+    if (!mp->keys || !mp->rows || !mp->literal) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    mp->mask = cap - 1;
+
+    int32_t n_rows = 0;
+    for (Py_ssize_t i = 0; i < mp->n_lit; ++i) {
+        uint32_t key = mp->lit_keys[i];
+        uint32_t j = mora_pattern_hash_(key) & mp->mask;
+        while (mp->keys[j] && mp->keys[j] != key) {j = (j + 1) & mp->mask;}
+        if (!mp->keys[j]) {
+            mp->keys[j] = key;
+            mp->rows[j] = n_rows++;
+        }
+        MORAPATTERN_SET(
+            MORAPATTERN_ROW(mp->literal, mp, mp->rows[j]), mp->lit_pos[i]);
+    }
+    return 0;
+}
+
+
+static bool
+mora_pattern_is_bitap(const struct MoraPattern *mp) {
+    return mp->n_words == 1 && !mp->has_optional;
+}
+
+
+/* Returns the positions accepting the mora p[0:len]. buf must hold
+   n_words words; it is used only when the mask has to be combined. */
+static inline const uint64_t *
+mora_pattern_mask_(
+    const struct MoraPattern *mp, const Katakana *p, Py_ssize_t len,
+    uint64_t *buf)
+{
+    if (len == 1) {
+        return MORAPATTERN_ROW(mp->single, mp, CHAR_INDEX(*p));
+    }
+    const uint64_t *base = MORAPATTERN_ROW(mp->last, mp, CHAR_INDEX(p[len-1]));
+    if (!mp->keys || len > MORAPATTERN_MORA_MAX) {return base;}
+
+    uint32_t key = mora_pattern_key_(p, len);
+    uint32_t j = mora_pattern_hash_(key) & mp->mask;
+    for (; mp->keys[j]; j = (j + 1) & mp->mask) {
+        if (mp->keys[j] != key) {continue;}
+        const uint64_t *lit = MORAPATTERN_ROW(mp->literal, mp, mp->rows[j]);
+        for (Py_ssize_t w = 0; w < mp->n_words; ++w) {
+            buf[w] = base[w] | lit[w];
+        }
+        return buf;
+    }
+    return base;
+}
+
+
+static Py_ssize_t
+mora_pattern_bitap_(
+    const struct MoraPattern *mp, const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t start, Py_ssize_t end, Py_ssize_t *match_end)
+{
+    uint64_t buf[1], d = 0, hi = (uint64_t)1 << (mp->n_pos - 1);
+    Py_ssize_t a = !start ? 0 : indices ? indices[start-1] : start;
+    for (Py_ssize_t i = start; i < end; ++i) {
+        Py_ssize_t b = indices ? indices[i] : i + 1;
+        d = ((d << 1) | 1) & *mora_pattern_mask_(mp, s + a, b - a, buf);
+        if (d & hi) {
+            *match_end = i + 1;
+            return i + 1 - mp->n_pos;
+        }
+        a = b;
+    }
+    return -1;
+}
+
+
+/* Skipping an optional position carries the start over from the
+   previous one; base is the start of an empty match. */
+static inline void
+mora_pattern_closure_(
+    const struct MoraPattern *mp, MINDEX_T *st, Py_ssize_t base)
+{
+    if (!mp->has_optional) {return;}
+    for (Py_ssize_t p = 0; p < mp->n_pos; ++p) {
+        if (!MORAPATTERN_TEST(mp->optional, p)) {continue;}
+        MINDEX_T prev = p ? st[p-1] : MINDEX(base);
+        if (prev < st[p]) {st[p] = prev;}
+    }
+}
+
+
+static Py_ssize_t
+mora_pattern_nfa_(
+    const struct MoraPattern *mp, const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t start, Py_ssize_t end, Py_ssize_t *match_end)
+{
+    Py_ssize_t n_pos = mp->n_pos;
+    MINDEX_T *st = (MINDEX_T *)PyMem_Malloc(
+        sizeof(MINDEX_T) * 2 * (size_t)n_pos);
+    uint64_t *buf = (uint64_t *)PyMem_Malloc(
+        sizeof(uint64_t) * (size_t)mp->n_words);
+    if (!st || !buf) {
+        PyMem_Free(st);
+        PyMem_Free(buf);
+        PyErr_NoMemory();
+        return -2;
+    }
+    MINDEX_T *cur = st, *nxt = st + n_pos;
+    for (Py_ssize_t p = 0; p < n_pos; ++p) {cur[p] = MINDEX_MAX;}
+    mora_pattern_closure_(mp, cur, start);
+
+    Py_ssize_t best = -1;
+    if (cur[n_pos-1] != MINDEX_MAX) {
+        best = cur[n_pos-1];
+        *match_end = start;
+    }
+    Py_ssize_t a = !start ? 0 : indices ? indices[start-1] : start;
+    for (Py_ssize_t i = start; i < end; ++i) {
+        /* no match starting at or before best can end past here */
+        if (best != -1 && i >= best + n_pos) {break;}
+        Py_ssize_t b = indices ? indices[i] : i + 1;
+        const uint64_t *m = mora_pattern_mask_(mp, s + a, b - a, buf);
+        nxt[0] = (m[0] & 1) ? MINDEX(i) : MINDEX_MAX;
+        for (Py_ssize_t p = 1; p < n_pos; ++p) {
+            nxt[p] = MORAPATTERN_TEST(m, p) ? cur[p-1] : MINDEX_MAX;
+        }
+        mora_pattern_closure_(mp, nxt, i + 1);
+        MINDEX_T *tmp = cur; cur = nxt; nxt = tmp;
+
+        MINDEX_T found = cur[n_pos-1];
+        if (found != MINDEX_MAX && (best == -1 || found <= best)) {
+            best = found;
+            *match_end = i + 1;
+        }
+        a = b;
+    }
+    PyMem_Free(st);
+    PyMem_Free(buf);
+    return best;
+}
+
+
+/* Finds the leftmost match within morae [start, end) and stores where
+   its longest variant ends in *match_end. Returns its start, -1 if there
+   is none, or -2 on error. */
+static Py_ssize_t
+mora_pattern_search(
+    const struct MoraPattern *mp, const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t start, Py_ssize_t end, Py_ssize_t *match_end)
+{
+    if (mora_pattern_is_bitap(mp)) {
+        if (end - start < mp->n_pos) {return -1;}
+        return mora_pattern_bitap_(mp, s, indices, start, end, match_end);
+    }
+    return mora_pattern_nfa_(mp, s, indices, start, end, match_end);
+}
+
+
+static void
+mora_pattern_dealloc(struct MoraPattern *mp) {
+    if (!mp) {return;}
+    PyMem_Free(mp->single);
+    PyMem_Free(mp->last);
+    PyMem_Free(mp->optional);
+    MoraStr_Free(mp->lit_keys);
+    MoraStr_Free(mp->lit_pos);
+    PyMem_Free(mp->keys);
+    PyMem_Free(mp->rows);
+    PyMem_Free(mp->literal);
+    PyMem_Free(mp);
+}
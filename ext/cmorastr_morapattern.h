@@ -0,0 +1,46 @@
+#include "cmorastr_pre.h"
+
+
+#ifndef MORAPATTERN_TABLE_SIZE
+  #define MORAPATTERN_TABLE_SIZE KATAKANA_RNG
+#endif
+#ifndef CHAR_INDEX
+  #define CHAR_INDEX(ch) KANA_ID(ch)
+#endif
+/* longest literal mora (in characters) a pattern may spell out */
+#ifndef MORAPATTERN_MORA_MAX
+  #define MORAPATTERN_MORA_MAX 3
+#endif
+
+
+struct MoraPattern;
+
+static struct MoraPattern *
+mora_pattern_new(Py_ssize_t n_pos);
+
+static void
+mora_pattern_set_optional(struct MoraPattern *mp, Py_ssize_t pos);
+
+static void
+mora_pattern_set_single(struct MoraPattern *mp, Py_ssize_t pos, Katakana c);
+
+static void
+mora_pattern_set_last(struct MoraPattern *mp, Py_ssize_t pos, Katakana c);
+
+static int
+mora_pattern_set_mora(
+    struct MoraPattern *mp, Py_ssize_t pos, const Katakana *m, Py_ssize_t len);
+
+static int
+mora_pattern_compile(struct MoraPattern *mp);
+
+static bool
+mora_pattern_is_bitap(const struct MoraPattern *mp);
+
+static Py_ssize_t
+mora_pattern_search(
+    const struct MoraPattern *mp, const Katakana *s, const MINDEX_T *indices,
+    Py_ssize_t start, Py_ssize_t end, Py_ssize_t *match_end);
+
+static void
+mora_pattern_dealloc(struct MoraPattern *mp);
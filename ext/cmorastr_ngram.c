@@ -0,0 +1,201 @@
+#include "cmorastr_ngram.h"
+
+// size_t NGRAM_DENSE_IDS
+// size_t NGRAM_DENSE_MAX_N
+
+
+/* Counts of the n-grams of a stream of mora IDs. For n up to
+ * NGRAM_DENSE_MAX_N, n-grams whose IDs are all below NGRAM_DENSE_IDS
+ * (every single character and the fixed list of multi-character morae)
+ * are counted in a dense array indexed by the IDs. Everything else goes
+ * to an open-addressing table that stores the n IDs of each key inline;
+ * a zero count marks an empty slot. */
+struct NgramTable {
+    Py_ssize_t n;
+    Py_ssize_t n_distinct;
+    uint64_t total;
+    uint64_t *dense;
+    Py_ssize_t cap;
+    Py_ssize_t used;
+    uint16_t *keys;
+    uint64_t *counts;
+};
+
+
+static struct NgramTable *
+ngram_table_new(Py_ssize_t n) {
+    struct NgramTable *t;
+    t = (struct NgramTable *)PyMem_Calloc(1, sizeof(struct NgramTable));
+    if (!t) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    t->n = n;
+    if (n <= NGRAM_DENSE_MAX_N) {
+        size_t size = 1;
+        for (Py_ssize_t i = 0; i < n; ++i) {size *= NGRAM_DENSE_IDS;}
+        t->dense = (uint64_t *)PyMem_Calloc(size, sizeof(uint64_t));
+        if (!t->dense) {
+            PyMem_Free(t);
+            PyErr_NoMemory();
+            return NULL;
+        }
+    }
+    return t;
+}
+
+
+static inline uint64_t
+ngram_hash_(const uint16_t *gram, Py_ssize_t n) {
+    uint64_t h = 0xcbf29ce484222325u;
+    for (Py_ssize_t i = 0; i < n; ++i) {
+        h = (h ^ gram[i]) * 0x100000001b3u;
+    }
+    return h ^ (h >> 29);
+}
+
+
+/* Returns the slot holding gram, or the empty slot where it belongs. */
+static inline Py_ssize_t
+ngram_table_probe_(const struct NgramTable *t, const uint16_t *gram) {
+    Py_ssize_t n = t->n, mask = t->cap - 1;
+    Py_ssize_t i = (Py_ssize_t)(ngram_hash_(gram, n) & (uint64_t)mask);
+    while (t->counts[i] &&
+            memcmp(t->keys + i*n, gram, sizeof(uint16_t)*n)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+
+static int
+ngram_table_grow_(struct NgramTable *t) {
+    Py_ssize_t n = t->n, old_cap = t->cap;
+    Py_ssize_t cap = old_cap ? old_cap * 2 : 1024;
+    if (cap > PY_SSIZE_T_MAX / (Py_ssize_t)(sizeof(uint16_t) * n)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    uint16_t *old_keys = t->keys;
+    uint64_t *old_counts = t->counts;
+    t->keys = PyMem_New(uint16_t, (size_t)cap * n);
+    t->counts = (uint64_t *)PyMem_Calloc((size_t)cap, sizeof(uint64_t));
+    if (!t->keys || !t->counts) {
+        PyMem_Free(t->keys);
+        PyMem_Free(t->counts);
+        t->keys = old_keys;
+        t->counts = old_counts;
+        PyErr_NoMemory();
+        return -1;
+    }
+    t->cap = cap;
+    for (Py_ssize_t i = 0; i < old_cap; ++i) {
+        if (!old_counts[i]) {continue;}
+        Py_ssize_t j = ngram_table_probe_(t, old_keys + i*n);
+        memcpy(t->keys + j*n, old_keys + i*n, sizeof(uint16_t)*n);
+        t->counts[j] = old_counts[i];
+    }
+    PyMem_Free(old_keys);
+    PyMem_Free(old_counts);
+    return 0;
+}
+
+
+static inline Py_ssize_t
+ngram_dense_index_(const struct NgramTable *t, const uint16_t *gram) {
+    if (!t->dense) {return -1;}
+    Py_ssize_t index = 0;
+    for (Py_ssize_t i = 0; i < t->n; ++i) {
+        if (gram[i] >= NGRAM_DENSE_IDS) {return -1;}
+        index = index * NGRAM_DENSE_IDS + gram[i];
+    }
+    return index;
+}
+
+
+/* Adds every n-gram of ids[0:len]. */
+static int
+ngram_table_add(struct NgramTable *t, const uint16_t *ids, Py_ssize_t len) {
+    Py_ssize_t n = t->n;
+    for (Py_ssize_t i = 0; i + n <= len; ++i) {
+        const uint16_t *gram = ids + i;
+        Py_ssize_t d = ngram_dense_index_(t, gram);
+        if (d >= 0) {
+            if (!t->dense[d]++) {++t->n_distinct;}
+            ++t->total;
+            continue;
+        }
+        if ((t->used + 1) * 2 > t->cap) {
+            if (ngram_table_grow_(t) < 0) {return -1;}
+        }
+        Py_ssize_t j = ngram_table_probe_(t, gram);
+        if (!t->counts[j]++) {
+            memcpy(t->keys + j*n, gram, sizeof(uint16_t)*n);
+            ++t->used;
+            ++t->n_distinct;
+        }
+        ++t->total;
+    }
+    return 0;
+}
+
+
+static Py_ssize_t
+ngram_table_size(const struct NgramTable *t) {
+    return t->n_distinct;
+}
+
+
+static uint64_t
+ngram_table_total(const struct NgramTable *t) {
+    return t->total;
+}
+
+
+static uint64_t
+ngram_table_get(const struct NgramTable *t, const uint16_t *gram) {
+    Py_ssize_t d = ngram_dense_index_(t, gram);
+    if (d >= 0) {return t->dense[d];}
+    if (!t->cap) {return 0;}
+    return t->counts[ngram_table_probe_(t, gram)];
+}
+
+
+/* Writes the distinct n-grams to grams (n IDs each) and their counts to
+   counts, both sized by ngram_table_size(). Dense entries come first, in
+   ID order. */
+static void
+ngram_table_export(
+    const struct NgramTable *t, uint16_t *grams, uint64_t *counts)
+{
+    Py_ssize_t n = t->n, k = 0;
+    if (t->dense) {
+        Py_ssize_t size = 1;
+        for (Py_ssize_t i = 0; i < n; ++i) {size *= NGRAM_DENSE_IDS;}
+        for (Py_ssize_t d = 0; d < size; ++d) {
+            if (!t->dense[d]) {continue;}
+            Py_ssize_t rest = d;
+            for (Py_ssize_t i = n - 1; i >= 0; --i) {
+                grams[k*n+i] = (uint16_t)(rest % NGRAM_DENSE_IDS);
+                rest /= NGRAM_DENSE_IDS;
+            }
+            counts[k++] = t->dense[d];
+        }
+    }
+    for (Py_ssize_t j = 0; j < t->cap; ++j) {
+        if (!t->counts[j]) {continue;}
+        memcpy(grams + k*n, t->keys + j*n, sizeof(uint16_t)*n);
+        counts[k++] = t->counts[j];
+    }
+    MoraStr_assert(k == t->n_distinct);
+}
+
+
+static void
+ngram_table_dealloc(struct NgramTable *t) {
+    if (!t) {return;}
+    PyMem_Free(t->dense);
+    PyMem_Free(t->keys);
+    PyMem_Free(t->counts);
+    PyMem_Free(t);
+}
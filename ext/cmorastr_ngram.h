@@ -0,0 +1,36 @@
+#include "cmorastr_pre.h"
+
+
+/* n-grams made only of IDs below this are counted in a dense array */
+#ifndef NGRAM_DENSE_IDS
+  #define NGRAM_DENSE_IDS 256
+#endif
+/* largest n for which the dense array is used */
+#ifndef NGRAM_DENSE_MAX_N
+  #define NGRAM_DENSE_MAX_N 2
+#endif
+
+
+struct NgramTable;
+
+static struct NgramTable *
+ngram_table_new(Py_ssize_t n);
+
+static int
+ngram_table_add(struct NgramTable *t, const uint16_t *ids, Py_ssize_t len);
+
+static Py_ssize_t
+ngram_table_size(const struct NgramTable *t);
+
+static uint64_t
+ngram_table_total(const struct NgramTable *t);
+
+static uint64_t
+ngram_table_get(const struct NgramTable *t, const uint16_t *gram);
+
+static void
+ngram_table_export(
+    const struct NgramTable *t, uint16_t *grams, uint64_t *counts);
+
+static void
+ngram_table_dealloc(struct NgramTable *t);
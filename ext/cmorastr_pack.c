@@ -0,0 +1,139 @@
+#include "cmorastr_pack.h"
+
+
+/* Checks the tag and the version at p and returns what follows them. */
+static const unsigned char *
+mora_unpack_header(const unsigned char *p, const unsigned char *end, int tag) {
+    if (end - p < 2 || p[0] != tag) {
+        PyErr_SetString(PyExc_ValueError, "malformed packed data");
+        return NULL;
+    }
+    if (p[1] != MORAPACK_VERSION) {
+        PyErr_Format(PyExc_ValueError,
+            "unsupported packed data version: %d", (int)p[1]);
+        return NULL;
+    }
+    return p + 2;
+}
+
+
+static Py_ssize_t
+mora_pack_varint_size(Py_ssize_t v) {
+    Py_ssize_t size = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+
+static unsigned char *
+mora_pack_varint(unsigned char *p, Py_ssize_t v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+
+/* Reads a varint no greater than MINDEX_MAX; returns NULL with an
+   exception set if there is none. */
+static const unsigned char *
+mora_unpack_varint(
+    const unsigned char *p, const unsigned char *end, Py_ssize_t *v)
+{
+    Py_ssize_t result = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        unsigned char b = *p++;
+        result |= (Py_ssize_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            if (result > MINDEX_MAX) {break;}
+            *v = result;
+            return p;
+        }
+    }
+    PyErr_SetString(PyExc_ValueError, "malformed packed data");
+    return NULL;
+}
+
+
+static unsigned char *
+mora_pack_codes(unsigned char *p, const Katakana *s, Py_ssize_t len) {
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        *p++ = (unsigned char)KANA_ID(s[i]);
+    }
+    return p;
+}
+
+
+/* Checks that each of the len codes stands for a katakana that a
+   MoraStr may hold. */
+static int
+mora_check_codes(const unsigned char *p, Py_ssize_t len) {
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        /* 0x30a0 and 0x30ff are outside of the katakana of a MoraStr */
+        if (!p[i] || p[i] >= KATAKANA_RNG - 1) {
+            PyErr_Format(PyExc_ValueError,
+                "invalid character code: %d", (int)p[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static int
+mora_unpack_codes(Katakana *s, const unsigned char *p, Py_ssize_t len) {
+    if (mora_check_codes(p, len) < 0) {return -1;}
+    for (Py_ssize_t i = 0; i < len; ++i) {
+        s[i] = (Katakana)(KATAKANA_OFF + p[i]);
+    }
+    return 0;
+}
+
+
+/* ORs the lengths of the morae ending at bounds[0:mora_cnt] (one
+   character each if NULL) into the zeroed 2-bit fields of p starting
+   from field first. */
+static void
+mora_pack_lengths(
+    unsigned char *p, Py_ssize_t first, const MINDEX_T *bounds,
+    Py_ssize_t mora_cnt)
+{
+    MINDEX_T prev = 0;
+    for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+        unsigned int len = bounds ? (unsigned int)(bounds[i] - prev) : 1;
+        if (bounds) {prev = bounds[i];}
+        Py_ssize_t k = first + i;
+        p[k >> 2] |= (unsigned char)(len << ((k & 3) << 1));
+    }
+}
+
+
+/* Reads mora_cnt lengths from field first of p and writes the end
+   offsets of the morae to bounds; they must add up to length. */
+static int
+mora_unpack_lengths(
+    MINDEX_T *bounds, const unsigned char *p, Py_ssize_t first,
+    Py_ssize_t mora_cnt, Py_ssize_t length)
+{
+    MINDEX_T end = 0;
+    for (Py_ssize_t i = 0; i < mora_cnt; ++i) {
+        Py_ssize_t k = first + i;
+        unsigned int len = (p[k >> 2] >> ((k & 3) << 1)) & 3;
+        if (!len || end + (MINDEX_T)len > length) {
+            PyErr_SetString(PyExc_ValueError, "malformed packed data");
+            return -1;
+        }
+        end += (MINDEX_T)len;
+        bounds[i] = end;
+    }
+    if (end != length) {
+        PyErr_SetString(PyExc_ValueError, "malformed packed data");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "cmorastr_pre.h"
+
+
+/* Packed layout of a single string (all integers are LEB128 varints):
+ *   'M' MORAPACK_VERSION length mora_cnt
+ *   uint8_t code[length]         KANA_ID of each character
+ *   uint8_t lengths[(mora_cnt+3)/4]
+ *                                2-bit character count of each mora,
+ *                                lowest bits first; omitted when every
+ *                                mora is a single character
+ * and of a sequence of strings:
+ *   'A' MORAPACK_VERSION n text_len total_morae
+ *   (length mora_cnt)[n]
+ *   uint8_t code[text_len]
+ *   uint8_t lengths[(total_morae+3)/4]
+ */
+#define MORAPACK_VERSION 1
+enum {MORAPACK_STR = 'M', MORAPACK_ARRAY = 'A'};
+
+/* for raw native buffers that come from the other byte order */
+#define MORAPACK_SWAP16(x) ((uint16_t)(((x) >> 8) | ((x) << 8)))
+#define MORAPACK_SWAP32(x) ((uint32_t)( \
+    ((uint32_t)(x) >> 24) | (((uint32_t)(x) >> 8) & 0xff00u) | \
+    (((uint32_t)(x) << 8) & 0xff0000u) | ((uint32_t)(x) << 24)))
+
+
+static const unsigned char *
+mora_unpack_header(const unsigned char *p, const unsigned char *end, int tag);
+
+static Py_ssize_t
+mora_pack_varint_size(Py_ssize_t v);
+
+static unsigned char *
+mora_pack_varint(unsigned char *p, Py_ssize_t v);
+
+static const unsigned char *
+mora_unpack_varint(
+    const unsigned char *p, const unsigned char *end, Py_ssize_t *v);
+
+static unsigned char *
+mora_pack_codes(unsigned char *p, const Katakana *s, Py_ssize_t len);
+
+static int
+mora_check_codes(const unsigned char *p, Py_ssize_t len);
+
+static int
+mora_unpack_codes(Katakana *s, const unsigned char *p, Py_ssize_t len);
+
+static void
+mora_pack_lengths(
+    unsigned char *p, Py_ssize_t first, const MINDEX_T *bounds,
+    Py_ssize_t mora_cnt);
+
+static int
+mora_unpack_lengths(
+    MINDEX_T *bounds, const unsigned char *p, Py_ssize_t first,
+    Py_ssize_t mora_cnt, Py_ssize_t length);
@@ -154,6 +154,18 @@ TZCNT64(uint64_t x) {
 #define TZCNT(x) \
     (sizeof(x) <= 4 ? TZCNT32((uint32_t)(x)) : TZCNT64((uint64_t)(x)))
 
+static inline unsigned int
+POPCNT32(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned int)__builtin_popcount(x);
+#else
+    x = x - ((x >> 1) & 0x55555555U);
+    x = (x & 0x33333333U) + ((x >> 2) & 0x33333333U);
+    x = (x + (x >> 4)) & 0x0F0F0F0FU;
+    return (x * 0x01010101U) >> 24;
+#endif
+}
+
 
 /* Generic Unicode String */
 
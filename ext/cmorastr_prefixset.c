@@ -0,0 +1,170 @@
+#include "cmorastr_prefixset.h"
+
+// size_t PREFIXTRIE_TABLE_SIZE
+// size_t CHAR_INDEX(Katakana ch)
+
+
+/* A plain katakana trie. The root keeps a full transition row since
+ * every walk starts there; deeper nodes are rarely wide and use
+ * child/sibling lists. term[v] is the mora count of the pattern that
+ * ends at v, or 0 if none does. A reverse trie stores its patterns
+ * back to front and is walked from the end of the haystack. */
+struct PrefixTrie {
+    int32_t n_nodes;
+    int32_t node_cap;
+    bool reverse;
+    bool has_empty;
+    int32_t root[PREFIXTRIE_TABLE_SIZE];
+    int32_t *child;
+    int32_t *sibling;
+    unsigned char *sym;
+    MINDEX_T *term;
+};
+
+
+static int
+prefix_trie_grow_(struct PrefixTrie *t) {
+    int32_t cap = t->node_cap ? t->node_cap : 64;
+    if (t->node_cap) {
+        if (cap > MINDEX_MAX / 2) {
+            PyErr_SetString(PyExc_OverflowError, "too many patterns");
+            return -1;
+        }
+        cap *= 2;
+    }
+    if (AC_GROW_ARRAY(t->child, int32_t, cap) < 0 ||
+        AC_GROW_ARRAY(t->sibling, int32_t, cap) < 0 ||
+        AC_GROW_ARRAY(t->sym, unsigned char, cap) < 0 ||
+        AC_GROW_ARRAY(t->term, MINDEX_T, cap) < 0) {return -1;}
+    t->node_cap = cap;
+    return 0;
+}
+
+
+static struct PrefixTrie *
+prefix_trie_new(bool reverse) {
+    struct PrefixTrie *t;
+    t = (struct PrefixTrie *)PyMem_Calloc(1, sizeof(struct PrefixTrie));
+    if (!t) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if (prefix_trie_grow_(t) < 0) {
+        prefix_trie_dealloc(t);
+        return NULL;
+    }
+    t->n_nodes = 1;
+    t->reverse = reverse;
+    t->child[0] = t->sibling[0] = 0;
+    t->term[0] = 0;
+    return t;
+}
+
+
+static inline int32_t
+prefix_trie_child_(const struct PrefixTrie *t, int32_t node, unsigned int c) {
+    if (!node) {return t->root[c];}
+    int32_t v = t->child[node];
+    while (v) {
+        if (t->sym[v] == c) {return v;}
+        v = t->sibling[v];
+    }
+    return 0;
+}
+
+
+static int
+prefix_trie_add(
+    struct PrefixTrie *t, const Katakana *p, Py_ssize_t p_len,
+    Py_ssize_t p_moracnt)
+{
+    if (!p_len) {
+        t->has_empty = true;
+        return 0;
+    }
+    if (p_len > MINDEX_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "pattern is too long");
+        return -1;
+    }
+
+    int32_t node = 0;
+    for (Py_ssize_t i = 0; i < p_len; ++i) {
+        Katakana ch = t->reverse ? p[p_len-1-i] : p[i];
+        unsigned int c = (unsigned int)CHAR_INDEX(ch);
+        int32_t next = prefix_trie_child_(t, node, c);
+        if (!next) {
+            if (t->n_nodes == t->node_cap) {
+                if (prefix_trie_grow_(t) < 0) {return -1;}
+            }
+            next = t->n_nodes++;
+            t->child[next] = 0;
+            t->sym[next] = (unsigned char)c;
+            t->term[next] = 0;
+            if (node) {
+                t->sibling[next] = t->child[node];
+                t->child[node] = next;
+            } else {
+                t->sibling[next] = 0;
+                t->root[c] = next;
+            }
+        }
+        node = next;
+    }
+    t->term[node] = (MINDEX_T)p_moracnt;
+    return 0;
+}
+
+
+/* Reports whether a pattern matches s[s_start:s_end] at its head and
+ * ends on a mora boundary. start/end are the corresponding mora
+ * indices; indices is NULL when every mora is a single character. */
+static bool
+prefix_trie_match_head(
+    const struct PrefixTrie *t, const Katakana *s,
+    Py_ssize_t s_start, Py_ssize_t s_end,
+    Py_ssize_t start, Py_ssize_t end, const MINDEX_T *indices)
+{
+    MoraStr_assert(!t->reverse);
+    if (t->has_empty) {return true;}
+    int32_t node = 0;
+    for (Py_ssize_t i = s_start; i < s_end; ++i) {
+        node = prefix_trie_child_(t, node, (unsigned int)CHAR_INDEX(s[i]));
+        if (!node) {break;}
+        Py_ssize_t m = t->term[node];
+        if (!m || start + m > end) {continue;}
+        if (!indices || indices[start+m-1] == i + 1) {return true;}
+    }
+    return false;
+}
+
+
+static bool
+prefix_trie_match_tail(
+    const struct PrefixTrie *t, const Katakana *s,
+    Py_ssize_t s_start, Py_ssize_t s_end,
+    Py_ssize_t start, Py_ssize_t end, const MINDEX_T *indices)
+{
+    MoraStr_assert(t->reverse);
+    if (t->has_empty) {return true;}
+    int32_t node = 0;
+    for (Py_ssize_t i = s_end - 1; i >= s_start; --i) {
+        node = prefix_trie_child_(t, node, (unsigned int)CHAR_INDEX(s[i]));
+        if (!node) {break;}
+        Py_ssize_t m = t->term[node];
+        if (!m || end - m < start) {continue;}
+        Py_ssize_t tail = end - m;
+        if (!indices || (tail ? indices[tail-1] : 0) == i) {return true;}
+    }
+    return false;
+}
+
+
+static void
+prefix_trie_dealloc(struct PrefixTrie *t) {
+    if (!t) {return;}
+    MoraStr_Free(t->child);
+    MoraStr_Free(t->sibling);
+    MoraStr_Free(t->sym);
+    MoraStr_Free(t->term);
+    PyMem_Free(t);
+}
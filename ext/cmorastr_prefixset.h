@@ -0,0 +1,35 @@
+#include "cmorastr_pre.h"
+
+
+#ifndef PREFIXTRIE_TABLE_SIZE
+  #define PREFIXTRIE_TABLE_SIZE KATAKANA_RNG
+#endif
+#ifndef CHAR_INDEX
+  #define CHAR_INDEX(ch) KANA_ID(ch)
+#endif
+
+
+struct PrefixTrie;
+
+static struct PrefixTrie *
+prefix_trie_new(bool reverse);
+
+static int
+prefix_trie_add(
+    struct PrefixTrie *t, const Katakana *p, Py_ssize_t p_len,
+    Py_ssize_t p_moracnt);
+
+static bool
+prefix_trie_match_head(
+    const struct PrefixTrie *t, const Katakana *s,
+    Py_ssize_t s_start, Py_ssize_t s_end,
+    Py_ssize_t start, Py_ssize_t end, const MINDEX_T *indices);
+
+static bool
+prefix_trie_match_tail(
+    const struct PrefixTrie *t, const Katakana *s,
+    Py_ssize_t s_start, Py_ssize_t s_end,
+    Py_ssize_t start, Py_ssize_t end, const MINDEX_T *indices);
+
+static void
+prefix_trie_dealloc(struct PrefixTrie *t);
@@ -1,33 +1,35 @@
 #include "cmorastr_twoway.h"
 
 // size_t TWOWAY_TABLE_SIZE
-// size_t CHAR_INDEX(Katakana ch)
+// size_t CHAR_INDEX(TWOWAY_CHAR ch)
 // type TWOWAY_SSIZE_T
 // TWOWAY_SSIZE_T TWOWAY_SSIZE_MAX
 
 
-struct TwoWayNeedle {
+struct TWOWAY(TwoWayNeedle) {
     uint64_t cache_state;
-    const Katakana *buffer;
+    const TWOWAY_CHAR *buffer;
     TWOWAY_SSIZE_T len;
     TWOWAY_SSIZE_T mora_cnt;
     Py_ssize_t suffix;
     Py_ssize_t period;
     Py_ssize_t gap;
     TWOWAY_SSIZE_T table[TWOWAY_TABLE_SIZE];
-} two_way_needle;
+} TWOWAY(two_way_needle);
+#define TWOWAY_NEEDLE TWOWAY(two_way_needle)
 
 
 static inline Py_ssize_t
-critical_factorization(
-    const Katakana *needle, Py_ssize_t length,
-    Py_ssize_t *p, bool direction)
+TWOWAY(critical_factorization)(
+    const TWOWAY_CHAR *needle, Py_ssize_t length,
+    Py_ssize_t *p, bool direction, bool reverse)
 {
+#define NEEDLE(x) (reverse ? needle[length-1-(x)] : needle[x])
     Py_ssize_t suffix = 0, period = 1;
     Py_ssize_t j = 1, k = 0;
     while (j + k < length) {
-        Katakana a = needle[j+k];
-        Katakana b = needle[suffix+k];
+        TWOWAY_CHAR a = NEEDLE(j+k);
+        TWOWAY_CHAR b = NEEDLE(suffix+k);
         if (direction ? (b < a) : (a < b)) {
             j += k + 1;
             k = 0;
@@ -45,29 +47,32 @@ critical_factorization(
             period = 1;
         }
     }
+#undef NEEDLE
     *p = period;
     return suffix;
 }
 
 static void
-two_way_prepare_x(
-    const Katakana *needle, Py_ssize_t length, Py_ssize_t mora_cnt)
+TWOWAY(two_way_prepare_x)(
+    const TWOWAY_CHAR *needle, Py_ssize_t length, Py_ssize_t mora_cnt)
 {
     MoraStr_assert(length <= TWOWAY_SSIZE_MAX);
-    if (two_way_needle.cache_state) {return;}
+    if (TWOWAY_NEEDLE.cache_state) {return;}
 
     Py_ssize_t suffix, period, suffix_r, period_r;
-    suffix = critical_factorization(needle, length, &period, 0);
-    suffix_r = critical_factorization(needle, length, &period_r, 1);
+    suffix = TWOWAY(critical_factorization)(
+        needle, length, &period, 0, false);
+    suffix_r = TWOWAY(critical_factorization)(
+        needle, length, &period_r, 1, false);
 
     if (suffix <= suffix_r) {
         suffix = suffix_r;
         period = period_r;
     }
     bool is_periodic = \
-        !memcmp(needle, needle+period, sizeof(Katakana)*suffix);
+        !memcmp(needle, needle+period, sizeof(TWOWAY_CHAR)*suffix);
 
-    TWOWAY_SSIZE_T *table = two_way_needle.table;
+    TWOWAY_SSIZE_T *table = TWOWAY_NEEDLE.table;
     TWOWAY_SSIZE_T len = (TWOWAY_SSIZE_T)length, i;
     for (i = 0; i < TWOWAY_TABLE_SIZE; ++i) {
         table[i] = len;
@@ -75,41 +80,41 @@ two_way_prepare_x(
     TWOWAY_SSIZE_T gap;
     if (is_periodic) {
         for (i = 0; i < len; ++i) {
-            Katakana k = needle[i];
+            TWOWAY_CHAR k = needle[i];
             table[CHAR_INDEX(k)] = len - (i + 1);
         }
         gap = -1;
     } else {
-        Katakana last = needle[len-1];
-        table[CHAR_INDEX(last)] = 0;
+        TWOWAY_CHAR last = needle[len-1];
         gap = len;
         for (i = 0; i + 1 < len; ++i) {
-            Katakana k = needle[i];
+            TWOWAY_CHAR k = needle[i];
             TWOWAY_SSIZE_T diff = len - (i + 1);
             table[CHAR_INDEX(k)] = diff;
             if (k == last) {gap = diff;}
         }
+        table[CHAR_INDEX(last)] = 0;
         period = Py_MAX(suffix, length - suffix) + 1;
     }
-    two_way_needle.buffer = needle;
-    two_way_needle.len = len;
-    two_way_needle.mora_cnt = (TWOWAY_SSIZE_T)mora_cnt;
-    two_way_needle.suffix = suffix;
-    two_way_needle.period = period;
-    two_way_needle.gap = gap;
+    TWOWAY_NEEDLE.buffer = needle;
+    TWOWAY_NEEDLE.len = len;
+    TWOWAY_NEEDLE.mora_cnt = (TWOWAY_SSIZE_T)mora_cnt;
+    TWOWAY_NEEDLE.suffix = suffix;
+    TWOWAY_NEEDLE.period = period;
+    TWOWAY_NEEDLE.gap = gap;
 }
 
 
 static Py_ssize_t
-two_way_repetition(
-    const Katakana *s, Py_ssize_t s_len,
+TWOWAY(two_way_repetition)(
+    const TWOWAY_CHAR *s, Py_ssize_t s_len,
     Py_ssize_t mora_off, const MINDEX_T *indices)
 {
-    const Katakana *p = two_way_needle.buffer;
-    Py_ssize_t p_len = two_way_needle.len;
+    const TWOWAY_CHAR *p = TWOWAY_NEEDLE.buffer;
+    Py_ssize_t p_len = TWOWAY_NEEDLE.len;
 
     MoraStr_assert(p_len >= 2);
-    Katakana h1, h2, t1, t2;
+    TWOWAY_CHAR h1, h2, t1, t2;
     Py_ssize_t last2_idx = p_len - 2;
     h1 = p[0]; h2 = p[1];
     if (p_len & 1) {
@@ -130,6 +135,8 @@ two_way_repetition(
                     goto kana_loop_end;
                 }
                 return j;
+            } else if (t1 == s[i+last2_idx+1]) {
+                i += 1;
             } else {
                 i += last2_idx + 1;
             }
@@ -137,7 +144,7 @@ two_way_repetition(
             continue;
         }
     } else {
-        Py_ssize_t p_moracnt = two_way_needle.mora_cnt;
+        Py_ssize_t p_moracnt = TWOWAY_NEEDLE.mora_cnt;
         Py_ssize_t i = mora_off ? indices[mora_off-1] : 0LL;
         const MINDEX_T *next_ptr = indices + mora_off;
         while (i < limit) {
@@ -153,6 +160,8 @@ two_way_repetition(
                     goto mora_loop_end;
                 }
                 return next_ptr - indices;
+            } else if (t1 == s[i+last2_idx+1]) {
+                i += 1;
             } else {
                 i += last2_idx + 1;
             }
@@ -167,19 +176,19 @@ two_way_repetition(
 
 
 static Py_ssize_t
-two_way_katakana_findindex(
-    const Katakana *s, Py_ssize_t s_len, Py_ssize_t mora_off)
+TWOWAY(two_way_katakana_findindex)(
+    const TWOWAY_CHAR *s, Py_ssize_t s_len, Py_ssize_t mora_off)
 {
-    const Katakana *p = two_way_needle.buffer;
-    Py_ssize_t suffix = two_way_needle.suffix;
-    Py_ssize_t period = two_way_needle.period;
+    const TWOWAY_CHAR *p = TWOWAY_NEEDLE.buffer;
+    Py_ssize_t suffix = TWOWAY_NEEDLE.suffix;
+    Py_ssize_t period = TWOWAY_NEEDLE.period;
     if (suffix == 1 && period == 2) {
-        return two_way_repetition(s, s_len, mora_off, NULL);
+        return TWOWAY(two_way_repetition)(s, s_len, mora_off, NULL);
     }
 
-    Py_ssize_t p_len = two_way_needle.len;
-    Py_ssize_t gap = two_way_needle.gap;
-    TWOWAY_SSIZE_T *table = two_way_needle.table;
+    Py_ssize_t p_len = TWOWAY_NEEDLE.len;
+    Py_ssize_t gap = TWOWAY_NEEDLE.gap;
+    TWOWAY_SSIZE_T *table = TWOWAY_NEEDLE.table;
 
     Py_ssize_t i, j = mora_off, limit = s_len - p_len + 1;
     TWOWAY_SSIZE_T shift;
@@ -203,7 +212,7 @@ two_way_katakana_findindex(
                     j += period;
                     if (j >= limit) {return -1;}
                     memory = p_len - period;
-                    shift = table[CHAR_INDEX(p[j+p_len-1])];
+                    shift = table[CHAR_INDEX(s[j+p_len-1])];
                     if (shift) {
                         gap = Py_MAX(suffix, memory) - suffix + 1;
                         j += Py_MAX(shift, gap);
@@ -252,21 +261,21 @@ two_way_katakana_findindex(
 }
 
 static Py_ssize_t
-two_way_mora_findindex(
-    const Katakana *s, Py_ssize_t s_len,
+TWOWAY(two_way_mora_findindex)(
+    const TWOWAY_CHAR *s, Py_ssize_t s_len,
     Py_ssize_t mora_off, const MINDEX_T *indices)
 {
-    const Katakana *p = two_way_needle.buffer;
-    Py_ssize_t suffix = two_way_needle.suffix;
-    Py_ssize_t period = two_way_needle.period;
+    const TWOWAY_CHAR *p = TWOWAY_NEEDLE.buffer;
+    Py_ssize_t suffix = TWOWAY_NEEDLE.suffix;
+    Py_ssize_t period = TWOWAY_NEEDLE.period;
     if (suffix == 1 && period == 2) {
-        return two_way_repetition(s, s_len, mora_off, indices);
+        return TWOWAY(two_way_repetition)(s, s_len, mora_off, indices);
     }
 
-    Py_ssize_t p_len = two_way_needle.len;
-    Py_ssize_t p_moracnt = two_way_needle.mora_cnt;
-    Py_ssize_t gap = two_way_needle.gap;
-    TWOWAY_SSIZE_T *table = two_way_needle.table;
+    Py_ssize_t p_len = TWOWAY_NEEDLE.len;
+    Py_ssize_t p_moracnt = TWOWAY_NEEDLE.mora_cnt;
+    Py_ssize_t gap = TWOWAY_NEEDLE.gap;
+    TWOWAY_SSIZE_T *table = TWOWAY_NEEDLE.table;
 
     Py_ssize_t i, j = mora_off ? indices[mora_off-1] : 0LL;
     Py_ssize_t limit = s_len - p_len + 1;
@@ -304,7 +313,7 @@ two_way_mora_findindex(
                     j += period;
                     if (j >= limit) {return -1;}
                     memory = p_len - period;
-                    shift = table[CHAR_INDEX(p[j+p_len-1])];
+                    shift = table[CHAR_INDEX(s[j+p_len-1])];
                     if (shift) {
                         gap = Py_MAX(suffix, memory) - suffix + 1;
                         j += Py_MAX(shift, gap);
@@ -371,19 +380,19 @@ two_way_mora_findindex(
 
 
 static Py_ssize_t
-two_way_search (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len,
+TWOWAY(two_way_search) (
+    const TWOWAY_CHAR *s, Py_ssize_t s_len,
+    const TWOWAY_CHAR *p, Py_ssize_t p_len,
     Py_ssize_t mora_off, Py_ssize_t count)
 {
     MoraStr_assert(p_len);
 
-    two_way_prepare_x(p, p_len, p_len);
+    TWOWAY(two_way_prepare_x)(p, p_len, p_len);
     if (count == -1) {
-        return two_way_katakana_findindex(s, s_len, mora_off);
+        return TWOWAY(two_way_katakana_findindex)(s, s_len, mora_off);
     }
     while (count) {
-        mora_off = two_way_katakana_findindex(s, s_len, mora_off);
+        mora_off = TWOWAY(two_way_katakana_findindex)(s, s_len, mora_off);
         if (mora_off == -1) {break;}
         mora_off += p_len;
         --count;
@@ -393,19 +402,20 @@ two_way_search (
 
 
 static Py_ssize_t
-two_way_mora_search (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len, Py_ssize_t mora_off,
+TWOWAY(two_way_mora_search) (
+    const TWOWAY_CHAR *s, Py_ssize_t s_len,
+    const TWOWAY_CHAR *p, Py_ssize_t p_len, Py_ssize_t mora_off,
     Py_ssize_t p_moracnt, const MINDEX_T *indices, Py_ssize_t count)
 {
     MoraStr_assert(p_len && p_moracnt);
 
-    two_way_prepare_x(p, p_len, p_moracnt);
+    TWOWAY(two_way_prepare_x)(p, p_len, p_moracnt);
     if (count == -1) {
-        return two_way_mora_findindex(s, s_len, mora_off, indices);
+        return TWOWAY(two_way_mora_findindex)(s, s_len, mora_off, indices);
     }
     while (count) {
-        mora_off = two_way_mora_findindex(s, s_len, mora_off, indices);
+        mora_off = TWOWAY(two_way_mora_findindex)(
+            s, s_len, mora_off, indices);
         if (mora_off == -1) {break;}
         mora_off += p_moracnt;
         --count;
@@ -414,41 +424,137 @@ two_way_mora_search (
 }
 
 
+#ifndef TWOWAY_FORWARD_ONLY
+#define RP(x) p[p_len-1-(x)]
+
+static void
+TWOWAY(two_way_rev_prepare)(
+    const TWOWAY_CHAR *p, Py_ssize_t p_len, struct TwoWayRevNeedle *needle)
+{
+    Py_ssize_t suffix, period, suffix_r, period_r;
+    suffix = TWOWAY(critical_factorization)(p, p_len, &period, 0, true);
+    suffix_r = TWOWAY(critical_factorization)(p, p_len, &period_r, 1, true);
+    if (suffix <= suffix_r) {
+        suffix = suffix_r;
+        period = period_r;
+    }
+    bool is_periodic = true;
+    for (Py_ssize_t i = 0; i < suffix; ++i) {
+        if (RP(i) != RP(i+period)) {
+            is_periodic = false;
+            break;
+        }
+    }
+    if (!is_periodic) {
+        period = Py_MAX(suffix, p_len - suffix) + 1;
+    }
+    needle->suffix = suffix;
+    needle->period = period;
+    needle->is_periodic = is_periodic;
+}
+
+
+/* Two-way search for the last occurrence, run on the reversed text and
+ * needle. It does not use the shared needle cache since rfind() looks
+ * for one occurrence per call; rfinditer() keeps its own prepared
+ * needle instead, otherwise pass NULL. */
+static Py_ssize_t
+TWOWAY(two_way_mora_rev_search) (
+    const TWOWAY_CHAR *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const TWOWAY_CHAR *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const TWOWAY_SSIZE_T *indices,
+    const struct TwoWayRevNeedle *needle)
+{
+    MoraStr_assert(p_len && p_moracnt);
+#define RS(x) s[s_len-1-(x)]
+
+    Py_ssize_t begin = (!indices || !mora_off) ? \
+        mora_off : (Py_ssize_t)indices[mora_off-1];
+    Py_ssize_t limit = s_len - begin - p_len;
+    if (limit < 0) {return -1;}
+
+    struct TwoWayRevNeedle local;
+    if (!needle) {
+        TWOWAY(two_way_rev_prepare)(p, p_len, &local);
+        needle = &local;
+    }
+    Py_ssize_t suffix = needle->suffix, period = needle->period;
+    bool is_periodic = needle->is_periodic;
+
+    Py_ssize_t i, j = 0, memory = 0, m_idx = s_moracnt - 1;
+    while (j <= limit) {
+        i = Py_MAX(suffix, memory);
+        while (i < p_len && RP(i) == RS(i+j)) {++i;}
+        if (i < p_len) {
+            j += i + 1 - suffix;
+            memory = 0;
+            continue;
+        }
+        i = suffix;
+        while (i > memory && RP(i-1) == RS(i-1+j)) {--i;}
+        if (i <= memory) {
+            Py_ssize_t pos = s_len - p_len - j;
+            if (!indices) {return pos;}
+            Py_ssize_t end = pos + p_len;
+            while (m_idx >= 0 && indices[m_idx] > end) {--m_idx;}
+            Py_ssize_t m_start = m_idx - p_moracnt + 1;
+            if (m_idx >= 0 && indices[m_idx] == end && m_start >= 0
+                && (m_start ? indices[m_start-1] : 0) == pos)
+            {
+                return m_start;
+            }
+        }
+        j += period;
+        memory = is_periodic ? p_len - period : 0;
+    }
+    return -1;
+#undef RS
+}
+#undef RP
+#endif
+
+
 static bool
-two_way_prepare(
-    const Katakana *needle, Py_ssize_t length, Py_ssize_t mora_cnt)
+TWOWAY(two_way_prepare)(
+    const TWOWAY_CHAR *needle, Py_ssize_t length, Py_ssize_t mora_cnt)
 {
     if (length > TWOWAY_SSIZE_MAX) {return false;}
-    two_way_prepare_x(needle, length, mora_cnt);
-    two_way_needle.cache_state = 1;
+    TWOWAY(two_way_prepare_x)(needle, length, mora_cnt);
+    TWOWAY_NEEDLE.cache_state = 1;
     return true;
 }
 
 
 static void
-two_way_set_needle(void *needle) {
+TWOWAY(two_way_set_needle)(void *needle) {
     if (!needle) {
-        two_way_needle.cache_state = 0;
+        TWOWAY_NEEDLE.cache_state = 0;
         return;
     }
-    two_way_needle = *((struct TwoWayNeedle *)needle);
-    two_way_needle.cache_state = 1;
+    TWOWAY_NEEDLE = *((struct TWOWAY(TwoWayNeedle) *)needle);
+    TWOWAY_NEEDLE.cache_state = 1;
 }
 
 
+#ifndef TWOWAY_FORWARD_ONLY
 static void *
-two_way_cache_new(void) {
-    const size_t SIZE = sizeof(struct TwoWayNeedle);
+TWOWAY(two_way_cache_new)(void) {
+    const size_t SIZE = sizeof(struct TWOWAY(TwoWayNeedle));
 
     void *result;
     result = PyMem_Malloc(SIZE);
     if (!result) {return NULL;}
-    memcpy(result, &two_way_needle, SIZE);
+    memcpy(result, &TWOWAY_NEEDLE, SIZE);
     return result;
 }
 
 
 static void
-two_way_cache_dealloc(void *needle) {
+TWOWAY(two_way_cache_dealloc)(void *needle) {
     PyMem_Free(needle);
-}
\ No newline at end of file
+}
+#endif
+
+#undef TWOWAY_NEEDLE
+#undef TWOWAY_CHAR
+#undef TWOWAY
\ No newline at end of file
@@ -13,29 +13,64 @@
 #ifndef TWOWAY_SSIZE_MAX
   #define TWOWAY_SSIZE_MAX MINDEX_MAX
 #endif
+// type TWOWAY_CHAR_T (optional, Katakana by default)
+// TWOWAY_NAME_SUFFIX (optional, appended to the function names)
+// TWOWAY_FORWARD_ONLY (optional, leaves out the reverse search and the
+//                      needle cache objects)
+#ifdef TWOWAY_CHAR_T
+  #define TWOWAY_CHAR TWOWAY_CHAR_T
+#else
+  #define TWOWAY_CHAR Katakana
+#endif
+#ifdef TWOWAY_NAME_SUFFIX
+  #define TWOWAY(name) JOIN(name, TWOWAY_NAME_SUFFIX)
+#else
+  #define TWOWAY(name) name
+#endif
 
 
 static Py_ssize_t
-two_way_search (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len,
+TWOWAY(two_way_search) (
+    const TWOWAY_CHAR *s, Py_ssize_t s_len,
+    const TWOWAY_CHAR *p, Py_ssize_t p_len,
     Py_ssize_t mora_off, Py_ssize_t count);
 
 static Py_ssize_t
-two_way_mora_search (
-    const Katakana *s, Py_ssize_t s_len,
-    const Katakana *p, Py_ssize_t p_len, Py_ssize_t mora_off, 
+TWOWAY(two_way_mora_search) (
+    const TWOWAY_CHAR *s, Py_ssize_t s_len,
+    const TWOWAY_CHAR *p, Py_ssize_t p_len, Py_ssize_t mora_off, 
     Py_ssize_t p_moracnt, const TWOWAY_SSIZE_T *indices, Py_ssize_t count);
 
+#ifndef TWOWAY_FORWARD_ONLY
+struct TwoWayRevNeedle {
+    Py_ssize_t suffix;
+    Py_ssize_t period;
+    bool is_periodic;
+};
+
+static void
+TWOWAY(two_way_rev_prepare)(
+    const TWOWAY_CHAR *p, Py_ssize_t p_len, struct TwoWayRevNeedle *needle);
+
+static Py_ssize_t
+TWOWAY(two_way_mora_rev_search) (
+    const TWOWAY_CHAR *s, Py_ssize_t s_len, Py_ssize_t s_moracnt,
+    const TWOWAY_CHAR *p, Py_ssize_t p_len, Py_ssize_t p_moracnt,
+    Py_ssize_t mora_off, const TWOWAY_SSIZE_T *indices,
+    const struct TwoWayRevNeedle *needle);
+#endif
+
 static bool
-two_way_prepare(
-    const Katakana *needle, Py_ssize_t length, Py_ssize_t mora_cnt);
+TWOWAY(two_way_prepare)(
+    const TWOWAY_CHAR *needle, Py_ssize_t length, Py_ssize_t mora_cnt);
 
 static void
-two_way_set_needle(void *needle);
+TWOWAY(two_way_set_needle)(void *needle);
 
+#ifndef TWOWAY_FORWARD_ONLY
 static void *
-two_way_cache_new(void);
+TWOWAY(two_way_cache_new)(void);
 
 static void
-two_way_cache_dealloc(void *needle);
\ No newline at end of file
+TWOWAY(two_way_cache_dealloc)(void *needle);
+#endif
\ No newline at end of file
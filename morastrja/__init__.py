@@ -1,7 +1,12 @@
-from ._morastr import MoraStr, count_all
+from ._morastr import MoraStr, MoraMatcher, PrefixSet, MoraPattern, MoraIndex
+from ._morastr import MoraStrArray, MoraStrBuilder, MoraRope, NgramCounter
+from ._morastr import count_all
 
 
-__all__ = ['MoraStr', 'count_all', 'CONVERSION_TABLE', 'utils',]
+__all__ = ['MoraStr', 'MoraMatcher', 'PrefixSet', 'MoraPattern', 'MoraIndex',
+           'MoraStrArray', 'MoraStrBuilder', 'MoraRope', 'NgramCounter',
+           'count_all',
+           'CONVERSION_TABLE', 'utils',]
 
 
 def _init():
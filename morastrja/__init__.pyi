@@ -1,7 +1,9 @@
 from __future__ import annotations
 
 import sys
-from typing import TypeVar, overload
+from array import array
+from os import PathLike
+from typing import IO, TypeVar, overload
 
 if sys.version_info >= (3, 8):
     from typing import SupportsIndex
@@ -49,10 +51,18 @@ class MoraStr(Sequence[str]):
 
     def __add__(self: Self, __other: MoraStr | str) -> Self: ...
 
-    def __contains__(self, __sub_morastr: str | MoraStr) -> bool: ...   # type: ignore[override]
+    def __contains__(self, __sub_morastr: str | MoraStr | tuple[str | MoraStr, ...]) -> bool: ...   # type: ignore[override]
 
     def __eq__(self, __other: object) -> bool: ...
 
+    def __lt__(self, __other: MoraStr) -> bool: ...
+
+    def __le__(self, __other: MoraStr) -> bool: ...
+
+    def __gt__(self, __other: MoraStr) -> bool: ...
+
+    def __ge__(self, __other: MoraStr) -> bool: ...
+
     @overload
     def __getitem__(self, __index: int | SupportsIndex) -> str: ...
     @overload
@@ -77,41 +87,103 @@ class MoraStr(Sequence[str]):
     def char_indices(self, *, zero: bool = False) -> list[int]:
         "Return a list of accumulative character counts for each mora."
 
-    def count(self, __sub_morastr: str | MoraStr,
+    def mora_ids(self) -> array[int]:
+        "Return the ID of each mora as array('H')."
+
+    def to_bytes(self) -> bytes:
+        "Return a compact binary form of self."
+
+    def sort_key(self) -> bytes:
+        "Return a bytes key that sorts self in gojuon order."
+
+    def code_units(self) -> memoryview:
+        "Return a read-only memoryview of the UTF-16 code units."
+
+    def end_offsets(self) -> memoryview:
+        "Return a read-only memoryview of the end offset of each mora."
+
+    def ngrams(self, __n: SupportsIndex) -> memoryview:
+        "Return the mora IDs of each n-gram as a 2-D memoryview of 'H'."
+
+    def contains(self, __sub_morastr: str | MoraStr
+                 | tuple[str | MoraStr, ...],
+                 *, fold: str | None = None) -> bool:
+        "Check if sub_morastr occurs in self, optionally folding kana."
+
+    def count(self, __sub_morastr: str | MoraStr
+              | tuple[str | MoraStr, ...] | MoraPattern,
               __start: int | SupportsIndex | None = 0,
-              __end: int | SupportsIndex | None = ...) -> int:
+              __end: int | SupportsIndex | None = ...,
+              *, fold: str | None = None) -> int:
         "Count the occurences of sub_morastr within self[start:end]."
 
-    def endswith(self, __suffix: str | MoraStr | tuple[str | MoraStr],
+    def endswith(self, __suffix: str | MoraStr | tuple[str | MoraStr]
+                 | PrefixSet,
                  __start: int | SupportsIndex | None = 0,
                  __end: int | SupportsIndex | None = ...) -> bool:
         "Check if self[start:end] ends w/ suffix."
 
+    def endswith_vowels(self, __vowels: str | MoraStr
+                        | tuple[str | MoraStr, ...]) -> bool:
+        "Check if self.vowels() ends w/ vowels."
+
     @overload
-    def find(self, __sub_morastr: str | MoraStr,
+    def find(self, __sub_morastr: str | MoraStr | MoraPattern,
              __start: int | SupportsIndex | None = 0,
-             __end: int | SupportsIndex | None = ...) -> int: ...
+             __end: int | SupportsIndex | None = ...,
+             *, fold: str | None = None) -> int: ...
     @overload
-    def find(self, __sub_morastr: str | MoraStr,
-             *, charwise: bool = False) -> int:
+    def find(self, __sub_morastr: str | MoraStr | MoraPattern,
+             *, charwise: bool = False, fold: str | None = None) -> int:
         "Return the 1st index " \
         "where sub_morastr is found within self[start:end]."
 
-    def finditer(self, __sub_morastr: str | MoraStr,
-                 *, charwise: bool = False) -> Iterator[int]:
+    def finditer(self, __sub_morastr: str | MoraStr | MoraPattern,
+                 *, charwise: bool = False, fold: str | None = None,
+                 overlapping: bool = False) -> Iterator[int]:
         "Return an iterator that yields indices of sub_morastr " \
         "found in self."
 
+    def rfinditer(self, __sub_morastr: str | MoraStr,
+                  *, charwise: bool = False, fold: str | None = None,
+                  overlapping: bool = False) -> Iterator[int]:
+        "Return an iterator that yields indices of sub_morastr " \
+        "found in self, from right to left."
+
+    def find_all(self, __sub_morastr: str | MoraStr,
+                 *, charwise: bool = False, overlapping: bool = False
+                 ) -> array[int]:
+        "Return array('i') of all indices where sub_morastr is found."
+
+    def find_approx(self, __sub_morastr: str | MoraStr, __max_dist: int,
+                    *, charwise: bool = False
+                    ) -> tuple[int, int, int] | None:
+        "Return (start, end, distance) of the first occurrence " \
+        "within max_dist mora edits."
+
+    def finditer_approx(self, __sub_morastr: str | MoraStr,
+                        __max_dist: int, *, charwise: bool = False
+                        ) -> Iterator[tuple[int, int, int]]:
+        "Return an iterator that yields (start, end, distance) " \
+        "of approximate occurrences."
+
+    def find_vowels(self, __vowels: str | MoraStr) -> int:
+        "Return the 1st index where vowels is found in self.vowels()."
+
     @overload
-    def index(self, __sub_morastr: str | MoraStr,
+    def index(self, __sub_morastr: str | MoraStr | MoraPattern,
               __start: int | SupportsIndex | None = 0,
-              __end: int | SupportsIndex | None = ...) -> int: ...
+              __end: int | SupportsIndex | None = ...,
+              *, fold: str | None = None) -> int: ...
     @overload
-    def index(self, __sub_morastr: str | MoraStr,
-              *, charwise: bool = False) -> int:
+    def index(self, __sub_morastr: str | MoraStr | MoraPattern,
+              *, charwise: bool = False, fold: str | None = None) -> int:
         "Like MoraStr.find(), but raises an error " \
         "when sub_morastr is not found."
 
+    def join(self, __iterable: Iterable[str | MoraStr]) -> MoraStr:
+        "Concatenate the items of iterable with self between each pair."
+
     def removeprefix(self, __prefix: str | MoraStr) -> MoraStr:
         "Return self[len(prefix):] if self starts w/ prefix, " \
         "or a copy of self."
@@ -145,7 +217,8 @@ class MoraStr(Sequence[str]):
         "Like MoraStr.rfind(), but raise an error " \
         "when sub_morastr is not found."
 
-    def startswith(self, __prefix: str | MoraStr | tuple[str | MoraStr],
+    def startswith(self, __prefix: str | MoraStr | tuple[str | MoraStr]
+                   | PrefixSet,
                    __start: int | SupportsIndex | None = 0,
                    __end: int | SupportsIndex | None = ...) -> bool:
         "Check if self[start:end][:len(prefix)] == prefix."
@@ -153,15 +226,241 @@ class MoraStr(Sequence[str]):
     def tostr(self) -> str:
         "Return the internal string representation of self."
 
+    def translate(self, __table: _MoraTransTable
+                  | Mapping[str | MoraStr, str | MoraStr | None]) -> MoraStr:
+        "Return a copy of self in which each mora is mapped " \
+        "through the translation table."
+
+    def vowels(self) -> str:
+        "Return the vowel of each mora as an ASCII string."
+
     @classmethod
     def fromstrs(cls: type[Self], *iterable: Iterable[str],
                  ignore: bool = False) -> Self:
         "Return a new MoraStr object from multiple strings."
 
+    @classmethod
+    def from_mora_ids(cls: type[Self],
+                      __ids: bytes | array[int] | Iterable[int]) -> Self:
+        "Return a new MoraStr object from the IDs given by mora_ids()."
+
+    @classmethod
+    def from_buffers(cls: type[Self], __code_units: bytes | memoryview
+                     | array[int], __end_offsets: bytes | memoryview
+                     | array[int]) -> Self:
+        "Return a new MoraStr object from trusted code units and offsets."
+
+    @classmethod
+    def from_bytes(cls: type[Self], __data: bytes | bytearray | memoryview
+                   ) -> Self:
+        "Return a new MoraStr object from the output of to_bytes()."
+
     @staticmethod
     def count_all(__kana_string: str, *, ignore: bool = False) -> int:
         "Return the total number of morae contained in kana_string."
 
+    @overload
+    @staticmethod
+    def maketrans(__x: Mapping[str | MoraStr, str | MoraStr | None]
+                  ) -> _MoraTransTable: ...
+
+    @overload
+    @staticmethod
+    def maketrans(__x: str | MoraStr, __y: str | MoraStr,
+                  __z: str | MoraStr = ...) -> _MoraTransTable: ...
+
+
+class _MoraTransTable:
+    "Compiled mora-to-mora mapping returned by MoraStr.maketrans()."
+
+    def __len__(self) -> int: ...
+
+
+class PrefixSet:
+    @property
+    def patterns(self) -> tuple[MoraStr, ...]:
+        "Patterns compiled into the set."
+
+    def __new__(cls, __patterns: Iterable[str | MoraStr]) -> PrefixSet:
+        "Compile sub-morastrs into tries for startswith/endswith."
+
+    def __len__(self) -> int: ...
+
+
+class MoraPattern:
+    @property
+    def pattern(self) -> str:
+        "The pattern string the object was compiled from."
+
+    def __new__(cls, __pattern: str) -> MoraPattern:
+        "Compile a pattern over morae for find/index/count/finditer."
+
+
+class MoraMatcher:
+    @property
+    def patterns(self) -> tuple[MoraStr, ...]:
+        "Patterns compiled into the matcher. Pattern ids index this tuple."
+
+    def __new__(cls, __patterns: Iterable[str | MoraStr]) -> MoraMatcher:
+        "Compile multiple sub-morastrs into a single automaton."
+
+    def __len__(self) -> int: ...
+
+    def count_each(self, __morastr: str | MoraStr) -> list[int]:
+        "Return the number of occurrences of each pattern in morastr."
+
+    def findall(self, __morastr: str | MoraStr,
+                *, charwise: bool = False) -> list[tuple[int, int]]:
+        "Return (index, pattern_id) pairs for all occurrences " \
+        "in morastr."
+
+    def search(self, __morastr: str | MoraStr,
+               *, charwise: bool = False) -> tuple[int, int] | None:
+        "Return the (index, pattern_id) pair for the occurrence " \
+        "that ends first."
+
+
+class MoraIndex:
+    def __new__(cls, __documents: Iterable[str | MoraStr]) -> MoraIndex:
+        "Build a suffix array over the mora boundaries of documents."
+
+    def __len__(self) -> int: ...
+
+    def count(self, __morastr: str | MoraStr) -> int:
+        "Return the number of occurrences of morastr in all documents."
+
+    def locate(self, __morastr: str | MoraStr) -> list[tuple[int, int]]:
+        "Return sorted (doc_id, index) pairs where morastr occurs."
+
+    def save(self, __file: str | PathLike[str] | IO[bytes]) -> None:
+        "Write the index image to a path or a binary file object."
+
+    @classmethod
+    def load(cls, __source: str | PathLike[str] | bytes) -> MoraIndex:
+        "Memory-map an index image from a path, or read it from bytes."
+
+
+class MoraStrArray:
+    def __new__(cls, __iterable: Iterable[str | MoraStr] = ...
+                ) -> MoraStrArray:
+        "Create a columnar array of mora strings."
+
+    def __len__(self) -> int: ...
+
+    def __getitem__(self, __index: SupportsIndex) -> MoraStr: ...
+
+    def __iter__(self) -> Iterator[MoraStr]: ...
+
+    def contains(self, __sub_morastr: str | MoraStr) -> array[int]:
+        "Return array('B') telling if each element contains sub_morastr."
+
+    def count(self, __sub_morastr: str | MoraStr) -> array[int]:
+        "Return array('i') of element.count(sub_morastr)."
+
+    def find(self, __sub_morastr: str | MoraStr,
+             *, charwise: bool = False) -> array[int]:
+        "Return array('i') of element.find(sub_morastr)."
+
+    def lengths(self) -> array[int]:
+        "Return array('i') of the number of morae in each element."
+
+    def slice(self, __start: int | SupportsIndex | None = None,
+              __end: int | SupportsIndex | None = None) -> MoraStrArray:
+        "Return a new MoraStrArray of element[start:end]."
+
+    def startswith(self, __prefix: str | MoraStr) -> array[int]:
+        "Return array('B') telling if each element starts w/ prefix."
+
+    def to_bytes(self) -> bytes:
+        "Return all the elements in a compact binary form."
+
+    @classmethod
+    def from_bytes(cls, __data: bytes | bytearray | memoryview
+                   ) -> MoraStrArray:
+        "Return a new MoraStrArray from the output of to_bytes()."
+
+
+class MoraStrBuilder:
+    def __new__(cls, __initial: str | MoraStr = ...) -> MoraStrBuilder:
+        "Create a mutable buffer for assembling a MoraStr."
+
+    def __len__(self) -> int: ...
+
+    def append(self, __morastr: str | MoraStr) -> None:
+        "Append a kana string or a MoraStr object."
+
+    def append_mora(self, __mora: str | MoraStr) -> None:
+        "Append exactly one mora."
+
+    def build(self) -> MoraStr:
+        "Hand the buffers over to a new MoraStr and empty the builder."
+
+    def extend(self, __iterable: Iterable[str | MoraStr]) -> None:
+        "Append each item of iterable."
+
+
+class MoraRope:
+    def __new__(cls, __morastr: str | MoraStr | MoraRope = ...) -> MoraRope:
+        "Create a balanced tree of MoraStr leaves."
+
+    def __len__(self) -> int: ...
+
+    def __add__(self, __other: str | MoraStr | MoraRope) -> MoraRope: ...
+
+    @overload
+    def __getitem__(self, __index: SupportsIndex) -> str: ...
+    @overload
+    def __getitem__(self, __index: slice) -> MoraRope: ...
+
+    @property
+    def height(self) -> int:
+        "Height of the balanced tree."
+
+    def find(self, __sub_morastr: str | MoraStr | MoraRope,
+             __start: SupportsIndex | None = ...,
+             __end: SupportsIndex | None = ...) -> int:
+        "Return the lowest mora index where sub_morastr is found, or -1."
+
+    def replace(self, __old: str | MoraStr, __new: str | MoraStr | MoraRope,
+                __maxcount: SupportsIndex = ...) -> MoraRope:
+        "Return a rope with occurrences of old replaced by new."
+
+    def tomorastr(self) -> MoraStr:
+        "Flatten the rope into a MoraStr object."
+
+    def tostr(self) -> str:
+        "Return the katakana string of the rope."
+
+
+class NgramCounter:
+    def __new__(cls, __n: SupportsIndex) -> NgramCounter:
+        "Create a counter of mora n-grams."
+
+    @property
+    def n(self) -> int:
+        "Number of morae in each n-gram."
+
+    @property
+    def total(self) -> int:
+        "Number of n-grams counted so far, with repetitions."
+
+    def __len__(self) -> int: ...
+
+    def __getitem__(self, __ngram: str | MoraStr) -> int: ...
+
+    def add(self, __morastr: str | MoraStr | MoraStrArray) -> None:
+        "Count the n-grams of morastr."
+
+    def update(self, __iterable: Iterable[str | MoraStr | MoraStrArray]
+               ) -> None:
+        "Call add() on each item of iterable."
+
+    def todict(self) -> dict[tuple[str, ...], int]:
+        "Return a dict mapping each n-gram to its count."
+
+    def toarrays(self) -> tuple[memoryview, array[int]]:
+        "Return the n-grams as mora IDs and their counts."
+
 
 def count_all(__kana_string: str, *, ignore: bool = False) -> int:
     "Return the total number of morae contained in kana_string."
@@ -3,7 +3,10 @@ from setuptools import setup, Extension
 
 ext = Extension('morastrja._morastr',
                 sources = ['ext/cmorastr.c'],
-                depends = ['*.h', 'cmorastr_twoway.c'],
+                depends = ['*.h', 'cmorastr_twoway.c', 'cmorastr_acmatch.c',
+                           'cmorastr_moraindex.c', 'cmorastr_prefixset.c',
+                           'cmorastr_morapattern.c', 'cmorastr_ngram.c',
+                           'cmorastr_pack.c'],
                 extra_compile_args=['-O2'])
 
 setup (name = 'morastrja',